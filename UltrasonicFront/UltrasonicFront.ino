@@ -1,47 +1,176 @@
+// Ranges from several Devantech SRF08/SRF10 ultrasonic sensors on I2C,
+// sent to the host as binary frames.
+//
+// Nothing waits with delay(): loop() runs a millis() driven state machine
+// that fires a group of sensors, polls them until they have finished
+// ranging, reads them, and moves on to the next group.  Sensors that face
+// each other's way are in different groups, so one's ping never lands in
+// another's listening window.  With the range cut to about 3 m a group
+// takes ~22 ms, so with two groups each sensor reads ~20 times a second.
+//
+// Frame, 13 bytes, little endian:
+//   0   0xA5
+//   1   0x5A
+//   2   payload length, 9
+//   3   sequence number, +1 per frame, gaps are frames lost
+//   4   sensor index, 0 to SENSOR_COUNT-1
+//   5   status: 0 ok, 1 no answer on the bus, 2 ranging timed out
+//   6   millis() when the sensor was fired, 4 bytes
+//   10  range in cm, 2 bytes, 0 when nothing echoed
+//   12  CRC-8 (poly 0x07, init 0) of bytes 2 to 11
+//
+// Sensors come with address 0xE0.  To give one a new address, connect it
+// alone, set SET_ADDRESS to 1 and NEW_ADDRESS to the address, and run the
+// sketch once.
+
 #include <Wire.h>
 
-void setup() {
-  Wire.begin();                // join i2c bus (address optional for master)
-  Serial.begin(9600);          // start serial communication at 9600bps
-}
+#define SET_ADDRESS 0
+#define NEW_ADDRESS 0xE2     // datasheet (8 bit) address: 0xE0, 0xE2, ... 0xFE
 
-int reading = 0;
+const byte SENSOR_COUNT = 4;
+// i2c uses the high 7 bits of the datasheet address, 0xE0 is 0x70
+const byte sensorAddress[SENSOR_COUNT] = {0x70, 0x71, 0x72, 0x73};
+// sensors fired together; neighbours are in different groups
+const byte GROUP_COUNT = 2;
+const byte sensorGroup[SENSOR_COUNT] = {0, 1, 0, 1};
 
-void loop() {
-  // step 1: instruct sensor to read echoes
-  Wire.beginTransmission(112); // transmit to device #112 (0x70)
-  // the address specified in the datasheet is 224 (0xE0)
-  // but i2c adressing uses the high 7 bits so it's 112
-  Wire.write(byte(0x00));      // sets register pointer to the command register (0x00)
-  Wire.write(byte(0x50));      // command sensor to measure in "inches" (0x50)
-  // use 0x51 for centimeters
-  // use 0x52 for ping microseconds
-  Wire.endTransmission();      // stop transmitting
-
-  // step 2: wait for readings to happen
-  delay(70);                   // datasheet suggests at least 65 milliseconds
-
-  // step 3: instruct sensor to return a particular echo reading
-  Wire.beginTransmission(112); // transmit to device #112
-  Wire.write(byte(0x02));      // sets register pointer to echo #1 register (0x02)
-  Wire.endTransmission();      // stop transmitting
-
-  // step 4: request reading from sensor
-  Wire.requestFrom(112, 2);    // request 2 bytes from slave device #112
-
-  // step 5: receive reading from sensor
-  if (2 <= Wire.available()) { // if two bytes were received
-    reading = Wire.read();  // receive high byte (overwrites previous reading)
-    reading = reading << 8;    // shift high byte to be high 8 bits
-    reading |= Wire.read(); // receive low byte as lower 8 bits
-    Serial.println(reading);   // print the reading
+// max range is (RANGE_REGISTER + 1) * 43 mm, 0x45 is about 3 m, whose
+// echo takes 17.5 ms.  a shorter range wants less gain, or the last
+// ping's echoes come back as this one's; see the datasheet's table
+const byte RANGE_REGISTER = 0x45;
+const byte GAIN_REGISTER  = 0x10;
+const unsigned long FIRST_POLL_MS = 18;  // no point asking before the echo can be back
+const unsigned long TIMEOUT_MS    = 70;  // the full 11 m range takes 65 ms
+const unsigned long QUIET_MS      = 3;   // between groups, for the last echoes to die
+
+const byte STATUS_OK        = 0;
+const byte STATUS_NO_ANSWER = 1;
+const byte STATUS_TIMEOUT   = 2;
+
+const byte FRAME_SIZE = 13;
+
+enum State { FIRE, LISTEN };
+
+State state = FIRE;
+byte group = 0;
+byte sequence = 0;
+unsigned long firedAt = 0;
+unsigned long doneAt = 0;
+byte answered[SENSOR_COUNT];   // took the ranging command
+
+
+byte crc8(const byte* data, byte len)
+{
+  byte crc = 0;
+  for (byte i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (byte bit = 0; bit < 8; bit++)
+      crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
   }
+  return crc;
+}
+
+// returns 0 if the sensor took it
+byte writeRegister(byte address, byte reg, byte value)
+{
+  Wire.beginTransmission(address);
+  Wire.write(reg);
+  Wire.write(value);
+  return Wire.endTransmission();
+}
+
+// a ranging sensor doesn't answer on the bus, or answers 0xFF, until it
+// is done
+bool rangingDone(byte address)
+{
+  Wire.beginTransmission(address);
+  Wire.write(byte(0x00));      // software revision register
+  if (Wire.endTransmission() != 0)
+    return false;
+  if (Wire.requestFrom(address, byte(1)) != 1)
+    return false;
+  return Wire.read() != 0xFF;
+}
+
+// first echo in cm, -1 if the read failed
+int readRange(byte address)
+{
+  Wire.beginTransmission(address);
+  Wire.write(byte(0x02));      // echo #1 register, high byte first
+  if (Wire.endTransmission() != 0)
+    return -1;
+  if (Wire.requestFrom(address, byte(2)) != 2)
+    return -1;
+  int reading = Wire.read() << 8;
+  reading |= Wire.read();
+  return reading;
+}
+
+void sendFrame(byte sensor, byte status, unsigned long timestamp, unsigned int range)
+{
+  byte frame[FRAME_SIZE];
+  frame[0]  = 0xA5;
+  frame[1]  = 0x5A;
+  frame[2]  = FRAME_SIZE - 4;
+  frame[3]  = sequence++;
+  frame[4]  = sensor;
+  frame[5]  = status;
+  frame[6]  = timestamp;
+  frame[7]  = timestamp >> 8;
+  frame[8]  = timestamp >> 16;
+  frame[9]  = timestamp >> 24;
+  frame[10] = range;
+  frame[11] = range >> 8;
+  frame[12] = crc8(frame + 2, FRAME_SIZE - 3);
+  // drop rather than block when the host isn't keeping up; the
+  // sequence number shows it
+  if (Serial.availableForWrite() >= FRAME_SIZE)
+    Serial.write(frame, FRAME_SIZE);
+}
 
-  delay(250);                  // wait a bit since people have to read the output :)
+void fireGroup(unsigned long now)
+{
+  for (byte i = 0; i < SENSOR_COUNT; i++) {
+    if (sensorGroup[i] != group)
+      continue;
+    // 0x51 ranges in centimeters
+    answered[i] = writeRegister(sensorAddress[i], 0x00, 0x51) == 0;
+  }
+  firedAt = now;
 }
 
+// true once every sensor of the group has its reading, or time is up
+bool groupDone(unsigned long now)
+{
+  if (now - firedAt < FIRST_POLL_MS)
+    return false;
+  if (now - firedAt >= TIMEOUT_MS)
+    return true;
+  for (byte i = 0; i < SENSOR_COUNT; i++) {
+    if (sensorGroup[i] == group && answered[i] && !rangingDone(sensorAddress[i]))
+      return false;
+  }
+  return true;
+}
 
-/*
+void readGroup(unsigned long now)
+{
+  bool timedOut = now - firedAt >= TIMEOUT_MS;
+  for (byte i = 0; i < SENSOR_COUNT; i++) {
+    if (sensorGroup[i] != group)
+      continue;
+    if (!answered[i]) {
+      sendFrame(i, STATUS_NO_ANSWER, firedAt, 0);
+      continue;
+    }
+    int range = (timedOut && !rangingDone(sensorAddress[i])) ? -1 : readRange(sensorAddress[i]);
+    if (range < 0)
+      sendFrame(i, STATUS_TIMEOUT, firedAt, 0);
+    else
+      sendFrame(i, STATUS_OK, firedAt, range);
+  }
+}
 
 // The following code changes the address of a Devantech Ultrasonic Range Finder (SRF10 or SRF08)
 // usage: changeAddress(0x70, 0xE6);
@@ -68,4 +197,41 @@ void changeAddress(byte oldAddress, byte newAddress)
   Wire.write(newAddress);
   Wire.endTransmission();
 }
-*/
+
+void setup() {
+  Wire.begin();                // join i2c bus (address optional for master)
+  Wire.setClock(400000);       // the SRF08 takes 400 kHz
+  Serial.begin(115200);
+
+#if SET_ADDRESS
+  changeAddress(0x70, NEW_ADDRESS);
+  while (true) {}              // power cycle with the sketch set back
+#endif
+
+  for (byte i = 0; i < SENSOR_COUNT; i++) {
+    writeRegister(sensorAddress[i], 0x01, GAIN_REGISTER);
+    writeRegister(sensorAddress[i], 0x02, RANGE_REGISTER);
+  }
+}
+
+void loop() {
+  unsigned long now = millis();
+
+  switch (state) {
+  case FIRE:
+    if (now - doneAt < QUIET_MS)
+      break;
+    fireGroup(now);
+    state = LISTEN;
+    break;
+
+  case LISTEN:
+    if (!groupDone(now))
+      break;
+    readGroup(now);
+    group = (group + 1) % GROUP_COUNT;
+    doneAt = now;
+    state = FIRE;
+    break;
+  }
+}
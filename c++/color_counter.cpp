@@ -1,32 +1,39 @@
-#include <fstream>
-#include <vector>
+// grey levels and occupancy numbers of a map image.
+//
+// build: g++ -O2 color_counter.cpp -pthread -o color_counter
+// run:   ./color_counter [map=new.pgm] [resolution=0.05]
 #include <iostream>
+#include <cstdlib>
+#include <time.h>
+#include "pgm.hpp"
+#include "map_stats.hpp"
 
 using namespace std;
-int main(){
-  vector <string> color;
-  int count = 0;
-  string word;
-  ifstream infile;
-  infile.open("new.pgm");
-  while (infile >> word)
-  {
-    if(color.size()==0){
-      color.push_back(word);
-      continue;
-    }
-    for(int i = 0; i< color.size(); i++){
-      if(word == color[i]){
-        count = 1;
-        break;
-      }
-    }
-    if(count ==0)
-      color.push_back(word);
+int main(int argc, char** argv){
+  const string mapfile = argc > 1 ? argv[1] : "new.pgm";
+  const double resolution = argc > 2 ? atof(argv[2]) : 0.05;
+  PgmImage img;
+  if(readPgm(mapfile, img) != 0)
+    return 1;
 
-    count = 0;
-  }
-  for (int i=3; i<color.size(); i++)
-    cout << color[i] << "\n";
+  MapStats stats;
+  timespec t0, t1;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  mapStats(&img.pixels[0], img.width, img.height, resolution, stats);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+
+  // the distinct grey levels, as before
+  for(int v = 0; v < 256; v++)
+    if(stats.hist[v])
+      cout << v << "\n";
+
+  cout << "free: " << stats.free << "\n";
+  cout << "occupied: " << stats.occupied << "\n";
+  cout << "unknown: " << stats.unknown << "\n";
+  cout << "explored m^2: " << stats.exploredArea << "\n";
+  if(stats.maxY >= 0)
+    cout << "known box: " << stats.minX << "," << stats.minY << " - "
+         << stats.maxX << "," << stats.maxY << "\n";
+  cout << "stats ms: " << (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) * 1e-6 << "\n";
   return 0;
 }
@@ -0,0 +1,163 @@
+#ifndef DISTANCE_MAP_HPP
+#define DISTANCE_MAP_HPP
+#include <algorithm>
+#include <queue>
+#include <vector>
+#include <cmath>
+#include <stdint.h>
+#include "occupancy_grid.hpp"
+using namespace::std;
+
+// euclidean distance to the nearest obstacle for every cell, kept up
+// to date as obstacles come and go (Lau, Sprunk and Burgard, "Improved
+// updating of Euclidean distance maps and Voronoi diagrams", 2010).
+//
+// each cell keeps its nearest obstacle cell.  a new obstacle sends a
+// lower wave out until it reaches cells that are closer to something
+// else; a removed one sends a raise wave that clears the cells that
+// pointed at it, and the obstacles around the hole lower them again.
+// only the cells whose answer changes are touched, and nothing past
+// maxDist cells is kept, so an update costs what changed, not the map.
+//
+// a lookup is one array read.
+class DistanceMap {
+public:
+    enum { NONE = -1, INF = 0x7fffffff };
+
+    DistanceMap() : width_(0), height_(0), maxDist2_(0) {}
+
+    // all free, maxDist in cells
+    void resize(int width, int height, int maxDist) {
+        width_  = width;
+        height_ = height;
+        maxDist2_ = maxDist * maxDist;
+        const size_t n = (size_t)width * height;
+        obst_.assign(n, NONE);
+        dist2_.assign(n, INF);
+        raise_.assign(n, 0);
+        occupied_.assign(n, 0);
+        queue_ = Queue();
+    }
+
+    void setObstacle(int x, int y) {
+        const int s = y * width_ + x;
+        if(occupied_[s]) return;
+        occupied_[s] = 1;
+        obst_[s] = s;
+        dist2_[s] = 0;
+        queue_.push(Entry(0, s));
+    }
+
+    void removeObstacle(int x, int y) {
+        const int s = y * width_ + x;
+        if(!occupied_[s]) return;
+        occupied_[s] = 0;
+        clearCell(s);
+        raise_[s] = 1;
+        queue_.push(Entry(0, s));
+    }
+
+    // run the waves queued by set/removeObstacle
+    void update() {
+        while(!queue_.empty()) {
+            const int s = queue_.top().second;
+            queue_.pop();
+            if(raise_[s]) raise(s);
+            else if(obst_[s] != NONE && occupied_[obst_[s]]) lower(s);
+        }
+    }
+
+    // take the obstacles of OccupancyGrid data, same size as the map;
+    // returns the number of cells that turned or stopped being one
+    int updateFromGrid(const signed char* data) {
+        int changed = 0;
+        for(int y = 0; y < height_; y++) {
+            for(int x = 0; x < width_; x++) {
+                const size_t s = (size_t)y * width_ + x;
+                const bool occ = data[s] >= OCCUPIED_THRESH;
+                if(occ == (occupied_[s] != 0)) continue;
+                if(occ) setObstacle(x, y);
+                else removeObstacle(x, y);
+                changed++;
+            }
+        }
+        update();
+        return changed;
+    }
+
+    // squared distance in cells to the nearest obstacle, INF if there is
+    // none within maxDist
+    int distance2(int x, int y) const { return dist2_[(size_t)y * width_ + x]; }
+
+    // the nearest obstacle cell, false if there is none within maxDist
+    bool nearest(int x, int y, int& ox, int& oy) const {
+        const int o = obst_[(size_t)y * width_ + x];
+        if(o == NONE) return false;
+        ox = o % width_;
+        oy = o / width_;
+        return true;
+    }
+
+    bool isObstacle(int x, int y) const { return occupied_[(size_t)y * width_ + x] != 0; }
+    int width() const { return width_; }
+    int height() const { return height_; }
+
+private:
+    typedef pair<int, int> Entry;   // squared distance, cell
+    typedef priority_queue<Entry, vector<Entry>, greater<Entry> > Queue;
+
+    void clearCell(int s) {
+        dist2_[s] = INF;
+        obst_[s] = NONE;
+    }
+
+    int dist2To(int o, int x, int y) const {
+        const int dx = o % width_ - x, dy = o / width_ - y;
+        return dx * dx + dy * dy;
+    }
+
+    void lower(int s) {
+        const int sx = s % width_, sy = s / width_;
+        const int o = obst_[s];
+        for(int ny = max(0, sy - 1); ny <= min(height_ - 1, sy + 1); ny++) {
+            for(int nx = max(0, sx - 1); nx <= min(width_ - 1, sx + 1); nx++) {
+                const int n = ny * width_ + nx;
+                if(n == s || raise_[n]) continue;
+                const int d = dist2To(o, nx, ny);
+                if(d < dist2_[n] && d <= maxDist2_) {
+                    dist2_[n] = d;
+                    obst_[n] = o;
+                    queue_.push(Entry(d, n));
+                }
+            }
+        }
+    }
+
+    void raise(int s) {
+        const int sx = s % width_, sy = s / width_;
+        for(int ny = max(0, sy - 1); ny <= min(height_ - 1, sy + 1); ny++) {
+            for(int nx = max(0, sx - 1); nx <= min(width_ - 1, sx + 1); nx++) {
+                const int n = ny * width_ + nx;
+                if(n == s || obst_[n] == NONE || raise_[n]) continue;
+                // queued at the old distance either way: cleared ones
+                // spread the raise, the rest lower the hole back in
+                queue_.push(Entry(dist2_[n], n));
+                if(!occupied_[obst_[n]]) {
+                    clearCell(n);
+                    raise_[n] = 1;
+                }
+            }
+        }
+        raise_[s] = 0;
+    }
+
+    int width_, height_;
+    int maxDist2_;
+    vector<int> obst_;           // nearest obstacle cell, NONE
+    vector<int> dist2_;          // squared distance to it
+    vector<uint8_t> raise_;
+    vector<uint8_t> occupied_;
+    Queue queue_;
+};
+
+#endif
@@ -0,0 +1,80 @@
+// answers hector_nav_msgs/GetDistanceToObstacle from a distance map of
+// /map that is updated with each map, so a query is a lookup.
+//
+// distance is to the nearest occupied cell in meters and end_point is
+// that cell's center.  -1 when nothing is within max_distance.  the
+// point has to be in the map frame; there is no tf lookup.
+//
+// build:
+//   g++ -O2 distance_server.cpp -I/opt/ros/lunar/include -I../ros/catkin_ws/devel/include
+//       -L/opt/ros/lunar/lib -lroscpp -lrosconsole -lroscpp_serialization -lrostime -o distance_server
+// run:
+//   ./distance_server [_max_distance:=2.0]
+#include <iostream>
+#include <cmath>
+#include "distance_map.hpp"
+#include <ros/ros.h>
+#include <nav_msgs/OccupancyGrid.h>
+#include <hector_nav_msgs/GetDistanceToObstacle.h>
+
+static DistanceMap distances;
+static double maxDistance = 2.0;
+static string frame;
+static double resolution = 0, originX = 0, originY = 0;
+
+void mapCallback(const nav_msgs::OccupancyGridConstPtr& map) {
+    const int width  = map->info.width;
+    const int height = map->info.height;
+    if((size_t)width * height != map->data.size()) return;
+
+    // a new size, resolution or origin invalidates every distance
+    if(width != distances.width() || height != distances.height() ||
+       map->info.resolution != resolution ||
+       map->info.origin.position.x != originX || map->info.origin.position.y != originY) {
+        resolution = map->info.resolution;
+        originX = map->info.origin.position.x;
+        originY = map->info.origin.position.y;
+        distances.resize(width, height, (int)ceil(maxDistance / resolution));
+    }
+    frame = map->header.frame_id;
+    int changed = distances.updateFromGrid(&map->data[0]);
+    ROS_DEBUG("distance_server: %d obstacle cells changed", changed);
+}
+
+bool getDistance(hector_nav_msgs::GetDistanceToObstacle::Request& req,
+                 hector_nav_msgs::GetDistanceToObstacle::Response& res) {
+    if(resolution <= 0) return false;
+    if(!req.point.header.frame_id.empty() && req.point.header.frame_id != frame) {
+        ROS_WARN("distance_server: point in %s, only %s is served",
+                 req.point.header.frame_id.c_str(), frame.c_str());
+        return false;
+    }
+    const int x = (int)floor((req.point.point.x - originX) / resolution);
+    const int y = (int)floor((req.point.point.y - originY) / resolution);
+    if(x < 0 || y < 0 || x >= distances.width() || y >= distances.height()) return false;
+
+    int ox, oy;
+    res.end_point.header.frame_id = frame;
+    if(!distances.nearest(x, y, ox, oy)) {
+        res.distance = -1;
+        res.end_point.point = req.point.point;
+        return true;
+    }
+    res.distance = sqrt((double)distances.distance2(x, y)) * resolution;
+    res.end_point.point.x = originX + (ox + 0.5) * resolution;
+    res.end_point.point.y = originY + (oy + 0.5) * resolution;
+    res.end_point.point.z = 0;
+    return true;
+}
+
+int main(int argc, char** argv){
+    ros::init(argc, argv, "distance_server");
+    ros::NodeHandle nh;
+    ros::NodeHandle nh_private("~");
+    nh_private.param<double>("max_distance", maxDistance, maxDistance);
+
+    ros::Subscriber sub = nh.subscribe("map", 1, mapCallback);
+    ros::ServiceServer service = nh_private.advertiseService("get_distance_to_obstacle", getDistance);
+    ros::spin();
+    return 0;
+}
@@ -0,0 +1,317 @@
+#ifndef GRID_PLANNER_HPP
+#define GRID_PLANNER_HPP
+#include <algorithm>
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <stdint.h>
+#include "occupancy_grid.hpp"
+#include "distance_map.hpp"
+using namespace::std;
+
+// cells the robot can't be in: radius cells or less from an obstacle,
+// and unknown ones unless allowUnknown.  grid is OccupancyGrid data of
+// the size of distances, whose maxDist has to reach radius.  run once
+// per map update
+inline void inflateGrid(const DistanceMap& distances, const signed char* grid, double radius,
+                        bool allowUnknown, vector<uint8_t>& blocked) {
+    const int width = distances.width(), height = distances.height();
+    const int r2 = (int)floor(radius * radius);
+    blocked.resize((size_t)width * height);
+    for(int y = 0; y < height; y++) {
+        for(int x = 0; x < width; x++) {
+            const size_t s = (size_t)y * width + x;
+            const signed char v = grid[s];
+            const bool unknown = v < 0 || (v > FREE_THRESH && v < OCCUPIED_THRESH);
+            blocked[s] = distances.distance2(x, y) <= r2 || (unknown && !allowUnknown);
+        }
+    }
+}
+
+// jump point search (Harabor and Grastien 2011) on an 8-connected
+// grid with uniform cost, diagonal moves only between two free
+// orthogonal cells so a path never cuts a corner.
+//
+// straight jumps test 8 cells at a time from a byte per cell, columns
+// from a transposed copy of the grid (Harabor and Grastien, "Improving
+// jump point search", 2014).
+//
+// everything a search needs is allocated by setMap: the open list is
+// an indexed binary heap over the cells, and per cell state is only
+// valid when its stamp is the current search, so nothing is cleared
+// between searches.
+class GridPlanner {
+public:
+    GridPlanner() : width_(0), height_(0), stride_(0), strideT_(0), search_(0), expanded_(0), free_(0), freeT_(0) {}
+
+    // blocked is width*height, non zero is blocked
+    void setMap(const uint8_t* blocked, int width, int height) {
+        // one blocked cell of border, so no bounds checks in the jumps
+        if(width != width_ || height != height_) {
+            width_  = width;
+            height_ = height;
+            stride_ = width + 2;
+            strideT_ = height + 2;
+            const size_t n = (size_t)stride_ * (height + 2);
+            // PAD more on each end for the word reads off the border
+            rows_.assign(n + 2 * PAD, 0);
+            cols_.assign(n + 2 * PAD, 0);
+            free_  = &rows_[PAD];
+            freeT_ = &cols_[PAD];
+            g_.resize(n);
+            f_.resize(n);
+            parent_.resize(n);
+            heapPos_.resize(n);
+            stamp_.assign(n, 0);
+            heap_.reserve(n);
+            search_ = 0;
+        }
+        for(int y = 0; y < height; y++)
+            for(int x = 0; x < width; x++)
+                free_[cell(x, y)] = !blocked[(size_t)y * width + x];
+        for(int x = 0; x < width; x++)
+            for(int y = 0; y < height; y++)
+                freeT_[(x + 1) * strideT_ + y + 1] = !blocked[(size_t)y * width + x];
+    }
+
+    // cells of the path from start to goal, both included.  false when
+    // either is blocked or there is no path
+    bool plan(int sx, int sy, int gx, int gy, vector<pair<int, int> >& path) {
+        path.clear();
+        expanded_ = 0;
+        if(!inside(sx, sy) || !inside(gx, gy) || !free_[cell(sx, sy)] || !free_[cell(gx, gy)])
+            return false;
+
+        if(++search_ == 0) {
+            // stamps wrapped, forget them all
+            fill(stamp_.begin(), stamp_.end(), 0);
+            search_ = 1;
+        }
+        heap_.clear();
+        goal_ = cell(gx, gy);
+        const int start = cell(sx, sy);
+        touch(start, 0, -1);
+        push(start);
+
+        while(!heap_.empty()) {
+            const int c = pop();
+            if(c == goal_) {
+                unwind(c, path);
+                return true;
+            }
+            expanded_++;
+            successors(c);
+        }
+        return false;
+    }
+
+    // cells expanded by the last plan
+    int expanded() const { return expanded_; }
+
+private:
+    int cell(int x, int y) const { return (y + 1) * stride_ + x + 1; }
+    bool inside(int x, int y) const { return x >= 0 && y >= 0 && x < width_ && y < height_; }
+
+    float heuristic(int c) const {
+        // octile distance
+        const int dx = abs(c % stride_ - goal_ % stride_), dy = abs(c / stride_ - goal_ / stride_);
+        return (float)(max(dx, dy) + (SQRT2 - 1) * min(dx, dy));
+    }
+
+    void touch(int c, float g, int parent) {
+        stamp_[c] = search_;
+        g_[c] = g;
+        f_[c] = g + heuristic(c);
+        parent_[c] = parent;
+        heapPos_[c] = -1;
+    }
+
+    // jump from c in direction (dx, dy), returns the jump point or -1
+    int jump(int c, int dx, int dy) const {
+        if(dx && dy) {
+            const int step = dy * stride_ + dx;
+            for(;;) {
+                if(!free_[c]) return -1;
+                if(c == goal_) return c;
+                if(jump(c + dx, dx, 0) >= 0 || jump(c + dy * stride_, 0, dy) >= 0) return c;
+                // no corner cutting: both orthogonal cells have to be free
+                if(!free_[c + dx] || !free_[c + dy * stride_]) return -1;
+                c += step;
+            }
+        }
+        if(!free_[c]) return -1;
+        if(dx) return stopAt(free_, stride_, c, dx, goal_);
+        // columns go through the transposed copy, so they scan like rows
+        const int x = c % stride_, y = c / stride_;
+        const int t = stopAt(freeT_, strideT_, x * strideT_ + y, dy, (goal_ % stride_) * strideT_ + goal_ / stride_);
+        return t < 0 ? -1 : (t % strideT_) * stride_ + t / strideT_;
+    }
+
+    // along a line of cells from free cell i, direction d: the goal, the
+    // first cell with a forced neighbour, or -1 when a blocked cell comes
+    // first.  a cell is forced when a cell beside it is free and the one
+    // behind that is blocked.  8 cells are tested a step, each byte of a
+    // word is one cell
+    static int stopAt(const uint8_t* line, int ls, int i, int d, int goal) {
+        const uint64_t ONES = 0x0101010101010101ULL;
+        const int start = i;
+        for(;;) {
+            uint64_t cur, a, ap, b, bp;
+            const int o = d > 0 ? i : i - 7;
+            memcpy(&cur, line + o, 8);
+            memcpy(&a,  line + o - ls, 8);
+            memcpy(&ap, line + o - ls - d, 8);
+            memcpy(&b,  line + o + ls, 8);
+            memcpy(&bp, line + o + ls - d, 8);
+            const uint64_t stop = ((a & ~ap) | (b & ~bp) | ~cur) & ONES;
+            if(stop) {
+                i = d > 0 ? o + __builtin_ctzll(stop) / 8 : o + (63 - __builtin_clzll(stop)) / 8;
+                break;
+            }
+            i += 8 * d;
+        }
+        // the goal on the way, rows and columns are stride apart
+        if(goal / ls == start / ls && (goal - start) * d >= 0 && (i - goal) * d >= 0) return goal;
+        return line[i] ? i : -1;
+    }
+
+    void successors(int c) {
+        const int p = parent_[c];
+        int dirs[8][2];
+        int count = 0;
+        const int x = c % stride_, y = c / stride_;
+        if(p < 0) {
+            for(int dy = -1; dy <= 1; dy++)
+                for(int dx = -1; dx <= 1; dx++)
+                    if(dx || dy) { dirs[count][0] = dx; dirs[count][1] = dy; count++; }
+        } else {
+            const int px = p % stride_, py = p / stride_;
+            const int dx = (x > px) - (x < px), dy = (y > py) - (y < py);
+            if(dx && dy) {
+                dirs[count][0] = dx; dirs[count][1] = 0; count++;
+                dirs[count][0] = 0; dirs[count][1] = dy; count++;
+                dirs[count][0] = dx; dirs[count][1] = dy; count++;
+            } else {
+                // straight on, the turns around hidden cells, and the
+                // diagonals between them
+                const int sx = dy ? 1 : 0, sy = dx ? 1 : 0;
+                dirs[count][0] = dx; dirs[count][1] = dy; count++;
+                dirs[count][0] = sx; dirs[count][1] = sy; count++;
+                dirs[count][0] = -sx; dirs[count][1] = -sy; count++;
+                dirs[count][0] = dx + sx; dirs[count][1] = dy + sy; count++;
+                dirs[count][0] = dx - sx; dirs[count][1] = dy - sy; count++;
+            }
+        }
+
+        for(int i = 0; i < count; i++) {
+            const int dx = dirs[i][0], dy = dirs[i][1];
+            const int n = c + dy * stride_ + dx;
+            if(dx && dy && (!free_[c + dx] || !free_[c + dy * stride_])) continue;
+            const int j = jump(n, dx, dy);
+            if(j < 0) continue;
+            const int jx = j % stride_, jy = j / stride_;
+            const int ax = abs(jx - x), ay = abs(jy - y);
+            const float g = g_[c] + max(ax, ay) + (SQRT2 - 1) * min(ax, ay);
+            if(stamp_[j] != search_) {
+                touch(j, g, c);
+                push(j);
+            } else if(g < g_[j] && heapPos_[j] >= 0) {
+                g_[j] = g;
+                f_[j] = g + heuristic(j);
+                parent_[j] = c;
+                up(heapPos_[j]);
+            }
+        }
+    }
+
+    void unwind(int c, vector<pair<int, int> >& path) {
+        // jump points back to front, then the cells between them
+        vector<int> points;
+        for(; c >= 0; c = parent_[c]) points.push_back(c);
+        reverse(points.begin(), points.end());
+        for(size_t i = 0; i < points.size(); i++) {
+            int x = points[i] % stride_ - 1, y = points[i] / stride_ - 1;
+            if(i == 0) {
+                path.push_back(make_pair(x, y));
+                continue;
+            }
+            int px = points[i - 1] % stride_ - 1, py = points[i - 1] / stride_ - 1;
+            const int dx = (x > px) - (x < px), dy = (y > py) - (y < py);
+            while(px != x || py != y) {
+                // diagonal first, then straight, as the jumps went
+                if(px != x && py != y) { px += dx; py += dy; }
+                else if(px != x) px += dx;
+                else py += dy;
+                path.push_back(make_pair(px, py));
+            }
+        }
+    }
+
+    // indexed min heap on f_, ties to the larger g
+    bool less(int a, int b) const { return f_[a] < f_[b] || (f_[a] == f_[b] && g_[a] > g_[b]); }
+
+    void push(int c) {
+        heap_.push_back(c);
+        heapPos_[c] = heap_.size() - 1;
+        up(heap_.size() - 1);
+    }
+
+    int pop() {
+        const int top = heap_[0];
+        heapPos_[top] = -2;   // closed
+        heap_[0] = heap_.back();
+        heap_.pop_back();
+        if(!heap_.empty()) {
+            heapPos_[heap_[0]] = 0;
+            down(0);
+        }
+        return top;
+    }
+
+    void up(size_t i) {
+        const int c = heap_[i];
+        while(i > 0) {
+            size_t p = (i - 1) / 2;
+            if(!less(c, heap_[p])) break;
+            heap_[i] = heap_[p];
+            heapPos_[heap_[i]] = i;
+            i = p;
+        }
+        heap_[i] = c;
+        heapPos_[c] = i;
+    }
+
+    void down(size_t i) {
+        const int c = heap_[i];
+        const size_t n = heap_.size();
+        for(;;) {
+            size_t l = 2 * i + 1;
+            if(l >= n) break;
+            if(l + 1 < n && less(heap_[l + 1], heap_[l])) l++;
+            if(!less(heap_[l], c)) break;
+            heap_[i] = heap_[l];
+            heapPos_[heap_[i]] = i;
+            i = l;
+        }
+        heap_[i] = c;
+        heapPos_[c] = i;
+    }
+
+    static constexpr float SQRT2 = 1.41421356f;
+    enum { PAD = 16 };
+
+    int width_, height_, stride_, strideT_;
+    int goal_;
+    uint32_t search_;
+    int expanded_;
+    vector<uint8_t> rows_, cols_;
+    uint8_t* free_;              // 1 free, padded by one blocked cell all round
+    uint8_t* freeT_;             // the same, transposed
+    vector<float> g_, f_;
+    vector<int> parent_;
+    vector<int> heapPos_;        // -1 not queued, -2 closed
+    vector<uint32_t> stamp_;
+    vector<int> heap_;
+};
+
+#endif
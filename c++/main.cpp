@@ -1,16 +1,129 @@
+// keeps new.pgm up to date with the /map topic.
+//
+// subscribes to the occupancy grid instead of running map_saver in a
+// loop, so there is no process per snapshot and no old.pgm round trip.
+//
+// build:
+//   g++ -O2 main.cpp -I/opt/ros/lunar/include -L/opt/ros/lunar/lib
+//       -lroscpp -lrosconsole -lroscpp_serialization -lrostime -lz -pthread -o map_export
+// run:
+//   ./map_export [_out:=new.pgm] [_tile_dir:=dir] [_stream_port:=port]
+//                [_packed_out:=map.pmap] [_changes_out:=changes.json]
+//
+// an empty out skips the pgm.  with tile_dir set the map is also kept
+// there as png tiles, see png_tiles.hpp.  with stream_port set the
+// tiles are pushed to map.html over websocket as they change, see
+// map_stream.hpp.  packed_out keeps a 2 bit per cell copy, see
+// packed_map.hpp.  changes_out gets the regions that changed since the
+// last map, see map_diff.hpp
 #include <iostream>
 #include <vector>
 #include "convert.hpp"
-#include <stdlib.h>
-#include <unistd.h>
+#include "occupancy_grid.hpp"
+#include "tile_map.hpp"
+#include "png_tiles.hpp"
+#include "map_stream.hpp"
+#include "map_stats.hpp"
+#include "packed_map.hpp"
+#include "map_diff.hpp"
+#include <cmath>
+#include <cstdio>
+#include <ros/ros.h>
+#include <nav_msgs/OccupancyGrid.h>
 
-int main(){
-  const string filename= "old.pgm";
-  long count=0;
-  while(1){
-    system("rosrun map_server map_saver -f old"); //run the robot os command to update image
-    convert(filename);                            //convert the binary pgm to ascii pgm
-    usleep(10000);
-  }
-  return 0;
+static string outfile = "new.pgm";
+static string tiledir;
+static int streamport = 0;
+static string packedfile;
+static string changesfile;
+static vector<unsigned char> image;
+static TileMap tiles;
+static TileTextCache text;
+static PngTileCache pngs;
+static MapStreamServer stream;
+static PackedMap packed;
+static MapDiff differ;
+static vector<unsigned char> previous;
+static int prevWidth = 0, prevHeight = 0;
+static double prevOriginX = 0, prevOriginY = 0;
+
+// changed regions as json, in image cells, for the overlay
+static void writeChanges(const nav_msgs::OccupancyGridConstPtr& map, int width, int height) {
+    vector<MapDiffRegion> regions;
+    // the grid's y runs up, the image's down
+    const double res = map->info.resolution;
+    const int dx = (int)lround((map->info.origin.position.x - prevOriginX) / res);
+    const int dy = prevHeight - height - (int)lround((map->info.origin.position.y - prevOriginY) / res);
+    if(!previous.empty())
+        differ.diff(&previous[0], prevWidth, prevHeight, &image[0], width, height, dx, dy, regions);
+
+    previous = image;
+    prevWidth = width;
+    prevHeight = height;
+    prevOriginX = map->info.origin.position.x;
+    prevOriginY = map->info.origin.position.y;
+
+    // written even with nothing changed, so a reader never takes the
+    // previous update's regions for this one's
+    string json = "{\"regions\":[";
+    char buf[160];
+    for(size_t i = 0; i < regions.size(); i++) {
+        const MapDiffRegion& r = regions[i];
+        snprintf(buf, sizeof(buf), "%s{\"box\":[%d,%d,%d,%d],\"cells\":%d,\"occupied\":%d,\"cleared\":%d,\"explored\":%d}",
+                 i ? "," : "", r.minX, r.minY, r.maxX, r.maxY, r.cells, r.occupied, r.cleared, r.explored);
+        json += buf;
+    }
+    json += "]}\n";
+    if(pgmWriteFile(changesfile, json.data(), json.size()) != 0)
+        ROS_WARN("map_export: unable to write %s", changesfile.c_str());
+}
+
+void mapCallback(const nav_msgs::OccupancyGridConstPtr& map) {
+    const int width  = map->info.width;
+    const int height = map->info.height;
+    if((size_t)width * height != map->data.size()) {
+        ROS_WARN("map_export: %dx%d map with %zu cells, skipped",
+                 width, height, map->data.size());
+        return;
+    }
+    gridToImage(&map->data[0], width, height, image);  //same pixels map_saver writes
+    // hector republishes the whole grid, most of it unchanged
+    const int dirty = tiles.update(&image[0], width, height);
+    if(!changesfile.empty()) writeChanges(map, width, height);
+    if(dirty == 0) return;
+    MapStats stats;
+    mapStats(&image[0], width, height, map->info.resolution, stats);
+    ROS_DEBUG("map_export: %zu free, %zu occupied, %.1f m^2 explored, known %d,%d - %d,%d",
+              stats.free, stats.occupied, stats.exploredArea,
+              stats.minX, stats.minY, stats.maxX, stats.maxY);
+    if(!packedfile.empty()) {
+        packGrid(&map->data[0], width, height, packed);
+        if(writePackedMap(packedfile, packed) != 0)
+            ROS_WARN("map_export: unable to write %s", packedfile.c_str());
+    }
+    if(!outfile.empty() && text.write(outfile, tiles) != 0)
+        ROS_WARN("map_export: unable to write %s", outfile.c_str());
+    if(tiledir.empty() && !streamport) return;
+    if(pngs.write(tiledir, tiles) != 0) {
+        ROS_WARN("map_export: unable to write tiles to %s", tiledir.c_str());
+        return;
+    }
+    if(streamport) stream.publish(tiles, pngs);
+}
+
+int main(int argc, char** argv){
+    ros::init(argc, argv, "map_export");
+    ros::NodeHandle nh;
+    ros::NodeHandle nh_private("~");
+    nh_private.param<string>("out", outfile, outfile);
+    nh_private.param<string>("tile_dir", tiledir, tiledir);
+    nh_private.param<int>("stream_port", streamport, streamport);
+    nh_private.param<string>("packed_out", packedfile, packedfile);
+    nh_private.param<string>("changes_out", changesfile, changesfile);
+    if(streamport && stream.start(streamport) != 0) return 1;
+
+    // only the newest map matters, drop the rest if we fall behind
+    ros::Subscriber sub = nh.subscribe("map", 1, mapCallback);
+    ros::spin();
+    return 0;
 }
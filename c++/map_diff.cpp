@@ -0,0 +1,74 @@
+// changed regions between two map snapshots.
+//
+// build: g++ -O2 map_diff.cpp -o map_diff
+// run:   ./map_diff [old=old.pgm] [new=new.pgm] [dx dy] [min cells]
+//        ./map_diff -b [size=4096]    time a diff of two generated maps
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <time.h>
+#include "pgm.hpp"
+#include "map_diff.hpp"
+
+static double now() {
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e3 + t.tv_nsec * 1e-6;
+}
+
+static int bench(int size) {
+    // an explored map, then the next snapshot with a few moving
+    // obstacles and some new ground at the edge of the known area
+    vector<uint8_t> a((size_t)size * size, GREY_UNKNOWN);
+    srand(1);
+    for(int y = size / 4; y < size * 3 / 4; y++)
+        for(int x = size / 4; x < size * 3 / 4; x++)
+            a[(size_t)y * size + x] = (rand() % 50) ? GREY_FREE : GREY_OCCUPIED;
+    vector<uint8_t> b = a;
+    for(int k = 0; k < 20; k++) {
+        int cx = size / 4 + rand() % (size / 2), cy = size / 4 + rand() % (size / 2);
+        for(int y = cy; y < cy + 10; y++)
+            for(int x = cx; x < cx + 10; x++) b[(size_t)y * size + x] = GREY_OCCUPIED;
+    }
+    for(int y = size / 4; y < size / 2; y++)
+        for(int x = size * 3 / 4; x < size * 3 / 4 + 40; x++) b[(size_t)y * size + x] = GREY_FREE;
+
+    MapDiff diff;
+    vector<MapDiffRegion> regions;
+    const int runs = 20;
+    size_t changed = 0, count = 0;
+    double t0 = now();
+    for(int run = 0; run < runs; run++)
+        changed = diff.diff(&a[0], size, size, &b[0], size, size, 0, 0, regions);
+    double t1 = now();
+    count = regions.size();
+    for(int run = 0; run < runs; run++)
+        diff.diff(&a[0], size, size, &a[0], size, size, 0, 0, regions);
+    double t2 = now();
+    printf("%dx%d, %zu changed cells in %zu regions\n", size, size, changed, count);
+    printf("  diff ms        %8.3f\n", (t1 - t0) / runs);
+    printf("  unchanged ms   %8.3f\n", (t2 - t1) / runs);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if(argc > 1 && strcmp(argv[1], "-b") == 0) return bench(argc > 2 ? atoi(argv[2]) : 4096);
+
+    PgmImage a, b;
+    if(readPgm(argc > 1 ? argv[1] : "old.pgm", a) != 0 || readPgm(argc > 2 ? argv[2] : "new.pgm", b) != 0)
+        return 1;
+    const int dx = argc > 4 ? atoi(argv[3]) : 0, dy = argc > 4 ? atoi(argv[4]) : 0;
+    const int minCells = argc > 5 ? atoi(argv[5]) : 1;
+
+    MapDiff diff;
+    vector<MapDiffRegion> regions;
+    size_t changed = diff.diff(&a.pixels[0], a.width, a.height, &b.pixels[0], b.width, b.height,
+                               dx, dy, regions, minCells);
+    cout << "changed cells: " << changed << "\n";
+    for(size_t i = 0; i < regions.size(); i++) {
+        const MapDiffRegion& r = regions[i];
+        cout << r.minX << "," << r.minY << " - " << r.maxX << "," << r.maxY << "  cells " << r.cells
+             << " occupied " << r.occupied << " cleared " << r.cleared << " explored " << r.explored << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,197 @@
+#ifndef MAP_DIFF_HPP
+#define MAP_DIFF_HPP
+#include <algorithm>
+#include <vector>
+#include <cstring>
+#include <stdint.h>
+#include "occupancy_grid.hpp"
+#include "map_stats.hpp"
+using namespace::std;
+
+// what changed between two map images: changed cells found 16 at a
+// time, grouped into 8-connected regions from runs of changed cells.
+//
+// the maps may be offset when the origin moved: cell (x, y) of the new
+// one is cell (x + dx, y + dy) of the old one.  new cells the old map
+// does not cover are compared against unknown.
+
+struct MapDiffRegion {
+    int minX, minY, maxX, maxY;   // in new map cells
+    int cells;                    // changed cells
+    int occupied;                 // turned occupied
+    int cleared;                  // were occupied, are not any more
+    int explored;                 // were unknown, are known now
+};
+
+struct MapDiffRun {
+    int y, x0, x1;                // cells [x0, x1) of row y
+    int parent;                   // union find, run index
+};
+
+inline int mapDiffFind(vector<MapDiffRun>& runs, int i) {
+    while(runs[i].parent != i) {
+        runs[i].parent = runs[runs[i].parent].parent;
+        i = runs[i].parent;
+    }
+    return i;
+}
+
+inline int mapDiffClass(uint8_t grey) {
+    return grey <= GREY_OCCUPIED_MAX ? 2 : grey >= GREY_FREE_MIN ? 1 : 0;
+}
+
+// runs of cells where a and b differ, b NULL compares with unknown
+inline void mapDiffRow(const uint8_t* a, const uint8_t* b, int n, int x, int y,
+                       vector<MapDiffRun>& runs) {
+    const MapVec unknown = (MapVec){} + GREY_UNKNOWN;
+    int i = 0;
+    int start = -1;
+    for(; i + 16 <= n; i += 16) {
+        MapVec va, vb, ne;
+        memcpy(&va, a + i, 16);
+        if(b) memcpy(&vb, b + i, 16);
+        else vb = unknown;
+        ne = va ^ vb;
+        uint64_t lo, hi;
+        memcpy(&lo, &ne, 8);
+        memcpy(&hi, (uint8_t*)&ne + 8, 8);
+        if(!(lo | hi)) {
+            if(start >= 0) {
+                MapDiffRun r = { y, x + start, x + i, (int)runs.size() };
+                runs.push_back(r);
+                start = -1;
+            }
+            continue;
+        }
+        for(int k = 0; k < 16; k++) {
+            const bool changed = ne[k] != 0;
+            if(changed && start < 0) {
+                start = i + k;
+            } else if(!changed && start >= 0) {
+                MapDiffRun r = { y, x + start, x + i + k, (int)runs.size() };
+                runs.push_back(r);
+                start = -1;
+            }
+        }
+    }
+    for(; i < n; i++) {
+        const bool changed = a[i] != (b ? b[i] : GREY_UNKNOWN);
+        if(changed && start < 0) {
+            start = i;
+        } else if(!changed && start >= 0) {
+            MapDiffRun r = { y, x + start, x + i, (int)runs.size() };
+            runs.push_back(r);
+            start = -1;
+        }
+    }
+    if(start >= 0) {
+        MapDiffRun r = { y, x + start, x + n, (int)runs.size() };
+        runs.push_back(r);
+    }
+}
+
+class MapDiff {
+public:
+    // returns the number of changed cells, 0 means nothing downstream
+    // needs to run.  regions smaller than minCells are left out of
+    // regions but still counted
+    size_t diff(const uint8_t* oldImage, int oldW, int oldH, const uint8_t* newImage, int newW, int newH,
+                int dx, int dy, vector<MapDiffRegion>& regions, int minCells = 1) {
+        runs_.clear();
+        regions.clear();
+        rowStart_.assign(newH + 1, 0);
+
+        // changed runs, row by row; the x range [xa, xb) of the new map
+        // has old cells under it
+        const int xa = max(0, -dx), xb = min(newW, oldW - dx);
+        for(int y = 0; y < newH; y++) {
+            rowStart_[y] = runs_.size();
+            const uint8_t* row = newImage + (size_t)y * newW;
+            const int yo = y + dy;
+            if(yo < 0 || yo >= oldH || xa >= xb) {
+                mapDiffRow(row, NULL, newW, 0, y, runs_);
+                continue;
+            }
+            const uint8_t* orow = oldImage + (size_t)yo * oldW + dx;
+            if(xa > 0) mapDiffRow(row, NULL, xa, 0, y, runs_);
+            mapDiffRow(row + xa, orow + xa, xb - xa, xa, y, runs_);
+            if(xb < newW) mapDiffRow(row + xb, NULL, newW - xb, xb, y, runs_);
+            mergeRow(y);
+        }
+        rowStart_[newH] = runs_.size();
+
+        // join runs touching a run of the row above, diagonals count
+        for(int y = 1; y < newH; y++) {
+            size_t p = rowStart_[y - 1];
+            const size_t pe = rowStart_[y];
+            for(size_t c = rowStart_[y]; c < rowStart_[y + 1]; c++) {
+                while(p < pe && runs_[p].x1 < runs_[c].x0) p++;
+                for(size_t q = p; q < pe && runs_[q].x0 <= runs_[c].x1; q++) {
+                    int a = mapDiffFind(runs_, c), b = mapDiffFind(runs_, q);
+                    if(a != b) runs_[max(a, b)].parent = min(a, b);
+                }
+            }
+        }
+
+        // one region per root
+        size_t changed = 0;
+        index_.assign(runs_.size(), -1);
+        for(size_t i = 0; i < runs_.size(); i++) {
+            const MapDiffRun& r = runs_[i];
+            const int root = mapDiffFind(runs_, i);
+            if(index_[root] < 0) {
+                index_[root] = regions.size();
+                MapDiffRegion g = { r.x0, r.y, r.x1 - 1, r.y, 0, 0, 0, 0 };
+                regions.push_back(g);
+            }
+            MapDiffRegion& g = regions[index_[root]];
+            g.minX = min(g.minX, r.x0);
+            g.maxX = max(g.maxX, r.x1 - 1);
+            g.maxY = r.y;
+            g.cells += r.x1 - r.x0;
+            changed += r.x1 - r.x0;
+
+            // what kind of change, only for the changed cells
+            const int yo = r.y + dy;
+            for(int x = r.x0; x < r.x1; x++) {
+                const int xo = x + dx;
+                const int was = (yo >= 0 && yo < oldH && xo >= 0 && xo < oldW)
+                              ? mapDiffClass(oldImage[(size_t)yo * oldW + xo]) : 0;
+                const int is = mapDiffClass(newImage[(size_t)r.y * newW + x]);
+                g.occupied += (is == 2 && was != 2);
+                g.cleared  += (was == 2 && is != 2);
+                g.explored += (was == 0 && is != 0);
+            }
+        }
+
+        if(minCells > 1) {
+            size_t keep = 0;
+            for(size_t i = 0; i < regions.size(); i++)
+                if(regions[i].cells >= minCells) regions[keep++] = regions[i];
+            regions.resize(keep);
+        }
+        return changed;
+    }
+
+private:
+    // a row compared in pieces can end one run where the next begins
+    void mergeRow(int y) {
+        size_t keep = rowStart_[y];
+        for(size_t i = rowStart_[y]; i < runs_.size(); i++) {
+            if(keep > rowStart_[y] && runs_[keep - 1].x1 == runs_[i].x0) {
+                runs_[keep - 1].x1 = runs_[i].x1;
+                continue;
+            }
+            runs_[keep] = runs_[i];
+            runs_[keep].parent = keep;
+            keep++;
+        }
+        runs_.resize(keep);
+    }
+
+    vector<MapDiffRun> runs_;
+    vector<size_t> rowStart_;
+    vector<int> index_;
+};
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef MAP_STATS_HPP
+#define MAP_STATS_HPP
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <cstring>
+#include <stdint.h>
+using namespace::std;
+
+// histogram and occupancy numbers of a map image, cheap enough for
+// every update.
+//
+// cells are classed the way map_server reads an image back:
+// occupancy = (255 - grey) / 255, occupied above 0.65, free below
+// 0.196, unknown in between.  so grey <= 89 is occupied, >= 206 free.
+const int GREY_OCCUPIED_MAX = 89;
+const int GREY_FREE_MIN     = 206;
+
+struct MapStats {
+    uint32_t hist[256];
+    size_t free;
+    size_t occupied;
+    size_t unknown;
+    double exploredArea;     // m^2 of free and occupied cells
+    // bounding box of the known cells, minX > maxX when there are none
+    int minX, minY, maxX, maxY;
+};
+
+// 16 pixels at a time, with gcc vector types so the same code is sse2
+// on the pc and neon on the jetson
+typedef uint8_t MapVec __attribute__((vector_size(16)));
+
+// histogram, rows of known cells and columns of known cells of rows
+// [y0, y1).  colKnown is width bytes, or-ed into
+inline void mapStatsRows(const uint8_t* image, int width, int y0, int y1, uint32_t hist[256],
+                         uint8_t* colKnown, int& minY, int& maxY) {
+    // four sub-histograms, so runs of one value don't serialise on
+    // the same counter
+    static const int LANES = 4;
+    vector<uint32_t> sub(256 * LANES, 0);
+    const MapVec occMax  = (MapVec){} + (uint8_t)GREY_OCCUPIED_MAX;
+    const MapVec freeMin = (MapVec){} + (uint8_t)(GREY_FREE_MIN - 1);
+
+    minY = 1 << 30;
+    maxY = -1;
+    for(int y = y0; y < y1; y++) {
+        const uint8_t* row = image + (size_t)y * width;
+        MapVec anyKnown = (MapVec){};
+        int x = 0;
+        for(; x + 16 <= width; x += 16) {
+            MapVec v;
+            memcpy(&v, row + x, 16);
+            MapVec known = (MapVec)((v <= occMax) | (v > freeMin));
+            anyKnown |= known;
+            MapVec col;
+            memcpy(&col, colKnown + x, 16);
+            col |= known;
+            memcpy(colKnown + x, &col, 16);
+
+            // most of a map is long runs, count a uniform block at once
+            MapVec same = (MapVec)(v == ((MapVec){} + v[0]));
+            uint64_t lo, hi;
+            memcpy(&lo, &same, 8);
+            memcpy(&hi, (uint8_t*)&same + 8, 8);
+            if((lo & hi) == ~0ULL) {
+                sub[v[0]] += 16;
+            } else {
+                for(int i = 0; i < 16; i++) sub[(i % LANES) * 256 + row[x + i]]++;
+            }
+        }
+        bool rowKnown = false;
+        for(int i = 0; i < 16; i++) rowKnown |= anyKnown[i] != 0;
+        for(; x < width; x++) {
+            const uint8_t p = row[x];
+            sub[(x % LANES) * 256 + p]++;
+            if(p <= GREY_OCCUPIED_MAX || p >= GREY_FREE_MIN) {
+                colKnown[x] = 0xff;
+                rowKnown = true;
+            }
+        }
+        if(rowKnown) {
+            minY = min(minY, y);
+            maxY = y;
+        }
+    }
+    for(int v = 0; v < 256; v++)
+        hist[v] = sub[v] + sub[256 + v] + sub[512 + v] + sub[768 + v];
+}
+
+// resolution in m per cell.  maps of at least threadMin pixels are
+// split across the cores
+inline void mapStats(const uint8_t* image, int width, int height, double resolution, MapStats& stats,
+                     size_t threadMin = 4 << 20) {
+    int threads = 1;
+    if((size_t)width * height >= threadMin)
+        threads = max(1, min((int)thread::hardware_concurrency(), height / 64));
+
+    vector<uint32_t> hists(256 * threads, 0);
+    vector<uint8_t> cols((size_t)width * threads, 0);
+    vector<int> minYs(threads), maxYs(threads);
+    vector<thread> pool;
+    for(int t = 0; t < threads; t++) {
+        int y0 = (int)((int64_t)height * t / threads), y1 = (int)((int64_t)height * (t + 1) / threads);
+        if(t + 1 < threads) {
+            pool.push_back(thread(mapStatsRows, image, width, y0, y1, &hists[256 * t],
+                                  &cols[(size_t)width * t], ref(minYs[t]), ref(maxYs[t])));
+        } else {
+            mapStatsRows(image, width, y0, y1, &hists[256 * t], &cols[(size_t)width * t],
+                         minYs[t], maxYs[t]);
+        }
+    }
+    for(size_t t = 0; t < pool.size(); t++) pool[t].join();
+
+    memset(stats.hist, 0, sizeof(stats.hist));
+    stats.minY = 1 << 30;
+    stats.maxY = -1;
+    for(int t = 0; t < threads; t++) {
+        for(int v = 0; v < 256; v++) stats.hist[v] += hists[256 * t + v];
+        stats.minY = min(stats.minY, minYs[t]);
+        stats.maxY = max(stats.maxY, maxYs[t]);
+        for(int x = 0; t && x < width; x++) cols[x] |= cols[(size_t)width * t + x];
+    }
+
+    stats.occupied = stats.free = stats.unknown = 0;
+    for(int v = 0; v < 256; v++) {
+        if(v <= GREY_OCCUPIED_MAX) stats.occupied += stats.hist[v];
+        else if(v >= GREY_FREE_MIN) stats.free += stats.hist[v];
+        else stats.unknown += stats.hist[v];
+    }
+    stats.exploredArea = (stats.free + stats.occupied) * resolution * resolution;
+
+    stats.minX = 0;
+    stats.maxX = width - 1;
+    while(stats.minX < width && !cols[stats.minX]) stats.minX++;
+    while(stats.maxX >= 0 && !cols[stats.maxX]) stats.maxX--;
+    if(stats.maxY < 0) {
+        stats.minX = stats.minY = 0;
+        stats.maxX = stats.maxY = -1;
+    }
+}
+
+#endif
@@ -0,0 +1,387 @@
+#ifndef MAP_STREAM_HPP
+#define MAP_STREAM_HPP
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <cstring>
+#include <cerrno>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "tile_map.hpp"
+#include "png_tiles.hpp"
+using namespace::std;
+
+// pushes the map to browsers over websocket as png tile deltas.
+//
+// the producer only swaps tile pointers into a snapshot under a lock
+// and pokes the server thread, it never waits on a client.  a client
+// gets its next frame only once the last one is fully written, and
+// that frame carries every tile changed since the last one it got, so
+// a slow browser skips generations instead of queueing them.
+//
+// frames are binary messages, little endian:
+//
+//   u32 generation, u16 width, u16 height, u16 tile, u16 count,
+//   u8 keyframe, u8 0, then count times:
+//   u16 tx, u16 ty, u32 length, length bytes of png
+//
+// a client's first frame, and the first after a resize, is a keyframe
+// with every tile.
+
+// sha1 and base64, only for the handshake
+inline string wsAcceptKey(const string& key) {
+    string msg = key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+    uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    uint64_t bits = (uint64_t)msg.size() * 8;
+    msg += (char)0x80;
+    while(msg.size() % 64 != 56) msg += (char)0;
+    for(int i = 7; i >= 0; i--) msg += (char)(bits >> (i * 8));
+
+    for(size_t off = 0; off < msg.size(); off += 64) {
+        uint32_t w[80];
+        for(int i = 0; i < 16; i++)
+            w[i] = (uint32_t)(uint8_t)msg[off + i * 4] << 24 | (uint32_t)(uint8_t)msg[off + i * 4 + 1] << 16 |
+                   (uint32_t)(uint8_t)msg[off + i * 4 + 2] << 8 | (uint32_t)(uint8_t)msg[off + i * 4 + 3];
+        for(int i = 16; i < 80; i++) {
+            uint32_t v = w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16];
+            w[i] = v << 1 | v >> 31;
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for(int i = 0; i < 80; i++) {
+            uint32_t f, k;
+            if(i < 20)      { f = (b & c) | (~b & d);          k = 0x5A827999; }
+            else if(i < 40) { f = b ^ c ^ d;                   k = 0x6ED9EBA1; }
+            else if(i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+            else            { f = b ^ c ^ d;                   k = 0xCA62C1D6; }
+            uint32_t t = (a << 5 | a >> 27) + f + e + k + w[i];
+            e = d; d = c; c = b << 30 | b >> 2; b = a; a = t;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+    }
+
+    uint8_t digest[20];
+    for(int i = 0; i < 20; i++) digest[i] = (uint8_t)(h[i / 4] >> (24 - (i % 4) * 8));
+    static const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    string out;
+    for(int i = 0; i < 20; i += 3) {
+        uint32_t v = digest[i] << 16 | (i + 1 < 20 ? digest[i + 1] << 8 : 0) | (i + 2 < 20 ? digest[i + 2] : 0);
+        out += b64[v >> 18 & 63];
+        out += b64[v >> 12 & 63];
+        out += i + 1 < 20 ? b64[v >> 6 & 63] : '=';
+        out += i + 2 < 20 ? b64[v & 63] : '=';
+    }
+    return out;
+}
+
+class MapStreamServer {
+public:
+    static const int MAX_CLIENTS = 16;
+
+    MapStreamServer() : listenFd_(-1), running_(false), generation_(0), resized_(0),
+                        width_(0), height_(0), tilesX_(0) {
+        wake_[0] = wake_[1] = -1;
+    }
+    ~MapStreamServer() { stop(); }
+
+    int start(int port) {
+        listenFd_ = socket(AF_INET, SOCK_STREAM, 0);
+        if(listenFd_ < 0) return -1;
+        int one = 1;
+        setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(port);
+        if(bind(listenFd_, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listenFd_, 8) != 0 ||
+           pipe(wake_) != 0) {
+            cerr << "MapStreamServer: unable to listen on " << port << endl;
+            stop();
+            return -1;
+        }
+        fcntl(listenFd_, F_SETFL, O_NONBLOCK);
+        fcntl(wake_[0], F_SETFL, O_NONBLOCK);
+        fcntl(wake_[1], F_SETFL, O_NONBLOCK);
+        running_ = true;
+        thread_ = thread(&MapStreamServer::run, this);
+        return 0;
+    }
+
+    void stop() {
+        if(running_.exchange(false)) {
+            poke();
+            thread_.join();
+        }
+        for(size_t i = 0; i < clients_.size(); i++) close(clients_[i].fd);
+        clients_.clear();
+        if(listenFd_ >= 0) close(listenFd_);
+        if(wake_[0] >= 0) close(wake_[0]);
+        if(wake_[1] >= 0) close(wake_[1]);
+        listenFd_ = wake_[0] = wake_[1] = -1;
+    }
+
+    // take the tiles changed in map, pngs has to be written for the
+    // same generation
+    void publish(const TileMap& map, PngTileCache& pngs) {
+        {
+            lock_guard<mutex> lock(mtx_);
+            if(map.width() != width_ || map.height() != height_ ||
+               !map.changedSince(generation_, tiles_)) {
+                width_  = map.width();
+                height_ = map.height();
+                tilesX_ = map.tilesX();
+                png_.assign(map.tileCount(), shared_ptr<const string>());
+                changed_.assign(map.tileCount(), 0);
+                resized_ = map.generation();
+                tiles_.clear();
+                for(int t = 0; t < map.tileCount(); t++) tiles_.push_back(t);
+            }
+            for(size_t i = 0; i < tiles_.size(); i++) {
+                png_[tiles_[i]] = make_shared<const string>(pngs.tilePng(tiles_[i]));
+                changed_[tiles_[i]] = map.generation();
+            }
+            generation_ = map.generation();
+        }
+        poke();
+    }
+
+    int clientCount() {
+        lock_guard<mutex> lock(mtx_);
+        return (int)clients_.size();
+    }
+
+private:
+    struct Client {
+        int fd;
+        bool open;        // handshake done
+        uint32_t sent;    // generation of the last frame queued
+        string in;
+        string out;
+        size_t outOff;
+    };
+
+    void poke() {
+        char c = 0;
+        if(wake_[1] >= 0 && write(wake_[1], &c, 1) < 0) {}   // full pipe is still a wakeup
+    }
+
+    void run() {
+        vector<pollfd> fds;
+        while(running_) {
+            fds.clear();
+            pollfd p = { wake_[0], POLLIN, 0 };
+            fds.push_back(p);
+            p.fd = listenFd_;
+            fds.push_back(p);
+            for(size_t i = 0; i < clients_.size(); i++) {
+                p.fd = clients_[i].fd;
+                p.events = POLLIN | (clients_[i].outOff < clients_[i].out.size() ? POLLOUT : 0);
+                fds.push_back(p);
+            }
+            if(poll(&fds[0], fds.size(), 1000) < 0 && errno != EINTR) break;
+
+            if(fds[0].revents & POLLIN) {
+                char buf[64];
+                while(read(wake_[0], buf, sizeof(buf)) > 0) {}
+            }
+            // back to front so dropping a client keeps the indexes valid
+            for(int i = (int)clients_.size() - 1; i >= 0; i--) {
+                short ev = fds[i + 2].revents;
+                bool ok = true;
+                if(ev & (POLLERR | POLLHUP | POLLNVAL)) ok = false;
+                if(ok && (ev & POLLIN)) ok = receive(clients_[i]);
+                if(ok) ok = flush(clients_[i]);
+                if(ok && clients_[i].open && clients_[i].outOff == clients_[i].out.size()) {
+                    queueFrame(clients_[i]);
+                    ok = flush(clients_[i]);
+                }
+                if(!ok) {
+                    close(clients_[i].fd);
+                    lock_guard<mutex> lock(mtx_);
+                    clients_.erase(clients_.begin() + i);
+                }
+            }
+            // after the clients, fds only covers the ones polled
+            if(fds[1].revents & POLLIN) accept_();
+        }
+    }
+
+    void accept_() {
+        int fd;
+        while((fd = accept(listenFd_, NULL, NULL)) >= 0) {
+            if(clients_.size() >= MAX_CLIENTS) {
+                close(fd);
+                continue;
+            }
+            int one = 1;
+            fcntl(fd, F_SETFL, O_NONBLOCK);
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            Client c;
+            c.fd = fd;
+            c.open = false;
+            c.sent = 0;
+            c.outOff = 0;
+            lock_guard<mutex> lock(mtx_);
+            clients_.push_back(c);
+        }
+    }
+
+    // false drops the client
+    bool receive(Client& c) {
+        char buf[4096];
+        ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+        if(n == 0) return false;
+        if(n < 0) return errno == EAGAIN || errno == EINTR;
+        c.in.append(buf, n);
+        if(c.in.size() > 65536) return false;
+        if(c.open) return frames(c);
+        // frames may follow the request in the same read
+        return handshake(c) && frames(c);
+    }
+
+    bool handshake(Client& c) {
+        size_t end = c.in.find("\r\n\r\n");
+        if(end == string::npos) return !c.open;
+        string req = c.in.substr(0, end + 2);
+        c.in.erase(0, end + 4);
+        string lower = req;
+        for(size_t i = 0; i < lower.size(); i++) lower[i] = tolower(lower[i]);
+        size_t k = lower.find("\r\nsec-websocket-key:");
+        if(k == string::npos) {
+            c.out = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\n\r\n";
+            c.outOff = 0;
+            flush(c);
+            return false;
+        }
+        k += strlen("\r\nsec-websocket-key:");
+        size_t e = req.find("\r\n", k);
+        string key = req.substr(k, e - k);
+        key.erase(0, key.find_first_not_of(" \t"));
+        key.erase(key.find_last_not_of(" \t") + 1);
+
+        c.out = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                "Sec-WebSocket-Accept: " + wsAcceptKey(key) + "\r\n\r\n";
+        c.outOff = 0;
+        c.open = true;
+        return true;
+    }
+
+    // client frames, only close and ping need an answer
+    bool frames(Client& c) {
+        while(c.open && c.in.size() >= 2) {
+            const uint8_t* p = (const uint8_t*)c.in.data();
+            int op = p[0] & 0x0f;
+            uint64_t len = p[1] & 0x7f;
+            size_t hdr = 2;
+            if(len == 126) {
+                if(c.in.size() < 4) return true;
+                len = p[2] << 8 | p[3];
+                hdr = 4;
+            } else if(len == 127) {
+                return false;   // nothing we expect is that big
+            }
+            size_t mask = (p[1] & 0x80) ? 4 : 0;
+            if(c.in.size() < hdr + mask + len) return true;
+            string payload = c.in.substr(hdr + mask, len);
+            for(size_t i = 0; mask && i < len; i++) payload[i] ^= p[hdr + i % 4];
+            c.in.erase(0, hdr + mask + len);
+            if(op == 0x8) return false;
+            // a pong has to go out even with a frame pending, put it
+            // after the part not yet written
+            if(op == 0x9) c.out += frameHeader(0xA, payload.size()) + payload;
+        }
+        return true;
+    }
+
+    static string frameHeader(int op, size_t len) {
+        string h;
+        h += (char)(0x80 | op);
+        if(len < 126) {
+            h += (char)len;
+        } else if(len < 65536) {
+            h += (char)126;
+            h += (char)(len >> 8);
+            h += (char)len;
+        } else {
+            h += (char)127;
+            for(int i = 7; i >= 0; i--) h += (char)(len >> (i * 8));
+        }
+        return h;
+    }
+
+    static void put16(string& s, uint32_t v) { s += (char)v; s += (char)(v >> 8); }
+    static void put32(string& s, uint32_t v) { put16(s, v & 0xffff); put16(s, v >> 16); }
+
+    // the next frame for a client that has nothing left to write
+    void queueFrame(Client& c) {
+        vector<pair<int, shared_ptr<const string> > > tiles;
+        uint32_t gen;
+        int width, height, tilesX;
+        bool key;
+        {
+            lock_guard<mutex> lock(mtx_);
+            if(c.sent == generation_ || generation_ == 0) return;
+            key = (c.sent < resized_);
+            for(size_t t = 0; t < changed_.size(); t++)
+                if(key || changed_[t] > c.sent) tiles.push_back(make_pair((int)t, png_[t]));
+            gen = generation_;
+            width = width_;
+            height = height_;
+            tilesX = tilesX_;
+        }
+
+        string body;
+        put32(body, gen);
+        put16(body, width);
+        put16(body, height);
+        put16(body, TileMap::TILE);
+        put16(body, tiles.size());
+        body += (char)key;
+        body += (char)0;
+        for(size_t i = 0; i < tiles.size(); i++) {
+            put16(body, tiles[i].first % tilesX);
+            put16(body, tiles[i].first / tilesX);
+            put32(body, tiles[i].second->size());
+            body += *tiles[i].second;
+        }
+        c.out = frameHeader(0x2, body.size()) + body;
+        c.outOff = 0;
+        c.sent = gen;
+    }
+
+    bool flush(Client& c) {
+        while(c.outOff < c.out.size()) {
+            ssize_t n = send(c.fd, c.out.data() + c.outOff, c.out.size() - c.outOff, MSG_NOSIGNAL);
+            if(n < 0) return errno == EAGAIN || errno == EINTR;
+            c.outOff += n;
+        }
+        c.out.clear();
+        c.outOff = 0;
+        return true;
+    }
+
+    int listenFd_;
+    int wake_[2];
+    atomic<bool> running_;
+    thread thread_;
+    vector<Client> clients_;   // server thread only, but for clientCount
+
+    mutex mtx_;
+    uint32_t generation_;
+    uint32_t resized_;
+    int width_, height_, tilesX_;
+    vector<shared_ptr<const string> > png_;
+    vector<uint32_t> changed_;
+    vector<int> tiles_;
+};
+
+#endif
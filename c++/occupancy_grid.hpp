@@ -0,0 +1,35 @@
+#ifndef OCCUPANCY_GRID_HPP
+#define OCCUPANCY_GRID_HPP
+#include <vector>
+using namespace::std;
+
+// map_saver's grey levels and thresholds (occupancy in percent, -1 unknown)
+const unsigned char GREY_FREE     = 254;
+const unsigned char GREY_OCCUPIED = 0;
+const unsigned char GREY_UNKNOWN  = 205;
+const int FREE_THRESH     = 25;
+const int OCCUPIED_THRESH = 65;
+
+// turn an occupancy grid into the image map_saver would have written.
+// the grid's first row is the bottom of the map, the image's is the top.
+inline void gridToImage(const signed char* data, int width, int height,
+                        vector<unsigned char>& image) {
+    // one lookup per cell instead of two compares
+    unsigned char lut[256];
+    for(int v = -128; v < 128; v++) {
+        unsigned char grey = GREY_UNKNOWN;
+        if(v >= 0 && v <= FREE_THRESH) grey = GREY_FREE;
+        else if(v >= OCCUPIED_THRESH) grey = GREY_OCCUPIED;
+        lut[(unsigned char)v] = grey;
+    }
+
+    image.resize((size_t)width * height);
+    for(int y = 0; y < height; y++) {
+        const signed char* src = data + (size_t)(height - y - 1) * width;
+        unsigned char* dst = &image[(size_t)y * width];
+        for(int x = 0; x < width; x++)
+            dst[x] = lut[(unsigned char)src[x]];
+    }
+}
+
+#endif
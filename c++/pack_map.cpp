@@ -0,0 +1,84 @@
+// converts between pgm maps and the 2 bit packed format.
+//
+// build: g++ -O2 pack_map.cpp -pthread -o pack_map
+// run:   ./pack_map old.pgm old.pmap      pack
+//        ./pack_map -u old.pmap out.pgm   unpack to P5
+//        ./pack_map -b old.pgm            time pack, unpack and counts
+#include <iostream>
+#include <cstring>
+#include <time.h>
+#include "pgm.hpp"
+#include "packed_map.hpp"
+
+static double now() {
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e3 + t.tv_nsec * 1e-6;
+}
+
+static int bench(const string& path) {
+    PgmImage img;
+    if(readPgm(path, img) != 0) return 1;
+    PackedMap map;
+    vector<uint8_t> back;
+    vector<signed char> grid;
+    MapStats stats;
+    size_t free_ = 0, occupied = 0, unknown = 0;
+    const int runs = 100;
+    double t[5] = {0, 0, 0, 0, 0};
+    for(int run = 0; run < runs; run++) {
+        double t0 = now();
+        packImage(&img.pixels[0], img.width, img.height, map);
+        double t1 = now();
+        unpackImage(map, back);
+        double t2 = now();
+        countCells(map, free_, occupied, unknown);
+        double t3 = now();
+        mapStats(&img.pixels[0], img.width, img.height, 0.05, stats);
+        double t4 = now();
+        unpackGrid(map, grid);
+        double t5 = now();
+        t[0] += t1 - t0; t[1] += t2 - t1; t[2] += t3 - t2; t[3] += t4 - t3; t[4] += t5 - t4;
+    }
+    // only map_saver's three grey levels survive the trip
+    for(size_t i = 0; i < img.pixels.size(); i++) {
+        uint8_t p = img.pixels[i];
+        uint8_t want = p <= GREY_OCCUPIED_MAX ? GREY_OCCUPIED : p >= GREY_FREE_MIN ? GREY_FREE : GREY_UNKNOWN;
+        if(back[i] != want) {
+            cerr << "round trip differs at " << i << endl;
+            return 1;
+        }
+    }
+    if(free_ != stats.free || occupied != stats.occupied) {
+        cerr << "packed counts differ from map_stats" << endl;
+        return 1;
+    }
+    printf("%s %dx%d, %zu bytes packed from %zu, ms per op over %d runs\n", path.c_str(),
+           img.width, img.height, map.bits.size() + map.tiles.size(), img.pixels.size(), runs);
+    printf("  pack          %8.3f\n", t[0] / runs);
+    printf("  unpack        %8.3f\n", t[1] / runs);
+    printf("  unpack grid   %8.3f\n", t[4] / runs);
+    printf("  count packed  %8.3f\n", t[2] / runs);
+    printf("  map_stats     %8.3f  (bytes, for comparison)\n", t[3] / runs);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if(argc == 3 && strcmp(argv[1], "-b") != 0) {
+        PgmImage img;
+        PackedMap map;
+        if(readPgm(argv[1], img) != 0) return 1;
+        packImage(&img.pixels[0], img.width, img.height, map);
+        return writePackedMap(argv[2], map) != 0;
+    }
+    if(argc == 4 && strcmp(argv[1], "-u") == 0) {
+        PackedMap map;
+        vector<uint8_t> image;
+        if(readPackedMap(argv[2], map) != 0) return 1;
+        unpackImage(map, image);
+        return writePgm(argv[3], &image[0], map.width, map.height, 255, false) != 0;
+    }
+    if(argc == 3) return bench(argv[2]);
+    cerr << "usage: pack_map in.pgm out.pmap | -u in.pmap out.pgm | -b in.pgm" << endl;
+    return 1;
+}
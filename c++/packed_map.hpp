@@ -0,0 +1,226 @@
+#ifndef PACKED_MAP_HPP
+#define PACKED_MAP_HPP
+#include <string>
+#include <vector>
+#include <cstring>
+#include <stdint.h>
+#include "pgm.hpp"
+#include "occupancy_grid.hpp"
+#include "map_stats.hpp"
+using namespace::std;
+
+// a map at 2 bits per cell: 0 unknown, 1 free, 2 occupied.
+//
+// rows are padded to whole blocks of 64 cells, 16 bytes.  inside a
+// block, byte j holds cells j, j+16, j+32 and j+48 in bits 0-1, 2-3,
+// 4-5 and 6-7, so packing and unpacking are plain 16 byte vector ops
+// with no shuffles.  padding cells are unknown.
+//
+// the tile index has one byte per 64x64 tile with bit c set when code c
+// occurs in it, so scans can skip tiles that are all unknown.
+//
+// file: "PMAP", u32 version, u32 width, u32 height, u32 tile size,
+// tile index, then the packed rows; little endian.
+const uint8_t CELL_UNKNOWN  = 0;
+const uint8_t CELL_FREE     = 1;
+const uint8_t CELL_OCCUPIED = 2;
+
+struct PackedMap {
+    static const int BLOCK = 64;    // cells per 16 byte block, and tile size
+    int width;
+    int height;
+    int stride;                     // bytes per row
+    int tilesX, tilesY;
+    vector<uint8_t> bits;           // stride * height, top row first
+    vector<uint8_t> tiles;          // tilesX * tilesY code masks
+
+    PackedMap() : width(0), height(0), stride(0), tilesX(0), tilesY(0) {}
+
+    void resize(int w, int h) {
+        width  = w;
+        height = h;
+        tilesX = (w + BLOCK - 1) / BLOCK;
+        tilesY = (h + BLOCK - 1) / BLOCK;
+        stride = tilesX * 16;
+        bits.assign((size_t)stride * h, 0);
+        tiles.assign(tilesX * tilesY, 0);
+    }
+
+    uint8_t cell(int x, int y) const {
+        return (bits[(size_t)y * stride + (x / BLOCK) * 16 + x % 16] >> (2 * (x % BLOCK / 16))) & 3;
+    }
+};
+
+typedef int8_t MapSVec __attribute__((vector_size(16)));
+
+// codes of 16 grey pixels, or of 16 grid cells
+inline MapVec packCodesGrey(MapVec v) {
+    const MapVec occMax  = (MapVec){} + (uint8_t)GREY_OCCUPIED_MAX;
+    const MapVec freeMin = (MapVec){} + (uint8_t)(GREY_FREE_MIN - 1);
+    return ((MapVec)(v <= occMax) & CELL_OCCUPIED) | ((MapVec)(v > freeMin) & CELL_FREE);
+}
+
+inline MapVec packCodesGrid(MapVec u) {
+    MapSVec v = (MapSVec)u;
+    MapSVec isFree = (v >= 0) & (v <= FREE_THRESH);
+    MapSVec isOcc  = (v >= OCCUPIED_THRESH);
+    return ((MapVec)isOcc & CELL_OCCUPIED) | ((MapVec)isFree & CELL_FREE);
+}
+
+// pack one row of n cells into dst, or-ing the codes seen into the
+// tile index entries of its tile row
+template <bool GRID>
+inline void packRow(const uint8_t* src, int n, uint8_t* dst, uint8_t* masks) {
+    uint8_t tmp[PackedMap::BLOCK];
+    for(int x = 0; x < n; x += PackedMap::BLOCK) {
+        const uint8_t* in = src + x;
+        if(n - x < PackedMap::BLOCK) {
+            // the last block, padded with unknown
+            memset(tmp, GRID ? 0xff : GREY_UNKNOWN, sizeof(tmp));
+            memcpy(tmp, in, n - x);
+            in = tmp;
+        }
+        MapVec out = (MapVec){};
+        MapVec any = (MapVec){};     // or of the codes, unknown as 4
+        for(int k = 0; k < 4; k++) {
+            MapVec v;
+            memcpy(&v, in + k * 16, 16);
+            MapVec code = GRID ? packCodesGrid(v) : packCodesGrey(v);
+            out |= code << (2 * k);
+            any |= code | ((MapVec)(code == 0) & 4);
+        }
+        memcpy(dst + x / 4, &out, 16);
+
+        // which codes the block has, for the tile index
+        uint64_t lo, hi;
+        memcpy(&lo, &any, 8);
+        memcpy(&hi, (uint8_t*)&any + 8, 8);
+        lo |= hi;
+        lo |= lo >> 32;
+        lo |= lo >> 16;
+        lo |= lo >> 8;
+        // bits 0-2 are free, occupied, unknown; the index wants 1 << code
+        masks[x / PackedMap::BLOCK] |= (uint8_t)((lo & 3) << 1 | (lo >> 2 & 1));
+    }
+}
+
+// from a grey image, top row first
+inline void packImage(const uint8_t* image, int width, int height, PackedMap& map) {
+    map.resize(width, height);
+    for(int y = 0; y < height; y++)
+        packRow<false>(image + (size_t)y * width, width, &map.bits[(size_t)y * map.stride],
+                       &map.tiles[(y / PackedMap::BLOCK) * map.tilesX]);
+}
+
+// from OccupancyGrid data, bottom row first like the message
+inline void packGrid(const signed char* data, int width, int height, PackedMap& map) {
+    map.resize(width, height);
+    for(int y = 0; y < height; y++)
+        packRow<true>((const uint8_t*)data + (size_t)(height - y - 1) * width, width,
+                      &map.bits[(size_t)y * map.stride], &map.tiles[(y / PackedMap::BLOCK) * map.tilesX]);
+}
+
+// 16 bytes of a block back to the values of one quarter, k 0-3
+inline MapVec unpackQuarter(MapVec packed, int k, uint8_t unknown, uint8_t free_, uint8_t occupied) {
+    MapVec code = (packed >> (2 * k)) & 3;
+    MapVec isFree = (MapVec)(code == 1);
+    MapVec isOcc  = (MapVec)(code == 2);
+    MapVec isUnk  = ~(isFree | isOcc);
+    return (isFree & free_) | (isOcc & occupied) | (isUnk & unknown);
+}
+
+inline void unpackRow(const uint8_t* src, int x0, int n, uint8_t* dst,
+                      uint8_t unknown, uint8_t free_, uint8_t occupied) {
+    uint8_t tmp[PackedMap::BLOCK];
+    for(int x = x0; x < x0 + n; x += PackedMap::BLOCK) {
+        MapVec packed;
+        memcpy(&packed, src + x / 4, 16);
+        const int count = min(PackedMap::BLOCK, x0 + n - x);
+        uint8_t* out = (count == PackedMap::BLOCK) ? dst + (x - x0) : tmp;
+        for(int k = 0; k < 4; k++) {
+            MapVec v = unpackQuarter(packed, k, unknown, free_, occupied);
+            memcpy(out + k * 16, &v, 16);
+        }
+        if(out == tmp) memcpy(dst + (x - x0), tmp, count);
+    }
+}
+
+// to the grey levels map_saver writes
+inline void unpackImage(const PackedMap& map, vector<uint8_t>& image) {
+    image.resize((size_t)map.width * map.height);
+    for(int y = 0; y < map.height; y++)
+        unpackRow(&map.bits[(size_t)y * map.stride], 0, map.width, &image[(size_t)y * map.width],
+                  GREY_UNKNOWN, GREY_FREE, GREY_OCCUPIED);
+}
+
+// to OccupancyGrid data: -1, 0 and 100, bottom row first
+inline void unpackGrid(const PackedMap& map, vector<signed char>& data) {
+    data.resize((size_t)map.width * map.height);
+    for(int y = 0; y < map.height; y++)
+        unpackRow(&map.bits[(size_t)y * map.stride], 0, map.width,
+                  (uint8_t*)&data[(size_t)(map.height - y - 1) * map.width], 0xff, 0, 100);
+}
+
+// grey pixels of one 64x64 tile, w*h packed rows, for the tile export
+inline void unpackTile(const PackedMap& map, int tile, vector<uint8_t>& out) {
+    const int x = (tile % map.tilesX) * PackedMap::BLOCK, y = (tile / map.tilesX) * PackedMap::BLOCK;
+    const int w = min(PackedMap::BLOCK, map.width - x), h = min(PackedMap::BLOCK, map.height - y);
+    out.resize((size_t)w * h);
+    for(int row = 0; row < h; row++)
+        unpackRow(&map.bits[(size_t)(y + row) * map.stride], x, w, &out[(size_t)row * w],
+                  GREY_UNKNOWN, GREY_FREE, GREY_OCCUPIED);
+}
+
+// free and occupied are popcounts of the low and high code bits, tiles
+// with nothing known are skipped
+inline void countCells(const PackedMap& map, size_t& free_, size_t& occupied, size_t& unknown) {
+    free_ = occupied = 0;
+    for(int ty = 0; ty < map.tilesY; ty++) {
+        for(int tx = 0; tx < map.tilesX; tx++) {
+            if(map.tiles[ty * map.tilesX + tx] == (1 << CELL_UNKNOWN)) continue;
+            const int y1 = min(map.height, (ty + 1) * PackedMap::BLOCK);
+            for(int y = ty * PackedMap::BLOCK; y < y1; y++) {
+                const uint8_t* p = &map.bits[(size_t)y * map.stride + tx * 16];
+                uint64_t a, b;
+                memcpy(&a, p, 8);
+                memcpy(&b, p + 8, 8);
+                free_    += __builtin_popcountll(a & 0x5555555555555555ULL) +
+                            __builtin_popcountll(b & 0x5555555555555555ULL);
+                occupied += __builtin_popcountll(a & 0xAAAAAAAAAAAAAAAAULL) +
+                            __builtin_popcountll(b & 0xAAAAAAAAAAAAAAAAULL);
+            }
+        }
+    }
+    unknown = (size_t)map.width * map.height - free_ - occupied;
+}
+
+inline int writePackedMap(const string& path, const PackedMap& map) {
+    uint32_t head[5] = { 0, 1, (uint32_t)map.width, (uint32_t)map.height, PackedMap::BLOCK };
+    memcpy(head, "PMAP", 4);
+    string buf((const char*)head, sizeof(head));
+    buf.append((const char*)&map.tiles[0], map.tiles.size());
+    buf.append((const char*)&map.bits[0], map.bits.size());
+    return pgmWriteFile(path, buf.data(), buf.size());
+}
+
+inline int readPackedMap(const string& path, PackedMap& map) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if(!f) {
+        cerr << "readPackedMap: unable to open " << path << endl;
+        return -1;
+    }
+    uint32_t head[5];
+    int ret = -1;
+    if(fread(head, sizeof(head), 1, f) == 1 && memcmp(head, "PMAP", 4) == 0 && head[1] == 1 &&
+       head[4] == PackedMap::BLOCK && head[2] > 0 && head[3] > 0 && head[2] < 65536 && head[3] < 65536) {
+        map.resize(head[2], head[3]);
+        if(fread(&map.tiles[0], map.tiles.size(), 1, f) == 1 &&
+           fread(&map.bits[0], map.bits.size(), 1, f) == 1)
+            ret = 0;
+    }
+    fclose(f);
+    if(ret != 0) cerr << "readPackedMap: " << path << " is not a packed map" << endl;
+    return ret;
+}
+
+#endif
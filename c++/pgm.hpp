@@ -0,0 +1,268 @@
+#ifndef PGM_HPP
+#define PGM_HPP
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+using namespace::std;
+
+// 8 bit P2/P5 images.  the file is mapped and the header checked once,
+// pixels stay uint8_t all the way through.
+
+struct PgmImage {
+    int width;
+    int height;
+    int maxval;
+    vector<uint8_t> pixels;   // width*height, top row first
+    PgmImage() : width(0), height(0), maxval(0) {}
+};
+
+// header token parser, skips whitespace and # comments
+inline bool pgmNextInt(const char*& p, const char* end, int& value) {
+    while(p < end) {
+        if(*p == '#') {
+            while(p < end && *p != '\n') p++;
+        } else if(*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+            p++;
+        } else {
+            break;
+        }
+    }
+    if(p == end || *p < '0' || *p > '9') return false;
+    long v = 0;
+    while(p < end && *p >= '0' && *p <= '9') {
+        v = v * 10 + (*p++ - '0');
+        if(v > 0xffffff) return false;
+    }
+    value = (int)v;
+    return true;
+}
+
+inline bool pgmIsSpace(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+// P2 pixels, nothing but digits and whitespace after the header
+inline bool pgmDecodeAscii(const char* p, const char* end, uint8_t* out, size_t count, int maxval) {
+    size_t i = 0;
+    // values are at most 3 digits, so with 4 bytes to spare the digits
+    // can be read without checking for the end of the file
+    const char* safe = (end - p > 4) ? end - 4 : p;
+    while(i < count && p < safe) {
+        unsigned v = (unsigned char)(*p - '0');
+        if(v > 9) {
+            if(!pgmIsSpace(*p)) return false;
+            p++;
+            continue;
+        }
+        unsigned d = (unsigned char)(p[1] - '0');
+        if(d > 9) {
+            p += 1;
+        } else {
+            v = v * 10 + d;
+            d = (unsigned char)(p[2] - '0');
+            if(d > 9) {
+                p += 2;
+            } else {
+                v = v * 10 + d;
+                p += 3;
+                if((unsigned char)(*p - '0') <= 9) return false;
+            }
+        }
+        if(v > (unsigned)maxval) return false;
+        out[i++] = (uint8_t)v;
+    }
+    // the tail, checked byte by byte
+    for(; i < count; i++) {
+        while(p < end && !(*p >= '0' && *p <= '9')) {
+            if(!pgmIsSpace(*p)) return false;
+            p++;
+        }
+        if(p == end) return false;
+        unsigned v = 0;
+        while(p < end && *p >= '0' && *p <= '9') {
+            v = v * 10 + (*p++ - '0');
+            if(v > (unsigned)maxval) return false;
+        }
+        out[i] = (uint8_t)v;
+    }
+    return true;
+}
+
+inline int readPgm(const string& path, PgmImage& img) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0) {
+        cerr << "readPgm: unable to open " << path << endl;
+        return -1;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < 2) {
+        cerr << "readPgm: " << path << " is empty" << endl;
+        close(fd);
+        return -1;
+    }
+    const size_t len = st.st_size;
+    void* map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED) {
+        cerr << "readPgm: unable to map " << path << endl;
+        return -1;
+    }
+    madvise(map, len, MADV_SEQUENTIAL);
+
+    const char* p   = (const char*)map;
+    const char* end = p + len;
+    int ret = -1;
+    bool ascii = false;
+    size_t count = 0;
+    int width, height, maxval;
+
+    if(p[0] != 'P' || (p[1] != '2' && p[1] != '5')) {
+        cerr << "readPgm: " << path << " is not a P2/P5 pgm" << endl;
+        goto done;
+    }
+    ascii = (p[1] == '2');
+    p += 2;
+    if(!pgmNextInt(p, end, width) || !pgmNextInt(p, end, height) ||
+       !pgmNextInt(p, end, maxval) || width <= 0 || height <= 0 ||
+       maxval <= 0 || maxval > 255 || p == end) {
+        cerr << "readPgm: bad header in " << path << endl;
+        goto done;
+    }
+    p++;   // the single whitespace after maxval
+    count = (size_t)width * height;
+    img.pixels.resize(count);
+
+    if(ascii) {
+        if(!pgmDecodeAscii(p, end, &img.pixels[0], count, maxval)) {
+            cerr << "readPgm: bad or short pixel data in " << path << endl;
+            goto done;
+        }
+    } else {
+        if((size_t)(end - p) < count) {
+            cerr << "readPgm: " << path << " is truncated" << endl;
+            goto done;
+        }
+        memcpy(&img.pixels[0], p, count);
+        // only a maxval below 255 can be broken by a pixel
+        if(maxval < 255) {
+            uint8_t top = 0;
+            for(size_t i = 0; i < count; i++)
+                top = max(top, img.pixels[i]);
+            if(top > maxval) {
+                cerr << "readPgm: pixel above maxval in " << path << endl;
+                goto done;
+            }
+        }
+    }
+    img.width  = width;
+    img.height = height;
+    img.maxval = maxval;
+    ret = 0;
+
+done:
+    munmap(map, len);
+    return ret;
+}
+
+// "v " for every byte value, packed in 4 bytes with the length apart
+struct PgmAsciiTable {
+    char    text[256][4];
+    uint8_t len[256];
+    PgmAsciiTable() {
+        for(int v = 0; v < 256; v++) {
+            char tmp[8];
+            len[v] = (uint8_t)snprintf(tmp, sizeof(tmp), "%d ", v);
+            memcpy(text[v], tmp, 4);
+        }
+    }
+};
+
+inline int pgmWriteAll(int fd, const char* buf, size_t len) {
+    while(len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if(n < 0) return -1;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// write len bytes to path through a temp file, renamed into place
+inline int pgmWriteFile(const string& path, const char* buf, size_t len) {
+    const string tmp = path + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) {
+        cerr << "pgmWriteFile: unable to create " << tmp << endl;
+        return -1;
+    }
+    int ret = pgmWriteAll(fd, buf, len);
+    if(close(fd) != 0 || ret != 0) {
+        cerr << "pgmWriteFile: unable to write " << tmp << endl;
+        unlink(tmp.c_str());
+        return -1;
+    }
+    return rename(tmp.c_str(), path.c_str());
+}
+
+// ascii output keeps the layout convert() always had, "P2 " header and
+// a newline after every 1024 values, so new.pgm readers see no change.
+// the file is written to a temp name and renamed into place.
+inline int writePgm(const string& path, const uint8_t* pixels, int width, int height,
+                    int maxval, bool ascii) {
+    static const PgmAsciiTable table;
+    // formatted text goes out in chunks that stay in cache, a buffer for
+    // the whole file costs more in page faults than the formatting
+    static const size_t CHUNK = 1 << 20;
+    const size_t count = (size_t)width * height;
+    const string tmp = path + ".tmp";
+    char header[64];
+    int hlen = snprintf(header, sizeof(header), ascii ? "P2 \n%d %d\n%d\n" : "P5\n%d %d\n%d\n",
+                        width, height, maxval);
+
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) {
+        cerr << "writePgm: unable to create " << tmp << endl;
+        return -1;
+    }
+    int ret = pgmWriteAll(fd, header, hlen);
+
+    if(!ascii) {
+        if(ret == 0) ret = pgmWriteAll(fd, (const char*)pixels, count);
+    } else {
+        // every value fits "255 " and the table rows are 4 bytes, so copy
+        // all 4 and advance by the real length.  a line of 1024 values
+        // plus its newline always fits the slack at the end
+        vector<char> buf(CHUNK + 4 * 1024 + 8);
+        char* out = &buf[0];
+        size_t i = 0;
+        while(ret == 0 && i < count) {
+            size_t stop = min(count, i + 1024 - i % 1024);
+            for(; i < stop; i++) {
+                const uint8_t v = pixels[i];
+                memcpy(out, table.text[v], 4);
+                out += table.len[v];
+            }
+            if(i % 1024 == 0) *out++ = '\n';
+            if((size_t)(out - &buf[0]) >= CHUNK || i == count) {
+                ret = pgmWriteAll(fd, &buf[0], out - &buf[0]);
+                out = &buf[0];
+            }
+        }
+    }
+
+    if(close(fd) != 0 || ret != 0) {
+        cerr << "writePgm: unable to write " << tmp << endl;
+        unlink(tmp.c_str());
+        return -1;
+    }
+    return rename(tmp.c_str(), path.c_str());
+}
+
+#endif
@@ -0,0 +1,64 @@
+// times the pgm codec on a generated map.
+//
+// build: g++ -O2 pgm_bench.cpp -o pgm_bench
+// run:   ./pgm_bench [size=4096] [dir=/tmp]
+#include <iostream>
+#include <cstdlib>
+#include <time.h>
+#include "pgm.hpp"
+#include "occupancy_grid.hpp"
+
+static double now() {
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e3 + t.tv_nsec * 1e-6;
+}
+
+int main(int argc, char** argv) {
+    const int size = argc > 1 ? atoi(argv[1]) : 4096;
+    const string dir = argc > 2 ? argv[2] : "/tmp";
+    const string p5 = dir + "/pgm_bench_p5.pgm", p2 = dir + "/pgm_bench_p2.pgm";
+    const int runs = 10;
+
+    // mostly unknown with free space and walls, like a real map
+    PgmImage img;
+    img.width = img.height = size;
+    img.maxval = 255;
+    img.pixels.resize((size_t)size * size, GREY_UNKNOWN);
+    srand(1);
+    for(size_t i = 0; i < img.pixels.size(); i++) {
+        int r = rand() % 100;
+        if(r < 40) img.pixels[i] = GREY_FREE;
+        else if(r < 45) img.pixels[i] = GREY_OCCUPIED;
+    }
+    writePgm(p5, &img.pixels[0], size, size, 255, false);
+
+    double t[4] = {0, 0, 0, 0};
+    for(int run = 0; run < runs; run++) {
+        PgmImage a, b;
+        double t0 = now();
+        if(readPgm(p5, a) != 0) return 1;
+        double t1 = now();
+        if(writePgm(p2, &a.pixels[0], a.width, a.height, a.maxval, true) != 0) return 1;
+        double t2 = now();
+        if(readPgm(p2, b) != 0) return 1;
+        double t3 = now();
+        if(writePgm(p5, &b.pixels[0], b.width, b.height, b.maxval, false) != 0) return 1;
+        double t4 = now();
+        if(a.pixels != b.pixels) {
+            cerr << "round trip mismatch" << endl;
+            return 1;
+        }
+        t[0] += t1 - t0; t[1] += t2 - t1; t[2] += t3 - t2; t[3] += t4 - t3;
+    }
+
+    printf("%dx%d, ms per op over %d runs\n", size, size, runs);
+    printf("  read  P5  %8.2f\n", t[0] / runs);
+    printf("  write P2  %8.2f\n", t[1] / runs);
+    printf("  read  P2  %8.2f\n", t[2] / runs);
+    printf("  write P5  %8.2f\n", t[3] / runs);
+    printf("  convert   %8.2f  (read P5 + write P2)\n", (t[0] + t[1]) / runs);
+    unlink(p5.c_str());
+    unlink(p2.c_str());
+    return 0;
+}
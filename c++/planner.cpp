@@ -0,0 +1,128 @@
+// plans paths on /map with grid_planner.  the inflated grid is made
+// once per map; a plan is made for each goal, and again on each map
+// while the goal stands.
+//
+// start is hector's slam_out_pose, goals come from
+// move_base_simple/goal (rviz's 2D nav goal), both in the map frame.
+// the plan is published on ~plan, one pose per cell.
+//
+// build:
+//   g++ -O2 planner.cpp -I/opt/ros/lunar/include -L/opt/ros/lunar/lib
+//       -lroscpp -lrosconsole -lroscpp_serialization -lrostime -o planner
+// run:
+//   ./planner [_robot_radius:=0.2] [_allow_unknown:=false]
+#include <iostream>
+#include <cmath>
+#include <time.h>
+#include "grid_planner.hpp"
+#include <ros/ros.h>
+#include <nav_msgs/OccupancyGrid.h>
+#include <nav_msgs/Path.h>
+#include <geometry_msgs/PoseStamped.h>
+
+static DistanceMap distances;
+static GridPlanner planner;
+static vector<uint8_t> blocked;
+static double robotRadius = 0.2;
+static bool allowUnknown = false;
+static string frame;
+static double resolution = 0, originX = 0, originY = 0;
+
+static bool havePose = false, haveGoal = false;
+static geometry_msgs::PoseStamped pose, goal;
+static ros::Publisher pathPub;
+
+static double now() {
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e3 + t.tv_nsec * 1e-6;
+}
+
+static bool toCell(const geometry_msgs::PoseStamped& p, int& x, int& y) {
+    x = (int)floor((p.pose.position.x - originX) / resolution);
+    y = (int)floor((p.pose.position.y - originY) / resolution);
+    return x >= 0 && y >= 0 && x < distances.width() && y < distances.height();
+}
+
+static void plan() {
+    if(!havePose || !haveGoal || resolution <= 0) return;
+    int sx, sy, gx, gy;
+    if(!toCell(pose, sx, sy) || !toCell(goal, gx, gy)) {
+        ROS_WARN("planner: start or goal is off the map");
+        return;
+    }
+
+    vector<pair<int, int> > cells;
+    const double t0 = now();
+    const bool found = planner.plan(sx, sy, gx, gy, cells);
+    ROS_DEBUG("planner: %s in %.2f ms, %d expanded", found ? "found" : "no path",
+              now() - t0, planner.expanded());
+
+    // an empty path when there is none, so followers stop
+    nav_msgs::Path path;
+    path.header.frame_id = frame;
+    path.header.stamp = ros::Time::now();
+    if(!found) ROS_WARN("planner: no path from (%d, %d) to (%d, %d)", sx, sy, gx, gy);
+    for(size_t i = 0; i < cells.size(); i++) {
+        geometry_msgs::PoseStamped p;
+        p.header = path.header;
+        p.pose.position.x = originX + (cells[i].first + 0.5) * resolution;
+        p.pose.position.y = originY + (cells[i].second + 0.5) * resolution;
+        p.pose.orientation.w = 1;
+        path.poses.push_back(p);
+    }
+    if(found) path.poses.back().pose.orientation = goal.pose.orientation;
+    pathPub.publish(path);
+}
+
+void mapCallback(const nav_msgs::OccupancyGridConstPtr& map) {
+    const int width  = map->info.width;
+    const int height = map->info.height;
+    if((size_t)width * height != map->data.size()) return;
+
+    const double t0 = now();
+    if(width != distances.width() || height != distances.height() ||
+       map->info.resolution != resolution ||
+       map->info.origin.position.x != originX || map->info.origin.position.y != originY) {
+        resolution = map->info.resolution;
+        originX = map->info.origin.position.x;
+        originY = map->info.origin.position.y;
+        distances.resize(width, height, (int)ceil(robotRadius / resolution) + 1);
+    }
+    frame = map->header.frame_id;
+    distances.updateFromGrid(&map->data[0]);
+    inflateGrid(distances, &map->data[0], robotRadius / resolution, allowUnknown, blocked);
+    planner.setMap(&blocked[0], width, height);
+    ROS_DEBUG("planner: map inflated in %.2f ms", now() - t0);
+    plan();
+}
+
+void poseCallback(const geometry_msgs::PoseStampedConstPtr& msg) {
+    pose = *msg;
+    havePose = true;
+}
+
+void goalCallback(const geometry_msgs::PoseStampedConstPtr& msg) {
+    if(!frame.empty() && !msg->header.frame_id.empty() && msg->header.frame_id != frame) {
+        ROS_WARN("planner: goal in %s, only %s is planned in", msg->header.frame_id.c_str(), frame.c_str());
+        return;
+    }
+    goal = *msg;
+    haveGoal = true;
+    plan();
+}
+
+int main(int argc, char** argv){
+    ros::init(argc, argv, "planner");
+    ros::NodeHandle nh;
+    ros::NodeHandle nh_private("~");
+    nh_private.param<double>("robot_radius", robotRadius, robotRadius);
+    nh_private.param<bool>("allow_unknown", allowUnknown, allowUnknown);
+
+    pathPub = nh_private.advertise<nav_msgs::Path>("plan", 1, true);
+    ros::Subscriber mapSub  = nh.subscribe("map", 1, mapCallback);
+    ros::Subscriber poseSub = nh.subscribe("slam_out_pose", 1, poseCallback);
+    ros::Subscriber goalSub = nh.subscribe("move_base_simple/goal", 1, goalCallback);
+    ros::spin();
+    return 0;
+}
@@ -0,0 +1,159 @@
+// times grid_planner on a stored map against plain A* on the same
+// grid, and checks the paths cost the same.
+//
+// build: g++ -O2 planner_bench.cpp -o planner_bench
+// run:   ./planner_bench old.pgm [radius cells, 4] [pairs, 200]
+#include <iostream>
+#include <cstdlib>
+#include <queue>
+#include <time.h>
+#include "pgm.hpp"
+#include "map_stats.hpp"
+#include "grid_planner.hpp"
+
+static double now() {
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e3 + t.tv_nsec * 1e-6;
+}
+
+// every cell a node, same moves and costs as the planner
+static double astar(const vector<uint8_t>& blocked, int w, int h, int sx, int sy, int gx, int gy) {
+    const float SQRT2 = 1.41421356f;
+    vector<float> g(blocked.size(), 1e30f);
+    vector<uint8_t> closed(blocked.size(), 0);
+    typedef pair<float, int> Entry;
+    priority_queue<Entry, vector<Entry>, greater<Entry> > open;
+    const int goal = gy * w + gx;
+    g[sy * w + sx] = 0;
+    open.push(Entry(0, sy * w + sx));
+    while(!open.empty()) {
+        const int c = open.top().second;
+        open.pop();
+        if(closed[c]) continue;
+        if(c == goal) return g[c];
+        closed[c] = 1;
+        const int x = c % w, y = c / w;
+        for(int dy = -1; dy <= 1; dy++) {
+            for(int dx = -1; dx <= 1; dx++) {
+                const int nx = x + dx, ny = y + dy;
+                if((!dx && !dy) || nx < 0 || ny < 0 || nx >= w || ny >= h || blocked[ny * w + nx]) continue;
+                if(dx && dy && (blocked[y * w + nx] || blocked[ny * w + x])) continue;
+                const int n = ny * w + nx;
+                const float ng = g[c] + (dx && dy ? SQRT2 : 1);
+                if(ng < g[n]) {
+                    g[n] = ng;
+                    const int hx = abs(nx - gx), hy = abs(ny - gy);
+                    open.push(Entry(ng + max(hx, hy) + (SQRT2 - 1) * min(hx, hy), n));
+                }
+            }
+        }
+    }
+    return -1;
+}
+
+static double pathCost(const vector<pair<int, int> >& path) {
+    double cost = 0;
+    for(size_t i = 1; i < path.size(); i++) {
+        const int dx = abs(path[i].first - path[i - 1].first), dy = abs(path[i].second - path[i - 1].second);
+        if(dx > 1 || dy > 1 || (!dx && !dy)) return -1;
+        cost += (dx && dy) ? 1.41421356f : 1;
+    }
+    return cost;
+}
+
+static int bench(const char* name, const vector<uint8_t>& blocked, int w, int h, int pairs, bool check) {
+    GridPlanner planner;
+    double t0 = now();
+    planner.setMap(&blocked[0], w, h);
+    double tFirst = now() - t0;
+    t0 = now();
+    planner.setMap(&blocked[0], w, h);
+    double tMap = now() - t0;
+
+    vector<int> freeCells;
+    for(size_t i = 0; i < blocked.size(); i++)
+        if(!blocked[i]) freeCells.push_back(i);
+    if(freeCells.empty()) return 0;
+
+    srand(1);
+    vector<pair<int, int> > path;
+    double tJps = 0, tAstar = 0, worst = 0;
+    long expanded = 0;
+    int found = 0;
+    for(int i = 0; i < pairs; i++) {
+        const int s = freeCells[rand() % freeCells.size()], g = freeCells[rand() % freeCells.size()];
+        t0 = now();
+        const bool ok = planner.plan(s % w, s / w, g % w, g / w, path);
+        const double t = now() - t0;
+        tJps += t;
+        worst = max(worst, t);
+        expanded += planner.expanded();
+        found += ok;
+        if(!check) continue;
+        t0 = now();
+        const double want = astar(blocked, w, h, s % w, s / w, g % w, g / w);
+        tAstar += now() - t0;
+        const double got = ok ? pathCost(path) : -1;
+        if((want < 0) != !ok || fabs(got - want) > 1e-2 * max(1.0, want) ||
+           (ok && (path.front() != make_pair(s % w, s / w) || path.back() != make_pair(g % w, g / w)))) {
+            cerr << name << ": pair " << i << " costs " << got << ", A* " << want << endl;
+            return 1;
+        }
+        for(size_t k = 0; k < path.size(); k++) {
+            if(blocked[path[k].second * w + path[k].first]) {
+                cerr << name << ": pair " << i << " goes through a blocked cell" << endl;
+                return 1;
+            }
+        }
+    }
+    printf("%s: %d pairs, %d found, setMap %.2f ms first, %.2f ms after\n", name, pairs, found, tFirst, tMap);
+    printf("  jps   %8.3f ms mean %8.3f ms worst  %ld expanded\n", tJps / pairs, worst, expanded / pairs);
+    if(check) printf("  A*    %8.3f ms mean\n", tAstar / pairs);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if(argc < 2) {
+        cerr << "usage: planner_bench map.pgm [radius cells] [pairs]" << endl;
+        return 1;
+    }
+    const double radius = argc > 2 ? atof(argv[2]) : 4;
+    const int pairs = argc > 3 ? atoi(argv[3]) : 200;
+    PgmImage img;
+    if(readPgm(argv[1], img) != 0) return 1;
+    const int w = img.width, h = img.height;
+
+    // grey back to OccupancyGrid values; rows stay as they are, the
+    // planner doesn't care which way up the map is
+    vector<signed char> grid(img.pixels.size());
+    for(size_t i = 0; i < grid.size(); i++) {
+        const uint8_t p = img.pixels[i];
+        grid[i] = p <= GREY_OCCUPIED_MAX ? 100 : p >= GREY_FREE_MIN ? 0 : -1;
+    }
+
+    double t0 = now();
+    DistanceMap distances;
+    distances.resize(w, h, (int)ceil(radius) + 1);
+    distances.updateFromGrid(&grid[0]);
+    double t1 = now();
+    vector<uint8_t> known, all;
+    inflateGrid(distances, &grid[0], radius, false, known);
+    double t2 = now();
+    inflateGrid(distances, &grid[0], radius, true, all);
+    printf("%s %dx%d, radius %.1f cells: distance map %.2f ms, inflate %.2f ms\n",
+           argv[1], w, h, radius, t1 - t0, t2 - t1);
+
+    if(bench("explored cells", known, w, h, pairs, true) != 0) return 1;
+    if(bench("unknown allowed", all, w, h, pairs, true) != 0) return 1;
+
+    // corner to corner over the whole map
+    GridPlanner planner;
+    planner.setMap(&all[0], w, h);
+    vector<pair<int, int> > path;
+    t0 = now();
+    const bool ok = planner.plan(0, 0, w - 1, h - 1, path);
+    printf("corner to corner: %s, %zu cells, %.3f ms, %d expanded\n", ok ? "found" : "none",
+           path.size(), now() - t0, planner.expanded());
+    return 0;
+}
@@ -0,0 +1,231 @@
+#ifndef PNG_TILES_HPP
+#define PNG_TILES_HPP
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <set>
+#include <deque>
+#include <unordered_map>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <zlib.h>
+#include "pgm.hpp"
+#include "tile_map.hpp"
+using namespace::std;
+
+// palette png tiles straight from the map image, in place of running
+// ImageMagick on map.pgm.  a map only has a handful of grey levels, so
+// a tile is a small palette and 1 or 2 bit indices, which deflate
+// squeezes to next to nothing.
+//
+// needs -lz
+
+inline void pngPut32(string& out, uint32_t v) {
+    char b[4] = { (char)(v >> 24), (char)(v >> 16), (char)(v >> 8), (char)v };
+    out.append(b, 4);
+}
+
+inline void pngChunk(string& out, const char* type, const void* data, size_t len) {
+    pngPut32(out, (uint32_t)len);
+    size_t start = out.size();
+    out.append(type, 4);
+    if(len) out.append((const char*)data, len);
+    uLong crc = crc32(0L, (const Bytef*)&out[start], (uInt)(len + 4));
+    pngPut32(out, (uint32_t)crc);
+}
+
+// encode w x h grey pixels, rows stride bytes apart, as an indexed png.
+// returns 0 on success
+inline int encodePalettePng(const uint8_t* pixels, int w, int h, int stride, string& out,
+                            int level = Z_BEST_SPEED) {
+    // grey level to palette index
+    int index[256];
+    uint8_t palette[256 * 3];
+    int colors = 0;
+    memset(index, -1, sizeof(index));
+    for(int y = 0; y < h; y++) {
+        const uint8_t* row = pixels + (size_t)y * stride;
+        for(int x = 0; x < w; x++) {
+            if(index[row[x]] >= 0) continue;
+            index[row[x]] = colors;
+            palette[colors * 3] = palette[colors * 3 + 1] = palette[colors * 3 + 2] = row[x];
+            colors++;
+        }
+    }
+    const int depth = colors <= 2 ? 1 : colors <= 4 ? 2 : colors <= 16 ? 4 : 8;
+    const int perByte = 8 / depth;
+    const size_t rowBytes = 1 + (w + perByte - 1) / perByte;
+
+    // filter type 0 and packed indices, msb first
+    vector<uint8_t> raw(rowBytes * h, 0);
+    for(int y = 0; y < h; y++) {
+        const uint8_t* row = pixels + (size_t)y * stride;
+        uint8_t* dst = &raw[y * rowBytes + 1];
+        for(int x = 0; x < w; x++) {
+            int shift = 8 - depth * (x % perByte + 1);
+            dst[x / perByte] |= (uint8_t)(index[row[x]] << shift);
+        }
+    }
+
+    // map data is long runs of the same byte, Z_RLE finds them fastest
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if(deflateInit2(&zs, level, Z_DEFLATED, 15, 8, Z_RLE) != Z_OK) return -1;
+    vector<uint8_t> idat(deflateBound(&zs, raw.size()));
+    zs.next_in   = &raw[0];
+    zs.avail_in  = (uInt)raw.size();
+    zs.next_out  = &idat[0];
+    zs.avail_out = (uInt)idat.size();
+    int zret = deflate(&zs, Z_FINISH);
+    size_t idatLen = zs.total_out;
+    deflateEnd(&zs);
+    if(zret != Z_STREAM_END) return -1;
+
+    uint8_t ihdr[13];
+    const uint32_t dims[2] = { (uint32_t)w, (uint32_t)h };
+    for(int i = 0; i < 2; i++) {
+        ihdr[i * 4]     = dims[i] >> 24;
+        ihdr[i * 4 + 1] = dims[i] >> 16;
+        ihdr[i * 4 + 2] = dims[i] >> 8;
+        ihdr[i * 4 + 3] = dims[i];
+    }
+    ihdr[8]  = depth;
+    ihdr[9]  = 3;   // indexed
+    ihdr[10] = ihdr[11] = ihdr[12] = 0;
+
+    out.assign("\x89PNG\r\n\x1a\n", 8);
+    pngChunk(out, "IHDR", ihdr, sizeof(ihdr));
+    pngChunk(out, "PLTE", palette, colors * 3);
+    pngChunk(out, "IDAT", &idat[0], idatLen);
+    pngChunk(out, "IEND", NULL, 0);
+    return 0;
+}
+
+// 64 bit hash of a tile's pixels and size
+inline uint64_t tileHash(const uint8_t* pixels, size_t len, int w, int h) {
+    uint64_t hash = 1469598103934665603ULL ^ ((uint64_t)w << 32 | (uint32_t)h);
+    size_t i = 0;
+    for(; i + 8 <= len; i += 8) {
+        uint64_t v;
+        memcpy(&v, pixels + i, 8);
+        hash = (hash ^ v) * 1099511628211ULL;
+        hash ^= hash >> 29;
+    }
+    for(; i < len; i++)
+        hash = (hash ^ pixels[i]) * 1099511628211ULL;
+    return hash ^ (hash >> 32);
+}
+
+// the map as png tiles in a directory, named by content hash, plus an
+// index.json listing them row by row:
+//
+//   {"generation":12,"width":1024,"height":1024,"tile":64,"tiles":["..",..]}
+//
+// a tile is only encoded when its content was never seen before; the
+// unknown tiles all over a fresh map are one file.  names stay valid
+// as long as their content, so a browser can cache them forever and
+// only fetch what an index adds.  files are removed once neither of
+// the last KEEP indexes lists them.  with an empty dir nothing goes to
+// disk and the tiles are only kept for tilePng.
+class PngTileCache {
+public:
+    static const int KEEP = 2;
+
+    PngTileCache() : generation_(0), encoded_(0) {}
+
+    int write(const string& dir, const TileMap& map) {
+        encoded_ = 0;
+        // hashes and generation only move on once everything is on disk,
+        // so the tiles of a failed write are still changed the next time
+        vector<uint64_t> hashes(hashes_);
+        if((int)hashes.size() != map.tileCount() || !map.changedSince(generation_, tiles_)) {
+            hashes.assign(map.tileCount(), 0);
+            tiles_.clear();
+            for(int t = 0; t < map.tileCount(); t++) tiles_.push_back(t);
+        }
+        const uint32_t generation = map.generation();
+
+        for(size_t i = 0; i < tiles_.size(); i++) {
+            const int t = tiles_[i];
+            int x, y, w, h;
+            map.tileRect(t, x, y, w, h);
+            map.copyTile(t, tile_);
+            const uint64_t hash = tileHash(&tile_[0], tile_.size(), w, h);
+            hashes[t] = hash;
+            if(png_.count(hash)) continue;
+
+            string& png = png_[hash];
+            if(encodePalettePng(&tile_[0], w, h, w, png) != 0 ||
+               (!dir.empty() &&
+                pgmWriteFile(dir + "/" + name(hash) + ".png", png.data(), png.size()) != 0)) {
+                png_.erase(hash);
+                return -1;
+            }
+            encoded_++;
+        }
+
+        if(!dir.empty() && writeIndex(dir, map, generation, hashes) != 0) return -1;
+        hashes_.swap(hashes);
+        generation_ = generation;
+
+        // drop tiles the oldest kept index had and no newer one does
+        history_.push_back(set<uint64_t>(hashes_.begin(), hashes_.end()));
+        if((int)history_.size() > KEEP) {
+            for(set<uint64_t>::iterator it = history_.front().begin(); it != history_.front().end(); ++it) {
+                bool live = false;
+                for(size_t k = 1; k < history_.size() && !live; k++)
+                    live = history_[k].count(*it) != 0;
+                if(live) continue;
+                if(!dir.empty()) unlink((dir + "/" + name(*it) + ".png").c_str());
+                png_.erase(*it);
+            }
+            history_.pop_front();
+        }
+        return 0;
+    }
+
+    // encoded png of a tile as of the last write, empty if it has none
+    const string& tilePng(int tile) const {
+        static const string none;
+        if(tile < 0 || tile >= (int)hashes_.size()) return none;
+        unordered_map<uint64_t, string>::const_iterator it = png_.find(hashes_[tile]);
+        return it != png_.end() ? it->second : none;
+    }
+
+    // tiles encoded by the last write, the rest came from the cache
+    int encodedTiles() const { return encoded_; }
+
+    static string name(uint64_t hash) {
+        char buf[17];
+        snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)hash);
+        return buf;
+    }
+
+private:
+    int writeIndex(const string& dir, const TileMap& map, uint32_t generation,
+                   const vector<uint64_t>& hashes) {
+        string index;
+        char head[128];
+        snprintf(head, sizeof(head), "{\"generation\":%u,\"width\":%d,\"height\":%d,\"tile\":%d,\"tiles\":[",
+                 generation, map.width(), map.height(), TileMap::TILE);
+        index = head;
+        for(size_t t = 0; t < hashes.size(); t++) {
+            index += t ? ",\"" : "\"";
+            index += name(hashes[t]);
+            index += "\"";
+        }
+        index += "]}\n";
+        return pgmWriteFile(dir + "/index.json", index.data(), index.size());
+    }
+
+    uint32_t generation_;
+    int encoded_;
+    vector<int> tiles_;
+    vector<uint8_t> tile_;
+    vector<uint64_t> hashes_;             // per tile, as of the last write
+    unordered_map<uint64_t, string> png_;
+    deque<set<uint64_t> > history_;
+};
+
+#endif
@@ -0,0 +1,108 @@
+// full re-export against dirty tiles, on old.pgm with a simulated rover
+// mapping around itself.
+//
+// build: g++ -O2 tile_bench.cpp -o tile_bench
+// run:   ./tile_bench [map=old.pgm] [updates=200] [dir=/tmp]
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+#include <time.h>
+#include "pgm.hpp"
+#include "tile_map.hpp"
+#include "occupancy_grid.hpp"
+
+static double cpuMs() {
+    timespec t;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+    return t.tv_sec * 1e3 + t.tv_nsec * 1e-6;
+}
+
+static size_t fileSize(const string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? st.st_size : 0;
+}
+
+// what one hector publish changes: a ring of scan endpoints around the
+// rover turns occupied, the space inside turns free
+static void scanAround(PgmImage& img, int cx, int cy, int range) {
+    for(int a = 0; a < 360; a += 2) {
+        double rad = a * M_PI / 180;
+        int r = range - rand() % (range / 4);
+        for(int d = 0; d <= r; d++) {
+            int x = cx + (int)(d * cos(rad)), y = cy + (int)(d * sin(rad));
+            if(x < 0 || y < 0 || x >= img.width || y >= img.height) break;
+            img.pixels[(size_t)y * img.width + x] = (d == r) ? GREY_OCCUPIED : GREY_FREE;
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    const string mapfile = argc > 1 ? argv[1] : "old.pgm";
+    const int updates = argc > 2 ? atoi(argv[2]) : 200;
+    const string dir = argc > 3 ? argv[3] : "/tmp";
+    const string fullpath = dir + "/tile_bench_full.pgm", tilepath = dir + "/tile_bench_tiles.pgm";
+
+    PgmImage img;
+    if(readPgm(mapfile, img) != 0) return 1;
+
+    TileMap tiles;
+    TileTextCache text;
+    tiles.update(&img.pixels[0], img.width, img.height);
+    text.write(tilepath, tiles);
+
+    double fullCpu = 0, tileCpu = 0, diffCpu = 0, shipCpu = 0;
+    vector<uint8_t> tile;
+    size_t fullBytes = 0, tileBytes = 0, textBytes = 0, dirtyTiles = 0;
+    srand(1);
+    for(int u = 0; u < updates; u++) {
+        // 0.5 s between publishes at a walking pace, 5 cm cells
+        int cx = img.width / 2 + (int)(200 * cos(u * 0.01));
+        int cy = img.height / 2 + (int)(200 * sin(u * 0.01));
+        scanAround(img, cx, cy, 60);
+
+        double t0 = cpuMs();
+        if(writePgm(fullpath, &img.pixels[0], img.width, img.height, 255, true) != 0) return 1;
+        double t1 = cpuMs();
+        int n = tiles.update(&img.pixels[0], img.width, img.height);
+        double t2 = cpuMs();
+        if(n && text.write(tilepath, tiles) != 0) return 1;
+        double t3 = cpuMs();
+        for(int i = 0; i < n; i++) tiles.copyTile(tiles.dirty()[i], tile);
+        double t4 = cpuMs();
+
+        fullCpu += t1 - t0;
+        diffCpu += t2 - t1;
+        tileCpu += t3 - t1;
+        shipCpu += (t2 - t1) + (t4 - t3);
+        fullBytes += fileSize(fullpath);
+        dirtyTiles += n;
+        for(int i = 0; i < n; i++) {
+            int x, y, w, h;
+            tiles.tileRect(tiles.dirty()[i], x, y, w, h);
+            tileBytes += 8 + (size_t)w * h;   // x, y, w, h as u16 + pixels
+        }
+        textBytes += text.encodedBytes();
+    }
+
+    // the tiled file has to be the same as the full export
+    PgmImage a, b;
+    readPgm(fullpath, a);
+    readPgm(tilepath, b);
+    if(a.pixels != b.pixels || fileSize(fullpath) != fileSize(tilepath)) {
+        cerr << "tiled export differs from the full one" << endl;
+        return 1;
+    }
+
+    printf("%s %dx%d, %d tiles of %d, %d updates\n", mapfile.c_str(), img.width, img.height,
+           tiles.tileCount(), TileMap::TILE, updates);
+    printf("  dirty tiles/update     %8.1f\n", (double)dirtyTiles / updates);
+    printf("  full new.pgm   cpu ms/update %8.3f   bytes/update %9zu\n",
+           fullCpu / updates, fullBytes / updates);
+    printf("  tiled new.pgm  cpu ms/update %8.3f   text formatted/update %9zu\n",
+           tileCpu / updates, textBytes / updates);
+    printf("  dirty tiles    cpu ms/update %8.3f   bytes/update %9zu  (diff %.3f ms)\n",
+           shipCpu / updates, tileBytes / updates, diffCpu / updates);
+    unlink(fullpath.c_str());
+    unlink(tilepath.c_str());
+    return 0;
+}
@@ -0,0 +1,195 @@
+#ifndef TILE_MAP_HPP
+#define TILE_MAP_HPP
+#include <string>
+#include <vector>
+#include <cstring>
+#include <stdint.h>
+#include "pgm.hpp"
+using namespace::std;
+
+// the map image cut into TILE x TILE tiles, kept against the previous
+// snapshot.  hector only changes the area around the rover between
+// publishes, so most tiles stay as they are and need no re-encoding.
+//
+// every update bumps the generation and stamps the tiles that changed
+// with it, so consumers at different generations can each ask what
+// changed since they last looked.
+class TileMap {
+public:
+    static const int TILE = 64;
+
+    TileMap() : width_(0), height_(0), tilesX_(0), tilesY_(0), generation_(0), resized_(0) {}
+
+    // take a new snapshot.  returns the number of changed tiles, all of
+    // them if the size changed
+    int update(const uint8_t* image, int width, int height) {
+        generation_++;
+        dirty_.clear();
+
+        if(width != width_ || height != height_) {
+            width_  = width;
+            height_ = height;
+            tilesX_ = (width + TILE - 1) / TILE;
+            tilesY_ = (height + TILE - 1) / TILE;
+            image_.assign(image, image + (size_t)width * height);
+            changed_.assign(tilesX_ * tilesY_, generation_);
+            resized_ = generation_;
+            for(int t = 0; t < tileCount(); t++) dirty_.push_back(t);
+            return tileCount();
+        }
+
+        for(int ty = 0; ty < tilesY_; ty++) {
+            for(int tx = 0; tx < tilesX_; tx++) {
+                int x, y, w, h;
+                tileRect(ty * tilesX_ + tx, x, y, w, h);
+                // first differing row, then copy from there down
+                int row = 0;
+                for(; row < h; row++) {
+                    size_t off = (size_t)(y + row) * width_ + x;
+                    if(memcmp(&image_[off], image + off, w) != 0) break;
+                }
+                if(row == h) continue;
+                for(; row < h; row++) {
+                    size_t off = (size_t)(y + row) * width_ + x;
+                    memcpy(&image_[off], image + off, w);
+                }
+                changed_[ty * tilesX_ + tx] = generation_;
+                dirty_.push_back(ty * tilesX_ + tx);
+            }
+        }
+        return (int)dirty_.size();
+    }
+
+    // tiles changed by the last update
+    const vector<int>& dirty() const { return dirty_; }
+
+    // tiles changed after generation gen.  returns false if the map was
+    // resized since, the caller then needs everything
+    bool changedSince(uint32_t gen, vector<int>& tiles) const {
+        tiles.clear();
+        if(gen < resized_) return false;
+        for(int t = 0; t < tileCount(); t++)
+            if(changed_[t] > gen) tiles.push_back(t);
+        return true;
+    }
+
+    void tileRect(int tile, int& x, int& y, int& w, int& h) const {
+        x = (tile % tilesX_) * TILE;
+        y = (tile / tilesX_) * TILE;
+        w = min(TILE, width_ - x);
+        h = min(TILE, height_ - y);
+    }
+
+    // tile pixels, w*h packed rows
+    void copyTile(int tile, vector<uint8_t>& out) const {
+        int x, y, w, h;
+        tileRect(tile, x, y, w, h);
+        out.resize((size_t)w * h);
+        for(int row = 0; row < h; row++)
+            memcpy(&out[(size_t)row * w], &image_[(size_t)(y + row) * width_ + x], w);
+    }
+
+    const uint8_t* image() const { return image_.empty() ? NULL : &image_[0]; }
+    int width() const { return width_; }
+    int height() const { return height_; }
+    int tilesX() const { return tilesX_; }
+    int tilesY() const { return tilesY_; }
+    int tileCount() const { return tilesX_ * tilesY_; }
+    uint32_t generation() const { return generation_; }
+
+private:
+    int width_, height_;
+    int tilesX_, tilesY_;
+    uint32_t generation_;
+    uint32_t resized_;
+    vector<uint8_t> image_;
+    vector<uint32_t> changed_;   // generation each tile last changed in
+    vector<int> dirty_;
+};
+
+// P2 text of a TileMap, kept per tile so an update only formats the
+// tiles that changed and the file is put together with memcpy.
+//
+// each tile row is a run of whole "v " values.  with the width a
+// multiple of TILE the newline after every 1024 values always falls
+// between runs; other widths are formatted in full.
+class TileTextCache {
+public:
+    TileTextCache() : generation_(0), encoded_(0) {}
+
+    int write(const string& path, const TileMap& map) {
+        const int width = map.width(), height = map.height();
+        if(width % TileMap::TILE != 0)
+            return writePgm(path, map.image(), width, height, 255, true);
+
+        encoded_ = 0;
+        if((int)text_.size() != map.tileCount() || !map.changedSince(generation_, tiles_)) {
+            // first write or resized since, format everything
+            text_.assign(map.tileCount(), vector<char>());
+            rowEnd_.assign(map.tileCount(), vector<uint32_t>());
+            for(int t = 0; t < map.tileCount(); t++) encode(map, t);
+        } else {
+            for(size_t i = 0; i < tiles_.size(); i++) encode(map, tiles_[i]);
+        }
+        generation_ = map.generation();
+
+        char header[64];
+        int hlen = snprintf(header, sizeof(header), "P2 \n%d %d\n%d\n", width, height, 255);
+        size_t total = hlen + (size_t)width * height / 1024 + 1;
+        for(size_t t = 0; t < text_.size(); t++) total += text_[t].size();
+        out_.resize(total);
+
+        char* out = &out_[0];
+        memcpy(out, header, hlen);
+        out += hlen;
+        size_t values = 0;
+        for(int ty = 0; ty < map.tilesY(); ty++) {
+            int h = min(TileMap::TILE, height - ty * TileMap::TILE);
+            for(int row = 0; row < h; row++) {
+                for(int tx = 0; tx < map.tilesX(); tx++) {
+                    const int t = ty * map.tilesX() + tx;
+                    const uint32_t beg = row ? rowEnd_[t][row - 1] : 0;
+                    const uint32_t end = rowEnd_[t][row];
+                    memcpy(out, &text_[t][beg], end - beg);
+                    out += end - beg;
+                    values += TileMap::TILE;
+                    if(values % 1024 == 0) *out++ = '\n';
+                }
+            }
+        }
+        return pgmWriteFile(path, &out_[0], out - &out_[0]);
+    }
+
+    // bytes of text formatted by the last write
+    size_t encodedBytes() const { return encoded_; }
+
+private:
+    void encode(const TileMap& map, int tile) {
+        static const PgmAsciiTable table;
+        int x, y, w, h;
+        map.tileRect(tile, x, y, w, h);
+        vector<char>& text = text_[tile];
+        text.resize((size_t)w * h * 4);
+        rowEnd_[tile].resize(h);
+        char* out = &text[0];
+        for(int row = 0; row < h; row++) {
+            const uint8_t* src = map.image() + (size_t)(y + row) * map.width() + x;
+            for(int i = 0; i < w; i++) {
+                memcpy(out, table.text[src[i]], 4);
+                out += table.len[src[i]];
+            }
+            rowEnd_[tile][row] = out - &text[0];
+        }
+        text.resize(out - &text[0]);
+        encoded_ += text.size();
+    }
+
+    uint32_t generation_;
+    size_t encoded_;
+    vector<int> tiles_;
+    vector<vector<char> > text_;
+    vector<vector<uint32_t> > rowEnd_;
+    vector<char> out_;
+};
+
+#endif
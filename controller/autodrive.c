@@ -1,162 +1,129 @@
-// Uses POSIX functions to send and receive data from the virtual serial
-// port of a Pololu Simple Motor Controller.
+// Drives both Pololu Simple Motor Controllers through a fixed schedule,
+// from a fixed rate control loop (see motor_loop.h).
 // NOTE: The Simple Motor Controller's Input Mode must be set to Serial/USB.
-// NOTE: You must change the 'const char * device' line below.
+// NOTE: You must change the 'const char * device' lines below.
+//
+// build: gcc -O2 autodrive.c smc.c motor_loop.c smc_telemetry.c -pthread -o drive
+// run:   sudo ./drive [-r rate Hz] [-p SCHED_FIFO priority] [-c cpu] [-t telemetry Hz]
+//        root, or CAP_SYS_NICE, is needed for -p; -t 0 turns telemetry off
 
 #include <fcntl.h>
+#include <signal.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 
-#ifdef _WIN32
-#define O_NOCTTY 0
-#else
-#include <termios.h>
-#endif
-
-#define SERIAL_ERROR -9999
-
-// Reads a variable from the SMC and returns it as number between 0 and 65535.
-// Returns SERIAL_ERROR if there was an error.
-// The 'variableId' argument must be one of IDs listed in the
-// "Controller Variables" section of the user's guide.
-// For variables that are actually signed, additional processing is required
-// (see smcGetTargetSpeed for an example).
-int smcGetVariable(int fd, unsigned char variableId)
-{
-  unsigned char command[] = {0xA1, variableId};
-  if(write(fd, &command, sizeof(command)) == -1)
-  {
-    perror("error writing");
-    return SERIAL_ERROR;
-  }
-
-  unsigned char response[2];
-  if(read(fd,response,2) != 2)
-  {
-    perror("error reading");
-    return SERIAL_ERROR;
-  }
+#include "smc.h"
+#include "motor_loop.h"
+#include "smc_telemetry.h"
 
-  return response[0] + 256*response[1];
-}
+// each step holds its speeds for 5 seconds, then the schedule repeats
+static const int schedule[][2] = {
+  {0, 0},
+  {500, -500},
+  {-500, -500},
+};
+#define SCHEDULE_STEPS (sizeof(schedule) / sizeof(schedule[0]))
+#define STEP_SECONDS 5
 
-// Returns the target speed (-3200 to 3200).
-// Returns SERIAL_ERROR if there is an error.
-int smcGetTargetSpeed(int fd)
-{
-  int val = smcGetVariable(fd, 20);
-  return val == SERIAL_ERROR ? SERIAL_ERROR : (signed short)val;
-}
+static volatile sig_atomic_t stopRequested = 0;
 
-// Returns a number where each bit represents a different error, and the
-// bit is 1 if the error is currently active.
-// See the user's guide for definitions of the different error bits.
-// Returns SERIAL_ERROR if there is an error.
-int smcGetErrorStatus(int fd)
+static void onSignal(int sig)
 {
-  return smcGetVariable(fd,0);
+  (void)sig;
+  stopRequested = 1;
 }
 
-// Sends the Exit Safe Start command, which is required to drive the motor.
-// Returns 0 if successful, SERIAL_ERROR if there was an error sending.
-int smcExitSafeStart(int fd)
+static int scheduleTick(void * arg, unsigned long long tick, int speed[2])
 {
-  const unsigned char command = 0x83;
-  if (write(fd, &command, 1) == -1)
-  {
-    perror("error writing");
-    return SERIAL_ERROR;
-  }
+  const int rateHz = *(const int *)arg;
+  const unsigned long long step = tick / ((unsigned long long)rateHz * STEP_SECONDS) % SCHEDULE_STEPS;
+  speed[0] = schedule[step][0];
+  speed[1] = schedule[step][1];
   return 0;
 }
 
-// Sets the SMC's target speed (-3200 to 3200).
-// Returns 0 if successful, SERIAL_ERROR if there was an error sending.
-int smcSetTargetSpeed(int fd, int speed)
+int main(int argc, char ** argv)
 {
-  unsigned char command[3];
-
-  if (speed < 0)
+  MotorLoopConfig config = {100, 0, -1, 100};
+  int telemetryHz = 10;
+  int opt;
+  while ((opt = getopt(argc, argv, "r:p:c:t:")) != -1)
   {
-    command[0] = 0x86; // Motor Reverse
-    speed = -speed;
+    switch (opt)
+    {
+    case 'r': config.rateHz = atoi(optarg); break;
+    case 'p': config.priority = atoi(optarg); break;
+    case 'c': config.cpu = atoi(optarg); break;
+    case 't': telemetryHz = atoi(optarg); break;
+    default:
+      fprintf(stderr, "usage: %s [-r rate Hz] [-p SCHED_FIFO priority] [-c cpu] [-t telemetry Hz]\n", argv[0]);
+      return 1;
+    }
   }
-  else
-  {
-    command[0] = 0x85; // Motor Forward
-  }
-  command[1] = speed & 0x1F;
-  command[2] = speed >> 5 & 0x7F;
 
-  if (write(fd, command, sizeof(command)) == -1)
+  // Open the Simple Motor Controllers' virtual COM ports.
+  const char * device = "/dev/ttyACM0";  // Motor1
+  const char * device1 = "/dev/ttyACM1"; // Motor2
+  //const char * device = "/dev/cu.usbmodemfa121"; // Mac OS X
+  int fd[2];
+  fd[0] = smcOpen(device);
+  if (fd[0] == -1)
+    return 1;
+  fd[1] = smcOpen(device1);
+  if (fd[1] == -1)
   {
-    perror("error writing");
-    return SERIAL_ERROR;
+    close(fd[0]);
+    return 1;
   }
-  return 0;
-}
 
+  smcExitSafeStart(fd[0]);
+  smcExitSafeStart(fd[1]);
 
+  printf("Error status: 0x%04x 0x%04x\n", smcGetErrorStatus(fd[0]), smcGetErrorStatus(fd[1]));
+  printf("Current Target Speed is %d %d.\n", smcGetTargetSpeed(fd[0]), smcGetTargetSpeed(fd[1]));
 
-int main()
-{
-  // Open the Simple Motor Controller's virtual COM port.
-  const char * device = "/dev/ttyACM0";  // Motor1
-  const char * device1 = "/dev/ttyACM1"; // Motor2
-  //const char * device = "\\\\.\\USBSER000";  // Windows, "\\\\.\\COM6" also works
-  //const char * device = "/dev/cu.usbmodemfa121"; // Mac OS X
-  int fd = open(device, O_RDWR | O_NOCTTY);
-  int fd1 = open(device1, O_RDWR | O_NOCTTY);
+  int i;
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+
+  // the blocking reads above are done, from here on telemetry owns the
+  // read side of the ports
+  SmcTelemetry * telemetry = telemetryHz > 0 ? smcTelemetryStart(fd, telemetryHz) : NULL;
 
-  if (fd == -1)
+  MotorLoopStats stats;
+  int ret = motorLoopRun(fd, &config, scheduleTick, &config.rateHz, &stats, &stopRequested);
+
+  if (telemetry)
   {
-    perror(device);
-    return 1;
+    SmcTelemetrySnapshot snapshot;
+    smcTelemetryRead(telemetry, &snapshot);
+    smcTelemetryStop(telemetry);
+    for (i = 0; i < 2; i++)
+    {
+      const SmcStatus * s = &snapshot.controller[i];
+      if (!s->valid)
+      {
+        printf("Motor%d: no telemetry, %llu timeouts\n", i + 1, s->timeouts);
+        continue;
+      }
+      printf("Motor%d: error 0x%04x target %d speed %d %.2f V %.1f C, %llu refreshes %llu timeouts\n",
+             i + 1, s->errorStatus, s->targetSpeed, s->speed, s->inputVoltage / 1000.0,
+             s->temperature / 10.0, s->refreshes, s->timeouts);
+    }
   }
 
-#ifdef _WIN32
-  _setmode(fd, _O_BINARY);
-#else
-  struct termios options;
-  tcgetattr(fd, &options);
-  options.c_iflag &= ~(INLCR | IGNCR | ICRNL | IXON | IXOFF);
-  options.c_oflag &= ~(ONLCR | OCRNL);
-  options.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
-  tcsetattr(fd, TCSANOW, &options);
-#endif
-
-  smcExitSafeStart(fd);
-
-  printf("Error status: 0x%04x\n", smcGetErrorStatus(fd));
-
-  int speed = smcGetTargetSpeed(fd);
-  printf("Current Target Speed is %d.\n", speed);
-
-//  int newSpeed = (speed <= 0) ? 3200 : -3200;
-//  int newSpeed = (speed <= 0) ? 600 : -600;
-
-  int newSpeed = 0;
-  int newSpeed1 = 0;
-
-  printf("Setting Target Speed to %d.\n", newSpeed);
-  smcSetTargetSpeed(fd, newSpeed);
-  smcSetTargetSpeed(fd1, newSpeed1);
-
-  int running = 1;
-  while(running = 1){
-    smcSetTargetSpeed(fd, newSpeed);
-    smcSetTargetSpeed(fd1, newSpeed1);
-    sleep(5);
-    newSpeed = 500;
-    newSpeed1 = -500;
-    sleep(5);
-    newSpeed = -500;
-    newSpeed1 = -500;
-    sleep(5);
+  // stop both motors on the way out, whatever the schedule was doing
+  for (i = 0; i < 2; i++)
+  {
+    int flags = fcntl(fd[i], F_GETFL);
+    fcntl(fd[i], F_SETFL, flags & ~O_NONBLOCK);
+    smcSetTargetSpeed(fd[i], 0);
   }
 
+  motorLoopPrintStats(stdout, &stats, config.rateHz);
 
-
-  close(fd);
-  return 0;
+  close(fd[0]);
+  close(fd[1]);
+  return ret == 0 ? 0 : 1;
 }
@@ -0,0 +1,241 @@
+#ifndef DIFF_DRIVE_HPP
+#define DIFF_DRIVE_HPP
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <cmath>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <stdint.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include "smc.h"
+#include "motor_loop.h"
+using namespace::std;
+
+// differential drive over the two simple motor controllers: (v, w)
+// commands in, wheel speeds out.
+//
+// command() can be called from any thread, a cmd_vel callback say; it
+// only stores the target.  the motor loop thread (motor_loop.h) ramps
+// toward it at most maxAccel and maxAngularAccel, turns it into wheel
+// speeds and sends both wheels in the same tick.  wheel speeds that
+// would pass maxWheelSpeed are scaled down together, so the curvature
+// is kept.  with no command for timeout seconds the target is zero.
+//
+// limit() caps the linear speed each way, for the safety supervisor.
+// the cap is not ramped: going faster than it drops to it in the next
+// tick, and emergencyStop() skips even that tick.  a cap given a hold
+// time turns into a stop once it is that old, so a supervisor that goes
+// quiet can't leave the last cap in force.
+//
+// speeds are open loop: 3200 is full duty, taken as maxWheelSpeed m/s.
+
+struct DiffDriveConfig {
+    double wheelBase;          // m between the wheel centres
+    double maxWheelSpeed;      // m/s of a wheel at 3200
+    double maxAccel;           // m/s^2
+    double maxAngularAccel;    // rad/s^2
+    double timeout;            // s
+    bool invert[2];            // left, right: motor turns backwards for positive speed
+
+    DiffDriveConfig() : wheelBase(0.3), maxWheelSpeed(1.0), maxAccel(1.0), maxAngularAccel(4.0),
+                        timeout(0.5) {
+        invert[0] = false;
+        invert[1] = true;
+    }
+};
+
+class DiffDrive {
+public:
+    explicit DiffDrive(const DiffDriveConfig& config = DiffDriveConfig())
+        : config_(config), target_(0), commandNs_(0), limit_(packPair(INFINITY, INFINITY)),
+          limitUntilNs_(INT64_MAX), linear_(0), angular_(0),
+          stop_(0), rateHz_(0), lastTick_(0), v_(0), w_(0), running_(false) {
+        memset(&stats_, 0, sizeof(stats_));
+    }
+
+    ~DiffDrive() { stop(); }
+
+    // linear m/s, angular rad/s, counter clockwise
+    void command(double v, double w) {
+        target_.store(packPair(v, w), memory_order_relaxed);
+        commandNs_.store(nowNs(), memory_order_release);
+    }
+
+    // most m/s allowed forward and backward, both >= 0, for hold seconds;
+    // after that the limit is 0 until the next call.  returns true when
+    // the wheels are going faster than that right now
+    bool limit(double forward, double backward, double hold = INFINITY) {
+        const int64_t until = hold < 1e9 ? nowNs() + (int64_t)(hold * 1e9) : INT64_MAX;
+        limit_.store(packPair(forward, backward), memory_order_relaxed);
+        limitUntilNs_.store(until, memory_order_release);
+        const float v = linear_.load(memory_order_relaxed);
+        return v > forward || -v > backward;
+    }
+
+    // true once the last limit() has outlived its hold time
+    bool limitExpired() const { return nowNs() > limitUntilNs_.load(memory_order_acquire); }
+
+    // zero to both controllers now, from the calling thread, instead of
+    // at the next tick.  the ports are non-blocking, so a full one is
+    // waited on for up to 50 ms.  the loop keeps to whatever limit() says
+    // after
+    void emergencyStop() {
+        if(!running_) return;
+        sendStop(fd_[0]);
+        sendStop(fd_[1]);
+    }
+
+    // fd[0] left, fd[1] right.  runs the motor loop in its own thread
+    int start(const int fd[2], const MotorLoopConfig& loop) {
+        if(running_) return -1;
+        fd_[0] = fd[0];
+        fd_[1] = fd[1];
+        loop_ = loop;
+        rateHz_ = loop.rateHz;
+        lastTick_ = 0;
+        v_ = w_ = 0;
+        stop_ = 0;
+        running_ = true;
+        thread_ = thread(&DiffDrive::run, this);
+        return 0;
+    }
+
+    // stops the loop and both motors
+    void stop() {
+        if(!running_) return;
+        stop_ = 1;
+        thread_.join();
+        running_ = false;
+        sendStop(fd_[0]);
+        sendStop(fd_[1]);
+    }
+
+    // one step of the ramp, dt seconds after the last; fills the SMC
+    // speeds of the left and right wheel.  the loop calls this, it is
+    // public so the ramp can be run without motors
+    void step(double dt, int64_t now, int speed[2]) {
+        float pair[2] = { 0, 0 };
+        const int64_t since = now - commandNs_.load(memory_order_acquire);
+        if(since < (int64_t)(config_.timeout * 1e9)) unpackPair(target_.load(memory_order_relaxed), pair);
+        float cap[2] = { 0, 0 };
+        if(now <= limitUntilNs_.load(memory_order_acquire)) unpackPair(limit_.load(memory_order_relaxed), cap);
+        pair[0] = max(-cap[1], min(cap[0], pair[0]));
+        v_ = ramp(v_, pair[0], config_.maxAccel * dt);
+        w_ = ramp(w_, pair[1], config_.maxAngularAccel * dt);
+        // braking for the limit doesn't wait for the ramp
+        v_ = max((double)-cap[1], min((double)cap[0], v_));
+
+        double left  = v_ - w_ * config_.wheelBase / 2;
+        double right = v_ + w_ * config_.wheelBase / 2;
+        const double over = max(fabs(left), fabs(right)) / config_.maxWheelSpeed;
+        if(over > 1) {
+            // what the wheels can do is where the next ramp starts from
+            left /= over;
+            right /= over;
+            v_ /= over;
+            w_ /= over;
+        }
+        speed[0] = toSmc(left, config_.invert[0]);
+        speed[1] = toSmc(right, config_.invert[1]);
+        linear_.store(v_, memory_order_relaxed);
+        angular_.store(w_, memory_order_relaxed);
+    }
+
+    // the ramped command the wheels are being driven at
+    double linear() const { return linear_.load(memory_order_relaxed); }
+    double angular() const { return angular_.load(memory_order_relaxed); }
+
+    // valid after stop()
+    const MotorLoopStats& stats() const { return stats_; }
+
+    static int64_t nowNs() {
+        timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return t.tv_sec * 1000000000LL + t.tv_nsec;
+    }
+
+private:
+    static uint64_t packPair(double a, double b) {
+        float pair[2] = { (float)a, (float)b };
+        uint64_t packed;
+        memcpy(&packed, pair, sizeof(packed));
+        return packed;
+    }
+
+    static void unpackPair(uint64_t packed, float pair[2]) {
+        memcpy(pair, &packed, 2 * sizeof(float));
+    }
+
+    // a whole speed 0 command, waiting for room on the port
+    static bool sendStop(int fd) {
+        unsigned char command[3];
+        smcSpeedCommand(command, 0);
+        const int64_t deadline = nowNs() + 50000000LL;
+        size_t sent = 0;
+        while(sent < sizeof(command)) {
+            const ssize_t n = write(fd, command + sent, sizeof(command) - sent);
+            if(n > 0) {
+                sent += n;
+                continue;
+            }
+            const int64_t left = deadline - nowNs();
+            if(n == -1 && errno == EINTR) continue;
+            if(n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK) && left > 0) {
+                pollfd pfd = { fd, POLLOUT, 0 };
+                poll(&pfd, 1, (int)((left + 999999) / 1000000));
+                continue;
+            }
+            perror("emergency stop");
+            return false;
+        }
+        return true;
+    }
+
+    static double ramp(double from, double to, double maxStep) {
+        if(to > from + maxStep) return from + maxStep;
+        if(to < from - maxStep) return from - maxStep;
+        return to;
+    }
+
+    int toSmc(double wheel, bool invert) const {
+        int s = (int)lround(wheel / config_.maxWheelSpeed * 3200);
+        s = max(-3200, min(3200, s));
+        return invert ? -s : s;
+    }
+
+    static int tick(void* arg, unsigned long long n, int speed[2]) {
+        DiffDrive* drive = (DiffDrive*)arg;
+        // tick counts missed periods too, so dt covers an overrun
+        const double dt = (double)(n + 1 - drive->lastTick_) / drive->rateHz_;
+        drive->lastTick_ = n + 1;
+        drive->step(dt, nowNs(), speed);
+        return 0;
+    }
+
+    void run() {
+        motorLoopRun(fd_, &loop_, &DiffDrive::tick, this, &stats_, &stop_);
+    }
+
+    DiffDriveConfig config_;
+    atomic<uint64_t> target_;          // two floats, v and w, so they change together
+    atomic<int64_t> commandNs_;
+    atomic<uint64_t> limit_;           // forward and backward m/s, as target_
+    atomic<int64_t> limitUntilNs_;     // CLOCK_MONOTONIC the limit holds until
+    atomic<float> linear_;             // v_, for other threads
+    atomic<float> angular_;            // w_, likewise
+    volatile sig_atomic_t stop_;
+    int fd_[2];
+    MotorLoopConfig loop_;
+    int rateHz_;
+    unsigned long long lastTick_;
+    double v_, w_;                     // loop thread only
+    MotorLoopStats stats_;
+    bool running_;
+    thread thread_;
+};
+
+#endif
@@ -0,0 +1,159 @@
+// drives the rover from cmd_vel (geometry_msgs/Twist) through
+// diff_drive.hpp: linear.x in m/s, angular.z in rad/s.  the callback only
+// stores the command; the motor loop sends both wheels together at
+// ~rate Hz.
+//
+// each scan goes through safety.hpp, which caps the speed to what can
+// stop short of the nearest return in the robot's path.  a scan that
+// finds the wheels already too fast stops them from the scan callback.
+// how long after the scan was taken the stop went out is logged, and
+// summed up on exit.  a cap only holds for two scan periods, so if the
+// scans stop coming the wheels stop too; until the first scan they
+// don't move at all.
+//
+// build:
+//   gcc -O2 -c smc.c motor_loop.c
+//   g++ -O2 drive_node.cpp smc.o motor_loop.o -I/opt/ros/lunar/include -L/opt/ros/lunar/lib
+//       -lroscpp -lrosconsole -lroscpp_serialization -lrostime -pthread -o drive_node
+// run:
+//   sudo ./drive_node [_left_port:=/dev/ttyACM0] [_right_port:=/dev/ttyACM1] [_rate:=100]
+//        [_priority:=0] [_cpu:=-1] [_wheel_base:=0.3] [_max_wheel_speed:=1.0]
+//        [_max_accel:=1.0] [_max_angular_accel:=4.0] [_timeout:=0.5]
+//        [_safety:=true] [_half_width:=0.2] [_front:=0.2] [_rear:=0.2] [_laser_x:=0]
+//        [_laser_yaw:=0] [_reaction_time:=0.15] [_max_decel:=1.0] [_margin:=0.05]
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include "diff_drive.hpp"
+#include "safety.hpp"
+#include <ros/ros.h>
+#include <geometry_msgs/Twist.h>
+#include <sensor_msgs/LaserScan.h>
+
+static DiffDrive* drive = NULL;
+static SafetySupervisor* supervisor = NULL;
+
+// scans checked, and the ones that had to stop the wheels
+static unsigned long long scans = 0, stops = 0;
+static int64_t checkNsMax = 0, stopNsMax = 0;
+static double checkNsSum = 0, stopNsSum = 0;
+static ros::Time lastScan;
+
+// the drive already stops on its own when the cap runs out, this says why
+void watchdogCallback(const ros::WallTimerEvent&) {
+    if(drive->limitExpired())
+        ROS_WARN_THROTTLE(1.0, "drive_node: no scan for two scan periods, holding the wheels at 0");
+}
+
+void cmdVelCallback(const geometry_msgs::TwistConstPtr& msg) {
+    drive->command(msg->linear.x, msg->angular.z);
+}
+
+void scanCallback(const sensor_msgs::LaserScanConstPtr& scan) {
+    if(scan->ranges.empty()) return;
+    const int64_t t0 = DiffDrive::nowNs();
+    float ahead, behind;
+    supervisor->clearance(&scan->ranges[0], scan->ranges.size(), scan->angle_min, scan->angle_increment,
+                          scan->range_min, scan->range_max, ahead, behind);
+    // scan_time if the lidar says, else the gap since the last scan
+    const ros::Time arrived = ros::Time::now();
+    double period = scan->scan_time;
+    if(period <= 0 && !lastScan.isZero()) period = (arrived - lastScan).toSec();
+    if(period <= 0 || period > 1.0) period = 0.1;
+    lastScan = arrived;
+    const bool tooFast = drive->limit(supervisor->maxSpeed(ahead), supervisor->maxSpeed(behind), 2 * period);
+    if(tooFast) drive->emergencyStop();
+    const int64_t check = DiffDrive::nowNs() - t0;
+
+    scans++;
+    checkNsSum += check;
+    checkNsMax = max(checkNsMax, check);
+    if(!tooFast) return;
+
+    // from when the scan was taken to when the stop was written
+    const double latency = (ros::Time::now() - scan->header.stamp).toSec();
+    const int64_t latencyNs = (int64_t)(latency * 1e9);
+    stops++;
+    stopNsSum += latencyNs;
+    stopNsMax = max(stopNsMax, latencyNs);
+    ROS_WARN("drive_node: stopped at %.2f m/s, %.2f m ahead %.2f m behind, %.2f ms after the scan",
+             drive->linear(), ahead, behind, latency * 1e3);
+}
+
+int main(int argc, char** argv){
+    ros::init(argc, argv, "drive_node");
+    ros::NodeHandle nh;
+    ros::NodeHandle nh_private("~");
+
+    string leftPort, rightPort;
+    bool invertLeft, invertRight;
+    DiffDriveConfig config;
+    MotorLoopConfig loop = {100, 0, -1, 100};
+    nh_private.param<string>("left_port", leftPort, "/dev/ttyACM0");
+    nh_private.param<string>("right_port", rightPort, "/dev/ttyACM1");
+    nh_private.param<int>("rate", loop.rateHz, loop.rateHz);
+    nh_private.param<int>("priority", loop.priority, loop.priority);
+    nh_private.param<int>("cpu", loop.cpu, loop.cpu);
+    nh_private.param<int>("resend_ms", loop.resendMs, loop.resendMs);
+    nh_private.param<double>("wheel_base", config.wheelBase, config.wheelBase);
+    nh_private.param<double>("max_wheel_speed", config.maxWheelSpeed, config.maxWheelSpeed);
+    nh_private.param<double>("max_accel", config.maxAccel, config.maxAccel);
+    nh_private.param<double>("max_angular_accel", config.maxAngularAccel, config.maxAngularAccel);
+    nh_private.param<double>("timeout", config.timeout, config.timeout);
+    nh_private.param<bool>("invert_left", invertLeft, config.invert[0]);
+    nh_private.param<bool>("invert_right", invertRight, config.invert[1]);
+    config.invert[0] = invertLeft;
+    config.invert[1] = invertRight;
+
+    bool safety;
+    SafetyConfig safetyConfig;
+    nh_private.param<bool>("safety", safety, true);
+    nh_private.param<double>("half_width", safetyConfig.halfWidth, safetyConfig.halfWidth);
+    nh_private.param<double>("front", safetyConfig.front, safetyConfig.front);
+    nh_private.param<double>("rear", safetyConfig.rear, safetyConfig.rear);
+    nh_private.param<double>("laser_x", safetyConfig.laserX, safetyConfig.laserX);
+    nh_private.param<double>("laser_yaw", safetyConfig.laserYaw, safetyConfig.laserYaw);
+    nh_private.param<double>("reaction_time", safetyConfig.reactionTime, safetyConfig.reactionTime);
+    nh_private.param<double>("max_decel", safetyConfig.maxDecel, safetyConfig.maxDecel);
+    nh_private.param<double>("margin", safetyConfig.margin, safetyConfig.margin);
+
+    int fd[2];
+    fd[0] = smcOpen(leftPort.c_str());
+    if(fd[0] == -1) return 1;
+    fd[1] = smcOpen(rightPort.c_str());
+    if(fd[1] == -1) {
+        close(fd[0]);
+        return 1;
+    }
+    smcExitSafeStart(fd[0]);
+    smcExitSafeStart(fd[1]);
+
+    DiffDrive diffDrive(config);
+    SafetySupervisor safetySupervisor(safetyConfig);
+    drive = &diffDrive;
+    supervisor = &safetySupervisor;
+    if(safety) diffDrive.limit(0, 0);
+    if(diffDrive.start(fd, loop) != 0) return 1;
+
+    ros::Subscriber sub = nh.subscribe("cmd_vel", 1, cmdVelCallback);
+    ros::Subscriber scanSub;
+    ros::WallTimer watchdog;
+    if(safety) {
+        scanSub = nh.subscribe("scan", 1, scanCallback);
+        watchdog = nh.createWallTimer(ros::WallDuration(0.1), watchdogCallback);
+    }
+    else ROS_WARN("drive_node: running without the lidar safety stop");
+    ros::spin();
+
+    diffDrive.stop();
+    motorLoopPrintStats(stdout, &diffDrive.stats(), loop.rateHz);
+    if(scans) {
+        printf("%llu scans checked, mean %.1f us max %.1f us; %llu stops", scans,
+               checkNsSum / scans / 1e3, checkNsMax / 1e3, stops);
+        if(stops) printf(", scan to stop mean %.2f ms max %.2f ms", stopNsSum / stops / 1e6, stopNsMax / 1e6);
+        printf("\n");
+    }
+    close(fd[0]);
+    close(fd[1]);
+    return 0;
+}
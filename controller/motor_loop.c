@@ -0,0 +1,193 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/timerfd.h>
+
+#include "motor_loop.h"
+#include "smc.h"
+
+static long long nowNs(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+static void setupRealtime(const MotorLoopConfig * config)
+{
+  if (config->cpu >= 0)
+  {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(config->cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) == -1)
+      perror("sched_setaffinity");
+  }
+
+  if (config->priority > 0)
+  {
+    // a page fault in the loop costs more than the whole tick
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) == -1)
+      perror("mlockall");
+
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = config->priority;
+    if (sched_setscheduler(0, SCHED_FIFO, &param) == -1)
+      perror("sched_setscheduler SCHED_FIFO");
+  }
+}
+
+// Writes a whole command without blocking.
+// Returns 0 if sent, 1 if the port was full, -1 on error.
+static int sendCommand(int fd, const unsigned char * command, int len)
+{
+  ssize_t n = write(fd, command, len);
+  if (n == len)
+    return 0;
+  if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    return 1;
+  // a short write leaves half a command; the next command byte has
+  // bit 7 set, which the SMC takes as the start of a new command
+  return -1;
+}
+
+static void record(MotorLoopStats * stats, long long latency, long long work)
+{
+  if (stats->ticks == 1 || latency < stats->latencyMinNs)
+    stats->latencyMinNs = latency;
+  if (stats->ticks == 1 || latency > stats->latencyMaxNs)
+    stats->latencyMaxNs = latency;
+  stats->latencySumNs += latency;
+  if (work > stats->workMaxNs)
+    stats->workMaxNs = work;
+
+  long long us = latency > 0 ? latency / 1000 : 0;
+  int bucket = 0;
+  while (bucket < MOTOR_LOOP_BUCKETS - 1 && us >= (1LL << bucket))
+    bucket++;
+  stats->latencyHist[bucket]++;
+}
+
+int motorLoopRun(const int fd[2], const MotorLoopConfig * config,
+                 MotorTickFunc tick, void * arg, MotorLoopStats * stats,
+                 volatile sig_atomic_t * stop)
+{
+  memset(stats, 0, sizeof(*stats));
+  if (config->rateHz <= 0 || config->rateHz > 1000)
+  {
+    fprintf(stderr, "motorLoopRun: rate %d Hz is out of range\n", config->rateHz);
+    return -1;
+  }
+
+  int i;
+  for (i = 0; i < 2; i++)
+    fcntl(fd[i], F_SETFL, fcntl(fd[i], F_GETFL) | O_NONBLOCK);
+
+  setupRealtime(config);
+
+  int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+  if (tfd == -1)
+  {
+    perror("timerfd_create");
+    return -1;
+  }
+
+  // absolute deadlines, so a late tick doesn't push the later ones back
+  const long long period = 1000000000LL / config->rateHz;
+  const long long start = nowNs() + period;
+  struct itimerspec spec;
+  spec.it_value.tv_sec = start / 1000000000LL;
+  spec.it_value.tv_nsec = start % 1000000000LL;
+  spec.it_interval.tv_sec = period / 1000000000LL;
+  spec.it_interval.tv_nsec = period % 1000000000LL;
+  if (timerfd_settime(tfd, TFD_TIMER_ABSTIME, &spec, NULL) == -1)
+  {
+    perror("timerfd_settime");
+    close(tfd);
+    return -1;
+  }
+
+  unsigned long long periods = 0;
+  int done = 0;
+  int sent[2] = {0, 0};
+  long long sentNs[2] = {0, 0};
+  int haveSent[2] = {0, 0};
+  const long long resend = config->resendMs * 1000000LL;
+  while (!done && !*stop)
+  {
+    uint64_t expirations;
+    if (read(tfd, &expirations, sizeof(expirations)) != sizeof(expirations))
+    {
+      if (errno == EINTR)
+        continue;
+      perror("timerfd read");
+      break;
+    }
+    const long long woke = nowNs();
+
+    // more than one expiration means we slept through deadlines
+    stats->overruns += expirations - 1;
+    periods += expirations;
+    stats->ticks++;
+
+    int speed[2] = {0, 0};
+    done = tick(arg, periods - 1, speed);
+
+    unsigned char command[2][3];
+    smcSpeedCommand(command[0], speed[0]);
+    smcSpeedCommand(command[1], speed[1]);
+    for (i = 0; i < 2; i++)
+    {
+      if (resend > 0 && haveSent[i] && speed[i] == sent[i] && woke - sentNs[i] < resend)
+      {
+        stats->coalesced++;
+        continue;
+      }
+      int ret = sendCommand(fd[i], command[i], 3);
+      if (ret > 0)
+        stats->dropped++;
+      else if (ret < 0)
+        stats->writeErrors++;
+      else
+      {
+        sent[i] = speed[i];
+        sentNs[i] = woke;
+        haveSent[i] = 1;
+      }
+    }
+
+    const long long deadline = start + (long long)(periods - 1) * period;
+    record(stats, woke - deadline, nowNs() - woke);
+  }
+
+  close(tfd);
+  return 0;
+}
+
+void motorLoopPrintStats(FILE * out, const MotorLoopStats * stats, int rateHz)
+{
+  fprintf(out, "%llu ticks at %d Hz, %llu overruns, %llu coalesced, %llu dropped, %llu write errors\n",
+          stats->ticks, rateHz, stats->overruns, stats->coalesced, stats->dropped, stats->writeErrors);
+  if (stats->ticks == 0)
+    return;
+  fprintf(out, "wakeup latency us: min %.1f mean %.1f max %.1f, work max %.1f us\n",
+          stats->latencyMinNs / 1e3, stats->latencySumNs / stats->ticks / 1e3,
+          stats->latencyMaxNs / 1e3, stats->workMaxNs / 1e3);
+  int i;
+  for (i = 0; i < MOTOR_LOOP_BUCKETS; i++)
+  {
+    if (!stats->latencyHist[i])
+      continue;
+    if (i == MOTOR_LOOP_BUCKETS - 1)
+      fprintf(out, "  >= %6lld us  %llu\n", 1LL << (i - 1), stats->latencyHist[i]);
+    else
+      fprintf(out, "  <  %6lld us  %llu\n", 1LL << i, stats->latencyHist[i]);
+  }
+}
@@ -0,0 +1,71 @@
+// Fixed rate control loop for the two Simple Motor Controllers.
+//
+// A timerfd on CLOCK_MONOTONIC wakes the loop every period.  Each tick
+// asks the caller for both target speeds and writes both commands back to
+// back, so the two motors always change in the same tick.  A speed the
+// controller already has is only sent again every resendMs, which keeps
+// the serial links quiet and still feeds the SMC's serial timeout.
+//
+// The ports are switched to non-blocking writes: a command the port can't
+// take right away is dropped and counted, and the next tick sends a fresh
+// one, instead of the loop waiting on USB.
+//
+// How late each wakeup is against its deadline, and how many periods were
+// missed, are kept in MotorLoopStats.
+
+#ifndef MOTOR_LOOP_H
+#define MOTOR_LOOP_H
+
+#include <signal.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MOTOR_LOOP_BUCKETS 16
+
+typedef struct
+{
+  int rateHz;          // ticks per second, 50 to 200 makes sense
+  int priority;        // SCHED_FIFO priority 1-99, 0 keeps the normal scheduler
+  int cpu;             // CPU to pin the loop to, -1 for any
+  int resendMs;        // repeat unchanged speeds this often, 0 sends every tick
+} MotorLoopConfig;
+
+typedef struct
+{
+  unsigned long long ticks;        // ticks run
+  unsigned long long overruns;     // periods that passed without a tick
+  unsigned long long coalesced;    // commands not sent, the speed was unchanged
+  unsigned long long dropped;      // commands the port would have blocked on
+  unsigned long long writeErrors;  // commands that failed to send
+  long long latencyMinNs;          // wakeup time minus deadline
+  long long latencyMaxNs;
+  double latencySumNs;
+  long long workMaxNs;             // wakeup to both commands written
+  // wakeup latency, bucket i counts latencies under 2^i microseconds,
+  // the last one everything above
+  unsigned long long latencyHist[MOTOR_LOOP_BUCKETS];
+} MotorLoopStats;
+
+// Called once a tick with the tick number, counting missed periods, to
+// fill in speed[0] and speed[1] (-3200 to 3200) for fd[0] and fd[1].
+// Returns 0 to keep going, anything else stops the loop after that
+// tick's commands are sent.
+typedef int (*MotorTickFunc)(void * arg, unsigned long long tick, int speed[2]);
+
+// Runs the loop until 'tick' returns non zero or *stop is set.
+// Priority and affinity failures are reported and the loop runs without
+// them.  Returns 0 when stopped, -1 if the timer could not be set up.
+int motorLoopRun(const int fd[2], const MotorLoopConfig * config,
+                 MotorTickFunc tick, void * arg, MotorLoopStats * stats,
+                 volatile sig_atomic_t * stop);
+
+void motorLoopPrintStats(FILE * out, const MotorLoopStats * stats, int rateHz);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
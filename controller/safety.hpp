@@ -0,0 +1,118 @@
+#ifndef SAFETY_HPP
+#define SAFETY_HPP
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <limits>
+using namespace::std;
+
+typedef float SafetyVec __attribute__((vector_size(16)));
+typedef int SafetyMask __attribute__((vector_size(16)));
+
+// stops the wheels before they can reach what the lidar sees.
+//
+// the robot is a rectangle, front and rear of the base origin and
+// halfWidth either side.  a scan gives the free distance ahead of the
+// front edge and behind the rear edge, counting only returns inside the
+// robot's width.  the footprint a speed needs is the rectangle stretched
+// by the stopping distance v * reactionTime + v^2 / (2 * maxDecel), so
+// the fastest safe speed each way comes out of that distance; the drive
+// clamps to it, and stops at once when it is already going faster.
+//
+// the check is one pass over the ranges, four beams at a time with
+// masks instead of branches.  beam directions come from a table made
+// when the scan's angles change.
+
+struct SafetyConfig {
+    double halfWidth;          // m, half the robot's width plus some room
+    double front;              // m from the base origin to the front edge
+    double rear;               // m from the base origin to the rear edge
+    double laserX;             // m, lidar ahead of the base origin
+    double laserYaw;           // rad, lidar zero angle from straight ahead
+    double reactionTime;       // s, a scan period plus a loop tick
+    double maxDecel;           // m/s^2 the wheels can brake at
+    double margin;             // m always kept free
+
+    SafetyConfig() : halfWidth(0.2), front(0.2), rear(0.2), laserX(0), laserYaw(0),
+                     reactionTime(0.15), maxDecel(1.0), margin(0.05) {}
+};
+
+class SafetySupervisor {
+public:
+    explicit SafetySupervisor(const SafetyConfig& config = SafetyConfig())
+        : config_(config), angleMin_(NAN), angleInc_(NAN) {}
+
+    // free distance in m ahead of the front edge and behind the rear edge,
+    // negative when something is inside the footprint, infinity when
+    // nothing is in the way.  ranges outside [rangeMin, rangeMax] are
+    // ignored, inf and nan included
+    void clearance(const float* ranges, int count, float angleMin, float angleInc,
+                   float rangeMin, float rangeMax, float& ahead, float& behind) {
+        table(count, angleMin, angleInc);
+        const float lx = config_.laserX, hw = config_.halfWidth;
+        const float front = config_.front, rear = config_.rear;
+        const float far = numeric_limits<float>::infinity();
+
+        // 4 beams at a time; a lane out of the robot's path offers far
+        const SafetyVec farV = (SafetyVec){} + far;
+        SafetyVec a = farV, b = farV;
+        int i = 0;
+        for(; i + 4 <= count; i += 4) {
+            SafetyVec r, c, sn;
+            memcpy(&r, ranges + i, sizeof(r));
+            memcpy(&c, &cos_[i], sizeof(c));
+            memcpy(&sn, &sin_[i], sizeof(sn));
+            const SafetyVec x = lx + r * c, y = r * sn;
+            const SafetyMask beside = (r >= rangeMin) & (r <= rangeMax) & (y < hw) & (y > -hw);
+            const SafetyVec fa = (beside & (x >= 0)) ? x - front : farV;
+            const SafetyVec fb = (beside & (x < 0)) ? -x - rear : farV;
+            a = a < fa ? a : fa;
+            b = b < fb ? b : fb;
+        }
+        float ma = far, mb = far;
+        for(int k = 0; k < 4; k++) {
+            ma = min(ma, a[k]);
+            mb = min(mb, b[k]);
+        }
+        for(; i < count; i++) {
+            const float r = ranges[i];
+            const float x = lx + r * cos_[i], y = r * sin_[i];
+            const bool beside = (r >= rangeMin) & (r <= rangeMax) & (y < hw) & (y > -hw);
+            ma = min(ma, (beside & (x >= 0)) ? x - front : far);
+            mb = min(mb, (beside & (x < 0)) ? -x - rear : far);
+        }
+        ahead = ma;
+        behind = mb;
+    }
+
+    // fastest speed that can still stop within clear m
+    double maxSpeed(double clear) const {
+        const double d = clear - config_.margin;
+        if(!(d > 0)) return 0;
+        if(isinf(d)) return numeric_limits<double>::infinity();
+        const double t = config_.reactionTime, a = config_.maxDecel;
+        return a * (sqrt(t * t + 2 * d / a) - t);
+    }
+
+    const SafetyConfig& config() const { return config_; }
+
+private:
+    void table(int count, float angleMin, float angleInc) {
+        if((int)cos_.size() == count && angleMin == angleMin_ && angleInc == angleInc_) return;
+        cos_.resize(count);
+        sin_.resize(count);
+        for(int i = 0; i < count; i++) {
+            const double angle = config_.laserYaw + angleMin + (double)angleInc * i;
+            cos_[i] = cos(angle);
+            sin_[i] = sin(angle);
+        }
+        angleMin_ = angleMin;
+        angleInc_ = angleInc;
+    }
+
+    SafetyConfig config_;
+    float angleMin_, angleInc_;
+    vector<float> cos_, sin_;
+};
+
+#endif
@@ -0,0 +1,34 @@
+// Serial commands for the Pololu Simple Motor Controller's virtual serial
+// port.
+// NOTE: The Simple Motor Controller's Input Mode must be set to Serial/USB.
+
+#ifndef SMC_H
+#define SMC_H
+
+#define SERIAL_ERROR -9999
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Opens an SMC's virtual COM port in raw mode.
+// Returns the file descriptor, or -1 if there was an error.
+int smcOpen(const char * device);
+
+// The Get Variable calls block until the answer comes; once the control
+// loop runs, use smc_telemetry.h instead.
+int smcGetVariable(int fd, unsigned char variableId);
+int smcGetTargetSpeed(int fd);
+int smcGetErrorStatus(int fd);
+int smcExitSafeStart(int fd);
+int smcSetTargetSpeed(int fd, int speed);
+
+// Fills 'command' with the 3 byte Set Target Speed command for 'speed'
+// (-3200 to 3200) without sending it.
+void smcSpeedCommand(unsigned char command[3], int speed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
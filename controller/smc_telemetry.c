@@ -0,0 +1,316 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include "smc_telemetry.h"
+
+static const unsigned char variables[] = {
+  SMC_VAR_ERROR_STATUS,
+  SMC_VAR_TARGET_SPEED,
+  SMC_VAR_SPEED,
+  SMC_VAR_INPUT_VOLTAGE,
+  SMC_VAR_TEMPERATURE,
+};
+#define VARIABLES (sizeof(variables) / sizeof(variables[0]))
+
+typedef struct
+{
+  int fd;
+  unsigned char pending[VARIABLES];  // ids asked for, in the order sent
+  int head, count;
+  int low;                           // first byte of a response, -1 if none
+  int draining;                      // a batch timed out, wait for quiet
+  long long byteNs;                  // one byte on the line
+  long long lastByteNs;              // CLOCK_MONOTONIC of the last read
+  SmcStatus status;                  // being filled in
+} Port;
+
+// the snapshot is published in two slots: the writer fills the one
+// readers aren't pointed at and then points them at it, so a reader
+// that interrupts a half written slot still has a whole one to copy
+typedef struct
+{
+  unsigned seq;                      // odd while being written
+  SmcTelemetrySnapshot snapshot;
+} Slot;
+
+struct SmcTelemetry
+{
+  Port port[2];
+  int epfd, tfd, stopfd;
+  pthread_t thread;
+  Slot slot[2];
+  unsigned latest;
+};
+
+static long long nowNs(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+static void publish(SmcTelemetry * t)
+{
+  unsigned next = !__atomic_load_n(&t->latest, __ATOMIC_RELAXED);
+  Slot * slot = &t->slot[next];
+  __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  slot->snapshot.controller[0] = t->port[0].status;
+  slot->snapshot.controller[1] = t->port[1].status;
+  __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELEASE);
+  __atomic_store_n(&t->latest, next, __ATOMIC_RELEASE);
+}
+
+void smcTelemetryRead(SmcTelemetry * t, SmcTelemetrySnapshot * snapshot)
+{
+  for (;;)
+  {
+    const Slot * slot = &t->slot[__atomic_load_n(&t->latest, __ATOMIC_ACQUIRE)];
+    unsigned before = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    *snapshot = slot->snapshot;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (!(before & 1) && __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == before)
+      return;
+  }
+}
+
+static void store(SmcStatus * status, unsigned char id, int value)
+{
+  switch (id)
+  {
+  case SMC_VAR_ERROR_STATUS:  status->errorStatus = value; break;
+  case SMC_VAR_TARGET_SPEED:  status->targetSpeed = (signed short)value; break;
+  case SMC_VAR_SPEED:         status->speed = (signed short)value; break;
+  case SMC_VAR_INPUT_VOLTAGE: status->inputVoltage = value; break;
+  case SMC_VAR_TEMPERATURE:   status->temperature = value; break;
+  }
+}
+
+// Start, 8 data and stop bit at the port's rate, 9600 if it can't tell.
+static long long byteTimeNs(int fd)
+{
+  struct termios options;
+  long long baud = 9600;
+  if (tcgetattr(fd, &options) == 0)
+  {
+    switch (cfgetispeed(&options))
+    {
+    case B1200:   baud = 1200;   break;
+    case B2400:   baud = 2400;   break;
+    case B4800:   baud = 4800;   break;
+    case B19200:  baud = 19200;  break;
+    case B38400:  baud = 38400;  break;
+    case B57600:  baud = 57600;  break;
+    case B115200: baud = 115200; break;
+    default: break;
+    }
+  }
+  return 10 * 1000000000LL / baud;
+}
+
+// Sends the whole batch of requests for one controller.  A batch still
+// waiting for answers has timed out, and its answers may yet come and be
+// taken for the next batch's.  So its bytes are flushed and nothing is
+// asked until the line has been quiet for a byte time; what arrives in
+// between is read and dropped by receive.  That costs one refresh.
+static void request(Port * port)
+{
+  if (port->count > 0)
+  {
+    port->status.timeouts++;
+    tcflush(port->fd, TCIFLUSH);
+    port->count = 0;
+    port->low = -1;
+    port->draining = 1;
+    port->lastByteNs = nowNs();
+    return;
+  }
+  if (port->draining)
+  {
+    if (nowNs() - port->lastByteNs < port->byteNs)
+      return;
+    tcflush(port->fd, TCIFLUSH);
+    port->draining = 0;
+  }
+  port->head = 0;
+  port->count = 0;
+  port->low = -1;
+
+  unsigned char command[2 * VARIABLES];
+  size_t i;
+  for (i = 0; i < VARIABLES; i++)
+  {
+    command[2 * i] = 0xA1;
+    command[2 * i + 1] = variables[i];
+  }
+  ssize_t n = write(port->fd, command, sizeof(command));
+  if (n <= 0)
+    return;   // port busy, try again next refresh
+  // only whole requests get answers
+  port->count = n / 2;
+  memcpy(port->pending, variables, port->count);
+}
+
+// Matches the bytes read against the requests in flight.
+// Returns 1 when the batch is complete.
+static int receive(Port * port)
+{
+  unsigned char buf[64];
+  int complete = 0;
+  ssize_t n;
+  while ((n = read(port->fd, buf, sizeof(buf))) > 0)
+  {
+    ssize_t i;
+    port->lastByteNs = nowNs();
+    for (i = 0; i < n; i++)
+    {
+      if (port->count == 0)
+        continue;   // nothing asked for, a late answer to a flushed batch
+      if (port->low < 0)
+      {
+        port->low = buf[i];
+        continue;
+      }
+      store(&port->status, port->pending[port->head], port->low + 256 * buf[i]);
+      port->low = -1;
+      port->head++;
+      if (--port->count == 0)
+      {
+        port->status.valid = 1;
+        port->status.updatedNs = nowNs();
+        port->status.refreshes++;
+        complete = 1;
+      }
+    }
+  }
+  return complete;
+}
+
+static void * telemetryThread(void * arg)
+{
+  SmcTelemetry * t = arg;
+  for (;;)
+  {
+    struct epoll_event events[4];
+    int n = epoll_wait(t->epfd, events, 4, -1);
+    if (n == -1)
+    {
+      if (errno == EINTR)
+        continue;
+      perror("smc telemetry epoll_wait");
+      return NULL;
+    }
+
+    int i, changed = 0;
+    for (i = 0; i < n; i++)
+    {
+      int fd = events[i].data.fd;
+      if (fd == t->stopfd)
+        return NULL;
+      if (fd == t->tfd)
+      {
+        uint64_t expirations;
+        if (read(t->tfd, &expirations, sizeof(expirations)) != sizeof(expirations))
+          continue;
+        request(&t->port[0]);
+        request(&t->port[1]);
+        // timeouts show up in the snapshot straight away
+        changed = 1;
+        continue;
+      }
+      int p = fd == t->port[0].fd ? 0 : 1;
+      changed |= receive(&t->port[p]);
+    }
+    if (changed)
+      publish(t);
+  }
+}
+
+static int watch(int epfd, int fd)
+{
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.fd = fd;
+  return epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+SmcTelemetry * smcTelemetryStart(const int fd[2], int rateHz)
+{
+  if (rateHz <= 0 || fd[0] == fd[1])
+  {
+    fprintf(stderr, "smcTelemetryStart: bad rate or ports\n");
+    return NULL;
+  }
+  SmcTelemetry * t = calloc(1, sizeof(*t));
+  if (!t)
+    return NULL;
+  int i;
+  for (i = 0; i < 2; i++)
+  {
+    t->port[i].fd = fd[i];
+    t->port[i].low = -1;
+    t->port[i].byteNs = byteTimeNs(fd[i]);
+    fcntl(fd[i], F_SETFL, fcntl(fd[i], F_GETFL) | O_NONBLOCK);
+  }
+  t->epfd = epoll_create1(EPOLL_CLOEXEC);
+  t->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+  t->stopfd = eventfd(0, EFD_CLOEXEC);
+  if (t->epfd == -1 || t->tfd == -1 || t->stopfd == -1)
+  {
+    perror("smcTelemetryStart");
+    goto Error;
+  }
+
+  const long long period = 1000000000LL / rateHz;
+  struct itimerspec spec;
+  spec.it_value.tv_sec = 0;
+  spec.it_value.tv_nsec = 1;   // the first refresh straight away
+  spec.it_interval.tv_sec = period / 1000000000LL;
+  spec.it_interval.tv_nsec = period % 1000000000LL;
+  if (timerfd_settime(t->tfd, 0, &spec, NULL) == -1 ||
+      watch(t->epfd, t->tfd) == -1 || watch(t->epfd, t->stopfd) == -1 ||
+      watch(t->epfd, fd[0]) == -1 || watch(t->epfd, fd[1]) == -1)
+  {
+    perror("smcTelemetryStart");
+    goto Error;
+  }
+
+  if (pthread_create(&t->thread, NULL, telemetryThread, t) != 0)
+  {
+    fprintf(stderr, "smcTelemetryStart: unable to start thread\n");
+    goto Error;
+  }
+  return t;
+
+Error:
+  if (t->epfd != -1) close(t->epfd);
+  if (t->tfd != -1) close(t->tfd);
+  if (t->stopfd != -1) close(t->stopfd);
+  free(t);
+  return NULL;
+}
+
+void smcTelemetryStop(SmcTelemetry * t)
+{
+  if (!t)
+    return;
+  uint64_t one = 1;
+  if (write(t->stopfd, &one, sizeof(one)) != sizeof(one))
+    perror("smcTelemetryStop");
+  pthread_join(t->thread, NULL);
+  close(t->epfd);
+  close(t->tfd);
+  close(t->stopfd);
+  free(t);
+}
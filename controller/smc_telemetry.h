@@ -0,0 +1,64 @@
+// Telemetry from both Simple Motor Controllers without blocking reads.
+//
+// A thread refreshes the variables at a fixed rate.  Each refresh writes
+// all the Get Variable requests for a controller in one go and the
+// responses, which come back in order two bytes each, are matched
+// against the queue of requests sent.  Both ports are watched by one
+// epoll loop, so the two controllers answer at the same time instead of
+// one round trip after another.
+//
+// Readers get a copy of the last complete refresh from
+// smcTelemetryRead, which never waits on the telemetry thread, so the
+// control loop can call it every tick.
+
+#ifndef SMC_TELEMETRY_H
+#define SMC_TELEMETRY_H
+
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// "Controller Variables" in the user's guide
+#define SMC_VAR_ERROR_STATUS   0
+#define SMC_VAR_TARGET_SPEED   20
+#define SMC_VAR_SPEED          21
+#define SMC_VAR_INPUT_VOLTAGE  23
+#define SMC_VAR_TEMPERATURE    24
+
+typedef struct
+{
+  int valid;                  // a refresh has completed
+  int errorStatus;
+  int targetSpeed;            // -3200 to 3200
+  int speed;                  // -3200 to 3200
+  int inputVoltage;           // mV
+  int temperature;            // 0.1 degrees C
+  long long updatedNs;        // CLOCK_MONOTONIC of the last complete refresh
+  unsigned long long refreshes;
+  unsigned long long timeouts; // refreshes not answered before the next one
+} SmcStatus;
+
+typedef struct
+{
+  SmcStatus controller[2];
+} SmcTelemetrySnapshot;
+
+typedef struct SmcTelemetry SmcTelemetry;
+
+// Starts refreshing both controllers 'rateHz' times a second.  The ports
+// are switched to non-blocking; nothing else may read from them while
+// telemetry runs.  Returns NULL if it could not start.
+SmcTelemetry * smcTelemetryStart(const int fd[2], int rateHz);
+
+void smcTelemetryStop(SmcTelemetry * telemetry);
+
+// Copies the latest snapshot.
+void smcTelemetryRead(SmcTelemetry * telemetry, SmcTelemetrySnapshot * snapshot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
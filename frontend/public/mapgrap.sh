@@ -1,6 +1,6 @@
-while true
-do 
-    rosrun map_server map_saver -f map
-    convert map.pgm map.png
-    sleep 1
-done
+# keeps map.html up to date with /map.  map_export is the subscriber in
+# c++/main.cpp, it encodes only the tiles that changed, pushes them on
+# port 8081 and keeps tiles/ for when the stream is not reachable.
+# map.html reads nothing else, so the full pgm export is off (_out:=).
+mkdir -p tiles
+exec ../../c++/map_export _out:= _tile_dir:=tiles _stream_port:=8081
@@ -3,6 +3,7 @@
 #pragma once
 
 #include <XCommon.h>
+#include <Udp.h>
 #include <rplidar.h>  //RPLIDAR standard sdk all-in-one header
 #include <RPLidarProxyStuff.h>
 
@@ -34,6 +35,15 @@ public:
   // TODO - retire this function
   S32 GetReading( DBL* buf, S32 len );
   S32 GetReading( rplidar_reading_t* rdn );
+
+  // split rdn into rplidar_reading_pkt sub packets and send them,
+  // the way RPLidarProxy expects them.
+  static S32 SendReading( UDPSend* snd, const rplidar_reading_t* rdn );
+
+  // attributes of the sdk's scan cache thread, which Start creates;
+  // see XThread::SetAttr.  NULL for the defaults
+  void SetThreadAttr( const XTHREADATTR* attr );
+
   S32 Start();
   S32 Stop();
 
@@ -0,0 +1,159 @@
+
+
+
+
+#ifndef __RPLIDARCLOCK_H__
+#define __RPLIDARCLOCK_H__
+#pragma once
+#include <XCommon.h>
+#include <XMutex.h>
+#include <Udp.h>
+#include <RPLidarProxyStuff.h>
+
+
+
+
+
+
+#define _CLOCK_FILTER_SIZE_  ( 8 )   // pongs the min delay one is picked from
+#define _CLOCK_FIT_SIZE_     ( 32 )  // filtered samples the drift is fit over
+
+
+
+
+//
+// streamer side.  answers pings with its own clock, the node does the
+// rest.
+//
+class RPLidarClockServer: public EventSinkPure
+{
+public:
+  RPLidarClockServer();
+  ~RPLidarClockServer();
+
+  S32  Init( S32 port );
+
+  // added to every time handed out, to test against a skewed clock
+  void SetOffset( S64 offset );
+
+  void Start();
+  void Stop();
+
+  // udp callback
+  void ReceiveMessage( PUDPMSG pMsg );
+
+  U32  GetPingCnt();
+
+
+private:
+  UDPRecv  _udprecv;
+  UDPSend  _udpsend;
+
+  STDSTR   _peerIP;
+  U32      _peerPort;
+
+  S64      _offset;
+  U32      _pingCnt;
+
+};  // class RPLidarClockServer
+
+
+
+
+//
+// node side.  pings the streamer every interval seconds and keeps an
+// estimate of its clock against ours:
+//
+//   offset = ( ( t2 - t1 ) + ( t3 - t4 ) ) / 2
+//   delay  = ( t4 - t1 ) - ( t3 - t2 )
+//
+// of the last _CLOCK_FILTER_SIZE_ pongs only the one with the least
+// delay is trusted, queuing only ever adds delay.  offset and drift
+// are then a least squares line through the last _CLOCK_FIT_SIZE_ of
+// those, so the estimate holds between pings.
+//
+// pongs arrive through RPLidarProxy, see RPLidarProxy::SetClock.
+//
+class RPLidarClock
+{
+public:
+  RPLidarClock();
+  ~RPLidarClock();
+
+  // host may be NULL, it is then learned from the first reading.
+  // replyPort is the port RPLidarProxy listens on.
+  S32  Init( const char* host, S32 port, S32 replyPort, DBL interval );
+
+  void SetHost( const char* host );
+  bool HasHost();
+
+  // attributes of the ping thread, see XThread::SetAttr
+  void SetThreadAttr( const XTHREADATTR* attr );
+
+  void Start();
+  void Stop();
+
+  void Run();
+
+  // recvTs is the CLOCK_MONOTONIC receive time from UDPMSG
+  void OnPong( const rplidar_clock_pkt_t* pkt, S64 recvTs );
+
+  bool IsSynced();
+
+  // streamer monotonic time to ours, see hal/clock.h
+  S64  ToLocal( S64 remoteTs );
+
+  // offset in ms, drift in ppm, delay of the last filtered sample in ms.
+  // return 1 if synced, 0 otherwise
+  S32  GetStats( DBL* offset, DBL* drift, DBL* delay );
+
+
+private:
+  typedef struct Sample
+  {
+    S64 _ts;      // our time at the middle of the exchange
+    S64 _offset;
+    S64 _delay;
+  } Sample_t;
+
+  void _Fit();
+  void _SendPing();
+
+
+private:
+  XThread*      _thread;
+  bool          _hasThreadAttr;
+  XTHREADATTR   _threadAttr;
+  volatile S32  _stop;
+
+  XMutex        _mtx;
+  volatile bool _hasHost;
+  STDSTR        _host;
+  S32           _port;
+  S32           _replyPort;
+  DBL           _interval;
+
+  UDPSend       _udpsend;
+  bool          _chnlOK;
+  U32           _seq;
+
+  Sample_t      _filter[_CLOCK_FILTER_SIZE_];
+  U32           _filterCnt;
+  S64           _lastUsedTs;
+
+  Sample_t      _fit[_CLOCK_FIT_SIZE_];
+  U32           _fitCnt;
+
+  // offset( t ) = _a + _b * ( t - _tref ), t in our nanoseconds
+  bool          _synced;
+  S64           _tref;
+  DBL           _a;
+  DBL           _b;
+  S64           _delay;
+
+};  // class RPLidarClock
+
+
+
+
+#endif // __RPLIDARCLOCK_H__
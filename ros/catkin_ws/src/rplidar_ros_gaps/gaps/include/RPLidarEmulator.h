@@ -0,0 +1,170 @@
+
+
+
+#ifndef __RPLIDAREMULATOR_H__
+#define __RPLIDAREMULATOR_H__
+#pragma once
+#include <XCommon.h>
+#include <XThread.h>
+#include <rplidar.h>  //RPLIDAR standard sdk all-in-one header
+#include <RPLidarProxyStuff.h>
+
+
+
+
+
+
+//
+// pseudo-terminal rplidar.  opens a pty pair and answers the serial
+// protocol on the master side, so RPlidarDriver can connect to the
+// slave (GetPortName) exactly as it would to /dev/ttyUSB0.
+//
+// supported requests: stop, reset, scan, force scan, express scan,
+// device info, device health, sample rate, motor pwm and accessory
+// board flag.
+//
+// scan data comes either from a RPLidarLog file or from a synthetic
+// room, and is paced by the configured sample rate and line rate.
+// set both to 0 to push data as fast as the reader drains the pty.
+//
+class RPLidarEmulator
+{
+public:
+  typedef struct Config
+  {
+    U32  _baudrate;    // line rate limit, 10 bits per byte, 0 for none
+    U32  _sampleRate;  // samples per second, 0 for no limit
+    U32  _scanNodes;   // synthetic samples per rotation
+    U16  _firmware;    // major << 8 | minor, express needs >= 1.17
+    U8   _model;
+    U8   _hardware;
+    bool _motorCtrl;   // report an accessory board (A2)
+    S32  _verbose;
+
+    Config(
+      ):
+      _baudrate( 115200 ),
+      _sampleRate( 4000 ),
+      _scanNodes( 400 ),
+      _firmware( ( 1 << 8 ) | 20 ),
+      _model( 0x18 ),
+      _hardware( 5 ),
+      _motorCtrl( true ),
+      _verbose( 0 )
+    {
+    }
+  } Config_t;
+
+
+public:
+  RPLidarEmulator();
+  ~RPLidarEmulator();
+
+  // logPath NULL for synthetic scans
+  S32  Init( const Config_t& cfg, const char* logPath );
+
+  // slave side of the pty, valid after Init
+  const char* GetPortName();
+
+  void Start();
+  void Stop();
+
+  void Run();
+
+  // statistics, safe to read from other threads
+  U64  GetScanCount();
+  U64  GetNodeCount();
+  U64  GetByteCount();
+  U64  GetCmdCount();
+  U64  GetDropCount();  // nodes skipped because the reader fell behind
+  U16  GetMotorPWM();
+
+  // monotonic nanoseconds at which the sync node of the last
+  // rotation went into the pty, i.e. when the previous rotation
+  // became complete from the driver's point of view.
+  S64  GetLastSyncTs();
+
+
+private:
+  enum
+  {
+    MODE_IDLE    = 0,
+    MODE_SCAN    = 1,
+    MODE_EXPRESS = 2
+  };
+
+  enum
+  {
+    PARSE_SYNC     = 0,
+    PARSE_CMD      = 1,
+    PARSE_SIZE     = 2,
+    PARSE_PAYLOAD  = 3,
+    PARSE_CHECKSUM = 4
+  };
+
+  S32  _OpenPty();
+  S32  _LoadLog( const char* path );
+  void _MakeSynthetic();
+
+  void _ReadCommands();
+  void _HandleCommand( U8 cmd, const U8* payload, U32 size );
+  void _SendResponse( U8 type, U32 size, bool loop, const void* payload );
+  void _StartScan( S32 mode );
+
+  void _Produce( S64 now );
+  void _EmitNode();
+  void _EmitCapsule();
+  void _SkipNodes( U64 count );
+  void _NextNode( rplidar_response_measurement_node_t* node, bool* sync );
+
+  void _Flush();
+
+
+private:
+  Config_t   _cfg;
+
+  S32        _fd;         // pty master
+  S32        _slavefd;    // held open so the master never sees a hangup
+  char       _portName[64];
+
+  XThread*     _thread;
+  volatile S32 _stop;
+
+  // one entry per rotation
+  STDVEC< STDVEC<rplidar_response_measurement_node_t> >  _scans;
+  U32        _scanIdx;
+  U32        _nodeIdx;
+
+  // command parser
+  S32        _parse;
+  U8         _cmd;
+  U8         _size;
+  U8         _cksum;
+  U32        _payloadLen;
+  U8         _payload[256];
+
+  // output
+  S32        _mode;
+  bool       _firstCapsule;
+  S64        _modeTs;     // when the current scan mode started
+  U64        _units;      // nodes or capsules sent in this mode
+  STDVEC<U8> _out;
+  U32        _outPos;
+  bool       _syncArmed;    // express: sync decodes with the next capsule
+  bool       _syncPending;  // sync node queued but not yet written
+  U32        _syncOff;
+
+  volatile U64  _scanCnt;
+  volatile U64  _nodeCnt;
+  volatile U64  _byteCnt;
+  volatile U64  _cmdCnt;
+  volatile U64  _dropCnt;
+  volatile U16  _pwm;
+  volatile S64  _lastSyncTs;
+
+};  // class RPLidarEmulator
+
+
+
+
+#endif // __RPLIDAREMULATOR_H__
@@ -0,0 +1,186 @@
+
+
+
+#ifndef __RPLIDARLOG_H__
+#define __RPLIDARLOG_H__
+#pragma once
+#include <XCommon.h>
+#include <Udp.h>
+#include <RPLidarProxyStuff.h>
+
+
+
+
+
+
+//
+// append-only binary log of rplidar_reading frames.
+//
+//  +----------------+
+//  | file header    |  written on open, patched on close
+//  +----------------+
+//  | frame header   |  one per reading
+//  | frame payload  |  _count nodes, raw or delta/varint coded
+//  +----------------+
+//  | ...            |
+//  +----------------+
+//  | index          |  one entry per frame, written on close
+//  +----------------+
+//
+// all fields are host (little) endian.  a log that was not closed
+// cleanly has no index; the reader rebuilds it by walking the frames.
+//
+#define _RPLOG_MAGIC_         ( 0x474C5052 )  // "RPLG"
+#define _RPLOG_FRAME_MAGIC_   ( 0x464C5052 )  // "RPLF"
+#define _RPLOG_VERSION_       ( 1 )
+
+#define _RPLOG_FLAG_COMPRESS_ ( 0x01 )
+
+
+typedef struct __attribute__((__packed__)) rplidar_log_hdr
+{
+  U32 _magic;
+  U16 _version;
+  U16 _flags;
+  U32 _nodeCount;
+  U32 _frameCount;   // valid only if _idxOffset != 0
+  S64 _createTs;
+  U64 _idxOffset;    // 0 if the log was not closed
+  U8  _reserved[32];
+} rplidar_log_hdr_t;
+
+
+typedef struct __attribute__((__packed__)) rplidar_log_frame
+{
+  U32 _magic;
+  U32 _size;         // payload bytes following this header
+  U32 _flags;
+  U32 _seq;
+  U32 _ascend;
+  U32 _count;
+  S64 _recvTs;       // receive time, drives replay pacing
+  S64 _scanBegTs;
+  S64 _scanEndTs;
+} rplidar_log_frame_t;
+
+
+typedef struct __attribute__((__packed__)) rplidar_log_idx
+{
+  U64 _offset;
+  S64 _recvTs;
+} rplidar_log_idx_t;
+
+
+
+
+class RPLidarLogWriter
+{
+public:
+  RPLidarLogWriter();
+  ~RPLidarLogWriter();
+
+  S32  Open( const char* path, bool compress );
+  void Close();
+
+  // ts is the receive timestamp in nanoseconds
+  S32  Write( const rplidar_reading_t* rdn, S64 ts );
+
+  U32  GetFrameCount();
+
+
+private:
+  FILE*    _fp;
+  bool     _compress;
+  U64      _offset;
+
+  STDVEC<rplidar_log_idx_t>  _idx;
+
+  U8       _buf[ _NODE_COUNT_ * 7 ];
+
+};  // class RPLidarLogWriter
+
+
+
+
+class RPLidarLogReader
+{
+public:
+  RPLidarLogReader();
+  ~RPLidarLogReader();
+
+  S32  Open( const char* path );
+  void Close();
+
+  U32  GetFrameCount();
+
+  // return 1 if successful
+  // return 0 if idx is out of range
+  // return -1 if the frame is corrupt
+  S32  GetFrame( U32 idx, rplidar_reading_t* rdn, S64* ts );
+
+  //
+  // split every frame back into rplidar_reading_pkt sub packets and
+  // feed them to the sink, e.g. RPLidarProxy::ReceiveMessage.
+  //
+  // speed  -  1.0 for real-time, 2.0 for twice as fast, etc.
+  //           0 or less for as fast as possible.
+  //
+  // stop   -  optional sentinel checked between frames.
+  //
+  // returns the number of frames replayed.
+  //
+  U32  Replay( EventSinkPure* sink, DBL speed, volatile S32* stop = NULL );
+
+
+private:
+  S32  _BuildIndex();
+
+
+private:
+  S32      _fd;
+  U8*      _base;
+  U64      _size;
+
+  STDVEC<rplidar_log_idx_t>  _idx;
+
+};  // class RPLidarLogReader
+
+
+
+
+//
+// replays a log on a separate thread, optionally looping.
+//
+class RPLidarLogPlayer
+{
+public:
+  RPLidarLogPlayer();
+  ~RPLidarLogPlayer();
+
+  S32  Init( const char* path, EventSinkPure* sink, DBL speed, bool loop );
+
+  // attributes of the replay thread, see XThread::SetAttr
+  void SetThreadAttr( const XTHREADATTR* attr );
+
+  void Start();
+  void Stop();
+
+  void Run();
+
+
+private:
+  RPLidarLogReader  _reader;
+  XThread*          _thread;
+  bool              _hasThreadAttr;
+  XTHREADATTR       _threadAttr;
+  EventSinkPure*    _sink;
+  DBL               _speed;
+  bool              _loop;
+  volatile S32      _stop;
+
+};  // class RPLidarLogPlayer
+
+
+
+
+#endif // __RPLIDARLOG_H__
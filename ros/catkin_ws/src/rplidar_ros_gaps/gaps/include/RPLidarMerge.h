@@ -0,0 +1,115 @@
+#ifndef __RPLIDARMERGE_H__
+#define __RPLIDARMERGE_H__
+#pragma once
+#include <XCommon.h>
+#include <RPLidarProxyStuff.h>
+
+
+
+
+
+
+#define _MERGE_MAX_SOURCES_  ( 4 )
+#define _MERGE_TURN_Q6_      ( 360 * 64 )  // a full turn in the readings' angle units
+
+
+
+
+//
+// merges the readings of several lidars into one scan around the origin
+// of a common frame, e.g. base_link with one A2 at the front and one at
+// the rear.
+//
+// each source is placed by a static extrinsic: the x, y and yaw of the
+// frame its own rplidarGapsNode would publish its LaserScan in (angle
+// pi at the lidar's 0 degrees, or -pi when inverted), as a urdf puts it.
+// every return is moved into the common frame and binned by its bearing
+// from the origin; a bin keeps the nearest return.
+//
+// the first source that isn't stale paces the output: when it completes
+// a scan, Add says so and Merge bins the latest scan of every source
+// that began within the max skew of it.  a source that is late or gone
+// is left out, never waited for, and a paced source that falls silent
+// hands the pace to the next one.
+//
+// Merge writes into plain float arrays, which the node points at the
+// ranges and intensities of the LaserScan it is about to publish.
+//
+class RPLidarMerge
+{
+public:
+  RPLidarMerge();
+  ~RPLidarMerge();
+
+  // bins evenly over a full turn from -pi.  ranges outside
+  // [ rangeMin, rangeMax ], as the lidar measured them, are dropped.
+  // return 1 if successful
+  S32  Init( U32 sources, U32 bins, FLT rangeMin, FLT rangeMax );
+
+  // meters and radians in the common frame
+  void SetExtrinsic( U32 source, FLT x, FLT y, FLT yaw, bool inverted );
+
+  // nanoseconds between the begin of two scans merged together.  a
+  // source is stale after twice that without a scan
+  void SetMaxSkew( S64 maxSkew );
+
+  // keep rdn as source's latest scan.  begTs and endTs are when it was
+  // taken on our CLOCK_MONOTONIC, see RPLidarClock::ToLocal.
+  // return 1 if it's time to Merge
+  // return 0 otherwise
+  S32  Add( U32 source, const rplidar_reading_t* rdn, S64 begTs, S64 endTs );
+
+  // bin the aligned scans into ranges and intensities, GetBins() of
+  // each.  ranges in meters, inf where nothing returned.  begTs and endTs
+  // span the scans merged.
+  // return a mask of the sources merged
+  U32  Merge( float* ranges, float* intensities, S64* begTs, S64* endTs );
+
+  U32  GetBins();
+  FLT  GetAngleMin();
+  FLT  GetAngleInc();
+
+
+private:
+  typedef struct Source
+  {
+    S32                _base;     // angle of the lidar's 0 degrees, q6 in the common frame
+    S32                _dir;      // -1, or 1 when inverted
+    FLT                _x;
+    FLT                _y;
+    bool               _has;
+    S64                _begTs;
+    S64                _endTs;
+    rplidar_reading_t  _rdn;
+  } Source_t;
+
+  void _Bin( const Source_t& src, float* ranges, float* intensities );
+
+
+private:
+  U32       _count;
+  U32       _bins;
+  FLT       _rangeMin;
+  FLT       _rangeMax;
+  S64       _maxSkew;
+  S32       _pace;
+
+  Source_t  _src[_MERGE_MAX_SOURCES_];
+
+  // cos and sin of every q6 angle
+  STDVEC<FLT>  _cos;
+  STDVEC<FLT>  _sin;
+
+  // one source's returns, a field per array so the loops vectorize
+  FLT       _px[_NODE_COUNT_];
+  FLT       _py[_NODE_COUNT_];
+  FLT       _pq[_NODE_COUNT_];
+  FLT       _pr[_NODE_COUNT_];
+  S32       _pb[_NODE_COUNT_];
+
+};  // class RPLidarMerge
+
+
+
+
+#endif // __RPLIDARMERGE_H__
@@ -4,6 +4,8 @@
 #include <XCommon.h>
 #include <Udp.h>
 #include <RPLidarProxyStuff.h>
+#include <RPLidarLog.h>
+#include <RPLidarClock.h>
 
 
 
@@ -38,12 +40,24 @@ public:
 
 public:
   RPLidarProxy();
-  ~RPLidarProxy();
+  virtual ~RPLidarProxy();
 
   S32  Init( S32 port );
 
   void SetVerbose( S32 verbose );
 
+  // completed readings are appended to rec, NULL to stop recording.
+  // rec is written from the udp receive thread.
+  void SetRecorder( RPLidarLogWriter* rec );
+
+  // clock sync pongs share the readings' port and are handed to clk,
+  // which also learns the streamer's address from the first reading.
+  // NULL to ignore them.
+  void SetClock( RPLidarClock* clk );
+
+  // attributes of the udp receive thread, see XThread::SetAttr
+  void SetThreadAttr( const XTHREADATTR* attr );
+
   void Start();
   void Stop();
 
@@ -62,6 +76,9 @@ private:
 
   S32      _verbose;
 
+  RPLidarLogWriter*  _recorder;
+  RPLidarClock*      _clock;
+
   S32      _port;
   U32      _msgCnt;
 
@@ -28,7 +28,7 @@
 //
 typedef struct rplidar_reading
 {
-  // all timestamps in nanoseconds
+  // all timestamps in monotonic nanoseconds, see hal/clock.h
   U32 _seq;
   U32 _ascend;  // sorted?
   U32 _count;
@@ -55,7 +55,7 @@ typedef struct rplidar_reading
 
 typedef struct __attribute__((__packed__)) rplidar_reading_pkt
 {
-  // all timestamps in nanoseconds
+  // all timestamps in monotonic nanoseconds, see hal/clock.h
   U32 _seq;
   U32 _subSeq;
   U32 _ascend;
@@ -82,6 +82,44 @@ typedef struct __attribute__((__packed__)) rplidar_reading_pkt
 } rplidar_reading_pkt_t;
 
 
+//
+// clock sync, NTP style.  the node pings the streamer's clock server,
+// which answers to _replyPort on the node, i.e. on the same socket the
+// readings arrive on.  the size tells the two packet kinds apart.
+// times are monotonic nanoseconds (rp::hal::clock_now) of the host that
+// took them, as are the readings' _scanBegTs and _scanEndTs.  the magic
+// changed with the switch from CLOCK_REALTIME, so an older peer is
+// ignored and the node stamps on arrival rather than mixing clocks.
+//
+#define _CLOCK_MAGIC_  ( 0x4D435052 )  // "RPCM"
+#define _CLOCK_PING_   ( 1 )
+#define _CLOCK_PONG_   ( 2 )
+
+
+typedef struct __attribute__((__packed__)) rplidar_clock_pkt
+{
+  U32 _magic;
+  U32 _type;
+  U32 _seq;
+  U32 _replyPort;
+  S64 _t1;  // ping sent, node clock
+  S64 _t2;  // ping received, streamer clock
+  S64 _t3;  // pong sent, streamer clock
+
+  rplidar_clock_pkt(
+    ):
+    _magic( _CLOCK_MAGIC_ ),
+    _type( 0 ),
+    _seq( 0 ),
+    _replyPort( 0 ),
+    _t1( 0 ),
+    _t2( 0 ),
+    _t3( 0 )
+  {
+  }
+} rplidar_clock_pkt_t;
+
+
 #endif  // !__RPLIDAR_PROXY_STUFF__
 
 
@@ -0,0 +1,58 @@
+
+
+
+#ifndef __RPLIDARSCAN_H__
+#define __RPLIDARSCAN_H__
+#pragma once
+#include <XCommon.h>
+#include <rplidar.h>  //RPLIDAR standard sdk all-in-one header
+#include <RPLidarProxyStuff.h>
+
+
+
+
+
+
+//
+// turning an rplidar_reading into LaserScan data, kept free of ros so
+// the node and rplidarGapsBench run the same code.
+//
+class RPLidarScan
+{
+public:
+  // bin the valid nodes of rdn by whole degree into out, which is
+  // cleared first.  count is how many of rdn's nodes to look at.
+  static void AngleCompensate(
+    const rplidar_reading_t* rdn,
+    U32 count,
+    rplidar_response_measurement_node_t* out,
+    U32 outCount
+    );
+
+  // copy rdn into nodes and find the first and last valid node.
+  // return 1 if successful
+  // return 0 if no node is valid, start/end then span all count nodes
+  static S32 CopyNodes(
+    const rplidar_reading_t* rdn,
+    U32 count,
+    rplidar_response_measurement_node_t* nodes,
+    U32* startNode,
+    U32* endNode
+    );
+
+  // ranges in meters, inf where there is no return.  with reverse the
+  // output is written back to front.
+  static void FillRanges(
+    const rplidar_response_measurement_node_t* nodes,
+    size_t count,
+    bool   reverse,
+    float* ranges,
+    float* intensities
+    );
+
+};  // class RPLidarScan
+
+
+
+
+#endif // __RPLIDARSCAN_H__
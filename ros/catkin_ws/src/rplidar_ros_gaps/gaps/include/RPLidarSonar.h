@@ -0,0 +1,144 @@
+#ifndef __RPLIDARSONAR_H__
+#define __RPLIDARSONAR_H__
+#pragma once
+#include <XCommon.h>
+#include <XMutex.h>
+#include <XThread.h>
+#include "hal/abs_rxtx.h"
+
+
+
+
+
+
+#define _SONAR_MAX_SENSORS_  ( 8 )
+#define _SONAR_FRAME_SIZE_   ( 13 )
+
+#define _SONAR_OK_           ( 0 )  // frame status, see UltrasonicFront.ino
+#define _SONAR_NO_ANSWER_    ( 1 )
+#define _SONAR_TIMEOUT_      ( 2 )
+
+
+
+
+typedef struct RPLidarSonarReading
+{
+  U32 _sensor;
+  U32 _status;
+  U32 _fireMs;   // arduino millis() when the sensor was fired
+  FLT _range;    // meters, inf when nothing echoed
+  S64 _recvTs;   // CLOCK_MONOTONIC nanoseconds the frame arrived
+
+  RPLidarSonarReading(
+    ):
+    _sensor( 0 ),
+    _status( 0 ),
+    _fireMs( 0 ),
+    _range( 0 ),
+    _recvTs( 0 )
+  {
+  }
+} RPLidarSonarReading_t;
+
+
+
+
+//
+// reads the ultrasonic frames UltrasonicFront.ino sends over the sdk's
+// serial hal and keeps the latest reading of every sensor.
+//
+// each sensor can be given the sector of the scan it looks over, in the
+// LaserScan's own angles.  Fuse then lowers the ranges of those beams to
+// the sonar's, for glass and things below the lidar's plane; a sonar
+// reading never makes a beam longer.  it holds the lock only to copy the
+// readings, so the publish path pays a few microseconds.
+//
+// Feed takes the bytes and their arrival time from any source, the
+// receive thread, a test or a captured stream, not only the port.
+//
+class RPLidarSonar
+{
+public:
+  RPLidarSonar();
+  ~RPLidarSonar();
+
+  // return 1 if successful
+  S32  Init( const char* port, U32 baudrate );
+
+  // yaw is the middle of the sensor's cone and fov its full width, both
+  // radians in the scan's angles.  sensors with no sector aren't fused
+  void SetSector( U32 sensor, FLT yaw, FLT fov );
+
+  // readings older than this many seconds aren't fused
+  void SetMaxAge( DBL maxAge );
+
+  // attributes of the receive thread, see XThread::SetAttr
+  void SetThreadAttr( const XTHREADATTR* attr );
+
+  void Start();
+  void Stop();
+
+  void Run();
+
+  // parse bytes off the port, recvTs is when they arrived
+  void Feed( const U8* data, U32 len, S64 recvTs );
+
+  // return 1 if sensor has a reading not returned before
+  // return 0 otherwise
+  S32  GetReading( U32 sensor, RPLidarSonarReading_t* rdn );
+
+  // lower ranges[ idx ], at angleMin + idx * angleInc, to the range of
+  // every fresh sensor looking that way.  now is CLOCK_MONOTONIC.
+  // return the number of beams lowered
+  U32  Fuse( float* ranges, U32 count, float angleMin, float angleInc, S64 now );
+
+  U32  GetFrameCnt();
+  U32  GetBadCnt();   // bytes skipped finding frames, bad crc included
+  U32  GetLostCnt();  // frames missing from the sequence
+
+
+private:
+  typedef struct Sensor
+  {
+    bool                   _hasSector;
+    FLT                    _yaw;
+    FLT                    _fov;
+    bool                   _new;
+    RPLidarSonarReading_t  _rdn;
+  } Sensor_t;
+
+  void _Parse( const U8* frame, S64 recvTs );
+
+  static U8 _Crc8( const U8* data, U32 len );
+
+
+private:
+  rp::hal::serial_rxtx*  _rxtx;
+  STDSTR        _port;
+  U32           _baudrate;
+
+  XThread*      _thread;
+  bool          _hasThreadAttr;
+  XTHREADATTR   _threadAttr;
+  volatile S32  _stop;
+
+  XMutex        _mtx;
+  Sensor_t      _sensors[_SONAR_MAX_SENSORS_];
+  S64           _maxAge;
+
+  // receive thread only
+  U8            _buf[_SONAR_FRAME_SIZE_ * 4];
+  U32           _bufLen;
+  bool          _hasSeq;
+  U8            _seq;
+
+  volatile U32  _frameCnt;
+  volatile U32  _badCnt;
+  volatile U32  _lostCnt;
+
+};  // class RPLidarSonar
+
+
+
+
+#endif // __RPLIDARSONAR_H__
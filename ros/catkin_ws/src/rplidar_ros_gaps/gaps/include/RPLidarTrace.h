@@ -0,0 +1,109 @@
+
+
+
+#ifndef __RPLIDARTRACE_H__
+#define __RPLIDARTRACE_H__
+#pragma once
+#include <XCommon.h>
+
+
+
+
+
+
+//
+// per-stage latency tracing from serial byte to published LaserScan.
+//
+// every thread that hits a tracepoint gets its own ring of records,
+// so recording is a clock read plus a few stores, with no locks and
+// no shared cache lines.  rings wrap; Dump writes whatever is left.
+//
+// stages 0-3 are keyed by the sdk driver's scan id.  the streamer's
+// send record carries both the reading _seq and the scan id it was
+// grabbed as, which links them to stages 4-8, keyed by _seq.
+//
+#define _TRACE_DECODE_       ( 0 )  // sdk: node completing the scan off the wire
+#define _TRACE_SDK_PUBLISH_  ( 1 )  // sdk: scan cached for grabScanData
+#define _TRACE_GRAB_         ( 2 )  // sdk: grabScanData returned it
+#define _TRACE_CAPTURE_      ( 3 )  // RPLidar::GetReading filled the reading
+#define _TRACE_SEND_         ( 4 )  // streamer starts sending the sub packets
+#define _TRACE_RECV_         ( 5 )  // last sub packet received by UDPRecv
+#define _TRACE_COMPLETE_     ( 6 )  // RPLidarProxy reassembled the reading
+#define _TRACE_GETREADING_   ( 7 )  // RPLidarProxy::GetReading returned it
+#define _TRACE_PUBLISH_      ( 8 )  // LaserScan published
+#define _TRACE_STAGE_COUNT_  ( 9 )
+
+#define _TRACE_MAGIC_        ( 0x52545052 )  // "RPTR"
+#define _TRACE_VERSION_      ( 1 )
+#define _TRACE_MAX_RINGS_    ( 64 )
+
+
+typedef struct __attribute__((__packed__)) rplidar_trace_rec
+{
+  S64 _ts;      // monotonic nanoseconds
+  U32 _key;     // sdk scan id for stages 0-3, reading _seq otherwise
+  U32 _aux;     // _TRACE_SEND_: sdk scan id of the reading
+  U16 _stage;
+  U16 _ring;    // which thread recorded it
+} rplidar_trace_rec_t;
+
+
+typedef struct __attribute__((__packed__)) rplidar_trace_hdr
+{
+  U32 _magic;
+  U16 _version;
+  U16 _ringCount;
+  U64 _recCount;
+  S64 _monoTs;  // clock pair taken at dump time, lets the dump tool
+  S64 _sysTs;   // line up files written on different hosts
+} rplidar_trace_hdr_t;
+
+
+
+
+class RPLidarTrace
+{
+public:
+  // ringSize is rounded up to a power of 2.  installs the sdk hook.
+  static void Enable( U32 ringSize = 65536 );
+  static void Disable();
+
+  static void Record( U32 stage, U32 key, U32 aux = 0, S64 ts = 0 );
+
+  // last sdk scan id grabbed on the calling thread
+  static U32  LastKey();
+
+  // returns the number of records written, -1 on error
+  static S64  Dump( const char* path );
+
+  static const char* StageName( U32 stage );
+
+  static volatile S32 _enabled;
+
+};  // class RPLidarTrace
+
+
+
+
+#define RPLIDAR_TRACE( _stage_, _key_, _aux_ )                      \
+  do                                                                \
+  {                                                                 \
+    if ( __builtin_expect( RPLidarTrace::_enabled, 0 ) )            \
+    {                                                               \
+      RPLidarTrace::Record( ( _stage_ ), ( _key_ ), ( _aux_ ) );    \
+    }                                                               \
+  } while ( 0 )
+
+#define RPLIDAR_TRACE_TS( _stage_, _key_, _ts_ )                    \
+  do                                                                \
+  {                                                                 \
+    if ( __builtin_expect( RPLidarTrace::_enabled, 0 ) )            \
+    {                                                               \
+      RPLidarTrace::Record( ( _stage_ ), ( _key_ ), 0, ( _ts_ ) );  \
+    }                                                               \
+  } while ( 0 )
+
+
+
+
+#endif // __RPLIDARTRACE_H__
@@ -121,7 +121,8 @@ typedef struct UDPMSG
   UDPMSG(
     ):
     pMsg(NULL),
-    ulCbMsg(0L)
+    ulCbMsg(0L),
+    llRecvTs(0LL)
   {
     szSrcIP[0] = '\0';
   }
@@ -132,6 +133,7 @@ typedef struct UDPMSG
   char     szSrcIP[XIPADDRSTR_CCH];
   PVOID    pMsg;
   U32      ulCbMsg;
+  S64      llRecvTs;  // CLOCK_MONOTONIC nanoseconds, taken right after recvfrom
 
 } *PUDPMSG;
 
@@ -319,6 +321,15 @@ public:
     EventSinkPure*  pxes  // IN
     );
 
+  //
+  // Attributes of the receive thread StartListen creates, NULL for the
+  // defaults.  See XThread::SetAttr.
+  //
+  void
+  SetThreadAttr(
+    const XTHREADATTR*  pAttr  // IN_OPT
+    );
+
   XRESULT
   StartListen(
     );
@@ -352,6 +363,9 @@ private:
   XThread*         m_pxth;
   EventSinkPure*  m_pxes;
 
+  bool         m_bHasAttr;
+  XTHREADATTR  m_attr;
+
   S32   m_pipefd[2];
   S32   m_iFD;
 
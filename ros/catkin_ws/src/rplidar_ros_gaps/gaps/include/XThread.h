@@ -69,6 +69,20 @@ typedef struct _XTHREADARG
 typedef PVOID (*XTHREADFUNC)(PVOID);  // thread function type.
 
 
+//
+// attributes a thread is created with.  zeroed fields are left at the
+// system default.
+//
+typedef struct _XTHREADATTR
+{
+  char    szName[16];   // up to 15 characters, shown by top and perf
+  S32     iPolicy;      // SCHED_OTHER, SCHED_FIFO or SCHED_RR
+  S32     iPriority;    // 1 to 99 under SCHED_FIFO and SCHED_RR
+  U64     ullCpuMask;   // bit n lets it run on cpu n, 0 for any
+  SIZE_T  ulStackSize;  // bytes, 0 for the default
+} XTHREADATTR, *PXTHREADATTR;
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -192,6 +206,9 @@ private:
   THREADFUNC  m_func;       // thread start-up function.
   THREADARG   m_arg;        // thread function argument.
 
+  bool         m_bHasAttr;  // m_attr is used by Run.
+  XTHREADATTR  m_attr;
+
 
 public:
   XThread();
@@ -199,6 +216,15 @@ public:
   virtual ~XThread();
 
 
+  //
+  // Attributes the thread is created with by the next Run, NULL for the
+  // system defaults.  If the process may not use them (a realtime policy
+  // without CAP_SYS_NICE, a cpu that isn't there) Run warns and creates
+  // the thread with the defaults, still named.
+  //
+  void
+  SetAttr(const XTHREADATTR* pAttr);
+
   void
   Run(THREADFUNC func, PVOID pv);
 
@@ -231,6 +257,29 @@ public:
   void
   Sleep(U32 ulMsec);
 
+  //
+  // Applies pAttr to the calling thread, the stack size aside.  Returns 0
+  // or the error number of the first call that failed.
+  //
+  static
+  S32
+  ApplyToSelf(const XTHREADATTR* pAttr);
+
+  //
+  // "2,3" or "0-3,6" to a cpu mask, "" to 0.  Returns false if malformed.
+  //
+  static
+  bool
+  ParseCpuList(const char* pszList, U64* pullMask);
+
+  //
+  // "other", "fifo" or "rr" to SCHED_OTHER, SCHED_FIFO or SCHED_RR.
+  // Returns -1 if unknown.
+  //
+  static
+  S32
+  ParsePolicy(const char* pszPolicy);
+
 
 };  // XThread
 
@@ -1,15 +1,7 @@
 #include <RPLidar.h>
-
-
-// returns nanoseconds
-inline S64 __getsystime()
-{
-  timespec time;
-  clock_gettime(CLOCK_REALTIME, &time);
-  return (((S64)time.tv_sec) * 1000000000ULL + (S64)time.tv_nsec);
-}
-
-
+#include <RPLidarTrace.h>
+#include "hal/thread.h"
+#include "hal/clock.h"
 
 
 RPLidar::RPLidar(
@@ -278,7 +270,7 @@ S32 RPLidar::GetReading( rplidar_reading_t* rdn )
     rplidar_response_measurement_node_t  nodes[_NODE_COUNT_];
     rplidar_response_measurement_node_t* node;
     U64 count = _NODE_COUNT_;
-    S64 begts = __getsystime();
+    S64 begts = (S64)rp::hal::clock_now();
     S64 endts = 0;
     u_result res;
 
@@ -288,7 +280,7 @@ S32 RPLidar::GetReading( rplidar_reading_t* rdn )
       goto Exit;
     }
 
-    endts = __getsystime();
+    endts = (S64)rp::hal::clock_now();
 
     rdn->_seq       = 0;
     rdn->_ascend    = 1;
@@ -317,6 +309,8 @@ S32 RPLidar::GetReading( rplidar_reading_t* rdn )
       rdn->_qua[idx] = 0;
     }
 
+    RPLIDAR_TRACE( _TRACE_CAPTURE_, RPLidarTrace::LastKey(), 0 );
+
     ret = 1;
   }
 
@@ -325,6 +319,65 @@ Exit:
 }
 
 
+S32
+RPLidar::SendReading( UDPSend* snd, const rplidar_reading_t* rdn )
+{
+  S32 ret = -1;
+  rplidar_reading_pkt_t pkt;
+
+  pkt._seq       = rdn->_seq;
+  pkt._ascend    = rdn->_ascend;
+  pkt._count     = rdn->_count;
+  pkt._scanBegTs = rdn->_scanBegTs;
+  pkt._scanEndTs = rdn->_scanEndTs;
+
+  RPLIDAR_TRACE( _TRACE_SEND_, rdn->_seq, RPLidarTrace::LastKey() );
+
+  for ( U32 sub = _BEG_SUB_SEQ_; sub <= _END_SUB_SEQ_; ++sub )
+  {
+    U32 base = ( sub * _PKT_NODE_COUNT_ );
+
+    pkt._subSeq = sub;
+    memcpy( pkt._agl, &rdn->_agl[base], sizeof( pkt._agl ) );
+    memcpy( pkt._dst, &rdn->_dst[base], sizeof( pkt._dst ) );
+    memcpy( pkt._qua, &rdn->_qua[base], sizeof( pkt._qua ) );
+
+    if ( X_FAILURE( snd->Send( &pkt, sizeof( pkt ), NULL ) ) )
+    {
+      fprintf( stderr, "[RPLidar::SendReading] send %u|%u failed.\n", rdn->_seq, sub );
+      goto Exit;
+    }
+  }
+
+  ret = 1;
+
+Exit:
+  return ret;
+}
+
+
+void
+RPLidar::SetThreadAttr( const XTHREADATTR* attr )
+{
+  rp::hal::Thread::thread_attr_t hal;
+
+  if ( attr == NULL )
+  {
+    rp::hal::Thread::setDefaultAttr( NULL );
+    return;
+  }
+
+  hal.name       = ( attr->szName[0] != '\0' ? attr->szName : NULL );
+  hal.policy     = ( attr->iPolicy == SCHED_FIFO ? rp::hal::Thread::SCHEDULE_FIFO :
+                     attr->iPolicy == SCHED_RR   ? rp::hal::Thread::SCHEDULE_RR :
+                                                   rp::hal::Thread::SCHEDULE_OTHER );
+  hal.priority   = attr->iPriority;
+  hal.cpu_mask   = attr->ullCpuMask;
+  hal.stack_size = attr->ulStackSize;
+  rp::hal::Thread::setDefaultAttr( &hal );
+}
+
+
 S32
 RPLidar::Start()
 {
@@ -0,0 +1,410 @@
+#include <RPLidarClock.h>
+#include <unistd.h>
+#include "hal/clock.h"
+
+
+#define _PING_BURST_      ( 8 )             // fast pings right after start
+#define _PONG_MAX_RTT_    ( 1000000000LL )  // older pongs are dropped
+#define _DRIFT_MIN_SPAN_  ( 8000000000LL )  // fit time span before drift is used
+
+
+static
+PVOID
+InvokePingFunction(
+  PVOID  pv
+  )
+{
+  PXTHREADARG    pxarg  = (PXTHREADARG)pv;
+  RPLidarClock*  pclock = (RPLidarClock*)pxarg->pv;
+
+  pclock->Run();
+
+  return NULL;
+}
+
+
+
+
+RPLidarClockServer::RPLidarClockServer(
+  ):
+  _udprecv(),
+  _udpsend(),
+  _peerIP(),
+  _peerPort( 0 ),
+  _offset( 0 ),
+  _pingCnt( 0 )
+{
+}
+
+
+RPLidarClockServer::~RPLidarClockServer(
+  )
+{
+}
+
+
+S32 RPLidarClockServer::Init( S32 port )
+{
+  S32      ret = -1;
+  XRESULT  xr;
+
+  xr = _udprecv.Init( NULL, port, true );
+  if ( X_FAILURE( xr ) )
+  {
+    fprintf( stderr, "[RPLidarClockServer::Init] unable to listen on %d.\n", port );
+    goto Exit;
+  }
+
+  _udprecv.SetCallback( this );
+
+  ret = 1;
+
+Exit:
+  return ret;
+}
+
+
+void RPLidarClockServer::SetOffset( S64 offset )
+{
+  _offset = offset;
+}
+
+
+void RPLidarClockServer::Start()
+{
+  _udprecv.StartListen();
+}
+
+
+void RPLidarClockServer::Stop()
+{
+  _udprecv.StopListen();
+}
+
+
+void RPLidarClockServer::ReceiveMessage( PUDPMSG pMsg )
+{
+  rplidar_clock_pkt_t* pkt = (rplidar_clock_pkt_t*)pMsg->pMsg;
+  rplidar_clock_pkt_t  pong;
+
+  if ( sizeof( rplidar_clock_pkt_t ) != pMsg->ulCbMsg ||
+       pkt->_magic != _CLOCK_MAGIC_ || pkt->_type != _CLOCK_PING_ )
+  {
+    return;
+  }
+
+  pong       = *pkt;
+  pong._type = _CLOCK_PONG_;
+  pong._t2   = pMsg->llRecvTs + _offset;
+
+  // a node restarting on another port or host moves the reply channel
+  if ( _peerIP != pMsg->szSrcIP || _peerPort != pkt->_replyPort )
+  {
+    Channel chnl;
+
+    _udpsend.DeInit();
+    _peerIP   = pMsg->szSrcIP;
+    _peerPort = pkt->_replyPort;
+
+    if ( X_FAILURE( chnl.Init( _peerIP.c_str(), _peerPort ) ) ||
+         X_FAILURE( _udpsend.Init() ) ||
+         X_FAILURE( _udpsend.AddChannel( chnl ) ) )
+    {
+      fprintf( stderr, "[RPLidarClockServer::ReceiveMessage] unable to reply to %s:%u.\n",
+               _peerIP.c_str(), _peerPort );
+      _peerIP.clear();
+      return;
+    }
+  }
+
+  pong._t3 = (S64)rp::hal::clock_now() + _offset;
+  _udpsend.Send( &pong, sizeof( pong ), NULL );
+
+  ++_pingCnt;
+}
+
+
+U32 RPLidarClockServer::GetPingCnt()
+{
+  return _pingCnt;
+}
+
+
+
+
+RPLidarClock::RPLidarClock(
+  ):
+  _thread( NULL ),
+  _hasThreadAttr( false ),
+  _threadAttr(),
+  _stop( 0 ),
+  _mtx(),
+  _hasHost( false ),
+  _host(),
+  _port( 0 ),
+  _replyPort( 0 ),
+  _interval( 1.0 ),
+  _udpsend(),
+  _chnlOK( false ),
+  _seq( 0 ),
+  _filterCnt( 0 ),
+  _lastUsedTs( 0 ),
+  _fitCnt( 0 ),
+  _synced( false ),
+  _tref( 0 ),
+  _a( 0 ),
+  _b( 0 ),
+  _delay( 0 )
+{
+}
+
+
+RPLidarClock::~RPLidarClock()
+{
+  Stop();
+}
+
+
+S32 RPLidarClock::Init( const char* host, S32 port, S32 replyPort, DBL interval )
+{
+  _port      = port;
+  _replyPort = replyPort;
+  _interval  = ( interval > 0 ? interval : 1.0 );
+
+  if ( host != NULL && host[0] != '\0' )
+  {
+    SetHost( host );
+  }
+
+  return 1;
+}
+
+
+void RPLidarClock::SetHost( const char* host )
+{
+  XScopedMutex lock( &_mtx );
+
+  _host    = host;
+  _hasHost = true;
+}
+
+
+bool RPLidarClock::HasHost()
+{
+  return _hasHost;
+}
+
+
+void RPLidarClock::SetThreadAttr( const XTHREADATTR* attr )
+{
+  _hasThreadAttr = ( attr != NULL );
+  if ( _hasThreadAttr )
+  {
+    _threadAttr = *attr;
+  }
+}
+
+
+void RPLidarClock::Start()
+{
+  Stop();
+
+  _stop   = 0;
+  _thread = new XThread();
+  _thread->SetAttr( _hasThreadAttr ? &_threadAttr : NULL );
+  _thread->Run( InvokePingFunction, this );
+}
+
+
+void RPLidarClock::Stop()
+{
+  if ( _thread != NULL )
+  {
+    _stop = 1;
+    _thread->Join();
+    delete _thread;
+    _thread = NULL;
+  }
+}
+
+
+void RPLidarClock::Run()
+{
+  S64 next = (S64)rp::hal::clock_now();
+
+  while ( !_stop )
+  {
+    if ( (S64)rp::hal::clock_now() < next )
+    {
+      usleep( 10000 );
+      continue;
+    }
+
+    if ( _hasHost )
+    {
+      _SendPing();
+    }
+
+    next += (S64)( ( _seq <= _PING_BURST_ ? _interval / _PING_BURST_ : _interval ) * 1e9 );
+  }
+}
+
+
+void RPLidarClock::_SendPing()
+{
+  rplidar_clock_pkt_t ping;
+
+  if ( !_chnlOK )
+  {
+    Channel chnl;
+    STDSTR  host;
+
+    {
+      XScopedMutex lock( &_mtx );
+      host = _host;
+    }
+
+    if ( X_FAILURE( chnl.Init( host.c_str(), _port ) ) ||
+         X_FAILURE( _udpsend.Init() ) ||
+         X_FAILURE( _udpsend.AddChannel( chnl ) ) )
+    {
+      fprintf( stderr, "[RPLidarClock::_SendPing] unable to reach %s:%d.\n", host.c_str(), _port );
+      _udpsend.DeInit();
+      return;
+    }
+
+    printf( "[RPLidarClock::_SendPing] syncing with %s:%d.\n", host.c_str(), _port );
+    _chnlOK = true;
+  }
+
+  ping._type      = _CLOCK_PING_;
+  ping._seq       = ++_seq;
+  ping._replyPort = (U32)_replyPort;
+  ping._t1        = (S64)rp::hal::clock_now();
+
+  _udpsend.Send( &ping, sizeof( ping ), NULL );
+}
+
+
+void RPLidarClock::OnPong( const rplidar_clock_pkt_t* pkt, S64 recvTs )
+{
+  S64 t4 = recvTs;
+  Sample_t smp;
+  const Sample_t* best = NULL;
+
+  if ( t4 - pkt->_t1 > _PONG_MAX_RTT_ || t4 < pkt->_t1 )
+  {
+    return;
+  }
+
+  smp._ts     = pkt->_t1 + ( t4 - pkt->_t1 ) / 2;
+  smp._offset = ( ( pkt->_t2 - pkt->_t1 ) + ( pkt->_t3 - t4 ) ) / 2;
+  smp._delay  = ( t4 - pkt->_t1 ) - ( pkt->_t3 - pkt->_t2 );
+
+  if ( smp._delay < 0 )
+  {
+    return;
+  }
+
+  XScopedMutex lock( &_mtx );
+
+  _filter[_filterCnt % _CLOCK_FILTER_SIZE_] = smp;
+  ++_filterCnt;
+
+  for ( U32 idx = 0; idx < std::min( _filterCnt, (U32)_CLOCK_FILTER_SIZE_ ); ++idx )
+  {
+    if ( best == NULL || _filter[idx]._delay < best->_delay )
+    {
+      best = &_filter[idx];
+    }
+  }
+
+  // the same sample can stay the best for a while, use it once
+  if ( best->_ts <= _lastUsedTs )
+  {
+    return;
+  }
+  _lastUsedTs = best->_ts;
+
+  _fit[_fitCnt % _CLOCK_FIT_SIZE_] = *best;
+  ++_fitCnt;
+  _delay = best->_delay;
+
+  _Fit();
+}
+
+
+// called locked
+void RPLidarClock::_Fit()
+{
+  U32 cnt = std::min( _fitCnt, (U32)_CLOCK_FIT_SIZE_ );
+  S64 tmin = 0, tmax = 0;
+  DBL st = 0, so = 0, stt = 0, sto = 0;
+
+  // newest sample as reference keeps the numbers small
+  _tref = _fit[( _fitCnt - 1 ) % _CLOCK_FIT_SIZE_]._ts;
+
+  for ( U32 idx = 0; idx < cnt; ++idx )
+  {
+    DBL t = ( _fit[idx]._ts - _tref ) * 1e-9;
+    DBL o = (DBL)( _fit[idx]._offset - _fit[0]._offset );
+
+    st  += t;
+    so  += o;
+    stt += t * t;
+    sto += t * o;
+
+    tmin = ( idx == 0 ? _fit[idx]._ts : std::min( tmin, _fit[idx]._ts ) );
+    tmax = ( idx == 0 ? _fit[idx]._ts : std::max( tmax, _fit[idx]._ts ) );
+  }
+
+  DBL den = ( cnt * stt - st * st );
+
+  if ( cnt >= 4 && tmax - tmin >= _DRIFT_MIN_SPAN_ && den > 0 )
+  {
+    // ns of offset per second
+    _b = ( cnt * sto - st * so ) / den;
+    _a = ( so - _b * st ) / cnt + _fit[0]._offset;
+  }
+  else
+  {
+    _b = 0;
+    _a = (DBL)_fit[( _fitCnt - 1 ) % _CLOCK_FIT_SIZE_]._offset;
+  }
+
+  _synced = true;
+}
+
+
+bool RPLidarClock::IsSynced()
+{
+  return _synced;
+}
+
+
+S64 RPLidarClock::ToLocal( S64 remoteTs )
+{
+  XScopedMutex lock( &_mtx );
+
+  if ( !_synced )
+  {
+    return remoteTs;
+  }
+
+  // the offset is a function of our time, which remoteTs - _a is
+  // close enough to
+  S64 t = remoteTs - (S64)_a;
+  return ( remoteTs - (S64)( _a + _b * ( t - _tref ) * 1e-9 ) );
+}
+
+
+S32 RPLidarClock::GetStats( DBL* offset, DBL* drift, DBL* delay )
+{
+  XScopedMutex lock( &_mtx );
+
+  *offset = _a * 1e-6;
+  *drift  = _b * 1e-3;
+  *delay  = _delay * 1e-6;
+
+  return ( _synced ? 1 : 0 );
+}
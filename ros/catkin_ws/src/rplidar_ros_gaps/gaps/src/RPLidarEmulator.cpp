@@ -0,0 +1,806 @@
+#include <RPLidarEmulator.h>
+#include <RPLidarLog.h>
+#include <XStrSafe.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <stddef.h>
+#include <termios.h>
+#include <time.h>
+#include "hal/clock.h"
+
+
+// keep at most this many bytes queued ahead of the pty
+#define _EMU_OUT_HIGH_WATER_  ( 4096 )
+
+// capsule layout, see rplidar_response_capsule_measurement_nodes_t
+#define _EMU_CAPSULE_NODES_   ( 32 )
+
+
+
+
+static
+PVOID
+InvokeEmulatorFunction(
+  PVOID  pv
+  )
+{
+  PXTHREADARG       pxarg = (PXTHREADARG)pv;
+  RPLidarEmulator*  pemu  = (RPLidarEmulator*)pxarg->pv;
+
+  pemu->Run();
+
+  return NULL;
+}
+
+
+
+
+RPLidarEmulator::RPLidarEmulator(
+  ):
+  _cfg(),
+  _fd( -1 ),
+  _slavefd( -1 ),
+  _thread( NULL ),
+  _stop( 0 ),
+  _scans(),
+  _scanIdx( 0 ),
+  _nodeIdx( 0 ),
+  _parse( PARSE_SYNC ),
+  _cmd( 0 ),
+  _size( 0 ),
+  _cksum( 0 ),
+  _payloadLen( 0 ),
+  _mode( MODE_IDLE ),
+  _firstCapsule( false ),
+  _modeTs( 0 ),
+  _units( 0 ),
+  _out(),
+  _outPos( 0 ),
+  _syncArmed( false ),
+  _syncPending( false ),
+  _syncOff( 0 ),
+  _scanCnt( 0 ),
+  _nodeCnt( 0 ),
+  _byteCnt( 0 ),
+  _cmdCnt( 0 ),
+  _dropCnt( 0 ),
+  _pwm( 0 ),
+  _lastSyncTs( 0 )
+{
+  _portName[0] = 0;
+}
+
+
+RPLidarEmulator::~RPLidarEmulator()
+{
+  Stop();
+
+  if ( _slavefd >= 0 )
+  {
+    close( _slavefd );
+    _slavefd = -1;
+  }
+  if ( _fd >= 0 )
+  {
+    close( _fd );
+    _fd = -1;
+  }
+}
+
+
+S32 RPLidarEmulator::Init( const Config_t& cfg, const char* logPath )
+{
+  S32 ret = -1;
+
+  _cfg = cfg;
+
+  if ( logPath != NULL && logPath[0] != 0 )
+  {
+    if ( 1 != _LoadLog( logPath ) )
+    {
+      goto Exit;
+    }
+  }
+  else
+  {
+    _MakeSynthetic();
+  }
+
+  if ( 1 != _OpenPty() )
+  {
+    goto Exit;
+  }
+
+  printf( "[RPLidarEmulator::Init] %s: %u rotations, %u samples/s, %u baud.\n",
+          _portName, (U32)_scans.size(), _cfg._sampleRate, _cfg._baudrate );
+
+  ret = 1;
+
+Exit:
+  return ret;
+}
+
+
+const char* RPLidarEmulator::GetPortName()
+{
+  return _portName;
+}
+
+
+void RPLidarEmulator::Start()
+{
+  Stop();
+
+  _stop   = 0;
+  _thread = new XThread();
+  _thread->Run( InvokeEmulatorFunction, this );
+}
+
+
+void RPLidarEmulator::Stop()
+{
+  if ( _thread != NULL )
+  {
+    _stop = 1;
+    _thread->Join();
+    delete _thread;
+    _thread = NULL;
+  }
+}
+
+
+U64 RPLidarEmulator::GetScanCount()
+{
+  return _scanCnt;
+}
+
+
+U64 RPLidarEmulator::GetNodeCount()
+{
+  return _nodeCnt;
+}
+
+
+U64 RPLidarEmulator::GetByteCount()
+{
+  return _byteCnt;
+}
+
+
+U64 RPLidarEmulator::GetCmdCount()
+{
+  return _cmdCnt;
+}
+
+
+U64 RPLidarEmulator::GetDropCount()
+{
+  return _dropCnt;
+}
+
+
+U16 RPLidarEmulator::GetMotorPWM()
+{
+  return _pwm;
+}
+
+
+S64 RPLidarEmulator::GetLastSyncTs()
+{
+  return _lastSyncTs;
+}
+
+
+
+
+S32 RPLidarEmulator::_OpenPty()
+{
+  S32 ret = -1;
+  const char* name;
+  termios tio;
+
+  _fd = posix_openpt( O_RDWR | O_NOCTTY );
+  if ( _fd < 0 )
+  {
+    fprintf( stderr, "[RPLidarEmulator::_OpenPty] posix_openpt failed, %s.\n",
+             strerror( errno ) );
+    goto Exit;
+  }
+
+  if ( 0 != grantpt( _fd ) || 0 != unlockpt( _fd ) ||
+       NULL == ( name = ptsname( _fd ) ) )
+  {
+    fprintf( stderr, "[RPLidarEmulator::_OpenPty] unable to unlock pty, %s.\n",
+             strerror( errno ) );
+    goto Exit;
+  }
+
+  XStrCopyA( _portName, sizeof( _portName ), name );
+
+  // the slave starts in cooked mode with echo on, which would loop
+  // everything we send straight back to us.  make it raw before the
+  // driver gets a chance to open it.
+  _slavefd = open( _portName, O_RDWR | O_NOCTTY );
+  if ( _slavefd < 0 )
+  {
+    fprintf( stderr, "[RPLidarEmulator::_OpenPty] unable to open %s, %s.\n",
+             _portName, strerror( errno ) );
+    goto Exit;
+  }
+
+  tcgetattr( _slavefd, &tio );
+  cfmakeraw( &tio );
+  tcsetattr( _slavefd, TCSANOW, &tio );
+
+  fcntl( _fd, F_SETFL, fcntl( _fd, F_GETFL ) | O_NONBLOCK );
+
+  ret = 1;
+
+Exit:
+  return ret;
+}
+
+
+S32 RPLidarEmulator::_LoadLog( const char* path )
+{
+  S32 ret = -1;
+  RPLidarLogReader reader;
+  rplidar_reading_t rdn;
+  S64 ts;
+
+  if ( 1 != reader.Open( path ) )
+  {
+    goto Exit;
+  }
+
+  for ( U32 idx = 0; idx < reader.GetFrameCount(); ++idx )
+  {
+    if ( 1 != reader.GetFrame( idx, &rdn, &ts ) || rdn._count == 0 )
+    {
+      continue;
+    }
+
+    _scans.push_back( STDVEC<rplidar_response_measurement_node_t>( rdn._count ) );
+
+    STDVEC<rplidar_response_measurement_node_t>& scan = _scans.back();
+
+    for ( U32 pos = 0; pos < rdn._count; ++pos )
+    {
+      // sync bits are redone when the node is sent
+      scan[pos].sync_quality      = ( rdn._qua[pos] & 0xFC );
+      scan[pos].angle_q6_checkbit = ( rdn._agl[pos] | RPLIDAR_RESP_MEASUREMENT_CHECKBIT );
+      scan[pos].distance_q2       = rdn._dst[pos];
+    }
+  }
+
+  if ( _scans.empty() )
+  {
+    fprintf( stderr, "[RPLidarEmulator::_LoadLog] %s has no usable frames.\n", path );
+    goto Exit;
+  }
+
+  ret = 1;
+
+Exit:
+  return ret;
+}
+
+
+//
+// a 6m x 4m room with the lidar off centre and a round pillar.
+// a few rotations with a little range noise so consecutive scans
+// are not byte identical.
+//
+void RPLidarEmulator::_MakeSynthetic()
+{
+  const U32 rotations = 8;
+  const U32 count     = ( _cfg._scanNodes > 0 ? _cfg._scanNodes : 400 );
+  const DBL xmin = -2.5, xmax = 3.5, ymin = -1.5, ymax = 2.5;
+  const DBL px = 1.5, py = 1.0, pr = 0.3;
+  U32 seed = 12345;
+
+  _scans.assign( rotations, STDVEC<rplidar_response_measurement_node_t>( count ) );
+
+  for ( U32 rot = 0; rot < rotations; ++rot )
+  {
+    for ( U32 pos = 0; pos < count; ++pos )
+    {
+      DBL agl = ( 2.0 * M_PI * pos ) / count;
+      DBL dx  = cos( agl );
+      DBL dy  = sin( agl );
+      DBL dst = 1e9;
+
+      // walls
+      if ( dx > 0 ) dst = std::min( dst, xmax / dx );
+      if ( dx < 0 ) dst = std::min( dst, xmin / dx );
+      if ( dy > 0 ) dst = std::min( dst, ymax / dy );
+      if ( dy < 0 ) dst = std::min( dst, ymin / dy );
+
+      // pillar
+      DBL b = dx * px + dy * py;
+      DBL c = px * px + py * py - pr * pr;
+      DBL d = b * b - c;
+      if ( d >= 0 && b - sqrt( d ) > 0 )
+      {
+        dst = std::min( dst, b - sqrt( d ) );
+      }
+
+      seed = seed * 1103515245 + 12345;
+      DBL mm = dst * 1000.0 + (DBL)( ( seed >> 16 ) % 9 ) - 4.0;
+
+      rplidar_response_measurement_node_t& node = _scans[rot][pos];
+      node.angle_q6_checkbit = (U16)( ( ( pos * 360 * 64 ) / count ) << RPLIDAR_RESP_MEASUREMENT_ANGLE_SHIFT ) |
+                               RPLIDAR_RESP_MEASUREMENT_CHECKBIT;
+      if ( mm > 0 && mm < 12000.0 )
+      {
+        node.distance_q2  = (U16)( mm * 4.0 );
+        node.sync_quality = ( 0x2F << RPLIDAR_RESP_MEASUREMENT_QUALITY_SHIFT );
+      }
+      else
+      {
+        node.distance_q2  = 0;
+        node.sync_quality = 0;
+      }
+    }
+  }
+}
+
+
+
+
+void RPLidarEmulator::Run()
+{
+  while ( !_stop )
+  {
+    S64     now  = (S64)rp::hal::clock_now();
+    S64     wait = 10000000LL;
+    pollfd  pfd;
+    timespec tmo;
+
+    if ( _mode != MODE_IDLE )
+    {
+      _Produce( now );
+    }
+    _Flush();
+
+    pfd.fd      = _fd;
+    pfd.events  = POLLIN;
+    pfd.revents = 0;
+
+    if ( _outPos < _out.size() )
+    {
+      pfd.events |= POLLOUT;
+    }
+    else if ( _mode != MODE_IDLE )
+    {
+      // come back when the next unit is due
+      if ( _cfg._sampleRate == 0 && _cfg._baudrate == 0 )
+      {
+        wait = 0;
+      }
+      else
+      {
+        wait = 250000;
+      }
+    }
+
+    tmo.tv_sec  = ( wait / 1000000000LL );
+    tmo.tv_nsec = ( wait % 1000000000LL );
+
+    if ( ppoll( &pfd, 1, &tmo, NULL ) > 0 && ( pfd.revents & POLLIN ) )
+    {
+      _ReadCommands();
+    }
+  }
+}
+
+
+void RPLidarEmulator::_ReadCommands()
+{
+  U8 buf[256];
+  S32 len;
+
+  while ( ( len = read( _fd, buf, sizeof( buf ) ) ) > 0 )
+  {
+    for ( S32 pos = 0; pos < len; ++pos )
+    {
+      U8 byte = buf[pos];
+
+      switch ( _parse )
+      {
+      case PARSE_SYNC:
+        if ( byte == RPLIDAR_CMD_SYNC_BYTE )
+        {
+          _parse = PARSE_CMD;
+        }
+        break;
+
+      case PARSE_CMD:
+        _cmd = byte;
+        if ( _cmd & RPLIDAR_CMDFLAG_HAS_PAYLOAD )
+        {
+          _cksum = ( RPLIDAR_CMD_SYNC_BYTE ^ _cmd );
+          _parse = PARSE_SIZE;
+        }
+        else
+        {
+          _HandleCommand( _cmd, NULL, 0 );
+          _parse = PARSE_SYNC;
+        }
+        break;
+
+      case PARSE_SIZE:
+        _size       = byte;
+        _payloadLen = 0;
+        _cksum     ^= byte;
+        _parse      = ( _size > 0 ? PARSE_PAYLOAD : PARSE_CHECKSUM );
+        break;
+
+      case PARSE_PAYLOAD:
+        _payload[_payloadLen++] = byte;
+        _cksum ^= byte;
+        if ( _payloadLen == _size )
+        {
+          _parse = PARSE_CHECKSUM;
+        }
+        break;
+
+      case PARSE_CHECKSUM:
+        if ( byte == _cksum )
+        {
+          _HandleCommand( _cmd, _payload, _payloadLen );
+        }
+        else if ( _cfg._verbose )
+        {
+          fprintf( stderr, "[RPLidarEmulator::_ReadCommands] bad checksum for 0x%02X.\n", _cmd );
+        }
+        _parse = PARSE_SYNC;
+        break;
+      }
+    }
+  }
+}
+
+
+void RPLidarEmulator::_HandleCommand( U8 cmd, const U8* payload, U32 size )
+{
+  ++_cmdCnt;
+
+  if ( _cfg._verbose )
+  {
+    printf( "[RPLidarEmulator::_HandleCommand] cmd=0x%02X size=%u.\n", cmd, size );
+  }
+
+  // everything except the motor pwm ends a running scan
+  if ( cmd != RPLIDAR_CMD_SET_MOTOR_PWM && _mode != MODE_IDLE )
+  {
+    _mode = MODE_IDLE;
+    _out.clear();
+    _outPos      = 0;
+    _syncArmed   = false;
+    _syncPending = false;
+  }
+
+  switch ( cmd )
+  {
+  case RPLIDAR_CMD_STOP:
+  case RPLIDAR_CMD_RESET:
+    break;
+
+  case RPLIDAR_CMD_SCAN:
+  case RPLIDAR_CMD_FORCE_SCAN:
+    _SendResponse( RPLIDAR_ANS_TYPE_MEASUREMENT,
+                   sizeof( rplidar_response_measurement_node_t ), true, NULL );
+    _StartScan( MODE_SCAN );
+    break;
+
+  case RPLIDAR_CMD_EXPRESS_SCAN:
+    if ( _cfg._firmware < ( ( 1 << 8 ) | 17 ) )
+    {
+      break;
+    }
+    _SendResponse( RPLIDAR_ANS_TYPE_MEASUREMENT_CAPSULED,
+                   sizeof( rplidar_response_capsule_measurement_nodes_t ), true, NULL );
+    _StartScan( MODE_EXPRESS );
+    break;
+
+  case RPLIDAR_CMD_GET_DEVICE_INFO:
+    {
+      rplidar_response_device_info_t info;
+      info.model            = _cfg._model;
+      info.firmware_version = _cfg._firmware;
+      info.hardware_version = _cfg._hardware;
+      for ( U32 idx = 0; idx < sizeof( info.serialnum ); ++idx )
+      {
+        info.serialnum[idx] = (U8)( 0xE0 + idx );
+      }
+      _SendResponse( RPLIDAR_ANS_TYPE_DEVINFO, sizeof( info ), false, &info );
+    }
+    break;
+
+  case RPLIDAR_CMD_GET_DEVICE_HEALTH:
+    {
+      rplidar_response_device_health_t health;
+      health.status     = RPLIDAR_STATUS_OK;
+      health.error_code = 0;
+      _SendResponse( RPLIDAR_ANS_TYPE_DEVHEALTH, sizeof( health ), false, &health );
+    }
+    break;
+
+  case RPLIDAR_CMD_GET_SAMPLERATE:
+    {
+      rplidar_response_sample_rate_t rate;
+      U32 us = ( _cfg._sampleRate > 0 ? 1000000 / _cfg._sampleRate : 1 );
+      rate.std_sample_duration_us     = (U16)std::max( 1U, us );
+      rate.express_sample_duration_us = (U16)std::max( 1U, us );
+      _SendResponse( RPLIDAR_ANS_TYPE_SAMPLE_RATE, sizeof( rate ), false, &rate );
+    }
+    break;
+
+  case RPLIDAR_CMD_SET_MOTOR_PWM:
+    if ( size >= sizeof( rplidar_payload_motor_pwm_t ) )
+    {
+      _pwm = ((const rplidar_payload_motor_pwm_t*)payload)->pwm_value;
+    }
+    break;
+
+  case RPLIDAR_CMD_GET_ACC_BOARD_FLAG:
+    {
+      rplidar_response_acc_board_flag_t flag;
+      flag.support_flag = ( _cfg._motorCtrl ? RPLIDAR_RESP_ACC_BOARD_FLAG_MOTOR_CTRL_SUPPORT_MASK : 0 );
+      _SendResponse( RPLIDAR_ANS_TYPE_ACC_BOARD_FLAG, sizeof( flag ), false, &flag );
+    }
+    break;
+
+  default:
+    if ( _cfg._verbose )
+    {
+      fprintf( stderr, "[RPLidarEmulator::_HandleCommand] unknown cmd 0x%02X.\n", cmd );
+    }
+    break;
+  }
+}
+
+
+void RPLidarEmulator::_SendResponse( U8 type, U32 size, bool loop, const void* payload )
+{
+  rplidar_ans_header_t hdr;
+  const U8* p = (const U8*)&hdr;
+
+  hdr.syncByte1        = RPLIDAR_ANS_SYNC_BYTE1;
+  hdr.syncByte2        = RPLIDAR_ANS_SYNC_BYTE2;
+  hdr.size_q30_subtype = ( size & RPLIDAR_ANS_HEADER_SIZE_MASK ) |
+                         ( ( loop ? RPLIDAR_ANS_PKTFLAG_LOOP : 0 ) << RPLIDAR_ANS_HEADER_SUBTYPE_SHIFT );
+  hdr.type             = type;
+
+  _out.insert( _out.end(), p, p + sizeof( hdr ) );
+
+  if ( payload != NULL )
+  {
+    p = (const U8*)payload;
+    _out.insert( _out.end(), p, p + size );
+  }
+}
+
+
+void RPLidarEmulator::_StartScan( S32 mode )
+{
+  _mode         = mode;
+  _modeTs       = (S64)rp::hal::clock_now();
+  _units        = 0;
+  _firstCapsule = true;
+  _syncArmed    = false;
+  _nodeIdx      = 0;
+}
+
+
+
+
+//
+// send whatever is due by now.  units are nodes in normal mode and
+// capsules in express mode; the due count is bounded by the sample
+// rate and by the line rate.  if the reader falls behind by more than
+// 100ms worth of data the backlog is skipped, the way a real uart
+// overruns, instead of being burst out later.
+//
+void RPLidarEmulator::_Produce( S64 now )
+{
+  const bool express   = ( _mode == MODE_EXPRESS );
+  const U32  unitBytes = ( express ? sizeof( rplidar_response_capsule_measurement_nodes_t )
+                                   : sizeof( rplidar_response_measurement_node_t ) );
+  const U32  unitNodes = ( express ? _EMU_CAPSULE_NODES_ : 1 );
+  DBL rate = -1.0;  // units per second, < 0 for no limit
+  U64 due  = ~0ULL;
+
+  if ( _cfg._sampleRate > 0 )
+  {
+    rate = (DBL)_cfg._sampleRate / unitNodes;
+  }
+  if ( _cfg._baudrate > 0 )
+  {
+    DBL lrate = ( _cfg._baudrate / 10.0 ) / unitBytes;
+    rate = ( rate < 0 ? lrate : std::min( rate, lrate ) );
+  }
+
+  if ( rate > 0 )
+  {
+    due = (U64)( ( now - _modeTs ) * 1e-9 * rate );
+
+    U64 lag = ( due > _units ? due - _units : 0 );
+    U64 cap = std::max( (U64)1, (U64)( rate / 10 ) );
+    if ( lag > cap )
+    {
+      _SkipNodes( ( lag - cap ) * unitNodes );
+      _units += ( lag - cap );
+    }
+  }
+
+  while ( _units < due && ( _out.size() - _outPos ) < _EMU_OUT_HIGH_WATER_ )
+  {
+    if ( express )
+    {
+      _EmitCapsule();
+    }
+    else
+    {
+      _EmitNode();
+    }
+    ++_units;
+  }
+}
+
+
+void RPLidarEmulator::_NextNode( rplidar_response_measurement_node_t* node, bool* sync )
+{
+  const STDVEC<rplidar_response_measurement_node_t>& scan = _scans[_scanIdx];
+
+  *node = scan[_nodeIdx];
+  *sync = ( _nodeIdx == 0 );
+
+  if ( ++_nodeIdx >= scan.size() )
+  {
+    _nodeIdx = 0;
+    _scanIdx = ( _scanIdx + 1 ) % _scans.size();
+  }
+}
+
+
+void RPLidarEmulator::_SkipNodes( U64 count )
+{
+  rplidar_response_measurement_node_t node;
+  bool sync;
+
+  for ( U64 idx = 0; idx < count; ++idx )
+  {
+    _NextNode( &node, &sync );
+  }
+
+  _dropCnt += count;
+
+  // the decoder needs two consecutive capsules
+  _syncArmed = false;
+}
+
+
+void RPLidarEmulator::_EmitNode()
+{
+  rplidar_response_measurement_node_t node;
+  bool sync;
+  const U8* p = (const U8*)&node;
+
+  _NextNode( &node, &sync );
+
+  node.sync_quality = ( node.sync_quality & 0xFC ) |
+                      ( sync ? RPLIDAR_RESP_MEASUREMENT_SYNCBIT : 0x02 );
+
+  if ( sync )
+  {
+    _syncPending = true;
+    _syncOff     = _out.size();
+  }
+
+  _out.insert( _out.end(), p, p + sizeof( node ) );
+  ++_nodeCnt;
+}
+
+
+//
+// inverse of RPlidarDriverSerialImpl::_capsuleToNormal.  the driver
+// spreads the 32 cabin samples evenly between this capsule's start
+// angle and the next one's, so the start angle is that of the first
+// node and the angle offsets stay zero.  quality is not carried.
+//
+void RPLidarEmulator::_EmitCapsule()
+{
+  rplidar_response_capsule_measurement_nodes_t cap;
+  rplidar_response_measurement_node_t node;
+  bool sync;
+  bool hasSync = false;
+  U16  dist[_EMU_CAPSULE_NODES_];
+  const U8* p = (const U8*)&cap;
+  U8 cksum = 0;
+
+  for ( U32 idx = 0; idx < _EMU_CAPSULE_NODES_; ++idx )
+  {
+    _NextNode( &node, &sync );
+
+    if ( idx == 0 )
+    {
+      cap.start_angle_sync_q6 = ( node.angle_q6_checkbit >> RPLIDAR_RESP_MEASUREMENT_ANGLE_SHIFT ) & 0x7FFF;
+    }
+    // _capsuleToNormal flags the node just before the angle wraps,
+    // i.e. the last node of the rotation, not the first of the next
+    hasSync   |= ( _nodeIdx == 0 );
+    dist[idx]  = node.distance_q2;
+  }
+
+  if ( _firstCapsule )
+  {
+    cap.start_angle_sync_q6 |= RPLIDAR_RESP_MEASUREMENT_EXP_SYNCBIT;
+    _firstCapsule = false;
+  }
+
+  for ( U32 idx = 0; idx < X_NUMBER_OF( cap.cabins ); ++idx )
+  {
+    cap.cabins[idx].distance_angle_1 = ( dist[idx * 2]     & 0xFFFC );
+    cap.cabins[idx].distance_angle_2 = ( dist[idx * 2 + 1] & 0xFFFC );
+    cap.cabins[idx].offset_angles_q3 = 0;
+  }
+
+  for ( U32 pos = offsetof( rplidar_response_capsule_measurement_nodes_t, start_angle_sync_q6 );
+        pos < sizeof( cap ); ++pos )
+  {
+    cksum ^= p[pos];
+  }
+  cap.s_checksum_1 = ( RPLIDAR_RESP_MEASUREMENT_EXP_SYNC_1 << 4 ) | ( cksum & 0x0F );
+  cap.s_checksum_2 = ( RPLIDAR_RESP_MEASUREMENT_EXP_SYNC_2 << 4 ) | ( cksum >> 4 );
+
+  // the driver decodes a capsule only once the next one arrives
+  if ( _syncArmed )
+  {
+    _syncPending = true;
+    _syncOff     = _out.size();
+  }
+  _syncArmed = hasSync;
+
+  _out.insert( _out.end(), p, p + sizeof( cap ) );
+  _nodeCnt += _EMU_CAPSULE_NODES_;
+}
+
+
+void RPLidarEmulator::_Flush()
+{
+  while ( _outPos < _out.size() )
+  {
+    S32 len = write( _fd, &_out[_outPos], _out.size() - _outPos );
+
+    if ( len <= 0 )
+    {
+      break;
+    }
+
+    _outPos  += len;
+    _byteCnt += len;
+  }
+
+  if ( _syncPending && _outPos > _syncOff )
+  {
+    _syncPending = false;
+    _lastSyncTs  = (S64)rp::hal::clock_now();
+    ++_scanCnt;
+  }
+
+  if ( _outPos == _out.size() )
+  {
+    _out.clear();
+    _outPos = 0;
+  }
+  else if ( _outPos >= _EMU_OUT_HIGH_WATER_ )
+  {
+    _out.erase( _out.begin(), _out.begin() + _outPos );
+    _syncOff = ( _syncOff > _outPos ? _syncOff - _outPos : 0 );
+    _outPos  = 0;
+  }
+}
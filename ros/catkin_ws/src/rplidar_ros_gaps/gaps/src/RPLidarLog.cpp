@@ -0,0 +1,653 @@
+
+
+
+#include <RPLidarLog.h>
+#include <XStrSafe.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stddef.h>
+#include <time.h>
+#include "hal/clock.h"
+
+
+static inline void __sleepuntil( S64 ts )
+{
+  timespec time;
+  time.tv_sec  = ( ts / 1000000000LL );
+  time.tv_nsec = ( ts % 1000000000LL );
+  while ( EINTR == clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &time, NULL ) );
+}
+
+
+
+
+//
+// delta + zigzag + varint coding for the angle and distance arrays.
+// angles are mostly ascending by a near constant step and distances
+// change slowly between neighbours, so most values fit one byte.
+//
+static U32 _EncodeU16( const U16* src, U32 count, U8* dst )
+{
+  U32 pos  = 0;
+  S32 prev = 0;
+
+  for ( U32 idx = 0; idx < count; ++idx )
+  {
+    S32 delta = (S32)src[idx] - prev;
+    U32 zz    = (U32)( ( delta << 1 ) ^ ( delta >> 31 ) );
+
+    prev = src[idx];
+
+    while ( zz >= 0x80 )
+    {
+      dst[pos++] = (U8)( zz | 0x80 );
+      zz >>= 7;
+    }
+    dst[pos++] = (U8)zz;
+  }
+
+  return pos;
+}
+
+
+// returns bytes consumed, 0 if the input is truncated
+static U32 _DecodeU16( const U8* src, U32 len, U32 count, U16* dst )
+{
+  U32 pos  = 0;
+  S32 prev = 0;
+
+  for ( U32 idx = 0; idx < count; ++idx )
+  {
+    U32 zz    = 0;
+    U32 shift = 0;
+
+    do
+    {
+      if ( pos >= len || shift > 21 )
+      {
+        return 0;
+      }
+      zz    |= (U32)( src[pos] & 0x7F ) << shift;
+      shift += 7;
+    } while ( src[pos++] & 0x80 );
+
+    prev    += (S32)( zz >> 1 ) ^ -(S32)( zz & 0x01 );
+    dst[idx] = (U16)prev;
+  }
+
+  return pos;
+}
+
+
+
+
+
+
+
+
+RPLidarLogWriter::RPLidarLogWriter(
+  ):
+  _fp( NULL ),
+  _compress( false ),
+  _offset( 0 ),
+  _idx()
+{
+}
+
+
+RPLidarLogWriter::~RPLidarLogWriter()
+{
+  Close();
+}
+
+
+S32 RPLidarLogWriter::Open( const char* path, bool compress )
+{
+  S32 ret = -1;
+  rplidar_log_hdr_t hdr;
+
+  Close();
+
+  _fp = fopen( path, "wb" );
+  if ( _fp == NULL )
+  {
+    fprintf( stderr, "[RPLidarLogWriter::Open] failed to open %s, errno=%d.\n",
+             path, errno );
+    goto Exit;
+  }
+
+  // writes are small and frequent, let stdio batch them
+  setvbuf( _fp, NULL, _IOFBF, ( 1 << 20 ) );
+
+  memset( &hdr, 0, sizeof( hdr ) );
+  hdr._magic     = _RPLOG_MAGIC_;
+  hdr._version   = _RPLOG_VERSION_;
+  hdr._flags     = ( compress ? _RPLOG_FLAG_COMPRESS_ : 0 );
+  hdr._nodeCount = _NODE_COUNT_;
+  hdr._createTs  = (S64)rp::hal::clock_to_wall( rp::hal::clock_now() );
+
+  if ( 1 != fwrite( &hdr, sizeof( hdr ), 1, _fp ) )
+  {
+    fprintf( stderr, "[RPLidarLogWriter::Open] failed to write header.\n" );
+    fclose( _fp );
+    _fp = NULL;
+    goto Exit;
+  }
+
+  _compress = compress;
+  _offset   = sizeof( hdr );
+  _idx.clear();
+
+  ret = 1;
+
+Exit:
+  return ret;
+}
+
+
+void RPLidarLogWriter::Close()
+{
+  if ( _fp == NULL )
+  {
+    return;
+  }
+
+  // append the index and patch the header so the reader can seek
+  U64 idxOffset  = _offset;
+  U32 frameCount = static_cast<U32>( _idx.size() );
+
+  if ( frameCount > 0 )
+  {
+    X_IGNORE_RESULT( fwrite( &_idx[0], sizeof( rplidar_log_idx_t ), frameCount, _fp ) );
+  }
+
+  if ( 0 == fseek( _fp, offsetof( rplidar_log_hdr_t, _frameCount ), SEEK_SET ) )
+  {
+    X_IGNORE_RESULT( fwrite( &frameCount, sizeof( frameCount ), 1, _fp ) );
+  }
+  if ( 0 == fseek( _fp, offsetof( rplidar_log_hdr_t, _idxOffset ), SEEK_SET ) )
+  {
+    X_IGNORE_RESULT( fwrite( &idxOffset, sizeof( idxOffset ), 1, _fp ) );
+  }
+
+  fclose( _fp );
+  _fp = NULL;
+  _idx.clear();
+}
+
+
+S32 RPLidarLogWriter::Write( const rplidar_reading_t* rdn, S64 ts )
+{
+  if ( _fp == NULL )
+  {
+    return -1;
+  }
+
+  rplidar_log_frame_t frm;
+  rplidar_log_idx_t   ent;
+  U32 count = ( rdn->_count > _NODE_COUNT_ ? _NODE_COUNT_ : rdn->_count );
+  U32 size  = 0;
+
+  frm._magic     = _RPLOG_FRAME_MAGIC_;
+  frm._flags     = 0;
+  frm._seq       = rdn->_seq;
+  frm._ascend    = rdn->_ascend;
+  frm._count     = count;
+  frm._recvTs    = ts;
+  frm._scanBegTs = rdn->_scanBegTs;
+  frm._scanEndTs = rdn->_scanEndTs;
+
+  if ( _compress )
+  {
+    size += _EncodeU16( rdn->_agl, count, &_buf[size] );
+    size += _EncodeU16( rdn->_dst, count, &_buf[size] );
+    memcpy( &_buf[size], rdn->_qua, count );
+    size += count;
+
+    frm._flags = _RPLOG_FLAG_COMPRESS_;
+  }
+  else
+  {
+    memcpy( &_buf[size], rdn->_agl, count * sizeof( U16 ) );
+    size += count * sizeof( U16 );
+    memcpy( &_buf[size], rdn->_dst, count * sizeof( U16 ) );
+    size += count * sizeof( U16 );
+    memcpy( &_buf[size], rdn->_qua, count );
+    size += count;
+  }
+
+  frm._size = size;
+
+  if ( 1 != fwrite( &frm, sizeof( frm ), 1, _fp ) ||
+       ( size > 0 && 1 != fwrite( _buf, size, 1, _fp ) ) )
+  {
+    fprintf( stderr, "[RPLidarLogWriter::Write] write failed, errno=%d.\n", errno );
+    return -1;
+  }
+
+  ent._offset = _offset;
+  ent._recvTs = ts;
+  _idx.push_back( ent );
+
+  _offset += sizeof( frm ) + size;
+
+  return 1;
+}
+
+
+U32 RPLidarLogWriter::GetFrameCount()
+{
+  return static_cast<U32>( _idx.size() );
+}
+
+
+
+
+
+
+
+
+RPLidarLogReader::RPLidarLogReader(
+  ):
+  _fd( -1 ),
+  _base( NULL ),
+  _size( 0 ),
+  _idx()
+{
+}
+
+
+RPLidarLogReader::~RPLidarLogReader()
+{
+  Close();
+}
+
+
+S32 RPLidarLogReader::Open( const char* path )
+{
+  S32 ret = -1;
+  struct stat st;
+  const rplidar_log_hdr_t* hdr;
+
+  Close();
+
+  _fd = open( path, O_RDONLY );
+  if ( _fd < 0 )
+  {
+    fprintf( stderr, "[RPLidarLogReader::Open] failed to open %s, errno=%d.\n",
+             path, errno );
+    goto Exit;
+  }
+
+  if ( 0 != fstat( _fd, &st ) || st.st_size < (off_t)sizeof( rplidar_log_hdr_t ) )
+  {
+    fprintf( stderr, "[RPLidarLogReader::Open] %s is too small.\n", path );
+    goto Exit;
+  }
+
+  _size = static_cast<U64>( st.st_size );
+  _base = (U8*)mmap( NULL, _size, PROT_READ, MAP_PRIVATE, _fd, 0 );
+  if ( _base == MAP_FAILED )
+  {
+    _base = NULL;
+    fprintf( stderr, "[RPLidarLogReader::Open] mmap failed, errno=%d.\n", errno );
+    goto Exit;
+  }
+
+  // frames are read front to back
+  madvise( _base, _size, MADV_SEQUENTIAL );
+
+  hdr = (const rplidar_log_hdr_t*)_base;
+  if ( hdr->_magic != _RPLOG_MAGIC_ || hdr->_version != _RPLOG_VERSION_ ||
+       hdr->_nodeCount != _NODE_COUNT_ )
+  {
+    fprintf( stderr, "[RPLidarLogReader::Open] %s is not a v%d log.\n",
+             path, _RPLOG_VERSION_ );
+    goto Exit;
+  }
+
+  if ( hdr->_idxOffset != 0 &&
+       hdr->_idxOffset + (U64)hdr->_frameCount * sizeof( rplidar_log_idx_t ) <= _size )
+  {
+    const rplidar_log_idx_t* idx = (const rplidar_log_idx_t*)( _base + hdr->_idxOffset );
+    _idx.assign( idx, idx + hdr->_frameCount );
+  }
+  else if ( _BuildIndex() < 0 )
+  {
+    goto Exit;
+  }
+
+  ret = 1;
+
+Exit:
+  if ( ret < 0 )
+  {
+    Close();
+  }
+  return ret;
+}
+
+
+void RPLidarLogReader::Close()
+{
+  if ( _base != NULL )
+  {
+    munmap( _base, _size );
+    _base = NULL;
+  }
+  if ( _fd >= 0 )
+  {
+    close( _fd );
+    _fd = -1;
+  }
+  _size = 0;
+  _idx.clear();
+}
+
+
+S32 RPLidarLogReader::_BuildIndex()
+{
+  U64 offset = sizeof( rplidar_log_hdr_t );
+
+  _idx.clear();
+
+  // unclosed log, walk the frames until the data runs out
+  while ( offset + sizeof( rplidar_log_frame_t ) <= _size )
+  {
+    const rplidar_log_frame_t* frm = (const rplidar_log_frame_t*)( _base + offset );
+    rplidar_log_idx_t ent;
+
+    if ( frm->_magic != _RPLOG_FRAME_MAGIC_ ||
+         offset + sizeof( rplidar_log_frame_t ) + frm->_size > _size )
+    {
+      break;
+    }
+
+    ent._offset = offset;
+    ent._recvTs = frm->_recvTs;
+    _idx.push_back( ent );
+
+    offset += sizeof( rplidar_log_frame_t ) + frm->_size;
+  }
+
+  if ( offset != _size )
+  {
+    fprintf( stderr, "[RPLidarLogReader::_BuildIndex] ignoring %llu trailing bytes.\n",
+             (unsigned long long)( _size - offset ) );
+  }
+
+  return 1;
+}
+
+
+U32 RPLidarLogReader::GetFrameCount()
+{
+  return static_cast<U32>( _idx.size() );
+}
+
+
+S32 RPLidarLogReader::GetFrame( U32 idx, rplidar_reading_t* rdn, S64* ts )
+{
+  if ( idx >= _idx.size() )
+  {
+    return 0;
+  }
+
+  U64 offset = _idx[idx]._offset;
+
+  if ( offset + sizeof( rplidar_log_frame_t ) > _size )
+  {
+    return -1;
+  }
+
+  const rplidar_log_frame_t* frm = (const rplidar_log_frame_t*)( _base + offset );
+  const U8* src = _base + offset + sizeof( rplidar_log_frame_t );
+  U32 count     = frm->_count;
+  U32 len       = frm->_size;
+  U32 pos       = 0;
+
+  if ( frm->_magic != _RPLOG_FRAME_MAGIC_ || count > _NODE_COUNT_ ||
+       offset + sizeof( rplidar_log_frame_t ) + len > _size )
+  {
+    return -1;
+  }
+
+  if ( frm->_flags & _RPLOG_FLAG_COMPRESS_ )
+  {
+    U32 used;
+
+    used = _DecodeU16( &src[pos], len - pos, count, rdn->_agl );
+    if ( used == 0 && count > 0 ) { return -1; }
+    pos += used;
+
+    used = _DecodeU16( &src[pos], len - pos, count, rdn->_dst );
+    if ( used == 0 && count > 0 ) { return -1; }
+    pos += used;
+  }
+  else
+  {
+    if ( len < count * 5 ) { return -1; }
+
+    memcpy( rdn->_agl, &src[pos], count * sizeof( U16 ) );
+    pos += count * sizeof( U16 );
+    memcpy( rdn->_dst, &src[pos], count * sizeof( U16 ) );
+    pos += count * sizeof( U16 );
+  }
+
+  if ( pos + count > len )
+  {
+    return -1;
+  }
+  memcpy( rdn->_qua, &src[pos], count );
+
+  for ( U32 i = count; i < _NODE_COUNT_; ++i )
+  {
+    rdn->_agl[i] = 0;
+    rdn->_dst[i] = 0;
+    rdn->_qua[i] = 0;
+  }
+
+  rdn->_seq       = frm->_seq;
+  rdn->_ascend    = frm->_ascend;
+  rdn->_count     = count;
+  rdn->_scanBegTs = frm->_scanBegTs;
+  rdn->_scanEndTs = frm->_scanEndTs;
+
+  if ( ts != NULL )
+  {
+    (*ts) = frm->_recvTs;
+  }
+
+  return 1;
+}
+
+
+U32 RPLidarLogReader::Replay( EventSinkPure* sink, DBL speed, volatile S32* stop )
+{
+  U32 frames = 0;
+  S64 logBeg = 0;
+  S64 wallBeg = (S64)rp::hal::clock_now();
+  rplidar_reading_t  rdn;
+  rplidar_reading_pkt_t pkt;
+  UDPMSG msg;
+
+  XStrCopyA( msg.szSrcIP, XIPADDRSTR_CCH, "replay" );
+  msg.pMsg    = &pkt;
+  msg.ulCbMsg = sizeof( pkt );
+
+  for ( U32 idx = 0; idx < _idx.size(); ++idx )
+  {
+    S64 ts = 0;
+
+    if ( stop != NULL && *stop )
+    {
+      break;
+    }
+
+    if ( 1 != GetFrame( idx, &rdn, &ts ) )
+    {
+      fprintf( stderr, "[RPLidarLogReader::Replay] skipping corrupt frame %u.\n", idx );
+      continue;
+    }
+
+    if ( speed > 0.0 )
+    {
+      if ( frames == 0 )
+      {
+        logBeg = ts;
+      }
+      __sleepuntil( wallBeg + (S64)( (DBL)( ts - logBeg ) / speed ) );
+    }
+
+    // the frame arrives now, as far as the sink can tell; the recorded
+    // receive time is on the clock of the session that wrote the log
+    msg.llRecvTs = (S64)rp::hal::clock_now();
+
+    pkt._seq       = rdn._seq;
+    pkt._ascend    = rdn._ascend;
+    pkt._count     = rdn._count;
+    pkt._scanBegTs = rdn._scanBegTs;
+    pkt._scanEndTs = rdn._scanEndTs;
+
+    for ( U32 sub = _BEG_SUB_SEQ_; sub <= _END_SUB_SEQ_; ++sub )
+    {
+      U32 beg = ( sub * _PKT_NODE_COUNT_ );
+
+      pkt._subSeq = sub;
+      memcpy( pkt._agl, &rdn._agl[beg], sizeof( pkt._agl ) );
+      memcpy( pkt._dst, &rdn._dst[beg], sizeof( pkt._dst ) );
+      memcpy( pkt._qua, &rdn._qua[beg], sizeof( pkt._qua ) );
+
+      sink->ReceiveMessage( &msg );
+    }
+
+    ++frames;
+  }
+
+  return frames;
+}
+
+
+
+
+
+
+
+
+extern "C"
+{
+
+static
+PVOID
+InvokeReplayFunction(
+  PVOID  pv
+  );
+
+}
+
+
+static
+PVOID
+InvokeReplayFunction(
+  PVOID  pv
+  )
+{
+  PXTHREADARG        pxarg   = (PXTHREADARG)pv;
+  RPLidarLogPlayer*  pplayer = (RPLidarLogPlayer*)pxarg->pv;
+
+  pplayer->Run();
+
+  return NULL;
+}
+
+
+
+
+RPLidarLogPlayer::RPLidarLogPlayer(
+  ):
+  _reader(),
+  _thread( NULL ),
+  _hasThreadAttr( false ),
+  _threadAttr(),
+  _sink( NULL ),
+  _speed( 1.0 ),
+  _loop( false ),
+  _stop( 0 )
+{
+}
+
+
+RPLidarLogPlayer::~RPLidarLogPlayer()
+{
+  Stop();
+}
+
+
+S32 RPLidarLogPlayer::Init( const char* path, EventSinkPure* sink, DBL speed, bool loop )
+{
+  if ( 1 != _reader.Open( path ) )
+  {
+    return -1;
+  }
+
+  printf( "[RPLidarLogPlayer::Init] %s: %u frames, speed=%.2f%s.\n",
+          path, _reader.GetFrameCount(), speed, ( loop ? ", looping" : "" ) );
+
+  _sink  = sink;
+  _speed = speed;
+  _loop  = loop;
+
+  return 1;
+}
+
+
+void RPLidarLogPlayer::SetThreadAttr( const XTHREADATTR* attr )
+{
+  _hasThreadAttr = ( attr != NULL );
+  if ( _hasThreadAttr )
+  {
+    _threadAttr = *attr;
+  }
+}
+
+
+void RPLidarLogPlayer::Start()
+{
+  Stop();
+
+  _stop   = 0;
+  _thread = new XThread();
+  _thread->SetAttr( _hasThreadAttr ? &_threadAttr : NULL );
+  _thread->Run( InvokeReplayFunction, this );
+}
+
+
+void RPLidarLogPlayer::Stop()
+{
+  if ( _thread != NULL )
+  {
+    _stop = 1;
+    _thread->Join();
+    delete _thread;
+    _thread = NULL;
+  }
+}
+
+
+void RPLidarLogPlayer::Run()
+{
+  do
+  {
+    U32 frames = _reader.Replay( _sink, _speed, &_stop );
+
+    printf( "[RPLidarLogPlayer::Run] replayed %u frames.\n", frames );
+
+    if ( frames == 0 )
+    {
+      break;
+    }
+  } while ( _loop && !_stop );
+}
@@ -0,0 +1,292 @@
+#include <RPLidarMerge.h>
+#include <rplidar.h>
+#include <limits>
+#include <string.h>
+
+
+// |error| under 1e-5 radians, a few hundredths of a bin.  branch free,
+// so the loop around it vectorizes where atan2f wouldn't.  gcc won't turn
+// a float compare or a float select into vector code while they may trap,
+// so both are done on the bits: non-negative floats order like their
+// integers, and __pick blends by mask
+static inline S32 __floatbits( FLT v )
+{
+  S32 bits;
+
+  memcpy( &bits, &v, sizeof( bits ) );
+  return bits;
+}
+
+
+static inline FLT __pick( bool cond, FLT a, FLT b )
+{
+  S32 mask = -(S32)cond;
+  S32 bits = ( __floatbits( a ) & mask ) | ( __floatbits( b ) & ~mask );
+  FLT v;
+
+  memcpy( &v, &bits, sizeof( v ) );
+  return v;
+}
+
+
+static inline FLT __fastatan2( FLT y, FLT x )
+{
+  FLT  ax   = fabsf( x );
+  FLT  ay   = fabsf( y );
+  bool swap = ( __floatbits( ay ) > __floatbits( ax ) );
+  FLT  a    = __pick( swap, ax, ay ) / ( __pick( swap, ay, ax ) + 1e-30f );
+  FLT  s    = a * a;
+  FLT  r    = ( ( -0.0464964749f * s + 0.15931422f ) * s - 0.327622764f ) * s * a + a;
+
+  r = __pick( swap, (FLT)( M_PI / 2 ) - r, r );
+  r = __pick( __floatbits( x ) < 0, (FLT)M_PI - r, r );
+
+  return copysignf( r, y );
+}
+
+
+
+
+RPLidarMerge::RPLidarMerge(
+  ):
+  _count( 0 ),
+  _bins( 0 ),
+  _rangeMin( 0 ),
+  _rangeMax( 0 ),
+  _maxSkew( 100000000LL ),
+  _pace( -1 ),
+  _cos(),
+  _sin()
+{
+  for ( U32 idx = 0; idx < _MERGE_MAX_SOURCES_; ++idx )
+  {
+    _src[idx]._has = false;
+    SetExtrinsic( idx, 0, 0, 0, false );
+  }
+}
+
+
+RPLidarMerge::~RPLidarMerge()
+{
+}
+
+
+S32 RPLidarMerge::Init( U32 sources, U32 bins, FLT rangeMin, FLT rangeMax )
+{
+  S32 ret = -1;
+
+  if ( sources == 0 || sources > _MERGE_MAX_SOURCES_ || bins == 0 )
+  {
+    fprintf( stderr, "[RPLidarMerge::Init] %u sources, %u bins not supported.\n", sources, bins );
+    goto Exit;
+  }
+
+  _count    = sources;
+  _bins     = bins;
+  _rangeMin = rangeMin;
+  _rangeMax = rangeMax;
+
+  _cos.resize( _MERGE_TURN_Q6_ );
+  _sin.resize( _MERGE_TURN_Q6_ );
+  for ( U32 idx = 0; idx < _MERGE_TURN_Q6_; ++idx )
+  {
+    DBL rad = idx * ( 2 * M_PI / _MERGE_TURN_Q6_ );
+
+    _cos[idx] = (FLT)cos( rad );
+    _sin[idx] = (FLT)sin( rad );
+  }
+
+  ret = 1;
+
+Exit:
+  return ret;
+}
+
+
+void RPLidarMerge::SetExtrinsic( U32 source, FLT x, FLT y, FLT yaw, bool inverted )
+{
+  if ( source >= _MERGE_MAX_SOURCES_ )
+  {
+    return;
+  }
+
+  // the lidar's clockwise angle a is pi - a in its scan frame, a - pi
+  // when mounted upside down, then turned by yaw
+  S32 base = (S32)lround( yaw * ( _MERGE_TURN_Q6_ / ( 2 * M_PI ) ) ) +
+             ( inverted ? -_MERGE_TURN_Q6_ / 2 : _MERGE_TURN_Q6_ / 2 );
+
+  base %= _MERGE_TURN_Q6_;
+  if ( base < 0 )
+  {
+    base += _MERGE_TURN_Q6_;
+  }
+
+  _src[source]._base = base;
+  _src[source]._dir  = ( inverted ? 1 : -1 );
+  _src[source]._x    = x;
+  _src[source]._y    = y;
+}
+
+
+void RPLidarMerge::SetMaxSkew( S64 maxSkew )
+{
+  _maxSkew = maxSkew;
+}
+
+
+S32 RPLidarMerge::Add( U32 source, const rplidar_reading_t* rdn, S64 begTs, S64 endTs )
+{
+  if ( source >= _count )
+  {
+    return 0;
+  }
+
+  Source_t& src = _src[source];
+
+  src._rdn   = *rdn;
+  src._begTs = begTs;
+  src._endTs = endTs;
+  src._has   = true;
+
+  // the first source heard from lately sets the pace
+  _pace = -1;
+  for ( U32 idx = 0; idx < _count; ++idx )
+  {
+    if ( _src[idx]._has && begTs - _src[idx]._begTs <= 2 * _maxSkew )
+    {
+      _pace = (S32)idx;
+      break;
+    }
+  }
+
+  return ( _pace == (S32)source ? 1 : 0 );
+}
+
+
+U32 RPLidarMerge::Merge( float* ranges, float* intensities, S64* begTs, S64* endTs )
+{
+  const float inf = std::numeric_limits<float>::infinity();
+  U32 used = 0;
+
+  for ( U32 idx = 0; idx < _bins; ++idx )
+  {
+    ranges[idx]      = inf;
+    intensities[idx] = 0;
+  }
+
+  *begTs = 0;
+  *endTs = 0;
+
+  if ( _pace < 0 )
+  {
+    return 0;
+  }
+
+  const Source_t& pace = _src[_pace];
+
+  for ( U32 idx = 0; idx < _count; ++idx )
+  {
+    const Source_t& src = _src[idx];
+
+    if ( !src._has || llabs( src._begTs - pace._begTs ) > _maxSkew )
+    {
+      continue;
+    }
+
+    _Bin( src, ranges, intensities );
+
+    if ( used == 0 || src._begTs < *begTs )
+    {
+      *begTs = src._begTs;
+    }
+    if ( used == 0 || src._endTs > *endTs )
+    {
+      *endTs = src._endTs;
+    }
+    used |= ( 1 << idx );
+  }
+
+  // _Bin leaves squared ranges
+  for ( U32 idx = 0; idx < _bins; ++idx )
+  {
+    ranges[idx] = sqrtf( ranges[idx] );
+  }
+
+  return used;
+}
+
+
+void RPLidarMerge::_Bin( const Source_t& src, float* ranges, float* intensities )
+{
+  const U32 count  = std::min( src._rdn._count, (U32)_NODE_COUNT_ );
+  const FLT invInc = _bins / (FLT)( 2 * M_PI );
+  const S32 bins   = (S32)_bins;
+  U32 n = 0;
+
+  // valid returns into the common frame
+  for ( U32 idx = 0; idx < count; ++idx )
+  {
+    FLT r = src._rdn._dst[idx] * ( 1.0f / 4 / 1000 );
+    // the angle field holds up to 512 degrees; a bad node must not index
+    // past the tables
+    S32 q = ( src._rdn._agl[idx] >> RPLIDAR_RESP_MEASUREMENT_ANGLE_SHIFT ) % _MERGE_TURN_Q6_;
+    S32 a = src._base + src._dir * q;
+
+    if ( src._rdn._dst[idx] == 0 || r < _rangeMin || r > _rangeMax )
+    {
+      continue;
+    }
+
+    a = ( a < 0 ? a + _MERGE_TURN_Q6_ : a );
+    a = ( a >= _MERGE_TURN_Q6_ ? a - _MERGE_TURN_Q6_ : a );
+
+    _px[n] = r * _cos[a] + src._x;
+    _py[n] = r * _sin[a] + src._y;
+    _pq[n] = (FLT)( src._rdn._qua[idx] >> 2 );
+    ++n;
+  }
+
+  // bearing and squared range from the origin; sqrtf sets errno, which
+  // alone keeps this loop from vectorizing, so Merge takes the roots of
+  // the bins instead
+  for ( U32 idx = 0; idx < n; ++idx )
+  {
+    S32 b = (S32)( ( __fastatan2( _py[idx], _px[idx] ) + (FLT)M_PI ) * invInc );
+
+    b = ( b >= bins ? b - bins : b );
+    b = ( b < 0 ? 0 : b );
+
+    _pr[idx] = _px[idx] * _px[idx] + _py[idx] * _py[idx];
+    _pb[idx] = b;
+  }
+
+  // nearest per bin
+  for ( U32 idx = 0; idx < n; ++idx )
+  {
+    S32 b = _pb[idx];
+
+    if ( _pr[idx] < ranges[b] )
+    {
+      ranges[b]      = _pr[idx];
+      intensities[b] = _pq[idx];
+    }
+  }
+}
+
+
+U32 RPLidarMerge::GetBins()
+{
+  return _bins;
+}
+
+
+FLT RPLidarMerge::GetAngleMin()
+{
+  return (FLT)-M_PI;
+}
+
+
+FLT RPLidarMerge::GetAngleInc()
+{
+  return ( _bins > 0 ? (FLT)( 2 * M_PI / _bins ) : 0 );
+}
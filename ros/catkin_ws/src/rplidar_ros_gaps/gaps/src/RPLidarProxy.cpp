@@ -1,19 +1,21 @@
 #include <RPLidarProxy.h>
-
-
+#include <RPLidarTrace.h>
+#include "hal/clock.h"
 
 
 RPLidarProxy::RPLidarProxy(
   ):
   _udprecv(),
   _verbose( 0 ),
+  _recorder( NULL ),
+  _clock( NULL ),
   _port( -1 ),
   _msgCnt( 0 ),
   _expSubSeq( 0 ),
   _expSeq( 0 ),
   _entVec(),
-  _curEntR( NULL ),
-  _curEntW( NULL ),
+  _curEntR( _entVec ),
+  _curEntW( _entVec ),
   _curridx( 0 ),
   _curwidx( 0 )
 {
@@ -66,6 +68,30 @@ void RPLidarProxy::SetVerbose( S32 verbose )
 
 
 
+void RPLidarProxy::SetRecorder( RPLidarLogWriter* rec )
+{
+  _recorder = rec;
+}
+
+
+
+
+void RPLidarProxy::SetClock( RPLidarClock* clk )
+{
+  _clock = clk;
+}
+
+
+
+
+void RPLidarProxy::SetThreadAttr( const XTHREADATTR* attr )
+{
+  _udprecv.SetThreadAttr( attr );
+}
+
+
+
+
 void RPLidarProxy::Start()
 {
   _udprecv.StartListen();
@@ -119,6 +145,11 @@ void RPLidarProxy::ReceiveMessage( PUDPMSG pMsg )
 
     if ( accept )
     {
+      if ( _clock != NULL && !_clock->HasHost() )
+      {
+        _clock->SetHost( pMsg->szSrcIP );
+      }
+
       if ( _verbose > 0 )
       {
         printf(
@@ -192,6 +223,20 @@ void RPLidarProxy::ReceiveMessage( PUDPMSG pMsg )
       if ( rdn->_subSeq == _END_SUB_SEQ_ )
       {
         // last sub packet
+        RPLIDAR_TRACE_TS( _TRACE_RECV_, rdn->_seq, pMsg->llRecvTs );
+
+        if ( cpyEnt )
+        {
+          _curEntW->_ts = (S64)rp::hal::clock_now();
+
+          RPLIDAR_TRACE_TS( _TRACE_COMPLETE_, rdn->_seq, _curEntW->_ts );
+
+          if ( _recorder != NULL )
+          {
+            _recorder->Write( &_curEntW->_rdn, _curEntW->_ts );
+          }
+        }
+
         // set the write counter to even to indicate entry is now
         // ready for consumption
         // also advance the current write entry pointer
@@ -217,6 +262,16 @@ void RPLidarProxy::ReceiveMessage( PUDPMSG pMsg )
       }
     }
   }
+  else if ( sizeof( rplidar_clock_pkt ) == cbmsg )
+  {
+    const rplidar_clock_pkt* pkt = (const rplidar_clock_pkt*)pMsg->pMsg;
+
+    if ( _clock != NULL &&
+         pkt->_magic == _CLOCK_MAGIC_ && pkt->_type == _CLOCK_PONG_ )
+    {
+      _clock->OnPong( pkt, pMsg->llRecvTs );
+    }
+  }
   else
   {
     if ( _verbose > 1 )
@@ -261,6 +316,8 @@ S32 RPLidarProxy::GetReading( rplidar_reading* rdn )
     // set the read counter to even to indicate entry has been read
     ++_curEntR->_rcnt;
 
+    RPLIDAR_TRACE( _TRACE_GETREADING_, rdn->_seq, 0 );
+
     // advance pointer
     if ( _curEntR == &_entVec[_BUF_SIZE_-1] )
     {
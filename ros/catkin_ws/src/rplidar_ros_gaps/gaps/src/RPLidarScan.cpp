@@ -0,0 +1,122 @@
+#include <RPLidarScan.h>
+#include <limits>
+
+
+
+
+void RPLidarScan::AngleCompensate(
+  const rplidar_reading_t* rdn,
+  U32 count,
+  rplidar_response_measurement_node_t* out,
+  U32 outCount
+  )
+{
+  const S32 angle_compensate_multiple = 1;
+  S32       angle_compensate_offset   = 0;
+
+  memset( out, 0, outCount * sizeof( rplidar_response_measurement_node_t ) );
+
+  count = std::min( count, (U32)_NODE_COUNT_ );
+
+  for ( U32 i = 0; i < count; ++i )
+  {
+    if ( rdn->_dst[i] == 0 )
+    {
+      continue;
+    }
+
+    float angle = (float)( ( rdn->_agl[i] >> RPLIDAR_RESP_MEASUREMENT_ANGLE_SHIFT ) / 64.0f );
+    S32 angle_value = (S32)( angle * angle_compensate_multiple );
+    if ( ( angle_value - angle_compensate_offset ) < 0 )
+    {
+      angle_compensate_offset = angle_value;
+    }
+
+    for ( S32 j = 0; j < angle_compensate_multiple; ++j )
+    {
+      U32 idx = (U32)( angle_value - angle_compensate_offset + j );
+
+      // a raw angle of exactly 360 degrees would land past the end
+      if ( idx < outCount )
+      {
+        out[idx].angle_q6_checkbit = rdn->_agl[i];
+        out[idx].distance_q2       = rdn->_dst[i];
+        out[idx].sync_quality      = rdn->_qua[i];
+      }
+    }
+  }
+}
+
+
+
+
+S32 RPLidarScan::CopyNodes(
+  const rplidar_reading_t* rdn,
+  U32 count,
+  rplidar_response_measurement_node_t* nodes,
+  U32* startNode,
+  U32* endNode
+  )
+{
+  S32 ret = 0;
+
+  count = std::min( count, (U32)_NODE_COUNT_ );
+
+  *startNode = 0;
+  *endNode   = ( count > 0 ? count - 1 : 0 );
+
+  for ( U32 idx = 0; idx < count; ++idx )
+  {
+    nodes[idx].angle_q6_checkbit = rdn->_agl[idx];
+    nodes[idx].distance_q2       = rdn->_dst[idx];
+    nodes[idx].sync_quality      = rdn->_qua[idx];
+  }
+
+  // find the first valid node and last valid node
+  for ( U32 idx = 0; idx < count; ++idx )
+  {
+    if ( rdn->_dst[idx] != 0 )
+    {
+      *startNode = idx;
+      ret = 1;
+      break;
+    }
+  }
+
+  if ( ret == 1 )
+  {
+    for ( U32 idx = count; idx-- > *startNode; )
+    {
+      if ( rdn->_dst[idx] != 0 )
+      {
+        *endNode = idx;
+        break;
+      }
+    }
+  }
+
+  return ret;
+}
+
+
+
+
+void RPLidarScan::FillRanges(
+  const rplidar_response_measurement_node_t* nodes,
+  size_t count,
+  bool   reverse,
+  float* ranges,
+  float* intensities
+  )
+{
+  const float inf = std::numeric_limits<float>::infinity();
+
+  for ( size_t i = 0; i < count; ++i )
+  {
+    size_t o = ( reverse ? count - 1 - i : i );
+    float read_value = (float)nodes[i].distance_q2 / 4.0f / 1000;
+
+    ranges[o]      = ( read_value == 0.0f ? inf : read_value );
+    intensities[o] = (float)( nodes[i].sync_quality >> 2 );
+  }
+}
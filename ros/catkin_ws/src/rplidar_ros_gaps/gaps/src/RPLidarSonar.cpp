@@ -0,0 +1,394 @@
+#include <RPLidarSonar.h>
+#include <unistd.h>
+#include "hal/clock.h"
+#include <limits>
+
+
+#define _SONAR_WAIT_MS_     ( 100 )     // serial wait, how often _stop is seen
+#define _SONAR_REOPEN_US_   ( 500000 )  // between tries at a port that went away
+
+
+static
+PVOID
+InvokeSonarFunction(
+  PVOID  pv
+  )
+{
+  PXTHREADARG    pxarg  = (PXTHREADARG)pv;
+  RPLidarSonar*  psonar = (RPLidarSonar*)pxarg->pv;
+
+  psonar->Run();
+
+  return NULL;
+}
+
+
+
+
+RPLidarSonar::RPLidarSonar(
+  ):
+  _rxtx( NULL ),
+  _port(),
+  _baudrate( 0 ),
+  _thread( NULL ),
+  _hasThreadAttr( false ),
+  _threadAttr(),
+  _stop( 0 ),
+  _mtx(),
+  _maxAge( 200000000LL ),
+  _bufLen( 0 ),
+  _hasSeq( false ),
+  _seq( 0 ),
+  _frameCnt( 0 ),
+  _badCnt( 0 ),
+  _lostCnt( 0 )
+{
+  for ( U32 idx = 0; idx < _SONAR_MAX_SENSORS_; ++idx )
+  {
+    _sensors[idx]._hasSector = false;
+    _sensors[idx]._yaw       = 0;
+    _sensors[idx]._fov       = 0;
+    _sensors[idx]._new       = false;
+  }
+}
+
+
+RPLidarSonar::~RPLidarSonar()
+{
+  Stop();
+
+  if ( _rxtx != NULL )
+  {
+    _rxtx->close();
+    rp::hal::serial_rxtx::ReleaseRxTx( _rxtx );
+    _rxtx = NULL;
+  }
+}
+
+
+S32 RPLidarSonar::Init( const char* port, U32 baudrate )
+{
+  S32 ret = -1;
+
+  _port     = port;
+  _baudrate = baudrate;
+
+  if ( _rxtx == NULL )
+  {
+    _rxtx = rp::hal::serial_rxtx::CreateRxTx();
+  }
+
+  if ( !_rxtx->bind( port, baudrate ) || !_rxtx->open() )
+  {
+    fprintf( stderr, "[RPLidarSonar::Init] unable to open %s at %u.\n", port, baudrate );
+    goto Exit;
+  }
+
+  ret = 1;
+
+Exit:
+  return ret;
+}
+
+
+void RPLidarSonar::SetSector( U32 sensor, FLT yaw, FLT fov )
+{
+  if ( sensor >= _SONAR_MAX_SENSORS_ )
+  {
+    return;
+  }
+
+  XScopedMutex lock( &_mtx );
+
+  _sensors[sensor]._hasSector = ( fov > 0 );
+  _sensors[sensor]._yaw       = yaw;
+  _sensors[sensor]._fov       = std::min( fov, (FLT)( 2 * M_PI ) );
+}
+
+
+void RPLidarSonar::SetMaxAge( DBL maxAge )
+{
+  _maxAge = (S64)( maxAge * 1e9 );
+}
+
+
+void RPLidarSonar::SetThreadAttr( const XTHREADATTR* attr )
+{
+  _hasThreadAttr = ( attr != NULL );
+  if ( _hasThreadAttr )
+  {
+    _threadAttr = *attr;
+  }
+}
+
+
+void RPLidarSonar::Start()
+{
+  Stop();
+
+  _stop   = 0;
+  _thread = new XThread();
+  _thread->SetAttr( _hasThreadAttr ? &_threadAttr : NULL );
+  _thread->Run( InvokeSonarFunction, this );
+}
+
+
+void RPLidarSonar::Stop()
+{
+  if ( _thread != NULL )
+  {
+    _stop = 1;
+    _thread->Join();
+    delete _thread;
+    _thread = NULL;
+  }
+}
+
+
+void RPLidarSonar::Run()
+{
+  U8 chunk[64];
+
+  while ( !_stop )
+  {
+    size_t avail = 0;
+    S32    ans;
+    S32    len;
+
+    if ( !_rxtx->isOpened() )
+    {
+      // an arduino reset or unplug; it comes back with the sequence restarted
+      if ( !_rxtx->open() )
+      {
+        usleep( _SONAR_REOPEN_US_ );
+        continue;
+      }
+      _bufLen = 0;
+      _hasSeq = false;
+    }
+
+    ans = _rxtx->waitfordata( 1, _SONAR_WAIT_MS_, &avail );
+
+    if ( ans == rp::hal::serial_rxtx::ANS_TIMEOUT )
+    {
+      // a tty that went away times out like a quiet one
+      if ( 0 != access( _port.c_str(), F_OK ) )
+      {
+        _rxtx->close();
+      }
+      continue;
+    }
+
+    if ( ans != rp::hal::serial_rxtx::ANS_OK )
+    {
+      _rxtx->close();
+      continue;
+    }
+
+    len = _rxtx->recvdata( chunk, std::min( avail, sizeof( chunk ) ) );
+
+    if ( len > 0 )
+    {
+      Feed( chunk, (U32)len, (S64)rp::hal::clock_now() );
+    }
+  }
+}
+
+
+void RPLidarSonar::Feed( const U8* data, U32 len, S64 recvTs )
+{
+  while ( len > 0 )
+  {
+    U32 take = std::min( len, (U32)sizeof( _buf ) - _bufLen );
+    U32 pos  = 0;
+
+    memcpy( _buf + _bufLen, data, take );
+    _bufLen += take;
+    data    += take;
+    len     -= take;
+
+    // resync a byte at a time past anything that isn't a good frame
+    while ( _bufLen - pos >= _SONAR_FRAME_SIZE_ )
+    {
+      const U8* frame = _buf + pos;
+
+      if ( frame[0] == 0xA5 && frame[1] == 0x5A && frame[2] == _SONAR_FRAME_SIZE_ - 4 &&
+           frame[_SONAR_FRAME_SIZE_ - 1] == _Crc8( frame + 2, _SONAR_FRAME_SIZE_ - 3 ) )
+      {
+        _Parse( frame, recvTs );
+        pos += _SONAR_FRAME_SIZE_;
+      }
+      else
+      {
+        ++_badCnt;
+        ++pos;
+      }
+    }
+
+    memmove( _buf, _buf + pos, _bufLen - pos );
+    _bufLen -= pos;
+  }
+}
+
+
+void RPLidarSonar::_Parse( const U8* frame, S64 recvTs )
+{
+  RPLidarSonarReading_t rdn;
+  U32 cm;
+
+  if ( _hasSeq )
+  {
+    _lostCnt += (U8)( frame[3] - _seq - 1 );
+  }
+  _seq    = frame[3];
+  _hasSeq = true;
+
+  rdn._sensor = frame[4];
+  rdn._status = frame[5];
+  rdn._fireMs = (U32)frame[6] | ( (U32)frame[7] << 8 ) | ( (U32)frame[8] << 16 ) | ( (U32)frame[9] << 24 );
+  rdn._recvTs = recvTs;
+
+  cm = (U32)frame[10] | ( (U32)frame[11] << 8 );
+  rdn._range = ( cm == 0 ? std::numeric_limits<float>::infinity() : cm * 0.01f );
+
+  if ( rdn._sensor >= _SONAR_MAX_SENSORS_ )
+  {
+    ++_badCnt;
+    return;
+  }
+
+  {
+    XScopedMutex lock( &_mtx );
+
+    _sensors[rdn._sensor]._rdn = rdn;
+    _sensors[rdn._sensor]._new = true;
+  }
+
+  ++_frameCnt;
+}
+
+
+S32 RPLidarSonar::GetReading( U32 sensor, RPLidarSonarReading_t* rdn )
+{
+  if ( sensor >= _SONAR_MAX_SENSORS_ )
+  {
+    return 0;
+  }
+
+  XScopedMutex lock( &_mtx );
+
+  if ( !_sensors[sensor]._new )
+  {
+    return 0;
+  }
+
+  *rdn = _sensors[sensor]._rdn;
+  _sensors[sensor]._new = false;
+
+  return 1;
+}
+
+
+U32 RPLidarSonar::Fuse( float* ranges, U32 count, float angleMin, float angleInc, S64 now )
+{
+  FLT yaw[_SONAR_MAX_SENSORS_];
+  FLT fov[_SONAR_MAX_SENSORS_];
+  FLT rng[_SONAR_MAX_SENSORS_];
+  U32 used = 0;
+  U32 lowered = 0;
+
+  if ( count == 0 || angleInc == 0 )
+  {
+    return 0;
+  }
+
+  {
+    XScopedMutex lock( &_mtx );
+
+    for ( U32 idx = 0; idx < _SONAR_MAX_SENSORS_; ++idx )
+    {
+      const Sensor_t& s = _sensors[idx];
+
+      if ( s._hasSector && s._rdn._recvTs != 0 && now - s._rdn._recvTs <= _maxAge &&
+           s._rdn._status == _SONAR_OK_ && isfinite( s._rdn._range ) )
+      {
+        yaw[used] = s._yaw;
+        fov[used] = s._fov;
+        rng[used] = s._rdn._range;
+        ++used;
+      }
+    }
+  }
+
+  for ( U32 idx = 0; idx < used; ++idx )
+  {
+    // beams counted from angleMin in the direction of increasing index
+    DBL inc = angleInc;
+    DBL beg = yaw[idx] - fov[idx] / 2 - angleMin;
+
+    if ( inc < 0 )
+    {
+      inc = -inc;
+      beg = angleMin - ( yaw[idx] + fov[idx] / 2 );
+    }
+
+    beg = fmod( beg, 2 * M_PI );
+    if ( beg < 0 )
+    {
+      beg += 2 * M_PI;
+    }
+
+    // a sector across the end of a full scan carries on at its start
+    S64 circle = std::max( (S64)llround( 2 * M_PI / inc ), (S64)1 );
+    S64 first  = (S64)ceil( beg / inc );
+    S64 last   = (S64)floor( ( beg + fov[idx] ) / inc );
+
+    for ( S64 k = first; k <= last; ++k )
+    {
+      U32 beam = (U32)( k % circle );
+
+      if ( beam < count && ranges[beam] > rng[idx] )
+      {
+        ranges[beam] = rng[idx];
+        ++lowered;
+      }
+    }
+  }
+
+  return lowered;
+}
+
+
+U32 RPLidarSonar::GetFrameCnt()
+{
+  return _frameCnt;
+}
+
+
+U32 RPLidarSonar::GetBadCnt()
+{
+  return _badCnt;
+}
+
+
+U32 RPLidarSonar::GetLostCnt()
+{
+  return _lostCnt;
+}
+
+
+U8 RPLidarSonar::_Crc8( const U8* data, U32 len )
+{
+  U8 crc = 0;
+
+  for ( U32 idx = 0; idx < len; ++idx )
+  {
+    crc ^= data[idx];
+    for ( U32 bit = 0; bit < 8; ++bit )
+    {
+      crc = ( crc & 0x80 ) ? (U8)( ( crc << 1 ) ^ 0x07 ) : (U8)( crc << 1 );
+    }
+  }
+
+  return crc;
+}
@@ -0,0 +1,188 @@
+#include <RPLidarTrace.h>
+#include <hal/trace.h>
+#include <time.h>
+#include "hal/clock.h"
+
+
+typedef struct TraceRing
+{
+  rplidar_trace_rec_t*  _buf;
+  U32                   _mask;
+  U64                   _widx;  // only the owning thread writes
+} TraceRing_t;
+
+
+static TraceRing_t*  s_rings[_TRACE_MAX_RINGS_];
+static U32           s_ringCnt  = 0;
+static U32           s_ringSize = 65536;
+
+static __thread TraceRing_t*  t_ring    = NULL;
+static __thread bool          t_noRing  = false;
+static __thread U32           t_lastKey = 0;
+
+volatile S32 RPLidarTrace::_enabled = 0;
+
+
+
+
+static void SdkTraceHook( int stage, _u32 key, _u64 ts )
+{
+  if ( stage == rp::hal::TRACE_STAGE_GRAB )
+  {
+    t_lastKey = key;
+  }
+  RPLidarTrace::Record( (U32)stage, key, 0, (S64)ts );
+}
+
+
+void RPLidarTrace::Enable( U32 ringSize )
+{
+  U32 size = 1;
+
+  while ( size < ringSize )
+  {
+    size <<= 1;
+  }
+  s_ringSize = size;
+
+  rp::hal::set_trace_hook( SdkTraceHook );
+  _enabled = 1;
+}
+
+
+void RPLidarTrace::Disable()
+{
+  _enabled = 0;
+  rp::hal::set_trace_hook( NULL );
+}
+
+
+void RPLidarTrace::Record( U32 stage, U32 key, U32 aux, S64 ts )
+{
+  TraceRing_t* ring = t_ring;
+
+  if ( __builtin_expect( ring == NULL, 0 ) )
+  {
+    if ( t_noRing )
+    {
+      return;
+    }
+
+    // first record on this thread, claim a slot
+    U32 idx = __atomic_fetch_add( &s_ringCnt, 1, __ATOMIC_RELAXED );
+    if ( idx >= _TRACE_MAX_RINGS_ )
+    {
+      fprintf( stderr, "[RPLidarTrace::Record] out of rings, thread not traced.\n" );
+      t_noRing = true;
+      return;
+    }
+
+    ring = new TraceRing_t;
+    ring->_buf  = new rplidar_trace_rec_t[s_ringSize];
+    ring->_mask = ( s_ringSize - 1 );
+    ring->_widx = 0;
+
+    __atomic_store_n( &s_rings[idx], ring, __ATOMIC_RELEASE );
+    t_ring = ring;
+  }
+
+  U64 widx = ring->_widx;
+  rplidar_trace_rec_t* rec = &ring->_buf[widx & ring->_mask];
+
+  rec->_ts    = ( ts != 0 ? ts : (S64)rp::hal::clock_now() );
+  rec->_key   = key;
+  rec->_aux   = aux;
+  rec->_stage = (U16)stage;
+
+  __atomic_store_n( &ring->_widx, widx + 1, __ATOMIC_RELEASE );
+}
+
+
+U32 RPLidarTrace::LastKey()
+{
+  return t_lastKey;
+}
+
+
+//
+// meant to be called once the pipeline has stopped.  records written
+// while dumping may be torn if the writer laps the reader.
+//
+S64 RPLidarTrace::Dump( const char* path )
+{
+  S64 ret = -1;
+  FILE* fp = NULL;
+  rplidar_trace_hdr_t hdr;
+  U32 ringCnt = std::min( __atomic_load_n( &s_ringCnt, __ATOMIC_ACQUIRE ), (U32)_TRACE_MAX_RINGS_ );
+
+  fp = fopen( path, "wb" );
+  if ( fp == NULL )
+  {
+    fprintf( stderr, "[RPLidarTrace::Dump] unable to open %s.\n", path );
+    goto Exit;
+  }
+
+  memset( &hdr, 0, sizeof( hdr ) );
+  hdr._magic     = _TRACE_MAGIC_;
+  hdr._version   = _TRACE_VERSION_;
+  hdr._ringCount = (U16)ringCnt;
+  hdr._monoTs    = (S64)rp::hal::clock_now();
+  hdr._sysTs     = (S64)rp::hal::clock_to_wall( (U64)hdr._monoTs );
+
+  // header is rewritten with the record count at the end
+  fwrite( &hdr, sizeof( hdr ), 1, fp );
+
+  for ( U32 idx = 0; idx < ringCnt; ++idx )
+  {
+    TraceRing_t* ring = __atomic_load_n( &s_rings[idx], __ATOMIC_ACQUIRE );
+    if ( ring == NULL )
+    {
+      continue;
+    }
+
+    U64 widx = __atomic_load_n( &ring->_widx, __ATOMIC_ACQUIRE );
+    U64 ridx = ( widx > ring->_mask + 1 ? widx - ring->_mask - 1 : 0 );
+
+    for ( ; ridx < widx; ++ridx )
+    {
+      rplidar_trace_rec_t rec = ring->_buf[ridx & ring->_mask];
+      rec._ring = (U16)idx;
+      fwrite( &rec, sizeof( rec ), 1, fp );
+      ++hdr._recCount;
+    }
+  }
+
+  fseek( fp, 0, SEEK_SET );
+  fwrite( &hdr, sizeof( hdr ), 1, fp );
+
+  printf( "[RPLidarTrace::Dump] %s: %llu records from %u threads.\n",
+          path, (unsigned long long)hdr._recCount, ringCnt );
+
+  ret = (S64)hdr._recCount;
+
+Exit:
+  if ( fp != NULL )
+  {
+    fclose( fp );
+  }
+  return ret;
+}
+
+
+const char* RPLidarTrace::StageName( U32 stage )
+{
+  static const char* names[_TRACE_STAGE_COUNT_] =
+  {
+    "decode",
+    "sdk_publish",
+    "grab",
+    "capture",
+    "send",
+    "recv",
+    "complete",
+    "get_reading",
+    "publish_scan"
+  };
+
+  return ( stage < _TRACE_STAGE_COUNT_ ? names[stage] : "unknown" );
+}
@@ -96,6 +96,8 @@
 #include <XStrSafe.h>
 #include <unistd.h>
 #include <errno.h>
+#include <time.h>
+#include "hal/clock.h"
 
 
 
@@ -368,10 +370,12 @@ UDPRecv::UDPRecv(
   ):
   m_pxth( NULL ),
   m_pxes( NULL ),
+  m_bHasAttr( false ),
   m_iFD( -1 )
 {
   m_pipefd[0] = ( -1 );
   m_pipefd[1] = ( -1 );
+  memset( &m_attr, 0, sizeof( m_attr ) );
 }
 
 
@@ -580,6 +584,19 @@ UDPRecv::SetCallback(
 }
 
 
+void
+UDPRecv::SetThreadAttr(
+  const XTHREADATTR*  pAttr  // IN_OPT
+  )
+{
+  m_bHasAttr = ( NULL != pAttr );
+  if ( m_bHasAttr )
+  {
+    m_attr = *pAttr;
+  }
+}
+
+
 XRESULT
 UDPRecv::StartListen(
   )
@@ -605,6 +622,7 @@ UDPRecv::StartListen(
     goto Exit;
   }
 
+  m_pxth->SetAttr( m_bHasAttr ? &m_attr : NULL );
   m_pxth->Run( InvokeLoopFunction, this );
 
   xr = RESULT_SUCCESS;
@@ -666,6 +684,7 @@ UDPRecv::LoopAndReceiveMessage(
     U32          uSrcAddrCb;
     U32          uMsgCb;
     S32          iReadyCnt;
+    S64          recvts;
 
 
     uSrcAddrCb = sizeof( srcaddr );
@@ -697,14 +716,17 @@ UDPRecv::LoopAndReceiveMessage(
                          (struct sockaddr*)&srcaddr,
                          (socklen_t*)&uSrcAddrCb );
 
+      recvts = (S64)rp::hal::clock_now();
+
       pszSrcIP = inet_ntoa(srcaddr.sin_addr);
 
       if ( 0UL < uMsgCb && NULL != m_pxes )
       {
         XStrCopyA( xudpmsg.szSrcIP, XIPADDRSTR_CCH, pszSrcIP );
 
-        xudpmsg.pMsg    = szBuf;
-        xudpmsg.ulCbMsg = uMsgCb;
+        xudpmsg.pMsg     = szBuf;
+        xudpmsg.ulCbMsg  = uMsgCb;
+        xudpmsg.llRecvTs = recvts;
 
         m_pxes->ReceiveMessage( &xudpmsg );
       }
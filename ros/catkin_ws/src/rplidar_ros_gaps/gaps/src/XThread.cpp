@@ -58,6 +58,8 @@
 #include <XThread.h>
 #include <XException.h>
 #include <time.h>  // for sleep
+#include <sched.h>
+#include <limits.h>
 
 
 
@@ -91,6 +93,10 @@ _ThreadRunner(
   )
 {
   XThread*  pxt  =  (XThread*)pv;
+  if (pxt->m_bHasAttr && '\0' != pxt->m_attr.szName[0])
+  {
+    pthread_setname_np(pthread_self(), pxt->m_attr.szName);
+  }
   pxt->m_vulID = (U32)syscall(SYS_gettid);  // gettid()
   (*(pxt->m_func))(&pxt->m_arg);
   return NULL;
@@ -99,6 +105,66 @@ _ThreadRunner(
 
 
 
+static
+void
+_CpuMaskToSet(
+  U64         ullMask,  // IN
+  cpu_set_t*  pSet      // OUT
+  )
+{
+  CPU_ZERO(pSet);
+  for (S32 iCpu = 0; iCpu < 64; ++iCpu)
+  {
+    if (ullMask & (1ULL << iCpu))
+    {
+      CPU_SET(iCpu, pSet);
+    }
+  }
+}
+
+
+//
+// the parts of pAttr that go into a pthread_attr_t.
+//
+static
+S32
+_SetCreateAttr(
+  pthread_attr_t*     pattr,  // INOUT
+  const XTHREADATTR*  pAttr   // IN
+  )
+{
+  S32 iError = 0;
+
+  if (0 != pAttr->ulStackSize)
+  {
+    iError = pthread_attr_setstacksize(pattr, std::max(pAttr->ulStackSize, (SIZE_T)PTHREAD_STACK_MIN));
+    if (0 != iError) return iError;
+  }
+
+  if (0 != pAttr->ullCpuMask)
+  {
+    cpu_set_t set;
+    _CpuMaskToSet(pAttr->ullCpuMask, &set);
+    iError = pthread_attr_setaffinity_np(pattr, sizeof(set), &set);
+    if (0 != iError) return iError;
+  }
+
+  if (SCHED_OTHER != pAttr->iPolicy)
+  {
+    struct sched_param param;
+    param.sched_priority = pAttr->iPriority;
+
+    iError = pthread_attr_setinheritsched(pattr, PTHREAD_EXPLICIT_SCHED);
+    if (0 == iError) iError = pthread_attr_setschedpolicy(pattr, pAttr->iPolicy);
+    if (0 == iError) iError = pthread_attr_setschedparam(pattr, &param);
+  }
+
+  return iError;
+}
+
+
+
+
 //---------------------------------------------------------------------------
 // XTHREAD IMPLEMENTATION
 //---------------------------------------------------------------------------
@@ -113,6 +179,22 @@ XThread::XThread(
   m_func      = NULL;
   m_arg.pv    = NULL;
   m_arg.bStop = false;
+  m_bHasAttr  = false;
+  memset(&m_attr, 0, sizeof(m_attr));
+}
+
+
+void
+XThread::SetAttr(
+  const XTHREADATTR*  pAttr  // IN_OPT
+  )
+{
+  m_bHasAttr = (NULL != pAttr);
+  if (m_bHasAttr)
+  {
+    m_attr = *pAttr;
+    m_attr.szName[sizeof(m_attr.szName) - 1] = '\0';
+  }
 }
 
 
@@ -160,7 +242,32 @@ XThread::Run(
     _ThrowThreadException(__FILE__, __LINE__, "pthread_attr_setinheritsched", iError);
   }
 
-  iError = pthread_create(&m_thread, &attr, _ThreadRunner, this);
+  if (m_bHasAttr)
+  {
+    iError = _SetCreateAttr(&attr, &m_attr);
+    if (0 == iError)
+    {
+      iError = pthread_create(&m_thread, &attr, _ThreadRunner, this);
+    }
+
+    if (0 != iError)
+    {
+      // not worth failing over; the thread runs, just not where or how asked
+      fprintf(stderr, "[XThread::Run] %s: %s, using the default policy and cpus.\n",
+              ('\0' != m_attr.szName[0] ? m_attr.szName : "thread"), strerror(iError));
+
+      pthread_attr_destroy(&attr);
+      pthread_attr_init(&attr);
+      pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+      pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+      iError = pthread_create(&m_thread, &attr, _ThreadRunner, this);
+    }
+  }
+  else
+  {
+    iError = pthread_create(&m_thread, &attr, _ThreadRunner, this);
+  }
+
   if (0 != iError)
   {
     m_thread = 0;
@@ -254,6 +361,103 @@ XThread::Sleep(
 
 
 
+//static
+S32
+XThread::ApplyToSelf(
+  const XTHREADATTR*  pAttr  // IN
+  )
+{
+  S32 iError = 0;
+
+  if ('\0' != pAttr->szName[0])
+  {
+    char szName[16];
+    strncpy(szName, pAttr->szName, sizeof(szName) - 1);
+    szName[sizeof(szName) - 1] = '\0';
+    iError = pthread_setname_np(pthread_self(), szName);
+    if (0 != iError) return iError;
+  }
+
+  if (0 != pAttr->ullCpuMask)
+  {
+    cpu_set_t set;
+    _CpuMaskToSet(pAttr->ullCpuMask, &set);
+    iError = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (0 != iError) return iError;
+  }
+
+  if (SCHED_OTHER != pAttr->iPolicy)
+  {
+    struct sched_param param;
+    param.sched_priority = pAttr->iPriority;
+    iError = pthread_setschedparam(pthread_self(), pAttr->iPolicy, &param);
+  }
+
+  return iError;
+}
+
+
+//static
+bool
+XThread::ParseCpuList(
+  const char*  pszList,  // IN
+  U64*         pullMask  // OUT
+  )
+{
+  const char* p = pszList;
+
+  *pullMask = 0;
+
+  while ('\0' != *p)
+  {
+    char* pEnd;
+    long  lFirst = strtol(p, &pEnd, 10);
+    long  lLast  = lFirst;
+
+    if (pEnd == p || lFirst < 0 || lFirst > 63) return false;
+    p = pEnd;
+
+    if ('-' == *p)
+    {
+      lLast = strtol(p + 1, &pEnd, 10);
+      if (pEnd == p + 1 || lLast < lFirst || lLast > 63) return false;
+      p = pEnd;
+    }
+
+    for (long lCpu = lFirst; lCpu <= lLast; ++lCpu)
+    {
+      *pullMask |= (1ULL << lCpu);
+    }
+
+    if (',' == *p)
+    {
+      ++p;
+    }
+    else if ('\0' != *p)
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+//static
+S32
+XThread::ParsePolicy(
+  const char*  pszPolicy  // IN
+  )
+{
+  if (0 == strcmp(pszPolicy, "other") || '\0' == pszPolicy[0]) return SCHED_OTHER;
+  if (0 == strcmp(pszPolicy, "fifo"))  return SCHED_FIFO;
+  if (0 == strcmp(pszPolicy, "rr"))    return SCHED_RR;
+  return -1;
+}
+
+
+
+
 //---------------------------------------------------------------------------
 // XCOND IMPLEMENTATION
 //---------------------------------------------------------------------------
@@ -38,14 +38,79 @@
 
 namespace rp{ namespace hal{
 
+static bool                   _has_default_attr = false;
+static Thread::thread_attr_t  _default_attr;
+static char                   _default_name[16];
+
+static void _cpu_mask_to_set(_u64 cpu_mask, cpu_set_t * set)
+{
+    CPU_ZERO(set);
+    for (int cpu = 0; cpu < 64; ++cpu) {
+        if (cpu_mask & (1ULL << cpu)) CPU_SET(cpu, set);
+    }
+}
+
+void Thread::setDefaultAttr(const thread_attr_t * attr)
+{
+    _has_default_attr = (attr != NULL);
+    if (!attr) return;
+
+    _default_attr = *attr;
+    _default_name[0] = 0;
+    if (attr->name) {
+        strncpy(_default_name, attr->name, sizeof(_default_name) - 1);
+        _default_name[sizeof(_default_name) - 1] = 0;
+        _default_attr.name = _default_name;
+    }
+}
+
 Thread Thread::create(thread_proc_t proc, void * data)
 {
     Thread newborn(proc, data);
+    pthread_attr_t attr;
     
     // tricky code, we assume pthread_t is not a structure but a word size value
     assert( sizeof(newborn._handle) >= sizeof(pthread_t));
 
-    pthread_create((pthread_t *)&newborn._handle, NULL, (void * (*)(void *))proc, data);
+    pthread_attr_init(&attr);
+    if (_has_default_attr) {
+        if (_default_attr.stack_size) {
+            pthread_attr_setstacksize(&attr, _default_attr.stack_size);
+        }
+        if (_default_attr.cpu_mask) {
+            // the thread never runs anywhere else, not even briefly
+            cpu_set_t set;
+            _cpu_mask_to_set(_default_attr.cpu_mask, &set);
+            pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+        }
+    }
+
+    int err = pthread_create((pthread_t *)&newborn._handle, &attr, (void * (*)(void *))proc, data);
+    pthread_attr_destroy(&attr);
+
+    if (err && _has_default_attr) {
+        // a cpu the board doesn't have or a stack size it won't take is
+        // not worth a driver that can't start its threads
+        fprintf(stderr, "[rp::hal::Thread::create] %s: %s, using the default stack and cpus.\n",
+                (_default_attr.name ? _default_attr.name : "thread"), strerror(err));
+        err = pthread_create((pthread_t *)&newborn._handle, NULL, (void * (*)(void *))proc, data);
+    }
+    if (err) {
+        newborn._handle = 0;
+    }
+
+    if (newborn._handle && _has_default_attr) {
+        // a realtime policy needs CAP_SYS_NICE; without it the thread
+        // still runs, time shared
+        if (_default_attr.policy != SCHEDULE_OTHER &&
+            IS_FAIL(newborn.setSchedule(_default_attr.policy, _default_attr.priority))) {
+            fprintf(stderr, "[rp::hal::Thread::create] %s: realtime policy not permitted, running time shared.\n",
+                    (_default_attr.name ? _default_attr.name : "thread"));
+        }
+        if (_default_attr.name) {
+            newborn.setName(_default_attr.name);
+        }
+    }
 
     return newborn;
 }
@@ -77,22 +142,21 @@ u_result Thread::setPriority( priority_val_t p)
     switch(p)
     {
     case PRIORITY_REALTIME:
-        //pthread_priority = pthread_priority_max;
         current_policy = SCHED_RR;
+        current_param.__sched_priority = sched_get_priority_max(SCHED_RR);
         break;
     case PRIORITY_HIGH:
-        //pthread_priority = (pthread_priority_max + pthread_priority_min)/2;
         current_policy = SCHED_RR;
+        current_param.__sched_priority = (sched_get_priority_max(SCHED_RR) + sched_get_priority_min(SCHED_RR))/2;
         break;
     case PRIORITY_NORMAL:
     case PRIORITY_LOW:
     case PRIORITY_IDLE:
-        //pthread_priority = 0;
         current_policy = SCHED_OTHER;
+        current_param.__sched_priority = 0;
         break;
     }
 
-    current_param.__sched_priority = current_policy;
     if ( (ans = pthread_setschedparam( (pthread_t) this->_handle, current_policy, &current_param)) )
     {
         return RESULT_OPERATION_FAIL;
@@ -126,6 +190,49 @@ Thread::priority_val_t Thread::getPriority()
     return PRIORITY_NORMAL;
 }
 
+u_result Thread::setAffinity(_u64 cpu_mask)
+{
+    if (!this->_handle) return RESULT_OPERATION_FAIL;
+
+    cpu_set_t set;
+    if (cpu_mask) {
+        _cpu_mask_to_set(cpu_mask, &set);
+    } else {
+        // back to every cpu
+        CPU_ZERO(&set);
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) CPU_SET(cpu, &set);
+    }
+    return pthread_setaffinity_np((pthread_t)this->_handle, sizeof(set), &set) == 0 ? RESULT_OK : RESULT_OPERATION_FAIL;
+}
+
+u_result Thread::setSchedule(int policy, int priority)
+{
+    if (!this->_handle) return RESULT_OPERATION_FAIL;
+
+    struct sched_param param;
+    int native;
+    switch (policy)
+    {
+    case SCHEDULE_FIFO:  native = SCHED_FIFO;  break;
+    case SCHEDULE_RR:    native = SCHED_RR;    break;
+    default:             native = SCHED_OTHER; break;
+    }
+    param.sched_priority = (native == SCHED_OTHER) ? 0 :
+        std::max(sched_get_priority_min(native), std::min(sched_get_priority_max(native), priority));
+    return pthread_setschedparam((pthread_t)this->_handle, native, &param) == 0 ? RESULT_OK : RESULT_OPERATION_FAIL;
+}
+
+u_result Thread::setName(const char * name)
+{
+    if (!this->_handle || !name) return RESULT_OPERATION_FAIL;
+
+    // the kernel keeps 15 characters
+    char trimmed[16];
+    strncpy(trimmed, name, sizeof(trimmed) - 1);
+    trimmed[sizeof(trimmed) - 1] = 0;
+    return pthread_setname_np((pthread_t)this->_handle, trimmed) == 0 ? RESULT_OK : RESULT_OPERATION_FAIL;
+}
+
 u_result Thread::join(unsigned long timeout)
 {
     if (!this->_handle) return RESULT_OK;
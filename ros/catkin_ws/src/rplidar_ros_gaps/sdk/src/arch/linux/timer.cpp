@@ -33,20 +33,16 @@
  */
 
 #include "arch/linux/arch_linux.h"
+#include "hal/clock.h"
 
 namespace rp{ namespace arch{
+// both on hal/clock.h's timeline, so driver and gaps timestamps compare
 _u64 rp_getus()
 {
-    struct timespec t;
-    t.tv_sec = t.tv_nsec = 0;
-    clock_gettime(CLOCK_MONOTONIC, &t);
-    return t.tv_sec*1000000LL + t.tv_nsec/1000;
+    return rp::hal::clock_now()/1000ULL;
 }
 _u32 rp_getms()
 {
-    struct timespec t;
-    t.tv_sec = t.tv_nsec = 0;
-    clock_gettime(CLOCK_MONOTONIC, &t);
-    return t.tv_sec*1000L + t.tv_nsec/1000000L;
+    return (_u32)(rp::hal::clock_now()/1000000ULL);
 }
 }}
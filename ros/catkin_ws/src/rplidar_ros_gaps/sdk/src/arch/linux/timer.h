@@ -46,7 +46,8 @@ static inline void delay(_word_size_t ms){
         usleep(ms*1000);
 }
 
-// TODO: the highest timer interface should be clock_gettime
+// millisecond ticks; the driver times its waits with rp::hal::clock_now(),
+// nanoseconds, see hal/clock.h
 namespace rp{ namespace arch{
 
 _u64 rp_getus();
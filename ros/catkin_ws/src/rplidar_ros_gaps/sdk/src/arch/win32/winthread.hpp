@@ -141,4 +141,24 @@ u_result Thread::join(unsigned long timeout)
     return RESULT_OK;
 }
 
+void Thread::setDefaultAttr(const thread_attr_t * attr)
+{
+    // not supported on this platform, threads keep the defaults
+}
+
+u_result Thread::setAffinity(_u64 cpu_mask)
+{
+    return RESULT_OPERATION_NOT_SUPPORT;
+}
+
+u_result Thread::setSchedule(int policy, int priority)
+{
+    return RESULT_OPERATION_NOT_SUPPORT;
+}
+
+u_result Thread::setName(const char * name)
+{
+    return RESULT_OPERATION_NOT_SUPPORT;
+}
+
 }}
@@ -0,0 +1,257 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2016 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#include "sdkcommon.h"
+#include "hal/clock.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#include <pthread.h>
+#if defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#endif
+#endif
+
+namespace rp{ namespace hal{
+
+volatile bool g_clock_raw_ok = false;
+
+_u64 clock_now()
+{
+#if defined(_WIN32)
+    LARGE_INTEGER freq, cnt;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&cnt);
+    return (_u64)(cnt.QuadPart / freq.QuadPart) * 1000000000ULL
+         + (_u64)(cnt.QuadPart % freq.QuadPart) * 1000000000ULL / freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (_u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+_s64 clock_wall_offset()
+{
+#if defined(_WIN32)
+    // 100ns since 1601 to ns since 1970
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+    _u64 wall = (((_u64)ft.dwHighDateTime << 32) | ft.dwLowDateTime) - 116444736000000000ULL;
+    return (_s64)(wall * 100) - (_s64)clock_now();
+#else
+    // the wall read bracketed by two monotonic ones; of a few tries the
+    // tightest bracket, so a preemption in between doesn't skew it
+    _s64 best_offset = 0;
+    _u64 best_span   = (_u64)-1;
+
+    for (int i = 0; i < 3; ++i) {
+        struct timespec wall;
+        _u64 before = clock_now();
+        clock_gettime(CLOCK_REALTIME, &wall);
+        _u64 after  = clock_now();
+
+        if (after - before < best_span) {
+            best_span   = after - before;
+            best_offset = (_s64)((_u64)wall.tv_sec * 1000000000ULL + wall.tv_nsec)
+                        - (_s64)(before + (after - before) / 2);
+        }
+    }
+    return best_offset;
+#endif
+}
+
+#if !defined(_WIN32) && defined(__GNUC__) && \
+    (defined(__i386__) || defined(__x86_64__) || defined(__aarch64__))
+
+#define RP_CLOCK_HAS_COUNTER
+
+static inline _u64 _read_counter()
+{
+#if defined(__aarch64__)
+    _u64 v;
+    __asm__ __volatile__("isb; mrs %0, cntvct_el0" : "=r"(v) :: "memory");
+    return v;
+#else
+    return __builtin_ia32_rdtsc();
+#endif
+}
+
+// raw to ns is ns0 + ( raw - raw0 ) / hz, behind a sequence count so a
+// re-fit never hands out a torn anchor
+static volatile _u32 s_seq  = 0;
+static volatile _u64 s_raw0 = 0;
+static volatile _u64 s_ns0  = 0;
+static volatile _u64 s_hz   = 1000000000ULL;
+static volatile int  s_refitting = 0;
+
+static pthread_once_t s_calib_once = PTHREAD_ONCE_INIT;
+
+// a counter read paired with the clock_now() taken in the middle of it
+static void _sample(_u64 & raw, _u64 & ns)
+{
+    _u64 best_span = (_u64)-1;
+
+    for (int i = 0; i < 3; ++i) {
+        _u64 r0 = _read_counter();
+        _u64 n  = clock_now();
+        _u64 r1 = _read_counter();
+
+        if (r1 - r0 < best_span) {
+            best_span = r1 - r0;
+            raw = r0 + (r1 - r0) / 2;
+            ns  = n;
+        }
+    }
+}
+
+static void _load_anchor(_u64 & raw0, _u64 & ns0, _u64 & hz)
+{
+    _u32 seq;
+    do {
+        seq  = __atomic_load_n(&s_seq, __ATOMIC_ACQUIRE);
+        raw0 = __atomic_load_n(&s_raw0, __ATOMIC_RELAXED);
+        ns0  = __atomic_load_n(&s_ns0, __ATOMIC_RELAXED);
+        hz   = __atomic_load_n(&s_hz, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || seq != __atomic_load_n(&s_seq, __ATOMIC_RELAXED));
+}
+
+static void _store_anchor(_u64 raw0, _u64 ns0, _u64 hz)
+{
+    __atomic_store_n(&s_seq, s_seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&s_raw0, raw0, __ATOMIC_RELAXED);
+    __atomic_store_n(&s_ns0, ns0, __ATOMIC_RELAXED);
+    __atomic_store_n(&s_hz, hz, __ATOMIC_RELAXED);
+    __atomic_store_n(&s_seq, s_seq + 1, __ATOMIC_RELEASE);
+}
+
+// the rate over everything since the last anchor, which also follows
+// NTP slewing clock_now()
+static void _refit()
+{
+    int idle = 0;
+    if (!__atomic_compare_exchange_n(&s_refitting, &idle, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return;
+    }
+
+    _u64 raw0, ns0, hz, raw, ns;
+    _load_anchor(raw0, ns0, hz);
+    _sample(raw, ns);
+
+    if (raw > raw0 && ns > ns0) {
+        hz = (_u64)((double)(raw - raw0) * 1e9 / (double)(ns - ns0) + 0.5);
+    }
+    _store_anchor(raw, ns, hz);
+
+    __atomic_store_n(&s_refitting, 0, __ATOMIC_RELEASE);
+}
+
+static void _calibrate()
+{
+    _u64 hz = 0;
+
+#if defined(__aarch64__)
+    __asm__ __volatile__("mrs %0, cntfrq_el0" : "=r"(hz));
+#else
+    // a TSC that may stop or change rate with the cpu is no clock
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1u << 8))) {
+        return;
+    }
+
+    _u64 raw0, ns0, raw1, ns1;
+    struct timespec pause = { 0, 10000000 };
+    _sample(raw0, ns0);
+    nanosleep(&pause, NULL);
+    _sample(raw1, ns1);
+    if (raw1 > raw0 && ns1 > ns0) {
+        hz = (_u64)((double)(raw1 - raw0) * 1e9 / (double)(ns1 - ns0) + 0.5);
+    }
+#endif
+
+    if (hz < 1000000ULL) return;
+
+    _u64 raw, ns;
+    _sample(raw, ns);
+    _store_anchor(raw, ns, hz);
+    __atomic_store_n(&g_clock_raw_ok, true, __ATOMIC_RELEASE);
+}
+
+#endif
+
+_u64 clock_raw_slow()
+{
+#if defined(RP_CLOCK_HAS_COUNTER)
+    pthread_once(&s_calib_once, _calibrate);
+    if (g_clock_raw_ok) return _read_counter();
+#endif
+    return clock_now();
+}
+
+_u64 clock_raw_to_ns(_u64 raw)
+{
+#if defined(RP_CLOCK_HAS_COUNTER)
+    if (!g_clock_raw_ok) return raw;
+
+    _u64 raw0, ns0, hz;
+    _load_anchor(raw0, ns0, hz);
+
+    if (raw >= raw0) {
+        _u64 d = raw - raw0;
+        if (d > hz) _refit();
+        return ns0 + (d / hz) * 1000000000ULL + (d % hz) * 1000000000ULL / hz;
+    } else {
+        // read before the anchor moved past it
+        _u64 d = raw0 - raw;
+        return ns0 - (d / hz) * 1000000000ULL - (d % hz) * 1000000000ULL / hz;
+    }
+#else
+    return raw;
+#endif
+}
+
+_u64 clock_raw_hz()
+{
+#if defined(RP_CLOCK_HAS_COUNTER)
+    if (g_clock_raw_ok) return __atomic_load_n(&s_hz, __ATOMIC_RELAXED);
+#endif
+    return 1000000000ULL;
+}
+
+}}
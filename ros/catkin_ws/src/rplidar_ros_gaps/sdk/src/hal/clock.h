@@ -0,0 +1,88 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2016 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#pragma once
+
+#include "rptypes.h"
+
+// The one clock the driver and the gaps pipeline time things with.
+//
+// clock_now() is monotonic nanoseconds (CLOCK_MONOTONIC on posix): it
+// never steps when NTP or a user sets the date, so waits, latencies and
+// scan stamps are all taken on it. Wall time is only wanted where a
+// stamp leaves the machine's own timeline, clock_to_wall() maps there.
+//
+// clock_raw() reads the cpu's counter (TSC on x86, CNTVCT_EL0 on ARMv8)
+// with no library call. The counter is calibrated against clock_now()
+// on first use and re-fit about once a second, and clock_raw_to_ns()
+// puts a read on clock_now()'s timeline, to within a few microseconds.
+// Where there is no usable counter (no invariant TSC, other cpus)
+// clock_raw() is clock_now() and the conversion is the identity.
+
+namespace rp{ namespace hal{
+
+_u64  clock_now();
+
+// CLOCK_REALTIME - clock_now(), as of now, in nanoseconds
+_s64  clock_wall_offset();
+
+static inline _u64 clock_to_wall(_u64 mono)
+{
+    return (_u64)((_s64)mono + clock_wall_offset());
+}
+
+extern volatile bool g_clock_raw_ok;
+
+_u64  clock_raw_slow();
+_u64  clock_raw_to_ns(_u64 raw);
+
+// counts per second, 1000000000 when clock_raw() is clock_now()
+_u64  clock_raw_hz();
+
+static inline _u64 clock_raw()
+{
+    if (!g_clock_raw_ok) return clock_raw_slow();
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    return __builtin_ia32_rdtsc();
+#elif defined(__GNUC__) && defined(__aarch64__)
+    _u64 v;
+    __asm__ __volatile__("isb; mrs %0, cntvct_el0" : "=r"(v) :: "memory");
+    return v;
+#else
+    return clock_raw_slow();
+#endif
+}
+
+}}
@@ -0,0 +1,292 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2016 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#pragma once
+
+#include "hal/locker.h"
+#include "hal/event.h"
+
+// Locker and Event for short critical sections.
+//
+// AdaptiveLocker spins a bounded, self-tuning number of times before it
+// parks on a futex, and an uncontended lock/unlock is two atomics with
+// no system call. MonotonicEvent keeps its state in a futex word and
+// waits against CLOCK_MONOTONIC, so a timeout isn't stretched or cut
+// short by the wall clock being stepped. Both keep the interface and
+// return codes of Locker and Event; off Linux they are those classes.
+
+#if defined(__linux__)
+
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+namespace rp{ namespace hal{
+
+namespace futex_detail {
+
+// deadline is absolute CLOCK_MONOTONIC, NULL to wait for ever
+static inline int wait(volatile int * word, int expected, const timespec * deadline)
+{
+    if (syscall(SYS_futex, word, FUTEX_WAIT_BITSET | FUTEX_PRIVATE_FLAG,
+                expected, deadline, NULL, FUTEX_BITSET_MATCH_ANY) == 0) {
+        return 0;
+    }
+    return errno;
+}
+
+static inline void wake(volatile int * word, int count)
+{
+    syscall(SYS_futex, word, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, count, NULL, NULL, 0);
+}
+
+static inline void deadline_after(unsigned long timeout_ms, timespec & deadline)
+{
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec  += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        ++deadline.tv_sec;
+        deadline.tv_nsec -= 1000000000L;
+    }
+}
+
+static inline void cpu_relax()
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield" ::: "memory");
+#else
+    __asm__ __volatile__("" ::: "memory");
+#endif
+}
+
+// spinning only pays when the owner can run at the same time
+static inline bool spin_useful()
+{
+    static int cpus = 0;
+    if (cpus == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        cpus = n > 0 ? (int)n : 1;
+    }
+    return cpus > 1;
+}
+
+}
+
+class AdaptiveLocker
+{
+public:
+    enum LOCK_STATUS
+    {
+        LOCK_OK = 1,
+        LOCK_TIMEOUT = -1,
+        LOCK_FAILED = 0
+    };
+
+    enum
+    {
+        SPIN_MAX = 1000, // ~ tens of microseconds of pause before parking
+    };
+
+    AdaptiveLocker()
+        : _state(0)
+        , _spin(SPIN_MAX / 10)
+    {
+    }
+
+    // timeout is in ms, 0 to try once, 0xFFFFFFFF for ever
+    LOCK_STATUS lock(unsigned long timeout = 0xFFFFFFFF)
+    {
+        int c = 0;
+        if (__atomic_compare_exchange_n(&_state, &c, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return LOCK_OK;
+        }
+        if (timeout == 0) return LOCK_TIMEOUT;
+
+        // spin up to twice what the last acquisitions took, so a lock
+        // whose owner never lets go quickly stops spinning on its own.
+        // _spin is only written with the lock held
+        int spin  = __atomic_load_n(&_spin, __ATOMIC_RELAXED);
+        int limit = 0;
+        if (futex_detail::spin_useful()) {
+            limit = spin * 2 + 10;
+            if (limit > SPIN_MAX) limit = SPIN_MAX;
+        }
+
+        for (int cnt = 0; cnt < limit; ++cnt) {
+            futex_detail::cpu_relax();
+            c = 0;
+            if (__atomic_load_n(&_state, __ATOMIC_RELAXED) == 0 &&
+                __atomic_compare_exchange_n(&_state, &c, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+                __atomic_store_n(&_spin, spin + (cnt - spin) / 8, __ATOMIC_RELAXED);
+                return LOCK_OK;
+            }
+        }
+
+        timespec deadline;
+        const timespec * pdeadline = NULL;
+        if (timeout != 0xFFFFFFFF) {
+            futex_detail::deadline_after(timeout, deadline);
+            pdeadline = &deadline;
+        }
+
+        // 2 tells unlock() someone may be parked
+        while ((c = __atomic_exchange_n(&_state, 2, __ATOMIC_ACQUIRE)) != 0) {
+            int err = futex_detail::wait(&_state, 2, pdeadline);
+            if (err == ETIMEDOUT) return LOCK_TIMEOUT;
+            if (err != 0 && err != EAGAIN && err != EINTR) return LOCK_FAILED;
+        }
+        if (limit) __atomic_store_n(&_spin, spin + (limit - spin) / 8, __ATOMIC_RELAXED);
+        return LOCK_OK;
+    }
+
+    void unlock()
+    {
+        if (__atomic_exchange_n(&_state, 0, __ATOMIC_RELEASE) == 2) {
+            futex_detail::wake(&_state, 1);
+        }
+    }
+
+protected:
+    // 0 free, 1 locked, 2 locked and maybe waited on
+    volatile int _state;
+    int          _spin;
+};
+
+class MonotonicEvent
+{
+public:
+    enum
+    {
+        EVENT_OK = 1,
+        EVENT_TIMEOUT = -1,
+        EVENT_FAILED = 0,
+    };
+
+    MonotonicEvent(bool isAutoReset = true, bool isSignal = false)
+        : _state(isSignal ? 1 : 0)
+        , _isAutoReset(isAutoReset)
+    {
+    }
+
+    void set( bool isSignal = true )
+    {
+        if (isSignal) {
+            // everyone parked is woken; under auto reset all but one of
+            // them find the event taken and park again
+            if (__atomic_exchange_n(&_state, 1, __ATOMIC_RELEASE) == 2) {
+                futex_detail::wake(&_state, INT_MAX);
+            }
+        } else {
+            int s = 1;
+            __atomic_compare_exchange_n(&_state, &s, 0, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+        }
+    }
+
+    // timeout is in ms, 0xFFFFFFFF for ever
+    unsigned long wait( unsigned long timeout = 0xFFFFFFFF )
+    {
+        // the clock is read only once it's known there's a wait
+        timespec deadline;
+        const timespec * pdeadline = NULL;
+
+        for (;;) {
+            int s = __atomic_load_n(&_state, __ATOMIC_ACQUIRE);
+
+            if (s == 1) {
+                if (!_isAutoReset) return EVENT_OK;
+                if (__atomic_compare_exchange_n(&_state, &s, 0, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+                    return EVENT_OK;
+                }
+                continue;
+            }
+
+            if (timeout == 0) return EVENT_TIMEOUT;
+
+            // 2 tells set() someone may be parked
+            if (s == 0 && !__atomic_compare_exchange_n(&_state, &s, 2, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                continue;
+            }
+
+            if (timeout != 0xFFFFFFFF && pdeadline == NULL) {
+                futex_detail::deadline_after(timeout, deadline);
+                pdeadline = &deadline;
+            }
+
+            int err = futex_detail::wait(&_state, 2, pdeadline);
+            if (err == ETIMEDOUT) return EVENT_TIMEOUT;
+            if (err != 0 && err != EAGAIN && err != EINTR) return EVENT_FAILED;
+        }
+    }
+
+protected:
+    // 0 clear, 1 signalled, 2 clear and maybe waited on
+    volatile int _state;
+    bool         _isAutoReset;
+};
+
+class AdaptiveAutoLocker
+{
+public :
+    AdaptiveAutoLocker(AdaptiveLocker &l): _binded(l)
+    {
+        _binded.lock();
+    }
+
+    void forceUnlock() {
+        _binded.unlock();
+    }
+    ~AdaptiveAutoLocker() {_binded.unlock();}
+    AdaptiveLocker & _binded;
+};
+
+}}
+
+#else
+
+namespace rp{ namespace hal{
+
+typedef Locker     AdaptiveLocker;
+typedef Event      MonotonicEvent;
+typedef AutoLocker AdaptiveAutoLocker;
+
+}}
+
+#endif
@@ -52,6 +52,24 @@ public:
 		PRIORITY_IDLE     = 4,
 	};
 
+    enum schedule_policy_t
+    {
+        SCHEDULE_OTHER = 0,     // time shared, the default
+        SCHEDULE_FIFO  = 1,     // realtime, runs until it blocks
+        SCHEDULE_RR    = 2,     // realtime, round robin among equal priorities
+    };
+
+    // what a thread is created with.  zero / NULL fields are left at the
+    // system default
+    struct thread_attr_t
+    {
+        const char * name;      // up to 15 characters, shown by top and perf
+        int          policy;    // schedule_policy_t
+        int          priority;  // 1 to 99 under SCHEDULE_FIFO and SCHEDULE_RR
+        _u64         cpu_mask;  // bit n lets it run on cpu n, 0 for any
+        size_t       stack_size;
+    };
+
     template <class T, u_result (T::*PROC)(void)>
     static Thread create_member(T * pthis)
     {
@@ -65,6 +83,11 @@ public:
 	}
 	static Thread create(thread_proc_t proc, void * data = NULL );
 
+    // attributes for the threads create() makes from now on, NULL for
+    // none.  the driver makes its scan cache thread itself, this is how
+    // it gets pinned.  the name is copied
+    static void setDefaultAttr(const thread_attr_t * attr);
+
 public:
     ~Thread() { }
     Thread():  _data(NULL),_func(NULL),_handle(0)  {}
@@ -74,6 +97,9 @@ public:
     u_result join(unsigned long timeout = -1);
 	u_result setPriority( priority_val_t p);
 	priority_val_t getPriority();
+    u_result setAffinity(_u64 cpu_mask);
+    u_result setSchedule(int policy, int priority);
+    u_result setName(const char * name);
 
     bool operator== ( const Thread & right) { return this->_handle == right._handle; }
 protected:
@@ -0,0 +1,77 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2016 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#pragma once
+
+#include "rptypes.h"
+
+// Optional latency tracepoints.
+//
+// The driver reports a few pipeline stages through a hook that the
+// application installs; with no hook installed a tracepoint costs one
+// load and a not-taken branch. Keys are the driver's own scan counter,
+// the same value for every stage of one published scan.
+
+namespace rp{ namespace hal{
+
+enum {
+    TRACE_STAGE_DECODE  = 0, // the node completing a scan came off the wire
+    TRACE_STAGE_PUBLISH = 1, // scan copied to the grab cache
+    TRACE_STAGE_GRAB    = 2, // grabScanData handed the scan out
+};
+
+// ts is in nanoseconds on the monotonic clock, see trace_now() and hal/clock.h
+typedef void (*trace_hook_t)(int stage, _u32 key, _u64 ts);
+
+extern volatile trace_hook_t g_trace_hook;
+
+void  set_trace_hook(trace_hook_t hook);
+_u64  trace_now();
+
+}}
+
+#define RP_TRACE_ON()  (rp::hal::g_trace_hook != NULL)
+
+#define RP_TRACE_TS(_stage_, _key_, _ts_) \
+    do { \
+        rp::hal::trace_hook_t _hook_ = rp::hal::g_trace_hook; \
+        if (_hook_) _hook_((_stage_), (_key_), (_ts_)); \
+    } while (0)
+
+#define RP_TRACE(_stage_, _key_) \
+    do { \
+        rp::hal::trace_hook_t _hook_ = rp::hal::g_trace_hook; \
+        if (_hook_) _hook_((_stage_), (_key_), rp::hal::trace_now()); \
+    } while (0)
@@ -37,6 +37,9 @@
 #include "hal/thread.h"
 #include "hal/locker.h"
 #include "hal/event.h"
+#include "hal/futex.h"
+#include "hal/clock.h"
+#include "hal/trace.h"
 #include "rplidar_driver_serial.h"
 
 #ifndef min
@@ -45,6 +48,18 @@
 
 namespace rp { namespace standalone{ namespace rplidar {
 
+// what's left of a ms timeout started at startTs (rp::hal::clock_now()),
+// rounded up so the last wait isn't cut to 0 and given up on at once;
+// false when there's nothing left
+static inline bool _timeLeft(_u64 startTs, _u32 timeout, _u32 & left)
+{
+    _u64 spent = rp::hal::clock_now() - startTs;
+    _u64 limit = (_u64)timeout * 1000000ULL;
+
+    if (spent > limit) return false;
+    left = (_u32)((limit - spent + 999999ULL) / 1000000ULL);
+    return true;
+}
 
 // Factory Impl
 RPlidarDriver * RPlidarDriver::CreateDriver(_u32 drivertype)
@@ -76,6 +91,9 @@ RPlidarDriverSerialImpl::RPlidarDriverSerialImpl()
     _cached_scan_node_count = 0;
     _cached_sampleduration_std = LEGACY_SAMPLE_DURATION;
     _cached_sampleduration_express = LEGACY_SAMPLE_DURATION;
+    _trace_scan_id = 0;
+    _cached_scan_id = 0;
+    _trace_sync_ts = 0;
 }
 
 RPlidarDriverSerialImpl::~RPlidarDriverSerialImpl()
@@ -395,11 +413,16 @@ u_result RPlidarDriverSerialImpl::_cacheScanData()
                 // only publish the data when it contains a full 360 degree scan 
                 
                 if ((local_scan[0].sync_quality & RPLIDAR_RESP_MEASUREMENT_SYNCBIT)) {
-                    _lock.lock();
+                    _u32 scan_id = ++_trace_scan_id;
+                    RP_TRACE_TS(rp::hal::TRACE_STAGE_DECODE, scan_id, _trace_sync_ts);
+
+                    _scanLock.lock();
                     memcpy(_cached_scan_node_buf, local_scan, scan_count*sizeof(rplidar_response_measurement_node_t));
                     _cached_scan_node_count = scan_count;
+                    _cached_scan_id = scan_id;
+                    RP_TRACE(rp::hal::TRACE_STAGE_PUBLISH, scan_id);
                     _dataEvt.set();
-                    _lock.unlock();
+                    _scanLock.unlock();
                 }
                 scan_count = 0;
             }
@@ -474,6 +497,7 @@ void     RPlidarDriverSerialImpl::_capsuleToNormal(const rplidar_response_capsul
 u_result RPlidarDriverSerialImpl::_cacheCapsuledScanData()
 {
     rplidar_response_capsule_measurement_nodes_t    capsule_node;
+    _u64                                     capsule_ts = 0;
     rplidar_response_measurement_node_t      local_buf[128];
     size_t                                   count = 128;
     rplidar_response_measurement_node_t      local_scan[MAX_SCAN_NODES];
@@ -495,6 +519,9 @@ u_result RPlidarDriverSerialImpl::_cacheCapsuledScanData()
             }
         }
 
+        // nodes of the previous capsule are decoded now, on this one's arrival
+        if (RP_TRACE_ON()) capsule_ts = rp::hal::trace_now();
+
         _capsuleToNormal(capsule_node, local_buf, count);
 
         for (size_t pos = 0; pos < count; ++pos)
@@ -504,11 +531,16 @@ u_result RPlidarDriverSerialImpl::_cacheCapsuledScanData()
                 // only publish the data when it contains a full 360 degree scan 
                 
                 if ((local_scan[0].sync_quality & RPLIDAR_RESP_MEASUREMENT_SYNCBIT)) {
-                    _lock.lock();
+                    _u32 scan_id = ++_trace_scan_id;
+                    RP_TRACE_TS(rp::hal::TRACE_STAGE_DECODE, scan_id, capsule_ts);
+
+                    _scanLock.lock();
                     memcpy(_cached_scan_node_buf, local_scan, scan_count*sizeof(rplidar_response_measurement_node_t));
                     _cached_scan_node_count = scan_count;
+                    _cached_scan_id = scan_id;
+                    RP_TRACE(rp::hal::TRACE_STAGE_PUBLISH, scan_id);
                     _dataEvt.set();
-                    _lock.unlock();
+                    _scanLock.unlock();
                 }
                 scan_count = 0;
             }
@@ -525,20 +557,22 @@ u_result RPlidarDriverSerialImpl::grabScanData(rplidar_response_measurement_node
 {
     switch (_dataEvt.wait(timeout))
     {
-    case rp::hal::Event::EVENT_TIMEOUT:
+    case rp::hal::MonotonicEvent::EVENT_TIMEOUT:
         count = 0;
         return RESULT_OPERATION_TIMEOUT;
-    case rp::hal::Event::EVENT_OK:
+    case rp::hal::MonotonicEvent::EVENT_OK:
         {
             if(_cached_scan_node_count == 0) return RESULT_OPERATION_TIMEOUT; //consider as timeout
 
-            rp::hal::AutoLocker l(_lock);
+            rp::hal::AdaptiveAutoLocker l(_scanLock);
 
             size_t size_to_copy = min(count, _cached_scan_node_count);
 
             memcpy(nodebuffer, _cached_scan_node_buf, size_to_copy*sizeof(rplidar_response_measurement_node_t));
             count = size_to_copy;
             _cached_scan_node_count = 0;
+
+            RP_TRACE(rp::hal::TRACE_STAGE_GRAB, _cached_scan_id);
         }
         return RESULT_OK;
 
@@ -616,16 +650,16 @@ u_result RPlidarDriverSerialImpl::ascendScanData(rplidar_response_measurement_no
 u_result RPlidarDriverSerialImpl::_waitNode(rplidar_response_measurement_node_t * node, _u32 timeout)
 {
     int  recvPos = 0;
-    _u32 startTs = getms();
+    _u64 startTs = rp::hal::clock_now();
     _u8  recvBuffer[sizeof(rplidar_response_measurement_node_t)];
     _u8 *nodeBuffer = (_u8*)node;
-    _u32 waitTime;
+    _u32 waitLeft;
 
-   while ((waitTime=getms() - startTs) <= timeout) {
+   while (_timeLeft(startTs, timeout, waitLeft)) {
         size_t remainSize = sizeof(rplidar_response_measurement_node_t) - recvPos;
         size_t recvSize;
 
-        int ans = _rxtx->waitfordata(remainSize, timeout-waitTime, &recvSize);
+        int ans = _rxtx->waitfordata(remainSize, waitLeft, &recvSize);
         if (ans == rp::hal::serial_rxtx::ANS_DEV_ERR) 
             return RESULT_OPERATION_FAIL;
         else if (ans == rp::hal::serial_rxtx::ANS_TIMEOUT)
@@ -663,6 +697,9 @@ u_result RPlidarDriverSerialImpl::_waitNode(rplidar_response_measurement_node_t
             nodeBuffer[recvPos++] = currentByte;
 
             if (recvPos == sizeof(rplidar_response_measurement_node_t)) {
+                if ((node->sync_quality & RPLIDAR_RESP_MEASUREMENT_SYNCBIT) && RP_TRACE_ON()) {
+                    _trace_sync_ts = rp::hal::trace_now();
+                }
                 return RESULT_OK;
             }
         }
@@ -680,13 +717,13 @@ u_result RPlidarDriverSerialImpl::_waitScanData(rplidar_response_measurement_nod
     }
 
     size_t   recvNodeCount =  0;
-    _u32     startTs = getms();
-    _u32     waitTime;
+    _u64     startTs = rp::hal::clock_now();
+    _u32     waitLeft;
     u_result ans;
 
-    while ((waitTime = getms() - startTs) <= timeout && recvNodeCount < count) {
+    while (_timeLeft(startTs, timeout, waitLeft) && recvNodeCount < count) {
         rplidar_response_measurement_node_t node;
-        if (IS_FAIL(ans = _waitNode(&node, timeout - waitTime))) {
+        if (IS_FAIL(ans = _waitNode(&node, waitLeft))) {
             return ans;
         }
         
@@ -702,16 +739,16 @@ u_result RPlidarDriverSerialImpl::_waitScanData(rplidar_response_measurement_nod
 u_result RPlidarDriverSerialImpl::_waitCapsuledNode(rplidar_response_capsule_measurement_nodes_t & node, _u32 timeout)
 {
     int  recvPos = 0;
-    _u32 startTs = getms();
+    _u64 startTs = rp::hal::clock_now();
     _u8  recvBuffer[sizeof(rplidar_response_capsule_measurement_nodes_t)];
     _u8 *nodeBuffer = (_u8*)&node;
-    _u32 waitTime;
+    _u32 waitLeft;
 
-   while ((waitTime=getms() - startTs) <= timeout) {
+   while (_timeLeft(startTs, timeout, waitLeft)) {
         size_t remainSize = sizeof(rplidar_response_capsule_measurement_nodes_t) - recvPos;
         size_t recvSize;
 
-        int ans = _rxtx->waitfordata(remainSize, timeout-waitTime, &recvSize);
+        int ans = _rxtx->waitfordata(remainSize, waitLeft, &recvSize);
         if (ans == rp::hal::serial_rxtx::ANS_DEV_ERR) 
             return RESULT_OPERATION_FAIL;
         else if (ans == rp::hal::serial_rxtx::ANS_TIMEOUT)
@@ -827,16 +864,16 @@ u_result RPlidarDriverSerialImpl::_sendCommand(_u8 cmd, const void * payload, si
 u_result RPlidarDriverSerialImpl::_waitResponseHeader(rplidar_ans_header_t * header, _u32 timeout)
 {
     int  recvPos = 0;
-    _u32 startTs = getms();
+    _u64 startTs = rp::hal::clock_now();
     _u8  recvBuffer[sizeof(rplidar_ans_header_t)];
     _u8  *headerBuffer = reinterpret_cast<_u8 *>(header);
-    _u32 waitTime;
+    _u32 waitLeft;
 
-    while ((waitTime=getms() - startTs) <= timeout) {
+    while (_timeLeft(startTs, timeout, waitLeft)) {
         size_t remainSize = sizeof(rplidar_ans_header_t) - recvPos;
         size_t recvSize;
         
-        int ans = _rxtx->waitfordata(remainSize, timeout - waitTime, &recvSize);
+        int ans = _rxtx->waitfordata(remainSize, waitLeft, &recvSize);
         if (ans == rp::hal::serial_rxtx::ANS_DEV_ERR) 
             return RESULT_OPERATION_FAIL;
         else if (ans == rp::hal::serial_rxtx::ANS_TIMEOUT)
@@ -95,7 +95,11 @@ protected:
     bool     _isSupportingMotorCtrl;
 
 	rp::hal::Locker         _lock;
-    rp::hal::Event          _dataEvt;
+    // the cache thread and grabScanData hand scans over under their own
+    // lock, held for one memcpy, so publishing never waits on _lock's
+    // command exchanges
+    rp::hal::AdaptiveLocker _scanLock;
+    rp::hal::MonotonicEvent _dataEvt;
     rp::hal::serial_rxtx  * _rxtx;
     rplidar_response_measurement_node_t      _cached_scan_node_buf[2048];
     size_t                                   _cached_scan_node_count;
@@ -106,6 +110,11 @@ protected:
     rplidar_response_capsule_measurement_nodes_t _cached_previous_capsuledata;
     bool                                         _is_previous_capsuledataRdy;
 
+    // tracepoint keys, see hal/trace.h
+    _u32                    _trace_scan_id;
+    _u32                    _cached_scan_id;
+    _u64                    _trace_sync_ts;
+
 	rp::hal::Thread _cachethread;
 };
 
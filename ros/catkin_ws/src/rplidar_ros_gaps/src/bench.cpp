@@ -0,0 +1,1192 @@
+//
+// rplidarGapsBench - micro benchmarks for the lidar pipeline.
+//
+//   rplidarGapsBench [-log file.rplog | -scans 64 -nodes 400 -seed 1]
+//                    [-filter substr] [-mintime 0.5] [-reps 5]
+//                    [-format console|json|csv] [-out file]
+//                    [-port 8899] [-noudp]
+//
+// every case runs long enough to take -mintime seconds, -reps times,
+// and reports the median time per op along with the min and max of
+// the repetitions.  the json output uses google benchmark's field
+// names (real_time, cpu_time, time_unit, items_per_second) so its
+// compare tooling can diff two runs.
+//
+// input is either a recorded log or synthetic scans of a rectangular
+// room, with a few dropped returns and a little angle jitter so that
+// ascendScanData has something to fix up.
+//
+#include <XCommon.h>
+#include <XCommandLine.h>
+#include <RPLidar.h>
+#include <RPLidarProxy.h>
+#include <RPLidarLog.h>
+#include <RPLidarScan.h>
+#include <RPLidarSonar.h>
+#include <RPLidarMerge.h>
+#include "sdkcommon.h"
+#include "hal/abs_rxtx.h"
+#include "hal/thread.h"
+#include "hal/locker.h"
+#include "hal/event.h"
+#include "hal/futex.h"
+#include "hal/clock.h"
+#include "rplidar_driver_serial.h"
+#include <math.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+
+using namespace rp::standalone::rplidar;
+
+
+#define _CAPSULE_NODES_  ( 32 )
+#define _RECV_TIMEOUT_   ( 100000000LL )  // udp round trip, nanoseconds
+
+
+static inline S64 __getcputime()
+{
+  timespec time;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+  return (((S64)time.tv_sec) * 1000000000ULL + (S64)time.tv_nsec);
+}
+
+
+
+
+// _capsuleToNormal is protected
+class BenchDriver: public RPlidarDriverSerialImpl
+{
+public:
+  using RPlidarDriverSerialImpl::_capsuleToNormal;
+};
+
+
+typedef STDVEC<rplidar_response_measurement_node_t>  NodeVec;
+
+
+typedef struct BenchCtx
+{
+  STDVEC<rplidar_reading_t>  _rdns;
+  STDVEC<NodeVec>            _scans;
+  STDVEC<rplidar_response_capsule_measurement_nodes_t>  _caps;
+  STDVEC<rplidar_reading_pkt_t>  _pkts;  // 6 per reading
+
+  BenchDriver    _drv;
+  RPLidarProxy*  _proxy;  // udp loopback, NULL if not set up
+  UDPSend        _snd;
+  U32            _seq;
+  U64            _lost;
+
+  BenchCtx(
+    ):
+    _proxy( NULL ),
+    _seq( 0 ),
+    _lost( 0 )
+  {
+  }
+} BenchCtx_t;
+
+
+//
+// wall and thread cpu time spent between Start and Stop, summed
+//
+typedef struct BenchTimer
+{
+  S64 _real;
+  S64 _cpu;
+  S64 _realBeg;
+  S64 _cpuBeg;
+
+  BenchTimer(
+    ):
+    _real( 0 ),
+    _cpu( 0 ),
+    _realBeg( 0 ),
+    _cpuBeg( 0 )
+  {
+  }
+
+  inline void Start()
+  {
+    _cpuBeg  = __getcputime();
+    _realBeg = (S64)rp::hal::clock_now();
+  }
+
+  inline void Stop()
+  {
+    _real += ( (S64)rp::hal::clock_now() - _realBeg );
+    _cpu  += ( __getcputime()  - _cpuBeg );
+  }
+} BenchTimer_t;
+
+
+//
+// runs iters ops, timing only the part that is measured; items is the
+// number of nodes done.
+//
+typedef void (*BenchFn)( BenchCtx_t* ctx, U64 iters, BenchTimer_t* tmr, U64* items );
+
+
+typedef struct BenchCase
+{
+  const char* _name;
+  BenchFn     _fn;
+  U64         _maxIters;
+  bool        _udp;
+} BenchCase_t;
+
+
+typedef struct BenchResult
+{
+  STDSTR  _name;
+  U64     _iters;
+  U32     _reps;
+  DBL     _realNs;     // median per op
+  DBL     _realMinNs;
+  DBL     _realMaxNs;
+  DBL     _cpuNs;      // median per op, calling thread only
+  DBL     _itemsPerSec;
+  U64     _errors;
+} BenchResult_t;
+
+
+
+
+//-----------------------------------------------------------------------------
+// input
+//-----------------------------------------------------------------------------
+static U32 s_rand = 1;
+
+static inline U32 NextRand()
+{
+  // numerical recipes lcg, enough to make runs repeatable
+  s_rand = s_rand * 1664525u + 1013904223u;
+  return ( s_rand >> 8 );
+}
+
+
+static inline DBL NextUnit()
+{
+  return ( NextRand() & 0xFFFF ) / 65536.0;
+}
+
+
+static void MakeSyntheticReading( U32 seq, U32 nodes, rplidar_reading_t* rdn )
+{
+  // 4m x 3m room, sensor off center
+  const DBL xmin = -1.5, xmax = 2.5, ymin = -1.0, ymax = 2.0;
+  DBL step  = 360.0 / nodes;
+  DBL start = NextUnit() * step;
+
+  nodes = std::min( nodes, (U32)_NODE_COUNT_ );
+
+  *rdn = rplidar_reading_t();
+  rdn->_seq    = seq;
+  rdn->_ascend = 0;
+  rdn->_count  = nodes;
+
+  for ( U32 idx = 0; idx < nodes; ++idx )
+  {
+    DBL agl = start + idx * step + ( NextUnit() - 0.5 ) * step * 0.4;
+    DBL rad = agl * M_PI / 180.0;
+    DBL c   = cos( rad );
+    DBL s   = sin( rad );
+    DBL tx  = ( c > 0 ? xmax / c : ( c < 0 ? xmin / c : 1e9 ) );
+    DBL ty  = ( s > 0 ? ymax / s : ( s < 0 ? ymin / s : 1e9 ) );
+    DBL mm  = std::min( tx, ty ) * 1000.0 + ( NextUnit() - 0.5 ) * 20.0;
+
+    if ( agl < 0 )
+    {
+      agl += 360.0;
+    }
+    if ( agl >= 360.0 )
+    {
+      agl -= 360.0;
+    }
+
+    rdn->_agl[idx] = (U16)( ( (U16)( agl * 64.0 ) << RPLIDAR_RESP_MEASUREMENT_ANGLE_SHIFT ) |
+                            RPLIDAR_RESP_MEASUREMENT_CHECKBIT );
+
+    // a few percent of the returns are lost
+    rdn->_dst[idx] = ( NextRand() % 100 < 3 ? 0 : (U16)( mm * 4.0 ) );
+    rdn->_qua[idx] = (U8)( ( rdn->_dst[idx] ? 0x2F << RPLIDAR_RESP_MEASUREMENT_QUALITY_SHIFT : 0 ) |
+                           ( idx == 0 ? RPLIDAR_RESP_MEASUREMENT_SYNCBIT : 0x02 ) );
+  }
+}
+
+
+static S32 LoadInput( BenchCtx_t* ctx, const STDSTR& logPath, U32 scans, U32 nodes )
+{
+  S32 ret = -1;
+
+  if ( !logPath.empty() )
+  {
+    RPLidarLogReader reader;
+    rplidar_reading_t rdn;
+    S64 ts;
+
+    if ( 1 != reader.Open( logPath.c_str() ) )
+    {
+      fprintf( stderr, "[LoadInput] unable to open %s.\n", logPath.c_str() );
+      goto Exit;
+    }
+
+    for ( U32 idx = 0; idx < reader.GetFrameCount(); ++idx )
+    {
+      if ( 1 == reader.GetFrame( idx, &rdn, &ts ) && rdn._count > 0 )
+      {
+        ctx->_rdns.push_back( rdn );
+      }
+    }
+  }
+  else
+  {
+    ctx->_rdns.resize( scans );
+    for ( U32 idx = 0; idx < scans; ++idx )
+    {
+      MakeSyntheticReading( idx + 1, nodes, &ctx->_rdns[idx] );
+    }
+  }
+
+  if ( ctx->_rdns.empty() )
+  {
+    fprintf( stderr, "[LoadInput] no readings to run on.\n" );
+    goto Exit;
+  }
+
+  for ( size_t idx = 0; idx < ctx->_rdns.size(); ++idx )
+  {
+    const rplidar_reading_t& rdn = ctx->_rdns[idx];
+    U32 count = std::min( rdn._count, (U32)_NODE_COUNT_ );
+    NodeVec scan( count );
+
+    for ( U32 n = 0; n < count; ++n )
+    {
+      scan[n].angle_q6_checkbit = rdn._agl[n];
+      scan[n].distance_q2       = rdn._dst[n];
+      scan[n].sync_quality      = rdn._qua[n];
+    }
+    ctx->_scans.push_back( scan );
+
+    // split the way RPLidar::SendReading does
+    for ( U32 sub = _BEG_SUB_SEQ_; sub <= _END_SUB_SEQ_; ++sub )
+    {
+      rplidar_reading_pkt_t pkt;
+      U32 base = ( sub * _PKT_NODE_COUNT_ );
+
+      pkt._seq       = rdn._seq;
+      pkt._subSeq    = sub;
+      pkt._ascend    = rdn._ascend;
+      pkt._count     = rdn._count;
+      pkt._scanBegTs = rdn._scanBegTs;
+      pkt._scanEndTs = rdn._scanEndTs;
+      memcpy( pkt._agl, &rdn._agl[base], sizeof( pkt._agl ) );
+      memcpy( pkt._dst, &rdn._dst[base], sizeof( pkt._dst ) );
+      memcpy( pkt._qua, &rdn._qua[base], sizeof( pkt._qua ) );
+      ctx->_pkts.push_back( pkt );
+    }
+  }
+
+  // express capsules carrying the same scans back to back, the start
+  // angle is that of the first node and the offsets stay zero
+  {
+    rplidar_response_capsule_measurement_nodes_t cap;
+    U32 fill = 0;
+
+    memset( &cap, 0, sizeof( cap ) );
+
+    for ( size_t s = 0; s < ctx->_scans.size(); ++s )
+    {
+      const NodeVec& scan = ctx->_scans[s];
+
+      for ( size_t n = 0; n < scan.size(); ++n )
+      {
+        U16 dist = ( scan[n].distance_q2 & 0xFFFC );
+
+        if ( fill == 0 )
+        {
+          cap.start_angle_sync_q6 = ( scan[n].angle_q6_checkbit >> RPLIDAR_RESP_MEASUREMENT_ANGLE_SHIFT ) & 0x7FFF;
+          if ( ctx->_caps.empty() )
+          {
+            cap.start_angle_sync_q6 |= RPLIDAR_RESP_MEASUREMENT_EXP_SYNCBIT;
+          }
+        }
+
+        if ( fill & 0x01 )
+        {
+          cap.cabins[fill / 2].distance_angle_2 = dist;
+        }
+        else
+        {
+          cap.cabins[fill / 2].distance_angle_1 = dist;
+          cap.cabins[fill / 2].offset_angles_q3 = 0;
+        }
+
+        if ( ++fill == _CAPSULE_NODES_ )
+        {
+          ctx->_caps.push_back( cap );
+          memset( &cap, 0, sizeof( cap ) );
+          fill = 0;
+        }
+      }
+    }
+  }
+
+  ret = 1;
+
+Exit:
+  return ret;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// cases
+//-----------------------------------------------------------------------------
+
+// copying the scan in is part of the op, ascendScanData sorts in place
+static void BenchAscendScanData( BenchCtx_t* ctx, U64 iters, BenchTimer_t* tmr, U64* items )
+{
+  rplidar_response_measurement_node_t buf[_NODE_COUNT_];
+  tmr->Start();
+
+  for ( U64 it = 0; it < iters; ++it )
+  {
+    const NodeVec& scan = ctx->_scans[it % ctx->_scans.size()];
+
+    memcpy( buf, &scan[0], scan.size() * sizeof( buf[0] ) );
+    ctx->_drv.ascendScanData( buf, scan.size() );
+    *items += scan.size();
+  }
+
+  tmr->Stop();
+}
+
+
+static void BenchCapsuleToNormal( BenchCtx_t* ctx, U64 iters, BenchTimer_t* tmr, U64* items )
+{
+  rplidar_response_measurement_node_t buf[128];
+  tmr->Start();
+
+  for ( U64 it = 0; it < iters; ++it )
+  {
+    size_t count = X_NUMBER_OF( buf );
+
+    ctx->_drv._capsuleToNormal( ctx->_caps[it % ctx->_caps.size()], buf, count );
+    *items += count;
+  }
+
+  tmr->Stop();
+}
+
+
+// one op is the 6 sub packets of a reading.  GetReading drains the
+// buffer between batches, outside the measured part.
+static void BenchProxyReceive( BenchCtx_t* ctx, U64 iters, BenchTimer_t* tmr, U64* items )
+{
+  RPLidarProxy proxy;
+  rplidar_reading_t rdn;
+  UDPMSG msg;
+  U64 it = 0;
+
+  msg.ulCbMsg = sizeof( rplidar_reading_pkt_t );
+
+  while ( it < iters )
+  {
+    U64 batch = std::min( iters - it, (U64)( _BUF_SIZE_ - 1 ) );
+    tmr->Start();
+
+    for ( U64 b = 0; b < batch; ++b )
+    {
+      size_t rdnIdx = ( ( it + b ) % ctx->_rdns.size() );
+
+      for ( U32 sub = _BEG_SUB_SEQ_; sub <= _END_SUB_SEQ_; ++sub )
+      {
+        msg.pMsg = &ctx->_pkts[rdnIdx * 6 + sub];
+        proxy.ReceiveMessage( &msg );
+      }
+      *items += ctx->_rdns[rdnIdx]._count;
+    }
+
+    tmr->Stop();
+    it += batch;
+
+    while ( 1 == proxy.GetReading( &rdn ) )
+    {
+    }
+  }
+
+}
+
+
+// the other half, filling happens outside the measured part
+static void BenchProxyGetReading( BenchCtx_t* ctx, U64 iters, BenchTimer_t* tmr, U64* items )
+{
+  RPLidarProxy proxy;
+  rplidar_reading_t rdn;
+  UDPMSG msg;
+  U64 it = 0;
+
+  msg.ulCbMsg = sizeof( rplidar_reading_pkt_t );
+
+  while ( it < iters )
+  {
+    U64 batch = std::min( iters - it, (U64)( _BUF_SIZE_ - 1 ) );
+
+    for ( U64 b = 0; b < batch; ++b )
+    {
+      size_t rdnIdx = ( ( it + b ) % ctx->_rdns.size() );
+
+      for ( U32 sub = _BEG_SUB_SEQ_; sub <= _END_SUB_SEQ_; ++sub )
+      {
+        msg.pMsg = &ctx->_pkts[rdnIdx * 6 + sub];
+        proxy.ReceiveMessage( &msg );
+      }
+    }
+
+    tmr->Start();
+
+    for ( U64 b = 0; b < batch; ++b )
+    {
+      if ( 1 == proxy.GetReading( &rdn ) )
+      {
+        *items += rdn._count;
+      }
+    }
+
+    tmr->Stop();
+    it += batch;
+  }
+
+}
+
+
+static void BenchAngleCompensate( BenchCtx_t* ctx, U64 iters, BenchTimer_t* tmr, U64* items )
+{
+  rplidar_response_measurement_node_t out[360];
+  tmr->Start();
+
+  for ( U64 it = 0; it < iters; ++it )
+  {
+    const rplidar_reading_t& rdn = ctx->_rdns[it % ctx->_rdns.size()];
+
+    // the node hands it the whole reading, not just _count nodes
+    RPLidarScan::AngleCompensate( &rdn, _NODE_COUNT_, out, X_NUMBER_OF( out ) );
+    *items += rdn._count;
+  }
+
+  tmr->Stop();
+}
+
+
+static void BenchCopyNodes( BenchCtx_t* ctx, U64 iters, BenchTimer_t* tmr, U64* items )
+{
+  rplidar_response_measurement_node_t out[_NODE_COUNT_];
+  U32 beg, end;
+  tmr->Start();
+
+  for ( U64 it = 0; it < iters; ++it )
+  {
+    const rplidar_reading_t& rdn = ctx->_rdns[it % ctx->_rdns.size()];
+
+    RPLidarScan::CopyNodes( &rdn, _NODE_COUNT_, out, &beg, &end );
+    *items += rdn._count;
+  }
+
+  tmr->Stop();
+}
+
+
+// what publish_scan does to the message: size the two arrays, fill them
+static void BenchPublishFill( BenchCtx_t* ctx, U64 iters, BenchTimer_t* tmr, U64* items )
+{
+  STDVEC<NodeVec> comp( ctx->_rdns.size(), NodeVec( 360 ) );
+
+  for ( size_t idx = 0; idx < ctx->_rdns.size(); ++idx )
+  {
+    RPLidarScan::AngleCompensate( &ctx->_rdns[idx], _NODE_COUNT_, &comp[idx][0], 360 );
+  }
+
+  tmr->Start();
+
+  for ( U64 it = 0; it < iters; ++it )
+  {
+    const NodeVec& nodes = comp[it % comp.size()];
+    STDVEC<float> ranges;
+    STDVEC<float> intensities;
+
+    intensities.resize( nodes.size() );
+    ranges.resize( nodes.size() );
+    RPLidarScan::FillRanges( &nodes[0], nodes.size(), true, &ranges[0], &intensities[0] );
+    *items += nodes.size();
+  }
+
+  tmr->Stop();
+}
+
+
+// one UltrasonicFront.ino frame
+static void MakeSonarFrame( U8 seq, U8 sensor, U16 cm, U8* frame )
+{
+  U8 crc = 0;
+
+  frame[0]  = 0xA5;
+  frame[1]  = 0x5A;
+  frame[2]  = _SONAR_FRAME_SIZE_ - 4;
+  frame[3]  = seq;
+  frame[4]  = sensor;
+  frame[5]  = _SONAR_OK_;
+  frame[6]  = seq;
+  frame[7]  = 0;
+  frame[8]  = 0;
+  frame[9]  = 0;
+  frame[10] = (U8)cm;
+  frame[11] = (U8)( cm >> 8 );
+
+  for ( U32 idx = 2; idx < _SONAR_FRAME_SIZE_ - 1; ++idx )
+  {
+    crc ^= frame[idx];
+    for ( U32 bit = 0; bit < 8; ++bit )
+    {
+      crc = ( crc & 0x80 ) ? (U8)( ( crc << 1 ) ^ 0x07 ) : (U8)( crc << 1 );
+    }
+  }
+  frame[_SONAR_FRAME_SIZE_ - 1] = crc;
+}
+
+
+// bytes off the sonar's serial port into readings, a few at a time the
+// way they arrive
+static void BenchSonarFeed( BenchCtx_t* ctx, U64 iters, BenchTimer_t* tmr, U64* items )
+{
+  RPLidarSonar sonar;
+  U8 frames[64 * _SONAR_FRAME_SIZE_];
+
+  for ( U32 idx = 0; idx < 64; ++idx )
+  {
+    MakeSonarFrame( (U8)idx, (U8)( idx % 4 ), (U16)( 20 + idx ), &frames[idx * _SONAR_FRAME_SIZE_] );
+  }
+
+  tmr->Start();
+
+  for ( U64 it = 0; it < iters; ++it )
+  {
+    for ( U32 pos = 0; pos < sizeof( frames ); pos += 16 )
+    {
+      sonar.Feed( frames + pos, std::min( (U32)16, (U32)sizeof( frames ) - pos ), 1 );
+    }
+    *items += 64;
+  }
+
+  tmr->Stop();
+
+  if ( sonar.GetFrameCnt() != iters * 64 || sonar.GetBadCnt() != 0 )
+  {
+    ++ctx->_lost;
+  }
+}
+
+
+// what publish_scan adds for the sonar: four front sensors over a full
+// angle compensated scan
+static void BenchSonarFuse( BenchCtx_t* ctx, U64 iters, BenchTimer_t* tmr, U64* items )
+{
+  RPLidarSonar sonar;
+  NodeVec nodes( 360 );
+  STDVEC<float> ranges( 360 ), intensities( 360 );
+  U8 frame[_SONAR_FRAME_SIZE_];
+  float angleMin = (float)( M_PI - 359 * M_PI / 180 );
+  float angleInc = (float)( M_PI / 180 );
+
+  RPLidarScan::AngleCompensate( &ctx->_rdns[0], _NODE_COUNT_, &nodes[0], 360 );
+  RPLidarScan::FillRanges( &nodes[0], nodes.size(), true, &ranges[0], &intensities[0] );
+
+  for ( U32 idx = 0; idx < 4; ++idx )
+  {
+    sonar.SetSector( idx, ( idx - 1.5f ) * 0.5f, 0.5f );
+    MakeSonarFrame( (U8)idx, (U8)idx, 40, frame );
+    sonar.Feed( frame, sizeof( frame ), (S64)rp::hal::clock_now() );
+  }
+  sonar.SetMaxAge( 1e6 );
+
+  tmr->Start();
+
+  for ( U64 it = 0; it < iters; ++it )
+  {
+    sonar.Fuse( &ranges[0], ranges.size(), angleMin, angleInc, (S64)rp::hal::clock_now() );
+    *items += ranges.size();
+  }
+
+  tmr->Stop();
+}
+
+
+// front and rear lidars into one scan, as the node does with two udp
+// ports: two Adds and the Merge
+static void BenchMergeTwo( BenchCtx_t* ctx, U64 iters, BenchTimer_t* tmr, U64* items )
+{
+  RPLidarMerge* merge = new RPLidarMerge();
+  STDVEC<float> ranges( 720 );
+  STDVEC<float> intensities( 720 );
+  S64 beg;
+  S64 end;
+
+  merge->Init( 2, ranges.size(), 0.15f, 12.0f );
+  merge->SetExtrinsic( 0,  0.25f, 0, 0, false );
+  merge->SetExtrinsic( 1, -0.25f, 0, (FLT)M_PI, false );
+
+  tmr->Start();
+
+  for ( U64 it = 0; it < iters; ++it )
+  {
+    const rplidar_reading_t& front = ctx->_rdns[it % ctx->_rdns.size()];
+    const rplidar_reading_t& rear  = ctx->_rdns[( it + 1 ) % ctx->_rdns.size()];
+    S64 ts = (S64)it * 100000000LL;
+
+    merge->Add( 1, &rear,  ts, ts + 100000000LL );
+    merge->Add( 0, &front, ts, ts + 100000000LL );
+    merge->Merge( &ranges[0], &intensities[0], &beg, &end );
+    *items += front._count + rear._count;
+  }
+
+  tmr->Stop();
+
+  delete merge;
+}
+
+
+// RPLidar::SendReading to RPLidarProxy::GetReading over loopback,
+// including the wakeup of the receive thread
+static void BenchUdpRoundTrip( BenchCtx_t* ctx, U64 iters, BenchTimer_t* tmr, U64* items )
+{
+  rplidar_reading_t out;
+  tmr->Start();
+
+  for ( U64 it = 0; it < iters; ++it )
+  {
+    rplidar_reading_t& rdn = ctx->_rdns[it % ctx->_rdns.size()];
+    S64 sendts;
+
+    rdn._seq = ++ctx->_seq;
+    sendts   = (S64)rp::hal::clock_now();
+
+    if ( 1 != RPLidar::SendReading( &ctx->_snd, &rdn ) )
+    {
+      ++ctx->_lost;
+      continue;
+    }
+
+    while ( 1 != ctx->_proxy->GetReading( &out ) )
+    {
+      if ( (S64)rp::hal::clock_now() - sendts > _RECV_TIMEOUT_ )
+      {
+        ++ctx->_lost;
+        break;
+      }
+      sched_yield();
+    }
+
+    *items += rdn._count;
+  }
+
+  tmr->Stop();
+}
+
+
+//
+// the scan handoff between the driver's cache thread and grabScanData,
+// under each lock and event pair:
+//
+//   cache thread:  lock, copy the scan in, set, unlock
+//   consumer:      wait, lock, copy the scan out, unlock
+//
+// the Sync_ structs give them one shape.  Set is called with the lock
+// held, as the driver does.
+//
+typedef struct SyncXMutex
+{
+  XMutex  _mtx;
+  XCond   _cond;
+  bool    _signalled;
+
+  SyncXMutex(
+    ):
+    _signalled( false )
+  {
+  }
+
+  inline void Lock()   { _mtx.lock(); }
+  inline void Unlock() { _mtx.unlock(); }
+  inline void Set()    { _signalled = true; _cond.Signal(); }
+
+  inline bool Wait( U32 ms )
+  {
+    XScopedMutex lock( &_mtx );
+
+    if ( !_signalled )
+    {
+      _cond.Wait( &_mtx, ms );
+    }
+    if ( !_signalled )
+    {
+      return false;
+    }
+    _signalled = false;
+    return true;
+  }
+} SyncXMutex_t;
+
+
+typedef struct SyncHal
+{
+  rp::hal::Locker  _lock;
+  rp::hal::Event   _evt;
+
+  inline void Lock()   { _lock.lock(); }
+  inline void Unlock() { _lock.unlock(); }
+  inline void Set()    { _evt.set(); }
+  inline bool Wait( U32 ms ) { return rp::hal::Event::EVENT_OK == _evt.wait( ms ); }
+} SyncHal_t;
+
+
+typedef struct SyncFutex
+{
+  rp::hal::AdaptiveLocker  _lock;
+  rp::hal::MonotonicEvent  _evt;
+
+  inline void Lock()   { _lock.lock(); }
+  inline void Unlock() { _lock.unlock(); }
+  inline void Set()    { _evt.set(); }
+  inline bool Wait( U32 ms ) { return rp::hal::MonotonicEvent::EVENT_OK == _evt.wait( ms ); }
+} SyncFutex_t;
+
+
+template <class SYNC>
+struct Handoff
+{
+  SYNC                 _sync;
+  BenchCtx_t*          _ctx;
+  volatile S32         _stop;
+  rplidar_response_measurement_node_t  _buf[_NODE_COUNT_];
+  size_t               _count;
+};
+
+
+template <class SYNC>
+static PVOID InvokeHandoffFunction( PVOID pv )
+{
+  PXTHREADARG     pxarg = (PXTHREADARG)pv;
+  Handoff<SYNC>*  ho    = (Handoff<SYNC>*)pxarg->pv;
+  U32             seq   = 0;
+
+  // a free running cache thread, so the consumer always finds the lock
+  // busy some of the time
+  while ( !ho->_stop )
+  {
+    const NodeVec& scan = ho->_ctx->_scans[seq++ % ho->_ctx->_scans.size()];
+
+    ho->_sync.Lock();
+    memcpy( ho->_buf, &scan[0], scan.size() * sizeof( ho->_buf[0] ) );
+    ho->_count = scan.size();
+    ho->_sync.Set();
+    ho->_sync.Unlock();
+  }
+
+  return NULL;
+}
+
+
+template <class SYNC>
+static void BenchHandoff( BenchCtx_t* ctx, U64 iters, BenchTimer_t* tmr, U64* items )
+{
+  Handoff<SYNC>*  ho = new Handoff<SYNC>();
+  rplidar_response_measurement_node_t out[_NODE_COUNT_];
+  XThread th;
+
+  ho->_ctx   = ctx;
+  ho->_stop  = 0;
+  ho->_count = 0;
+  th.Run( InvokeHandoffFunction<SYNC>, ho );
+
+  tmr->Start();
+
+  for ( U64 it = 0; it < iters; ++it )
+  {
+    if ( !ho->_sync.Wait( 1000 ) )
+    {
+      ++ctx->_lost;
+      continue;
+    }
+
+    ho->_sync.Lock();
+    memcpy( out, ho->_buf, ho->_count * sizeof( out[0] ) );
+    *items += ho->_count;
+    ho->_sync.Unlock();
+  }
+
+  tmr->Stop();
+
+  ho->_stop = 1;
+  th.Join();
+  delete ho;
+}
+
+
+// the same, one thread: what the pair costs a scan when nobody contends
+template <class SYNC>
+static void BenchHandoffSolo( BenchCtx_t* ctx, U64 iters, BenchTimer_t* tmr, U64* items )
+{
+  Handoff<SYNC>*  ho = new Handoff<SYNC>();
+  rplidar_response_measurement_node_t out[_NODE_COUNT_];
+
+  tmr->Start();
+
+  for ( U64 it = 0; it < iters; ++it )
+  {
+    const NodeVec& scan = ctx->_scans[it % ctx->_scans.size()];
+
+    ho->_sync.Lock();
+    memcpy( ho->_buf, &scan[0], scan.size() * sizeof( ho->_buf[0] ) );
+    ho->_count = scan.size();
+    ho->_sync.Set();
+    ho->_sync.Unlock();
+
+    ho->_sync.Wait( 0 );
+    ho->_sync.Lock();
+    memcpy( out, ho->_buf, ho->_count * sizeof( out[0] ) );
+    *items += ho->_count;
+    ho->_sync.Unlock();
+  }
+
+  tmr->Stop();
+
+  delete ho;
+}
+
+
+// the clock reads a stamp costs, see hal/clock.h; items are reads
+static void BenchClockNow( BenchCtx_t*, U64 iters, BenchTimer_t* tmr, U64* items )
+{
+  volatile U64 sink = 0;
+  tmr->Start();
+
+  for ( U64 it = 0; it < iters; ++it )
+  {
+    sink += rp::hal::clock_now();
+  }
+
+  tmr->Stop();
+  *items += iters;
+}
+
+
+static void BenchClockRaw( BenchCtx_t*, U64 iters, BenchTimer_t* tmr, U64* items )
+{
+  volatile U64 sink = rp::hal::clock_raw();  // calibrates on first use, keep it off the clock
+  tmr->Start();
+
+  for ( U64 it = 0; it < iters; ++it )
+  {
+    sink += rp::hal::clock_raw();
+  }
+
+  tmr->Stop();
+  *items += iters;
+}
+
+
+static void BenchClockRawToNs( BenchCtx_t*, U64 iters, BenchTimer_t* tmr, U64* items )
+{
+  volatile U64 sink = rp::hal::clock_raw();  // calibrates on first use, keep it off the clock
+  tmr->Start();
+
+  for ( U64 it = 0; it < iters; ++it )
+  {
+    sink += rp::hal::clock_raw_to_ns( rp::hal::clock_raw() );
+  }
+
+  tmr->Stop();
+  *items += iters;
+}
+
+
+static const BenchCase_t s_cases[] =
+{
+  { "sdk/ascendScanData",       BenchAscendScanData,  1ULL << 30, false },
+  { "sdk/capsuleToNormal",      BenchCapsuleToNormal, 1ULL << 30, false },
+  { "proxy/ReceiveMessage",     BenchProxyReceive,    1ULL << 30, false },
+  { "proxy/GetReading",         BenchProxyGetReading, 1ULL << 30, false },
+  { "scan/angle_compensate",    BenchAngleCompensate, 1ULL << 30, false },
+  { "scan/copy_nodes",          BenchCopyNodes,       1ULL << 30, false },
+  { "scan/publish_fill",        BenchPublishFill,     1ULL << 30, false },
+  { "sonar/feed",               BenchSonarFeed,       1ULL << 30, false },
+  { "sonar/fuse",               BenchSonarFuse,       1ULL << 30, false },
+  { "merge/two",                BenchMergeTwo,        1ULL << 30, false },
+  { "sync/xmutex/solo",         BenchHandoffSolo<SyncXMutex_t>,  1ULL << 30, false },
+  { "sync/hal/solo",            BenchHandoffSolo<SyncHal_t>,     1ULL << 30, false },
+  { "sync/futex/solo",          BenchHandoffSolo<SyncFutex_t>,   1ULL << 30, false },
+  { "sync/xmutex/handoff",      BenchHandoff<SyncXMutex_t>,      1ULL << 24, false },
+  { "sync/hal/handoff",         BenchHandoff<SyncHal_t>,         1ULL << 24, false },
+  { "sync/futex/handoff",       BenchHandoff<SyncFutex_t>,       1ULL << 24, false },
+  { "clock/now",                BenchClockNow,        1ULL << 30, false },
+  { "clock/raw",                BenchClockRaw,        1ULL << 30, false },
+  { "clock/raw_to_ns",          BenchClockRawToNs,    1ULL << 30, false },
+  { "udp/roundtrip",            BenchUdpRoundTrip,    20000,      true  },
+};
+
+
+
+
+//-----------------------------------------------------------------------------
+// harness
+//-----------------------------------------------------------------------------
+static void RunCase( BenchCtx_t* ctx, const BenchCase_t& bc, DBL minTime, U32 reps, BenchResult_t* res )
+{
+  STDVEC<DBL> real;
+  STDVEC<DBL> cpu;
+  U64 items = 0;
+  U64 iters = 1;
+  S64 target = (S64)( minTime * 1e9 );
+
+  // grow by 10x until a run is long enough to scale from
+  for ( ;; )
+  {
+    BenchTimer_t tmr;
+
+    bc._fn( ctx, iters, &tmr, &items );
+    tmr._real = std::max( tmr._real, (S64)1 );
+    if ( tmr._real >= target / 10 || iters >= bc._maxIters )
+    {
+      iters = std::max( (U64)1, std::min( (U64)( (DBL)iters * target / tmr._real ), bc._maxIters ) );
+      break;
+    }
+    iters = std::min( iters * 10, bc._maxIters );
+  }
+
+  ctx->_lost = 0;
+  items = 0;
+
+  for ( U32 rep = 0; rep < reps; ++rep )
+  {
+    BenchTimer_t tmr;
+
+    bc._fn( ctx, iters, &tmr, &items );
+
+    real.push_back( (DBL)tmr._real / iters );
+    cpu.push_back(  (DBL)tmr._cpu  / iters );
+  }
+
+  std::sort( real.begin(), real.end() );
+  std::sort( cpu.begin(), cpu.end() );
+
+  res->_name        = bc._name;
+  res->_iters       = iters;
+  res->_reps        = reps;
+  res->_realNs      = real[real.size() / 2];
+  res->_realMinNs   = real.front();
+  res->_realMaxNs   = real.back();
+  res->_cpuNs       = cpu[cpu.size() / 2];
+  res->_itemsPerSec = ( res->_realNs > 0 ? (DBL)items / reps / iters / res->_realNs * 1e9 : 0 );
+  res->_errors      = ctx->_lost;
+}
+
+
+static void WriteJson( FILE* fp, const STDVEC<BenchResult_t>& res, const STDSTR& source, const BenchCtx_t& ctx )
+{
+  char host[256] = { 0 };
+  char date[64]  = { 0 };
+  time_t now = time( NULL );
+  U64 nodes = 0;
+
+  gethostname( host, sizeof( host ) - 1 );
+  strftime( date, sizeof( date ), "%Y-%m-%dT%H:%M:%S%z", localtime( &now ) );
+
+  for ( size_t idx = 0; idx < ctx._rdns.size(); ++idx )
+  {
+    nodes += ctx._rdns[idx]._count;
+  }
+
+  fprintf( fp, "{\n" );
+  fprintf( fp, "  \"context\": {\n" );
+  fprintf( fp, "    \"date\": \"%s\",\n", date );
+  fprintf( fp, "    \"host_name\": \"%s\",\n", host );
+  fprintf( fp, "    \"executable\": \"rplidarGapsBench\",\n" );
+  fprintf( fp, "    \"num_cpus\": %ld,\n", sysconf( _SC_NPROCESSORS_ONLN ) );
+#ifdef __OPTIMIZE__
+  fprintf( fp, "    \"library_build_type\": \"release\",\n" );
+#else
+  fprintf( fp, "    \"library_build_type\": \"debug\",\n" );
+#endif
+  fprintf( fp, "    \"source\": \"%s\",\n", source.c_str() );
+  fprintf( fp, "    \"scans\": %u,\n", (U32)ctx._rdns.size() );
+  fprintf( fp, "    \"nodes_per_scan\": %.1f\n", (DBL)nodes / ctx._rdns.size() );
+  fprintf( fp, "  },\n" );
+  fprintf( fp, "  \"benchmarks\": [\n" );
+
+  for ( size_t idx = 0; idx < res.size(); ++idx )
+  {
+    const BenchResult_t& r = res[idx];
+
+    fprintf( fp, "    {\n" );
+    fprintf( fp, "      \"name\": \"%s\",\n", r._name.c_str() );
+    fprintf( fp, "      \"run_type\": \"aggregate\",\n" );
+    fprintf( fp, "      \"aggregate_name\": \"median\",\n" );
+    fprintf( fp, "      \"iterations\": %llu,\n", (unsigned long long)r._iters );
+    fprintf( fp, "      \"repetitions\": %u,\n", r._reps );
+    fprintf( fp, "      \"real_time\": %.2f,\n", r._realNs );
+    fprintf( fp, "      \"real_time_min\": %.2f,\n", r._realMinNs );
+    fprintf( fp, "      \"real_time_max\": %.2f,\n", r._realMaxNs );
+    fprintf( fp, "      \"cpu_time\": %.2f,\n", r._cpuNs );
+    fprintf( fp, "      \"time_unit\": \"ns\",\n" );
+    fprintf( fp, "      \"items_per_second\": %.1f,\n", r._itemsPerSec );
+    fprintf( fp, "      \"errors\": %llu\n", (unsigned long long)r._errors );
+    fprintf( fp, "    }%s\n", ( idx + 1 < res.size() ? "," : "" ) );
+  }
+
+  fprintf( fp, "  ]\n" );
+  fprintf( fp, "}\n" );
+}
+
+
+static void WriteCsv( FILE* fp, const STDVEC<BenchResult_t>& res )
+{
+  fprintf( fp, "name,iterations,repetitions,real_time_ns,real_time_min_ns,real_time_max_ns,cpu_time_ns,items_per_second,errors\n" );
+
+  for ( size_t idx = 0; idx < res.size(); ++idx )
+  {
+    const BenchResult_t& r = res[idx];
+
+    fprintf( fp, "%s,%llu,%u,%.2f,%.2f,%.2f,%.2f,%.1f,%llu\n",
+             r._name.c_str(), (unsigned long long)r._iters, r._reps,
+             r._realNs, r._realMinNs, r._realMaxNs, r._cpuNs,
+             r._itemsPerSec, (unsigned long long)r._errors );
+  }
+}
+
+
+static void WriteConsole( FILE* fp, const STDVEC<BenchResult_t>& res )
+{
+  fprintf( fp, "%-26s %12s %12s %12s %12s %14s %8s\n",
+           "benchmark", "iterations", "ns/op", "min ns", "max ns", "items/s", "errors" );
+
+  for ( size_t idx = 0; idx < res.size(); ++idx )
+  {
+    const BenchResult_t& r = res[idx];
+
+    fprintf( fp, "%-26s %12llu %12.1f %12.1f %12.1f %14.0f %8llu\n",
+             r._name.c_str(), (unsigned long long)r._iters,
+             r._realNs, r._realMinNs, r._realMaxNs,
+             r._itemsPerSec, (unsigned long long)r._errors );
+  }
+}
+
+
+
+
+int main( int argc, char* argv[] )
+{
+  XCommandLine cmd;
+  BenchCtx_t ctx;
+  STDVEC<BenchResult_t> res;
+  STDSTR logPath, filter, format = "console", outPath;
+  S64 scans = 64, nodes = 400, seed = 1, reps = 5, port = 8899;
+  DBL minTime = 0.5;
+  Channel chnl;
+  FILE* fp = stdout;
+  S32 ret = 1;
+
+  cmd.Init( argc, argv );
+  cmd.Get( "log", &logPath );
+  cmd.Get( "filter", &filter );
+  cmd.Get( "format", &format );
+  cmd.Get( "out", &outPath );
+  cmd.GetAsS64( "scans", &scans );
+  cmd.GetAsS64( "nodes", &nodes );
+  cmd.GetAsS64( "seed", &seed );
+  cmd.GetAsS64( "reps", &reps );
+  cmd.GetAsS64( "port", &port );
+  cmd.GetAsDBL( "mintime", &minTime );
+
+  s_rand = (U32)seed;
+  reps   = std::max( reps, (S64)1 );
+
+  if ( 1 != LoadInput( &ctx, logPath, (U32)scans, (U32)nodes ) )
+  {
+    return 1;
+  }
+
+  if ( !cmd.Has( "noudp" ) )
+  {
+    ctx._proxy = new RPLidarProxy();
+    if ( 1 != ctx._proxy->Init( (S32)port ) ||
+         X_FAILURE( chnl.Init( "127.0.0.1", (S32)port ) ) ||
+         X_FAILURE( ctx._snd.Init() ) ||
+         X_FAILURE( ctx._snd.AddChannel( chnl ) ) )
+    {
+      fprintf( stderr, "udp loopback on %d failed, skipping udp cases\n", (S32)port );
+      delete ctx._proxy;
+      ctx._proxy = NULL;
+    }
+    else
+    {
+      ctx._proxy->Start();
+    }
+  }
+
+  for ( U32 idx = 0; idx < X_NUMBER_OF( s_cases ); ++idx )
+  {
+    const BenchCase_t& bc = s_cases[idx];
+    BenchResult_t r;
+
+    if ( ( !filter.empty() && NULL == strstr( bc._name, filter.c_str() ) ) ||
+         ( bc._udp && ctx._proxy == NULL ) )
+    {
+      continue;
+    }
+
+    fprintf( stderr, "running %s...\n", bc._name );
+    RunCase( &ctx, bc, minTime, (U32)reps, &r );
+    res.push_back( r );
+  }
+
+  if ( ctx._proxy != NULL )
+  {
+    ctx._proxy->Stop();
+    delete ctx._proxy;
+  }
+
+  if ( !outPath.empty() )
+  {
+    fp = fopen( outPath.c_str(), "w" );
+    if ( fp == NULL )
+    {
+      fprintf( stderr, "unable to open %s\n", outPath.c_str() );
+      goto Exit;
+    }
+  }
+
+  if ( format == "json" )
+  {
+    WriteJson( fp, res, ( logPath.empty() ? "synthetic" : logPath ), ctx );
+  }
+  else if ( format == "csv" )
+  {
+    WriteCsv( fp, res );
+  }
+  else
+  {
+    WriteConsole( fp, res );
+  }
+
+  ret = 0;
+
+Exit:
+  if ( fp != NULL && fp != stdout )
+  {
+    fclose( fp );
+  }
+  return ret;
+}
@@ -0,0 +1,314 @@
+//
+// rplidarGapsEmulator - serve an emulated RPLidar on a pty.
+//
+//   rplidarGapsEmulator [-baud 115200] [-rate 4000] [-nodes 400]
+//                       [-log file.rplog] [-verbose 1]
+//
+// prints the pty path and runs until interrupted; point serial_port
+// at it.  with -selftest it drives RPlidarDriver against itself
+// instead and reports throughput and sync-to-grab latency:
+//
+//   rplidarGapsEmulator -selftest [-express] [-seconds 10]
+//                       [-baud 0 -rate 0 for unthrottled]
+//                       [-trace file, see rplidarGapsTraceDump]
+//                       [-udp 8899, also stream each scan over loopback
+//                        through RPLidar::SendReading and RPLidarProxy]
+//                       [-clockskew ms, with -udp, run clock sync against
+//                        a streamer clock that is off by that much]
+//
+#include <XCommon.h>
+#include <XCommandLine.h>
+#include <RPLidarEmulator.h>
+#include <RPLidarTrace.h>
+#include <RPLidar.h>
+#include <RPLidarProxy.h>
+#include <RPLidarClock.h>
+#include <signal.h>
+#include <unistd.h>
+#include "hal/clock.h"
+
+
+using namespace rp::standalone::rplidar;
+
+
+static volatile S32 g_stop = 0;
+
+
+static void OnSignal( int sig )
+{
+  g_stop = 1;
+}
+
+
+static S32 SelfTest( RPLidarEmulator* emu, bool express, DBL seconds, S32 udpPort, S64 skew )
+{
+  S32 ret = -1;
+  RPlidarDriver* drv = NULL;
+  rplidar_response_device_info_t   devinfo;
+  rplidar_response_device_health_t health;
+  rplidar_response_measurement_node_t nodes[8192];
+  STDVEC<S64> lat;
+  STDVEC<S64> clkErr;
+  U64 scans = 0, samples = 0, timeouts = 0, delivered = 0;
+  S64 begts, endts;
+  RPLidarProxy* proxy = NULL;
+  UDPSend snd;
+  Channel chnl;
+  rplidar_reading_t rdn, out;
+  RPLidarClockServer clkSrv;
+  RPLidarClock clk;
+
+  drv = RPlidarDriver::CreateDriver( RPlidarDriver::DRIVER_TYPE_SERIALPORT );
+  if ( drv == NULL )
+  {
+    fprintf( stderr, "[SelfTest] out of memory.\n" );
+    goto Exit;
+  }
+
+  if ( IS_FAIL( drv->connect( emu->GetPortName(), 115200 ) ) )
+  {
+    fprintf( stderr, "[SelfTest] failed to connect %s.\n", emu->GetPortName() );
+    goto Exit;
+  }
+
+  if ( IS_FAIL( drv->getDeviceInfo( devinfo ) ) ||
+       IS_FAIL( drv->getHealth( health ) ) )
+  {
+    fprintf( stderr, "[SelfTest] device info/health failed.\n" );
+    goto Exit;
+  }
+
+  printf( "[SelfTest] model %u firmware %d.%02d hardware %u health %u.\n",
+          devinfo.model, devinfo.firmware_version >> 8,
+          devinfo.firmware_version & 0xFF, devinfo.hardware_version,
+          health.status );
+
+  if ( udpPort > 0 )
+  {
+    proxy = new RPLidarProxy();
+    if ( 1 != proxy->Init( udpPort ) ||
+         X_FAILURE( chnl.Init( "127.0.0.1", udpPort ) ) ||
+         X_FAILURE( snd.Init() ) ||
+         X_FAILURE( snd.AddChannel( chnl ) ) )
+    {
+      fprintf( stderr, "[SelfTest] udp loopback on %d failed.\n", udpPort );
+      goto Exit;
+    }
+    proxy->Start();
+
+    // the streamer's clock server on the next port up
+    if ( 1 != clkSrv.Init( udpPort + 1 ) )
+    {
+      goto Exit;
+    }
+    clkSrv.SetOffset( skew );
+    clkSrv.Start();
+
+    clk.Init( "127.0.0.1", udpPort + 1, udpPort, 1.0 );
+    proxy->SetClock( &clk );
+    clk.Start();
+  }
+
+  drv->startMotor();
+
+  if ( IS_FAIL( express ? drv->startScanExpress( false ) : drv->startScanNormal( false ) ) )
+  {
+    fprintf( stderr, "[SelfTest] start scan failed.\n" );
+    goto Exit;
+  }
+
+  begts = (S64)rp::hal::clock_now();
+  endts = begts + (S64)( seconds * 1e9 );
+
+  while ( !g_stop && (S64)rp::hal::clock_now() < endts )
+  {
+    size_t count = X_NUMBER_OF( nodes );
+    S64 grabts = (S64)rp::hal::clock_now();
+
+    if ( IS_FAIL( drv->grabScanData( nodes, count, 1000 ) ) )
+    {
+      ++timeouts;
+      continue;
+    }
+
+    // the scan became complete when the emulator wrote the next sync
+    lat.push_back( (S64)rp::hal::clock_now() - emu->GetLastSyncTs() );
+
+    drv->ascendScanData( nodes, count );
+
+    ++scans;
+    samples += count;
+
+    if ( proxy != NULL )
+    {
+      // what the streamer does with each scan
+      count = std::min( count, (size_t)_NODE_COUNT_ );
+
+      rdn._seq       = (U32)scans;
+      rdn._ascend    = 1;
+      rdn._count     = (U32)count;
+      rdn._scanBegTs = grabts + skew;
+      rdn._scanEndTs = (S64)rp::hal::clock_now() + skew;
+      for ( U32 idx = 0; idx < _NODE_COUNT_; ++idx )
+      {
+        rdn._agl[idx] = ( idx < count ? nodes[idx].angle_q6_checkbit : 0 );
+        rdn._dst[idx] = ( idx < count ? nodes[idx].distance_q2       : 0 );
+        rdn._qua[idx] = ( idx < count ? nodes[idx].sync_quality      : 0 );
+      }
+      RPLIDAR_TRACE( _TRACE_CAPTURE_, RPLidarTrace::LastKey(), 0 );
+
+      RPLidar::SendReading( &snd, &rdn );
+
+      // and what the node does, without the ros message
+      for ( S32 spin = 0; spin < 50; ++spin )
+      {
+        if ( 1 == proxy->GetReading( &out ) )
+        {
+          RPLIDAR_TRACE( _TRACE_PUBLISH_, out._seq, 0 );
+          ++delivered;
+
+          if ( clk.IsSynced() )
+          {
+            clkErr.push_back( llabs( clk.ToLocal( out._scanBegTs ) - grabts ) );
+          }
+          break;
+        }
+        usleep( 100 );
+      }
+    }
+  }
+
+  endts = (S64)rp::hal::clock_now();
+
+  drv->stop();
+  drv->stopMotor();
+
+  {
+    DBL secs = ( endts - begts ) * 1e-9;
+
+    std::sort( lat.begin(), lat.end() );
+
+    printf( "[SelfTest] %s: %llu scans, %.1f scans/s, %.0f samples/s, %llu timeouts.\n",
+            ( express ? "express" : "normal" ),
+            (unsigned long long)scans, scans / secs, samples / secs,
+            (unsigned long long)timeouts );
+    if ( proxy != NULL )
+    {
+      DBL offset, drift, delay;
+
+      printf( "[SelfTest] udp loopback: %llu of %llu readings delivered.\n",
+              (unsigned long long)delivered, (unsigned long long)scans );
+
+      clk.GetStats( &offset, &drift, &delay );
+      std::sort( clkErr.begin(), clkErr.end() );
+      printf( "[SelfTest] clock sync: %u pings, offset %.3f ms (skew %.3f), drift %.2f ppm, delay %.3f ms.\n",
+              clkSrv.GetPingCnt(), offset, skew * 1e-6, drift, delay );
+      if ( !clkErr.empty() )
+      {
+        printf( "[SelfTest] scan stamp error us: p50 %.1f p99 %.1f max %.1f over %u scans.\n",
+                clkErr[clkErr.size() * 50 / 100] * 1e-3,
+                clkErr[clkErr.size() * 99 / 100] * 1e-3,
+                clkErr.back() * 1e-3, (U32)clkErr.size() );
+      }
+    }
+    printf( "[SelfTest] emulator: %llu nodes, %llu bytes, %llu dropped, %llu cmds, pwm %u.\n",
+            (unsigned long long)emu->GetNodeCount(),
+            (unsigned long long)emu->GetByteCount(),
+            (unsigned long long)emu->GetDropCount(),
+            (unsigned long long)emu->GetCmdCount(),
+            emu->GetMotorPWM() );
+
+    if ( !lat.empty() )
+    {
+      printf( "[SelfTest] sync-to-grab latency us: p50 %.1f p90 %.1f p99 %.1f max %.1f.\n",
+              lat[lat.size() * 50 / 100] * 1e-3,
+              lat[lat.size() * 90 / 100] * 1e-3,
+              lat[lat.size() * 99 / 100] * 1e-3,
+              lat.back() * 1e-3 );
+    }
+  }
+
+  ret = ( scans > 0 ? 1 : -1 );
+
+Exit:
+  clk.Stop();
+  if ( proxy != NULL )
+  {
+    proxy->Stop();
+    proxy->SetClock( NULL );
+    delete proxy;
+  }
+  clkSrv.Stop();
+  if ( drv != NULL )
+  {
+    RPlidarDriver::DisposeDriver( drv );
+  }
+  return ret;
+}
+
+
+
+
+int main( int argc, char* argv[] )
+{
+  XCommandLine cmd;
+  RPLidarEmulator::Config_t cfg;
+  RPLidarEmulator emu;
+  STDSTR logPath;
+  STDSTR tracePath;
+  S64 val;
+  DBL seconds = 10.0;
+  S64 udpPort = 0;
+  DBL skewMs = 0;
+  S32 ret = 0;
+
+  cmd.Init( argc, argv );
+
+  if ( cmd.GetAsS64( "baud", &val ) )    cfg._baudrate   = (U32)val;
+  if ( cmd.GetAsS64( "rate", &val ) )    cfg._sampleRate = (U32)val;
+  if ( cmd.GetAsS64( "nodes", &val ) )   cfg._scanNodes  = (U32)val;
+  if ( cmd.GetAsS64( "verbose", &val ) ) cfg._verbose    = (S32)val;
+  cmd.GetAsDBL( "seconds", &seconds );
+  cmd.GetAsS64( "udp", &udpPort );
+  cmd.GetAsDBL( "clockskew", &skewMs );
+  cmd.Get( "log", &logPath );
+  cmd.Get( "trace", &tracePath );
+
+  if ( !tracePath.empty() )
+  {
+    RPLidarTrace::Enable();
+  }
+
+  if ( 1 != emu.Init( cfg, logPath.c_str() ) )
+  {
+    fprintf( stderr, "Init Emulator fail, exit\n" );
+    return -2;
+  }
+
+  signal( SIGINT,  OnSignal );
+  signal( SIGTERM, OnSignal );
+
+  emu.Start();
+
+  if ( cmd.Has( "selftest" ) )
+  {
+    ret = ( 1 == SelfTest( &emu, cmd.Has( "express" ), seconds, (S32)udpPort, (S64)( skewMs * 1e6 ) ) ? 0 : 1 );
+  }
+  else
+  {
+    printf( "emulating RPLidar on %s\n", emu.GetPortName() );
+    while ( !g_stop )
+    {
+      sleep( 1 );
+    }
+  }
+
+  emu.Stop();
+
+  if ( !tracePath.empty() )
+  {
+    RPLidarTrace::Dump( tracePath.c_str() );
+  }
+
+  return ret;
+}
@@ -34,9 +34,18 @@
 
 #include "ros/ros.h"
 #include "sensor_msgs/LaserScan.h"
+#include "sensor_msgs/Range.h"
 #include "std_srvs/Empty.h"
 #include "rplidar.h"
 #include "RPLidarProxy.h"
+#include "RPLidarLog.h"
+#include "RPLidarTrace.h"
+#include "RPLidarScan.h"
+#include "RPLidarClock.h"
+#include "RPLidarSonar.h"
+#include "RPLidarMerge.h"
+#include "XThread.h"
+#include "hal/clock.h"
 
 #ifndef _countof
 #define _countof(_Array) (int)(sizeof(_Array) / sizeof(_Array[0]))
@@ -48,11 +57,25 @@ using namespace rp::standalone::rplidar;
 
 RPlidarDriver* drv = NULL;
 RPLidarProxy*  proxy = NULL;
+RPLidarSonar*  sonar = NULL;  // fused into the scans when set
 bool spin_motor = false;
 
 
 
 
+//
+// a rp::hal::clock_now() time to ros time, through how long ago it was,
+// so it follows whatever ros time is, sim time included
+//
+ros::Time mono_to_ros(
+  S64 mono
+  )
+{
+  S64 age = (S64)rp::hal::clock_now() - mono;
+  return ros::Time::now() - ros::Duration( age * 1e-9 );
+}
+
+
 void publish_scan(
   ros::Publisher* pub,
   rplidar_response_measurement_node_t* nodes,
@@ -94,43 +117,106 @@ void publish_scan(
   scan_msg.intensities.resize(node_count);
   scan_msg.ranges.resize(node_count);
   bool reverse_data = (!inverted && reversed) || (inverted && !reversed);
-  if (!reverse_data)
+  RPLidarScan::FillRanges(
+    nodes,
+    node_count,
+    reverse_data,
+    &scan_msg.ranges[0],
+    &scan_msg.intensities[0]
+    );
+
+  if ( sonar != NULL )
   {
-    for (size_t i = 0; i < node_count; i++)
-    {
-      float read_value = (float) nodes[i].distance_q2/4.0f/1000;
-      if (read_value == 0.0)
-      {
-        scan_msg.ranges[i] = std::numeric_limits<float>::infinity();
-      }
-      else
-      {
-        scan_msg.ranges[i] = read_value;
-      }
-      scan_msg.intensities[i] = (float) (nodes[i].sync_quality >> 2);
-    }
+    sonar->Fuse(
+      &scan_msg.ranges[0],
+      node_count,
+      scan_msg.angle_min,
+      scan_msg.angle_increment,
+      (S64)rp::hal::clock_now()
+      );
   }
-  else
+
+  pub->publish(scan_msg);
+}
+
+
+void publish_merged(
+  ros::Publisher* pub,
+  RPLidarMerge*   merge,
+  std::string     frame_id
+  )
+{
+  sensor_msgs::LaserScan scan_msg;
+  U32 bins = merge->GetBins();
+  S64 beg_ts, end_ts;
+
+  scan_msg.ranges.resize(bins);
+  scan_msg.intensities.resize(bins);
+  if ( 0 == merge->Merge( &scan_msg.ranges[0], &scan_msg.intensities[0], &beg_ts, &end_ts ) )
   {
-    for (size_t i = 0; i < node_count; i++)
-    {
-      float read_value = (float)nodes[i].distance_q2/4.0f/1000;
-      if (read_value == 0.0)
-      {
-        scan_msg.ranges[node_count-1-i] = std::numeric_limits<float>::infinity();
-      }
-      else
-      {
-        scan_msg.ranges[node_count-1-i] = read_value;
-      }
-      scan_msg.intensities[node_count-1-i] = (float) (nodes[i].sync_quality >> 2);
-    }
+    return;
+  }
+
+  scan_msg.header.stamp    = mono_to_ros( beg_ts );
+  scan_msg.header.frame_id = frame_id;
+
+  scan_msg.angle_min       = merge->GetAngleMin();
+  scan_msg.angle_increment = merge->GetAngleInc();
+  scan_msg.angle_max       = scan_msg.angle_min + (bins-1) * scan_msg.angle_increment;
+
+  // the beams come from several sweeps, so no time per beam
+  scan_msg.scan_time      = ( end_ts - beg_ts ) * 1e-9;
+  scan_msg.time_increment = 0;
+  scan_msg.range_min = 0.15;
+  scan_msg.range_max = 8.0;
+
+  if ( sonar != NULL )
+  {
+    sonar->Fuse(
+      &scan_msg.ranges[0],
+      bins,
+      scan_msg.angle_min,
+      scan_msg.angle_increment,
+      (S64)rp::hal::clock_now()
+      );
   }
 
   pub->publish(scan_msg);
 }
 
 
+// a Range per sensor with a new reading, one frame per sensor
+void publish_sonar(
+  ros::Publisher* pub,
+  RPLidarSonar*   reader,
+  const std::vector<std::string>& frames,
+  double          fov,
+  double          min_range,
+  double          max_range
+  )
+{
+  for ( int idx = 0; idx < (int)frames.size(); ++idx )
+  {
+    RPLidarSonarReading_t sr;
+
+    if ( 1 != reader->GetReading( idx, &sr ) || sr._status != _SONAR_OK_ )
+    {
+      continue;
+    }
+
+    sensor_msgs::Range range_msg;
+    range_msg.header.stamp    = mono_to_ros( sr._recvTs );
+    range_msg.header.frame_id = frames[idx];
+    range_msg.radiation_type  = sensor_msgs::Range::ULTRASOUND;
+    range_msg.field_of_view   = fov;
+    range_msg.min_range       = min_range;
+    range_msg.max_range       = max_range;
+    range_msg.range           = sr._range;
+    pub->publish( range_msg );
+  }
+}
+
+
 bool getRPLIDARDeviceInfo(RPlidarDriver* drv)
 {
   u_result     op_result;
@@ -231,6 +317,46 @@ bool start_motor(
   //return true;
 }
 
+// ~<role>_cpus ("2,3" or "0-3", empty for any), ~<role>_policy (other,
+// fifo or rr), ~<role>_priority and ~<role>_stack_kb into attr.  threads
+// are named whatever the params say, so top -H and perf can tell them apart
+void get_thread_attr(
+  ros::NodeHandle& nh,
+  const std::string& role,
+  const char* name,
+  XTHREADATTR* attr
+  )
+{
+  std::string cpus;
+  std::string policy;
+  int priority = 0;
+  int stack_kb = 0;
+
+  nh.param<std::string>(role + "_cpus", cpus, "");
+  nh.param<std::string>(role + "_policy", policy, "other");
+  nh.param<int>(role + "_priority", priority, 0);
+  nh.param<int>(role + "_stack_kb", stack_kb, 0);
+
+  memset(attr, 0, sizeof(*attr));
+  strncpy(attr->szName, name, sizeof(attr->szName) - 1);
+
+  if (!XThread::ParseCpuList(cpus.c_str(), &attr->ullCpuMask))
+  {
+    ROS_WARN("%s_cpus \"%s\" is not a cpu list like 2,3 or 0-3, ignored", role.c_str(), cpus.c_str());
+    attr->ullCpuMask = 0;
+  }
+
+  attr->iPolicy = XThread::ParsePolicy(policy.c_str());
+  if (attr->iPolicy < 0)
+  {
+    ROS_WARN("%s_policy \"%s\" is not other, fifo or rr, ignored", role.c_str(), policy.c_str());
+    attr->iPolicy = SCHED_OTHER;
+  }
+
+  attr->iPriority   = (attr->iPolicy == SCHED_OTHER ? 0 : priority);
+  attr->ulStackSize = (SIZE_T)std::max(stack_kb, 0) * 1024;
+}
+
 
 
 
@@ -245,6 +371,28 @@ int main(int argc, char* argv[])
   std::string frame_id;
   bool inverted = false;
   bool angle_compensate = true;
+  std::string record_file;
+  bool record_compress = true;
+  std::string replay_file;
+  double replay_speed = 1.0;
+  bool replay_loop = false;
+  std::string trace_file;
+  bool clock_sync = false;
+  std::string clock_sync_host;
+  int clock_sync_port = 8889;
+  double clock_sync_interval = 1.0;
+  std::string sonar_port;
+  int sonar_baudrate = 115200;
+  int sonar_count = 4;
+  bool sonar_fuse = true;
+  double sonar_max_age = 0.2;
+  double sonar_fov = 0.5;
+  double sonar_min_range = 0.03;
+  double sonar_max_range = 3.0;
+  std::string sonar_frame_id;
+  std::string udp_ports;
+  int merge_bins = 720;
+  double merge_max_skew = 0.1;
 
   ros::NodeHandle nh;
   ros::Publisher scan_pub = nh.advertise<sensor_msgs::LaserScan>("scan", 1000);
@@ -256,6 +404,68 @@ int main(int argc, char* argv[])
   nh_private.param<bool>("angle_compensate", angle_compensate, true);
   nh_private.param<int>("udp_port", udp_port, 8888);
   nh_private.param<int>("verbose", verbose, 0);
+  nh_private.param<std::string>("record_file", record_file, "");
+  nh_private.param<bool>("record_compress", record_compress, true);
+  nh_private.param<std::string>("replay_file", replay_file, "");
+  nh_private.param<double>("replay_speed", replay_speed, 1.0);
+  nh_private.param<bool>("replay_loop", replay_loop, false);
+  nh_private.param<std::string>("trace_file", trace_file, "");
+  nh_private.param<bool>("clock_sync", clock_sync, false);
+  nh_private.param<std::string>("clock_sync_host", clock_sync_host, "");
+  nh_private.param<int>("clock_sync_port", clock_sync_port, 8889);
+  nh_private.param<double>("clock_sync_interval", clock_sync_interval, 1.0);
+  nh_private.param<std::string>("sonar_port", sonar_port, "");
+  nh_private.param<int>("sonar_baudrate", sonar_baudrate, 115200);
+  nh_private.param<int>("sonar_count", sonar_count, 4);
+  nh_private.param<bool>("sonar_fuse", sonar_fuse, true);
+  nh_private.param<double>("sonar_max_age", sonar_max_age, 0.2);
+  nh_private.param<double>("sonar_fov", sonar_fov, 0.5);
+  nh_private.param<double>("sonar_min_range", sonar_min_range, 0.03);
+  nh_private.param<double>("sonar_max_range", sonar_max_range, 3.0);
+  nh_private.param<std::string>("sonar_frame_id", sonar_frame_id, "sonar");
+  nh_private.param<std::string>("udp_ports", udp_ports, "");
+  nh_private.param<int>("merge_bins", merge_bins, 720);
+  nh_private.param<double>("merge_max_skew", merge_max_skew, 0.1);
+
+  // udp_ports "8888,8890" merges a lidar per port into one scan; a
+  // single port is udp_port
+  std::vector<int> ports;
+  for ( size_t pos = 0; pos < udp_ports.size(); )
+  {
+    size_t end = udp_ports.find( ',', pos );
+    if ( end == std::string::npos )
+    {
+      end = udp_ports.size();
+    }
+
+    int port = atoi( udp_ports.substr( pos, end - pos ).c_str() );
+    if ( port > 0 )
+    {
+      ports.push_back( port );
+    }
+    pos = end + 1;
+  }
+  if ( ports.empty() )
+  {
+    ports.push_back( udp_port );
+  }
+  udp_port = ports[0];
+
+  // source_<n>_clock_sync_port, for lidars whose streamers share a host
+  std::vector<int> clock_ports( ports.size(), clock_sync_port );
+  for ( size_t idx = 0; idx < ports.size() && ports.size() > 1; ++idx )
+  {
+    char name[40];
+    snprintf( name, sizeof( name ), "source_%d_clock_sync_port", (int)idx );
+    nh_private.param<int>( name, clock_ports[idx], clock_sync_port );
+  }
+
+  XTHREADATTR main_attr, udp_attr, clock_attr, replay_attr, sonar_attr;
+  get_thread_attr(nh_private, "main_thread",   "gaps_main",   &main_attr);
+  get_thread_attr(nh_private, "udp_thread",    "gaps_udp",    &udp_attr);
+  get_thread_attr(nh_private, "clock_thread",  "gaps_clock",  &clock_attr);
+  get_thread_attr(nh_private, "replay_thread", "gaps_replay", &replay_attr);
+  get_thread_attr(nh_private, "sonar_thread",  "gaps_sonar",  &sonar_attr);
 
   printf("RPLIDAR running on ROS package rplidar_ros_gaps\n"
          "SDK Version: "RPLIDAR_SDK_VERSION"\n");
@@ -277,11 +487,144 @@ int main(int argc, char* argv[])
 
   proxy->SetVerbose( verbose );
 
-  if ( -1 == proxy->Init( udp_port ) )
+  if ( !trace_file.empty() )
+  {
+    RPLidarTrace::Enable();
+  }
+
+  RPLidarLogWriter recorder;
+  RPLidarLogPlayer player;
+  RPLidarClock     clock;
+
+  if ( !record_file.empty() )
+  {
+    if ( -1 == recorder.Open( record_file.c_str(), record_compress ) )
+    {
+      fprintf(stderr, "Open record file %s fail, exit\n", record_file.c_str());
+      return -2;
+    }
+    proxy->SetRecorder( &recorder );
+  }
+
+  if ( !replay_file.empty() )
+  {
+    // feed the proxy from the log instead of the network
+    if ( -1 == player.Init( replay_file.c_str(), proxy, replay_speed, replay_loop ) )
+    {
+      fprintf(stderr, "Open replay file %s fail, exit\n", replay_file.c_str());
+      return -2;
+    }
+  }
+  else if ( -1 == proxy->Init( udp_port ) )
   {
     fprintf(stderr, "Init Proxy fail, exit\n");
     return -2;
   }
+  else if ( clock_sync )
+  {
+    // streamer host is learned from the first reading if not given
+    clock.Init( clock_sync_host.c_str(), clock_ports[0], udp_port, clock_sync_interval );
+    proxy->SetClock( &clock );
+  }
+
+  RPLidarSonar sonar_reader;
+  ros::Publisher sonar_pub;
+  std::vector<std::string> sonar_frames;
+
+  if ( !sonar_port.empty() )
+  {
+    if ( -1 == sonar_reader.Init( sonar_port.c_str(), (U32)sonar_baudrate ) )
+    {
+      return -2;
+    }
+
+    sonar_count = std::max( 0, std::min( sonar_count, _SONAR_MAX_SENSORS_ ) );
+    sonar_reader.SetMaxAge( sonar_max_age );
+
+    // sonar_yaw_<n> is where sensor n looks in the scan's angles, by
+    // default the sensors side by side across the middle of the scan
+    for ( int idx = 0; idx < sonar_count; ++idx )
+    {
+      char   name[32];
+      double yaw = ( idx - ( sonar_count - 1 ) / 2.0 ) * sonar_fov;
+
+      snprintf( name, sizeof( name ), "sonar_yaw_%d", idx );
+      nh_private.param<double>( name, yaw, yaw );
+      sonar_reader.SetSector( idx, yaw, sonar_fov );
+
+      snprintf( name, sizeof( name ), "_%d", idx );
+      sonar_frames.push_back( sonar_frame_id + name );
+    }
+
+    sonar_pub = nh.advertise<sensor_msgs::Range>( "sonar", 100 );
+    sonar_reader.SetThreadAttr( &sonar_attr );
+    sonar_reader.Start();
+
+    if ( sonar_fuse )
+    {
+      sonar = &sonar_reader;
+    }
+  }
+
+  // source 0 is proxy and clock above, every other port gets its own.
+  // recording and replay only cover source 0
+  std::vector<RPLidarProxy*> proxies( 1, proxy );
+  std::vector<RPLidarClock*> clocks( 1, &clock );
+  std::vector<bool>          clocks_synced( ports.size(), false );
+  RPLidarMerge merge;
+  bool merged = ( ports.size() > 1 );
+
+  if ( merged )
+  {
+    if ( 1 != merge.Init( ports.size(), (U32)std::max( merge_bins, 1 ), 0.15, 8.0 ) )
+    {
+      return -2;
+    }
+    merge.SetMaxSkew( (S64)( merge_max_skew * 1e9 ) );
+
+    // source_<n>_x, _y and _yaw place lidar n's own scan frame in
+    // frame_id, as its urdf joint would
+    for ( size_t idx = 0; idx < ports.size(); ++idx )
+    {
+      char   name[32];
+      double x = 0, y = 0, yaw = 0;
+      bool   inv = inverted;
+
+      snprintf( name, sizeof( name ), "source_%d_x", (int)idx );
+      nh_private.param<double>( name, x, 0.0 );
+      snprintf( name, sizeof( name ), "source_%d_y", (int)idx );
+      nh_private.param<double>( name, y, 0.0 );
+      snprintf( name, sizeof( name ), "source_%d_yaw", (int)idx );
+      nh_private.param<double>( name, yaw, 0.0 );
+      snprintf( name, sizeof( name ), "source_%d_inverted", (int)idx );
+      nh_private.param<bool>( name, inv, inverted );
+      merge.SetExtrinsic( idx, x, y, yaw, inv );
+    }
+
+    for ( size_t idx = 1; idx < ports.size(); ++idx )
+    {
+      RPLidarProxy* source_proxy = new RPLidarProxy();
+      RPLidarClock* source_clock = new RPLidarClock();
+
+      proxies.push_back( source_proxy );
+      clocks.push_back( source_clock );
+
+      source_proxy->SetVerbose( verbose );
+      if ( -1 == source_proxy->Init( ports[idx] ) )
+      {
+        fprintf(stderr, "Init Proxy on port %d fail, exit\n", ports[idx]);
+        return -2;
+      }
+      if ( clock_sync )
+      {
+        source_clock->Init( clock_sync_host.c_str(), clock_ports[idx], ports[idx], clock_sync_interval );
+        source_proxy->SetClock( source_clock );
+      }
+    }
+
+    ROS_INFO( "Merging %d lidars into %d bins in %s",
+              (int)ports.size(), merge_bins, frame_id.c_str() );
+  }
 
   printf(
     "\n"
@@ -326,15 +669,103 @@ int main(int argc, char* argv[])
   ros::ServiceServer stop_motor_service  = nh.advertiseService( "stop_motor",  stop_motor  );
   ros::ServiceServer start_motor_service = nh.advertiseService( "start_motor", start_motor );
 
-  proxy->Start();
+  if ( !replay_file.empty() )
+  {
+    player.SetThreadAttr( &replay_attr );
+    player.Start();
+  }
+  else
+  {
+    proxy->SetThreadAttr( &udp_attr );
+    proxy->Start();
+
+    if ( clock_sync )
+    {
+      clock.SetThreadAttr( &clock_attr );
+      clock.Start();
+    }
+  }
+
+  for ( size_t idx = 1; idx < proxies.size(); ++idx )
+  {
+    XTHREADATTR source_udp_attr   = udp_attr;
+    XTHREADATTR source_clock_attr = clock_attr;
+
+    snprintf( source_udp_attr.szName, sizeof( source_udp_attr.szName ), "gaps_udp%d", (int)idx );
+    snprintf( source_clock_attr.szName, sizeof( source_clock_attr.szName ), "gaps_clock%d", (int)idx );
+
+    proxies[idx]->SetThreadAttr( &source_udp_attr );
+    proxies[idx]->Start();
+
+    if ( clock_sync )
+    {
+      clocks[idx]->SetThreadAttr( &source_clock_attr );
+      clocks[idx]->Start();
+    }
+  }
   //drv->startMotor();
   //drv->startScan();
 
+  // last, so the threads above don't inherit the main thread's cpus
+  S32 attr_error = XThread::ApplyToSelf( &main_attr );
+  if ( attr_error != 0 )
+  {
+    ROS_WARN( "main thread attributes not applied: %s", strerror( attr_error ) );
+  }
+
   ros::Time start_scan_time;
   ros::Time end_scan_time;
   double scan_duration;
+  bool clock_synced = false;
+
+  while ( ros::ok() && merged )
+  {
+    rplidar_reading  reading;
+
+    // never waits on a source: whatever arrived is binned, and the
+    // merge goes out when the pacing lidar completes a scan
+    for ( size_t idx = 0; idx < proxies.size(); ++idx )
+    {
+      if ( 1 != proxies[idx]->GetReading( &reading ) )
+      {
+        continue;
+      }
+
+      RPLidarClock* source_clock = clocks[idx];
+      S64 beg_ts = (S64)rp::hal::clock_now();
+      S64 end_ts = beg_ts;
+
+      if ( source_clock->IsSynced() && reading._scanBegTs != 0 )
+      {
+        beg_ts = source_clock->ToLocal( reading._scanBegTs );
+        end_ts = std::max( beg_ts, source_clock->ToLocal( reading._scanEndTs ) );
+
+        if ( !clocks_synced[idx] )
+        {
+          double offset, drift, delay;
+          source_clock->GetStats( &offset, &drift, &delay );
+          ROS_INFO( "Clock synced with streamer on port %d, offset %.3f ms, delay %.3f ms",
+                    ports[idx], offset, delay );
+          clocks_synced[idx] = true;
+        }
+      }
 
-  while ( ros::ok() )
+      if ( 1 == merge.Add( idx, &reading, beg_ts, end_ts ) )
+      {
+        publish_merged( &scan_pub, &merge, frame_id );
+        RPLIDAR_TRACE( _TRACE_PUBLISH_, reading._seq, 0 );
+      }
+    }
+
+    if ( !sonar_port.empty() )
+    {
+      publish_sonar( &sonar_pub, &sonar_reader, sonar_frames, sonar_fov, sonar_min_range, sonar_max_range );
+    }
+
+    ros::spinOnce();
+  }  // while merged
+
+  while ( ros::ok() && !merged )
   {
     rplidar_reading  reading;
     rplidar_response_measurement_node_t  nodes[360*2];
@@ -349,6 +780,26 @@ int main(int argc, char* argv[])
     //if ( op_result == RESULT_OK )
     if ( gaps_result == 1 )
     {
+      // once the streamer's clock is known, stamp the scan with when it
+      // was taken instead of when it got here
+      if ( clock.IsSynced() && reading._scanBegTs != 0 )
+      {
+        start_scan_time = mono_to_ros( clock.ToLocal( reading._scanBegTs ) );
+
+        if ( !clock_synced )
+        {
+          double offset, drift, delay;
+          clock.GetStats( &offset, &drift, &delay );
+          ROS_INFO( "Clock synced with streamer, offset %.3f ms, delay %.3f ms",
+                    offset, delay );
+          clock_synced = true;
+        }
+      }
+      if ( reading._scanEndTs > reading._scanBegTs )
+      {
+        scan_duration = ( reading._scanEndTs - reading._scanBegTs ) * 1e-9;
+      }
+
       //op_result = drv->ascendScanData(nodes, count);
 
       float angle_min = DEG2RAD( 0.0f );
@@ -358,43 +809,14 @@ int main(int argc, char* argv[])
         if ( angle_compensate )
         {
           const int angle_compensate_nodes_count = 360;
-          const int angle_compensate_multiple    = 1;
-          int       angle_compensate_offset      = 0;
-
           rplidar_response_measurement_node_t  angle_compensate_nodes[angle_compensate_nodes_count];
-          memset( angle_compensate_nodes, 0, angle_compensate_nodes_count * sizeof( rplidar_response_measurement_node_t ) );
-          int i = 0, j = 0;
-          for( ; i < count; i++ )
-          {
-            if ( reading._dst[i] != 0 )
-            {
-              float angle = (float)((reading._agl[i] >> RPLIDAR_RESP_MEASUREMENT_ANGLE_SHIFT)/64.0f);
-              int angle_value = (int)( angle * angle_compensate_multiple );
-              if ( ( angle_value - angle_compensate_offset ) < 0 )
-              {
-                angle_compensate_offset = angle_value;
-              }
-              for ( j = 0; j < angle_compensate_multiple; ++j )
-              {
-                angle_compensate_nodes[angle_value-angle_compensate_offset+j].angle_q6_checkbit = reading._agl[i];
-                angle_compensate_nodes[angle_value-angle_compensate_offset+j].distance_q2       = reading._dst[i];
-                angle_compensate_nodes[angle_value-angle_compensate_offset+j].sync_quality      = reading._qua[i];
-              }
-            }
-          
-            //
-            //if (nodes[i].distance_q2 != 0)
-            //{
-            //  float angle = (float)((nodes[i].angle_q6_checkbit >> RPLIDAR_RESP_MEASUREMENT_ANGLE_SHIFT)/64.0f);
-            //  int angle_value = (int)(angle * angle_compensate_multiple);
-            //  if ((angle_value - angle_compensate_offset) < 0) angle_compensate_offset = angle_value;
-            //  for (j = 0; j < angle_compensate_multiple; j++)
-            //  {
-            //    angle_compensate_nodes[angle_value-angle_compensate_offset+j] = nodes[i];
-            //  }
-            //}
-            //
-          }
+
+          RPLidarScan::AngleCompensate(
+            &reading,
+            count,
+            angle_compensate_nodes,
+            angle_compensate_nodes_count
+            );
 
           publish_scan(
             &scan_pub,
@@ -408,30 +830,14 @@ int main(int argc, char* argv[])
         }
         else
         {
-          int start_node = 0, end_node = 0;
-          int i = 0;
-          // find the first valid node and last valid node
-          while (reading._dst[i++] == 0);
-          //while (nodes[i++].distance_q2 == 0);
-          start_node = i-1;
-          i = count -1;
-          while (reading._dst[i--] == 0);
-          //while (nodes[i--].distance_q2 == 0);
-          end_node = i+1;
+          U32 start_node = 0, end_node = 0;
+
+          // copy data over and find the first and last valid node
+          RPLidarScan::CopyNodes( &reading, count, nodes, &start_node, &end_node );
 
           angle_min = DEG2RAD( (float)(reading._agl[start_node] >> RPLIDAR_RESP_MEASUREMENT_ANGLE_SHIFT)/64.0f );
           angle_max = DEG2RAD( (float)(reading._agl[end_node]   >> RPLIDAR_RESP_MEASUREMENT_ANGLE_SHIFT)/64.0f );
 
-          // copy data over
-          memset( nodes, 0, count*sizeof( rplidar_response_measurement_node_t ) );
-
-          for( int idx = 0; idx < count; ++idx )
-          {
-            nodes[idx].angle_q6_checkbit = reading._agl[idx];
-            nodes[idx].distance_q2       = reading._dst[idx];
-            nodes[idx].sync_quality      = reading._qua[idx];
-          }
-
           publish_scan(
             &scan_pub,
             &nodes[start_node],
@@ -462,17 +868,47 @@ int main(int argc, char* argv[])
       //    frame_id
       //    );
       //}
+
+      RPLIDAR_TRACE( _TRACE_PUBLISH_, reading._seq, 0 );
     }  // result ok
 
+    if ( !sonar_port.empty() )
+    {
+      publish_sonar( &sonar_pub, &sonar_reader, sonar_frames, sonar_fov, sonar_min_range, sonar_max_range );
+    }
+
     ros::spinOnce();
   }  // while
 
   // done!
+  player.Stop();
+  clock.Stop();
+
+  sonar = NULL;
+  sonar_reader.Stop();
+
+  for ( size_t idx = 1; idx < proxies.size(); ++idx )
+  {
+    clocks[idx]->Stop();
+    proxies[idx]->Stop();
+    proxies[idx]->SetClock( NULL );
+    delete proxies[idx];
+    delete clocks[idx];
+  }
+
   if ( proxy )
   {
+    proxy->Stop();
+    proxy->SetRecorder( NULL );
+    proxy->SetClock( NULL );
     delete proxy;
     proxy = NULL;
   }
+
+  if ( !trace_file.empty() )
+  {
+    RPLidarTrace::Dump( trace_file.c_str() );
+  }
   //drv->stop();
   //drv->stopMotor();
   //RPlidarDriver::DisposeDriver(drv);
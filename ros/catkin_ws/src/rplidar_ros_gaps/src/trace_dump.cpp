@@ -0,0 +1,265 @@
+//
+// rplidarGapsTraceDump - per-stage latency from RPLidarTrace dumps.
+//
+//   rplidarGapsTraceDump [-csv] node.trace [streamer.trace ...]
+//
+// records of one reading are joined by _seq, and the sdk stages by
+// the scan id the streamer's send record links to that _seq.  each
+// stage is reported as the time since the previous stage present for
+// that reading, plus the end to end time from first to last stage.
+//
+// with more than one file, timestamps are moved onto each host's wall
+// clock using the clock pair saved at dump time, so cross host stages
+// are only as good as the clock sync between the hosts.
+//
+#include <XCommon.h>
+#include <RPLidarTrace.h>
+
+
+typedef struct Chain
+{
+  S64 _ts[_TRACE_STAGE_COUNT_];
+
+  Chain()
+  {
+    memset( _ts, 0, sizeof( _ts ) );
+  }
+} Chain_t;
+
+
+static S32 LoadFile( const char* path, bool wall, STDMAP<U32, Chain_t>* bySeq, STDVEC<Chain_t>* unlinked )
+{
+  S32 ret = -1;
+  FILE* fp = NULL;
+  rplidar_trace_hdr_t hdr;
+  STDVEC<rplidar_trace_rec_t> recs;
+  STDMAP<U32, Chain_t> byScan;
+  STDMAP<U32, U32> scanToSeq;
+  S64 shift = 0;
+
+  fp = fopen( path, "rb" );
+  if ( fp == NULL )
+  {
+    fprintf( stderr, "[LoadFile] unable to open %s.\n", path );
+    goto Exit;
+  }
+
+  if ( 1 != fread( &hdr, sizeof( hdr ), 1, fp ) ||
+       hdr._magic != _TRACE_MAGIC_ || hdr._version != _TRACE_VERSION_ )
+  {
+    fprintf( stderr, "[LoadFile] %s is not a trace dump.\n", path );
+    goto Exit;
+  }
+
+  recs.resize( hdr._recCount );
+  if ( hdr._recCount > 0 &&
+       hdr._recCount != fread( &recs[0], sizeof( rplidar_trace_rec_t ), hdr._recCount, fp ) )
+  {
+    fprintf( stderr, "[LoadFile] %s is truncated.\n", path );
+    goto Exit;
+  }
+
+  if ( wall )
+  {
+    shift = ( hdr._sysTs - hdr._monoTs );
+  }
+
+  // first pass, sdk stages by scan id and the scan id -> _seq links
+  for ( size_t idx = 0; idx < recs.size(); ++idx )
+  {
+    const rplidar_trace_rec_t& rec = recs[idx];
+
+    if ( rec._stage <= _TRACE_CAPTURE_ )
+    {
+      S64& ts = byScan[rec._key]._ts[rec._stage];
+      if ( ts == 0 )
+      {
+        ts = rec._ts + shift;
+      }
+    }
+    else if ( rec._stage == _TRACE_SEND_ && rec._aux != 0 )
+    {
+      scanToSeq[rec._aux] = rec._key;
+    }
+  }
+
+  // second pass, everything keyed by _seq
+  for ( size_t idx = 0; idx < recs.size(); ++idx )
+  {
+    const rplidar_trace_rec_t& rec = recs[idx];
+
+    if ( rec._stage > _TRACE_CAPTURE_ && rec._stage < _TRACE_STAGE_COUNT_ )
+    {
+      S64& ts = (*bySeq)[rec._key]._ts[rec._stage];
+      if ( ts == 0 )
+      {
+        ts = rec._ts + shift;
+      }
+    }
+  }
+
+  for ( STDMAP<U32, Chain_t>::iterator it = byScan.begin(); it != byScan.end(); ++it )
+  {
+    STDMAP<U32, U32>::iterator link = scanToSeq.find( it->first );
+
+    if ( link == scanToSeq.end() )
+    {
+      unlinked->push_back( it->second );
+      continue;
+    }
+
+    Chain_t& chain = (*bySeq)[link->second];
+    for ( U32 stage = 0; stage <= _TRACE_CAPTURE_; ++stage )
+    {
+      if ( chain._ts[stage] == 0 )
+      {
+        chain._ts[stage] = it->second._ts[stage];
+      }
+    }
+  }
+
+  printf( "# %s: %llu records, %u threads, %u linked scans\n",
+          path, (unsigned long long)hdr._recCount, hdr._ringCount,
+          (U32)scanToSeq.size() );
+
+  ret = 1;
+
+Exit:
+  if ( fp != NULL )
+  {
+    fclose( fp );
+  }
+  return ret;
+}
+
+
+static void Account( const Chain_t& chain, STDVEC<S64>* stageLat, STDVEC<S64>* total )
+{
+  S32 first = -1;
+  S32 prev  = -1;
+
+  for ( S32 stage = 0; stage < _TRACE_STAGE_COUNT_; ++stage )
+  {
+    if ( chain._ts[stage] == 0 )
+    {
+      continue;
+    }
+    if ( prev >= 0 )
+    {
+      stageLat[stage].push_back( chain._ts[stage] - chain._ts[prev] );
+    }
+    else
+    {
+      first = stage;
+    }
+    prev = stage;
+  }
+
+  // only a scan followed from capture to the LaserScan is end to end,
+  // not the pieces of one, like a reading the sdk cached but nobody sent
+  if ( first >= 0 && first <= _TRACE_CAPTURE_ &&
+       chain._ts[_TRACE_CAPTURE_] != 0 && chain._ts[_TRACE_PUBLISH_] != 0 )
+  {
+    total->push_back( chain._ts[_TRACE_PUBLISH_] - chain._ts[first] );
+  }
+}
+
+
+static void Report( const char* name, STDVEC<S64>& lat, bool csv )
+{
+  if ( lat.empty() )
+  {
+    return;
+  }
+
+  std::sort( lat.begin(), lat.end() );
+
+  DBL sum = 0;
+  for ( size_t idx = 0; idx < lat.size(); ++idx )
+  {
+    sum += lat[idx];
+  }
+
+  DBL p50 = lat[lat.size() * 50 / 100] * 1e-3;
+  DBL p90 = lat[lat.size() * 90 / 100] * 1e-3;
+  DBL p99 = lat[lat.size() * 99 / 100] * 1e-3;
+  DBL max = lat.back() * 1e-3;
+  DBL avg = sum / lat.size() * 1e-3;
+
+  if ( csv )
+  {
+    printf( "%s,%u,%.1f,%.1f,%.1f,%.1f,%.1f\n",
+            name, (U32)lat.size(), avg, p50, p90, p99, max );
+  }
+  else
+  {
+    printf( "%-14s %8u %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+            name, (U32)lat.size(), avg, p50, p90, p99, max );
+  }
+}
+
+
+
+
+int main( int argc, char* argv[] )
+{
+  STDMAP<U32, Chain_t> bySeq;
+  STDVEC<Chain_t> unlinked;
+  STDVEC<S64> stageLat[_TRACE_STAGE_COUNT_];
+  STDVEC<S64> total;
+  STDVEC<const char*> files;
+  bool csv = false;
+
+  for ( S32 idx = 1; idx < argc; ++idx )
+  {
+    if ( 0 == strcmp( argv[idx], "-csv" ) )
+    {
+      csv = true;
+    }
+    else
+    {
+      files.push_back( argv[idx] );
+    }
+  }
+
+  if ( files.empty() )
+  {
+    fprintf( stderr, "usage: %s [-csv] file.trace [file.trace ...]\n", argv[0] );
+    return 1;
+  }
+
+  for ( size_t idx = 0; idx < files.size(); ++idx )
+  {
+    if ( 1 != LoadFile( files[idx], files.size() > 1, &bySeq, &unlinked ) )
+    {
+      return 1;
+    }
+  }
+
+  for ( STDMAP<U32, Chain_t>::iterator it = bySeq.begin(); it != bySeq.end(); ++it )
+  {
+    Account( it->second, stageLat, &total );
+  }
+  for ( size_t idx = 0; idx < unlinked.size(); ++idx )
+  {
+    Account( unlinked[idx], stageLat, &total );
+  }
+
+  if ( csv )
+  {
+    printf( "stage,count,avg_us,p50_us,p90_us,p99_us,max_us\n" );
+  }
+  else
+  {
+    printf( "%-14s %8s %10s %10s %10s %10s %10s\n",
+            "stage", "count", "avg us", "p50 us", "p90 us", "p99 us", "max us" );
+  }
+
+  for ( U32 stage = 0; stage < _TRACE_STAGE_COUNT_; ++stage )
+  {
+    Report( RPLidarTrace::StageName( stage ), stageLat[stage], csv );
+  }
+  Report( "end_to_end", total, csv );
+
+  return 0;
+}